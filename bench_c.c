@@ -0,0 +1,1716 @@
+/**
+ * @file bench_c.c
+ * @brief used to benchmark scap.c
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: bench_c [case] [iterations]
+ * every case runs in its own process, because the command tree of scap is global.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <scap.h>
+
+extern char **environ;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, long iterations, double seconds) {
+    printf("%-32s %10ld iters %10.1f ns/iter %12.0f iters/s\n",
+           name, iterations, seconds * 1e9 / (double) iterations, (double) iterations / seconds);
+}
+
+static int nop_exec(SAPCommand *caller) {
+    (void) caller;
+    return 0;
+}
+
+/* ++++ combined short flags: scap vs getopt_long ++++ */
+
+static int bench_short(long iterations) {
+    static Flag flags[7];
+    static const char shorthands[] = "abcdef";
+    static char names[6][2];
+
+    init_root_cmd("bench", "short flags benchmark", NULL, nop_exec);
+    for (int i = 0; i < 6; i++) {
+        names[i][0] = shorthands[i];
+        init_flag(&flags[i], names[i], shorthands[i], "no_arg flag", NULL);
+        set_flag_type(&flags[i], no_arg);
+        add_flag(&rootCmd, &flags[i]);
+    }
+    init_flag(&flags[6], "output", 'o', "single_arg flag", NULL);
+    add_flag(&rootCmd, &flags[6]);
+
+    char *argv_tpl[] = {"bench", "-abc", "-ofile", "-de", "-o", "out", "-f", NULL};
+    int argc = (int) (sizeof(argv_tpl) / sizeof(argv_tpl[0])) - 1;
+    char *argv[sizeof(argv_tpl) / sizeof(argv_tpl[0])];
+
+    double start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        memcpy(argv, argv_tpl, sizeof(argv_tpl));
+        if (do_parse_subcmd(argc, argv) != 0) {
+            fprintf(stderr, "scap failed to parse\n");
+            return 1;
+        }
+    }
+    report("short/scap", iterations, now_sec() - start);
+
+    static const struct option longopts[] = {
+        {"a", no_argument, NULL, 'a'}, {"b", no_argument, NULL, 'b'},
+        {"c", no_argument, NULL, 'c'}, {"d", no_argument, NULL, 'd'},
+        {"e", no_argument, NULL, 'e'}, {"f", no_argument, NULL, 'f'},
+        {"output", required_argument, NULL, 'o'}, {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    volatile int seen = 0;
+    const char *volatile output = NULL;
+
+    start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        memcpy(argv, argv_tpl, sizeof(argv_tpl));
+        optind = 0;     /* full reinitialization of glibc getopt */
+        int opt;
+        while ((opt = getopt_long(argc, argv, "abcdefho:", longopts, NULL)) != -1) {
+            if (opt == 'o') {
+                output = optarg;
+            } else if (opt == '?') {
+                fprintf(stderr, "getopt_long failed to parse\n");
+                return 1;
+            } else {
+                seen++;
+            }
+        }
+    }
+    report("short/getopt_long", iterations, now_sec() - start);
+    (void) output;
+
+    free_root_cmd();
+    return 0;
+}
+
+/* ---- combined short flags: scap vs getopt_long ---- */
+
+
+
+/* ++++ asynchronous execution: handler throughput ++++ */
+
+static volatile long completed = 0;
+
+static void work_async(SAPParseResult *res, SAPCompletion *done) {
+    /* simulate a handler doing some work with its own values */
+    const char *input = (const char *) sap_get_value(res, "input");
+    unsigned long acc = 0;
+    for (int round = 0; round < 200; round++) {
+        for (const char *p = input; *p != '\0'; p++) {
+            acc = acc * 131 + (unsigned char) *p;
+        }
+    }
+    sap_complete(done, (int) (acc & 1));
+}
+
+static void on_work_done(SAPParseResult *res, int ret, void *ctx) {
+    (void) res;
+    (void) ret;
+    (void) ctx;
+    __atomic_add_fetch(&completed, 1, __ATOMIC_RELAXED);
+}
+
+static int bench_async(long iterations) {
+    static SAPCommand work;
+    static Flag input;
+
+    init_root_cmd("bench", "async benchmark", NULL, nop_exec);
+    init_sap_command(&work, "work", "do some work", NULL, NULL);
+    set_cmd_async_exec(&work, work_async);
+    init_flag(&input, "input", 'i', "the input of the work", NULL);
+    add_flag(&work, &input);
+    add_subcmd(&rootCmd, &work);
+
+    char *argv[] = {"bench", "work", "-i", "a moderately long input string for the handler", NULL};
+    SAPParseResult *results = (SAPParseResult *) malloc(sizeof(SAPParseResult) * iterations);
+    const int thread_cnts[] = {0, 1, 2, 4, 8};     /* 0 means the inline executor */
+
+    for (size_t t = 0; t < sizeof(thread_cnts) / sizeof(thread_cnts[0]); t++) {
+        SAPExecutor *executor = (thread_cnts[t] == 0) ? sap_inline_executor() : sap_thread_pool_create(thread_cnts[t]);
+        char name[32];
+        if (thread_cnts[t] == 0) {
+            snprintf(name, sizeof(name), "async/inline");
+        } else {
+            snprintf(name, sizeof(name), "async/pool-%d", thread_cnts[t]);
+        }
+        completed = 0;
+
+        /* parse on this thread, run the handlers on the executor */
+        double start = now_sec();
+        for (long it = 0; it < iterations; it++) {
+            sap_parse(4, argv, &results[it]);
+            sap_exec_async(executor, &results[it], on_work_done, NULL);
+        }
+        while (__atomic_load_n(&completed, __ATOMIC_RELAXED) < iterations) {
+            sched_yield();
+        }
+        report(name, iterations, now_sec() - start);
+
+        if (thread_cnts[t] != 0) {
+            sap_thread_pool_destroy(executor);
+        }
+        for (long it = 0; it < iterations; it++) {
+            sap_free_result(&results[it]);
+        }
+    }
+
+    free(results);
+    free_root_cmd();
+    return 0;
+}
+
+/* ---- asynchronous execution: handler throughput ---- */
+
+/* ++++ memory layout: bytes per command ++++ */
+
+static int bench_layout(long iterations) {
+    const int fanout = 100;     /* root -> 100 groups -> 100 leaves each */
+    int cmd_cnt = fanout * fanout + fanout;
+    SAPCommand *cmds = (SAPCommand *) calloc(cmd_cnt, sizeof(SAPCommand));
+    Flag *flags = (Flag *) calloc(cmd_cnt * 2, sizeof(Flag));
+    char (*names)[16] = calloc(cmd_cnt, sizeof(*names));
+    static Flag persist;
+
+    init_root_cmd("bench", "layout benchmark", NULL, nop_exec);
+    for (int g = 0; g < fanout; g++) {
+        SAPCommand *group = &cmds[g];
+        snprintf(names[g], sizeof(names[g]), "group%d", g);
+        init_sap_command(group, names[g], "a group of commands", NULL, nop_exec);
+        add_subcmd(&rootCmd, group);    /* top-down, every add_subcmd appends a single node */
+        for (int l = 0; l < fanout; l++) {
+            int i = fanout + g * fanout + l;
+            snprintf(names[i], sizeof(names[i]), "leaf%d", l);
+            init_sap_command(&cmds[i], names[i], "a leaf command", "the long description of a leaf command", nop_exec);
+            init_flag(&flags[2 * i], "verbose", 'v', "print more", NULL);
+            set_flag_type(&flags[2 * i], no_arg);
+            init_flag(&flags[2 * i + 1], "output", 'o', "the output file", NULL);
+            add_flag(&cmds[i], &flags[2 * i]);
+            add_flag(&cmds[i], &flags[2 * i + 1]);
+            add_subcmd(group, &cmds[i]);
+        }
+    }
+    init_flag(&persist, "config", 'c', "the config file", NULL);
+    add_persist_flag(&rootCmd, &persist);
+
+    size_t tree_bytes = sap_tree_bytes(&rootCmd);
+    double start = now_sec();
+    SAPCompactTree *tree = NULL;
+    for (long it = 0; it < iterations; it++) {
+        sap_compact_free(tree);
+        tree = sap_compact_build(&rootCmd);
+    }
+    double seconds = now_sec() - start;
+
+    printf("%-32s %10u cmds %10.1f bytes/cmd\n", "layout/pointer-tree", tree->cmd_cnt, (double) tree_bytes / tree->cmd_cnt);
+    printf("%-32s %10u cmds %10.1f bytes/cmd\n", "layout/compact-tree", tree->cmd_cnt, (double) sap_compact_bytes(tree) / tree->cmd_cnt);
+    report("layout/compact-build", iterations, seconds);
+
+    char *path[] = {"group42", "leaf7", NULL};
+    uint32_t leaf = sap_compact_find(tree, path, NULL);
+    if (sap_compact_find_flag(tree, leaf, "output") == SAP_NIL) {
+        fprintf(stderr, "compact lookup failed\n");
+        return 1;
+    }
+
+    sap_compact_free(tree);
+    free_root_cmd();
+    free(names);
+    free(flags);
+    free(cmds);
+    return 0;
+}
+
+/* ---- memory layout: bytes per command ---- */
+
+/* ++++ error reporting: error-heavy corpus ++++ */
+
+static void null_error_sink(const SAPParseResult *res, void *ctx) {
+    (void) ctx;
+    __atomic_add_fetch(&completed, res->err.code, __ATOMIC_RELAXED);
+}
+
+/* the way the errors were reported before: printf-style formatting for every error */
+static void fprintf_error_sink(const SAPParseResult *res, void *ctx) {
+    int idx = res->err.argv_idx - res->argv_offset;
+    fprintf((FILE *) ctx, "Error %d: %s\n", res->err.code, res->argv[idx]);
+}
+
+static int bench_errors(long iterations) {
+    static Flag flags[4];
+
+    init_root_cmd("bench", "error reporting benchmark", NULL, nop_exec);
+    init_flag(&flags[0], "verbose", 'v', "no_arg flag", NULL);
+    set_flag_type(&flags[0], no_arg);
+    init_flag(&flags[1], "output", 'o', "single_arg flag", NULL);
+    init_flag(&flags[2], "output-format", 'f', "single_arg flag", NULL);
+    init_flag(&flags[3], "inputs", 'i', "multi_arg flag", NULL);
+    set_flag_type(&flags[3], multi_arg);
+    for (int i = 0; i < 4; i++) {
+        add_flag(&rootCmd, &flags[i]);
+    }
+    set_prefix_match(&rootCmd, 1);
+
+    /* every line of the corpus fails, in a different way */
+    static char *corpus[][4] = {
+        {"bench", "--unknown", NULL, NULL},
+        {"bench", "-vx", NULL, NULL},
+        {"bench", "-v", "-o", NULL},
+        {"bench", "--verbose=1", NULL, NULL},
+        {"bench", "--out", "file", NULL},
+        {"bench", "stray", NULL, NULL},
+        {"bench", "-i", "-v", NULL},
+        {"bench", "-", NULL, NULL},
+    };
+    const int corpus_cnt = (int) (sizeof(corpus) / sizeof(corpus[0]));
+    int corpus_argc[sizeof(corpus) / sizeof(corpus[0])];
+    for (int c = 0; c < corpus_cnt; c++) {
+        corpus_argc[c] = 0;
+        while (corpus_argc[c] < 4 && corpus[c][corpus_argc[c]] != NULL) {
+            corpus_argc[c]++;
+        }
+    }
+
+    int dev_null = open("/dev/null", O_WRONLY);
+    FILE *dev_null_file = fopen("/dev/null", "w");
+    struct {
+        const char *name;
+        SAPErrorSink sink;
+        void *ctx;
+    } sinks[] = {
+        {"errors/null-sink", null_error_sink, NULL},
+        {"errors/fd-sink", sap_fd_error_sink, (void *) (intptr_t) dev_null},
+        {"errors/file-sink", sap_file_error_sink, dev_null_file},
+        {"errors/fprintf-sink", fprintf_error_sink, dev_null_file},
+    };
+
+    for (size_t k = 0; k < sizeof(sinks) / sizeof(sinks[0]); k++) {
+        sap_set_error_sink(sinks[k].sink, sinks[k].ctx);
+        double start = now_sec();
+        for (long it = 0; it < iterations; it++) {
+            int c = (int) (it % corpus_cnt);
+            if (do_parse_subcmd(corpus_argc[c], corpus[c]) == 0) {
+                fprintf(stderr, "the corpus line %d is parsed without error\n", c);
+                return 1;
+            }
+        }
+        report(sinks[k].name, iterations, now_sec() - start);
+    }
+
+    sap_set_error_sink(NULL, NULL);
+    fclose(dev_null_file);
+    close(dev_null);
+    free_root_cmd();
+    return 0;
+}
+
+/* ---- error reporting: error-heavy corpus ---- */
+
+/* ++++ incremental parsing: per-keystroke latency ++++ */
+
+static int bench_incremental(long lines) {
+    static SAPCommand run;
+    static Flag flags[3];
+    enum { token_cnt = 1000 };
+
+    init_root_cmd("bench", "incremental parsing benchmark", NULL, nop_exec);
+    init_sap_command(&run, "run", "run with files", NULL, nop_exec);
+    init_flag(&flags[0], "verbose", 'v', "no_arg flag", NULL);
+    set_flag_type(&flags[0], no_arg);
+    init_flag(&flags[1], "output", 'o', "single_arg flag", NULL);
+    init_flag(&flags[2], "files", 'f', "multi_arg default flag", NULL);
+    set_flag_type(&flags[2], multi_arg);
+    add_flag(&run, &flags[0]);
+    add_flag(&run, &flags[1]);
+    add_default_flag(&run, &flags[2]);
+    add_subcmd(&rootCmd, &run);
+
+    /* a 1000-token line, every completed token triggers a parse of the line so far */
+    static const char *pattern[] = {"-v", "-o", "out.txt", "file1", "file2", "--verbose", "file3", "--output=x"};
+    static char *argv[token_cnt + 1];
+    argv[0] = "bench";
+    argv[1] = "run";
+    for (int i = 2; i < token_cnt; i++) {
+        argv[i] = (char *) pattern[(i - 2) % (sizeof(pattern) / sizeof(pattern[0]))];
+    }
+    argv[token_cnt] = NULL;
+
+    double start = now_sec();
+    for (long line = 0; line < lines; line++) {
+        SAPParseState st;
+        sap_parse_begin(&st);
+        for (int argc = 1; argc <= token_cnt; argc++) {
+            if (sap_parse_feed(&st, argc, argv) != 0) {
+                fprintf(stderr, "the incremental parse failed at %d\n", argc);
+                return 1;
+            }
+        }
+        sap_parse_end(&st);
+        sap_parse_state_free(&st);
+    }
+    report("incremental/feed", lines * token_cnt, now_sec() - start);
+
+    start = now_sec();
+    for (long line = 0; line < lines; line++) {
+        for (int argc = 1; argc <= token_cnt; argc++) {
+            SAPParseResult res;
+            char *next = argv[argc];
+            argv[argc] = NULL;      /* sap_parse needs a null-terminated argv */
+            sap_parse(argc, argv, &res);    /* fails where "-o" waits for its value, as sap_parse_end would */
+            argv[argc] = next;
+            sap_free_result(&res);
+        }
+    }
+    report("incremental/full-reparse", lines * token_cnt, now_sec() - start);
+
+    free_root_cmd();
+    return 0;
+}
+
+/* ---- incremental parsing: per-keystroke latency ---- */
+
+/* ++++ serialisation: JSON and binary records ++++ */
+
+static size_t discard_write(void *ctx, const char *data, size_t len) {
+    (void) ctx;
+    (void) data;
+    return len;
+}
+
+/* the way the results were logged before: walk the flags and format them with printf */
+static size_t printf_walk(const SAPParseResult *res, char *buf, size_t size) {
+    const SAPCommand *cmd = res->cmd;
+    size_t len = (size_t) snprintf(buf, size, "cmd=%s", cmd->name);
+    for (int i = 0; i < cmd->flag_cnt && len < size; i++) {
+        const void *value = res->values[i];
+        if (cmd->flags[i]->type == no_arg) {
+            len += (size_t) snprintf(buf + len, size - len, " %s=%d", cmd->flags[i]->flag_name, value != NULL);
+        } else if (cmd->flags[i]->type == single_arg) {
+            len += (size_t) snprintf(buf + len, size - len, " %s=%s", cmd->flags[i]->flag_name, (const char *) value);
+        } else {
+            for (char **arg = (char **) value; arg != NULL && *arg != NULL && len < size; arg++) {
+                len += (size_t) snprintf(buf + len, size - len, " %s+=%s", cmd->flags[i]->flag_name, *arg);
+            }
+        }
+    }
+    return len;
+}
+
+static int bench_serialize(long iterations) {
+    static SAPCommand commit;
+    static Flag flags[4];
+
+    init_root_cmd("bench", "serialisation benchmark", NULL, nop_exec);
+    init_sap_command(&commit, "commit", "record changes", NULL, nop_exec);
+    init_flag(&flags[0], "all", 'a', "no_arg flag", NULL);
+    set_flag_type(&flags[0], no_arg);
+    init_flag(&flags[1], "message", 'm', "single_arg flag", NULL);
+    init_flag(&flags[2], "author", 0, "single_arg flag", "nobody <nobody@example.com>");
+    init_flag(&flags[3], "file", 'f', "multi_arg flag", NULL);
+    set_flag_type(&flags[3], multi_arg);
+    for (int i = 0; i < 4; i++) {
+        add_flag(&commit, &flags[i]);
+    }
+    add_subcmd(&rootCmd, &commit);
+
+    char *argv[] = {"bench", "commit", "-a", "-m", "fix the \"quoted\" path\tand a tab", "-f", "src/main.c", "src/util.c", "docs/README.md", NULL};
+    SAPParseResult res;
+    if (sap_parse(9, argv, &res) != 0) {
+        fprintf(stderr, "the parse failed\n");
+        return 1;
+    }
+
+    SAPOutput out;
+    sap_output_init(&out, discard_write, NULL);
+    double start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        sap_write_json(&res, &out);
+    }
+    report("serialize/json", iterations, now_sec() - start);
+
+    start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        sap_write_record(&res, &out);
+    }
+    report("serialize/record", iterations, now_sec() - start);
+
+    char buf[512];
+    start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        printf_walk(&res, buf, sizeof(buf));
+    }
+    report("serialize/printf-walk", iterations, now_sec() - start);
+    sap_output_free(&out);
+
+    /* replay: read the record back */
+    SAPMemBuf mem = {0};
+    sap_output_mem(&out, &mem);
+    sap_write_record(&res, &out);
+    sap_output_flush(&out);
+    start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        SAPParseResult replay;
+        if (sap_read_record(mem.data, mem.len, &replay, NULL) != 0) {
+            fprintf(stderr, "the record can't be read\n");
+            return 1;
+        }
+        sap_free_result(&replay);
+    }
+    report("serialize/read-record", iterations, now_sec() - start);
+
+    sap_output_free(&out);
+    sap_mem_buf_free(&mem);
+    sap_free_result(&res);
+    free_root_cmd();
+    return 0;
+}
+
+/* ---- serialisation: JSON and binary records ---- */
+
+/* ++++ choice flags: perfect hash vs strcmp scan ++++ */
+
+#define CHOICE_CNT 40
+
+static int bench_choices(long iterations) {
+    static Flag choice, plain;
+    static char names[CHOICE_CNT][16];
+    static const char *choices[CHOICE_CNT + 1];
+    for (int i = 0; i < CHOICE_CNT; i++) {
+        snprintf(names[i], sizeof(names[i]), "encoding-%02d", i);
+        choices[i] = names[i];
+    }
+    choices[CHOICE_CNT] = NULL;
+
+    init_root_cmd("bench", "choice flag benchmark", NULL, nop_exec);
+    init_flag(&choice, "choice", 'c', "choice flag", NULL);
+    set_flag_choices(&choice, choices);
+    init_flag(&plain, "plain", 'p', "single_arg flag", NULL);
+    add_flag(&rootCmd, &choice);
+    add_flag(&rootCmd, &plain);
+
+    /* the late choices are the worst case of the scan */
+    char *choice_argv[] = {"bench", "-c", names[CHOICE_CNT - 3], NULL};
+    char *plain_argv[] = {"bench", "-p", names[CHOICE_CNT - 3], NULL};
+    SAPParseResult res;
+    long sum = 0;
+
+    double start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        if (sap_parse(3, choice_argv, &res) != 0) {
+            return 1;
+        }
+        sum += sap_choice_id(&choice, (const char *) res.values[1]);
+        sap_free_result(&res);
+    }
+    report("choices/perfect-hash", iterations, now_sec() - start);
+
+    start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        if (sap_parse(3, plain_argv, &res) != 0) {
+            return 1;
+        }
+        const char *value = (const char *) res.values[2];
+        int id = 0;
+        while (id < CHOICE_CNT && strcmp(choices[id], value) != 0) {
+            id++;
+        }
+        sum += id;
+        sap_free_result(&res);
+    }
+    report("choices/strcmp-scan", iterations, now_sec() - start);
+
+    free_root_cmd();
+    return (sum == 2 * iterations * (CHOICE_CNT - 3)) ? 0 : 1;
+}
+
+/* ---- choice flags: perfect hash vs strcmp scan ---- */
+
+/* ++++ repeatable flags: append and count ++++ */
+
+#define REPEAT_MAX 100000
+
+static int bench_repeat(long iterations) {
+    static Flag include, verbose, last;
+    static char *argv[2 * REPEAT_MAX + 2];
+
+    init_root_cmd("bench", "repeatable flag benchmark", NULL, nop_exec);
+    init_flag(&include, "include", 'I', "repeat_append flag", NULL);
+    set_flag_repeat(&include, repeat_append);
+    init_flag(&verbose, "verbose", 'v', "repeat_count flag", NULL);
+    set_flag_type(&verbose, no_arg);
+    set_flag_repeat(&verbose, repeat_count);
+    init_flag(&last, "last", 'l', "repeat_last flag", NULL);
+    add_flag(&rootCmd, &include);
+    add_flag(&rootCmd, &verbose);
+    add_flag(&rootCmd, &last);
+
+    /* the cost per occurrence stays flat as the repetitions grow */
+    static const struct { const char *name; const char *option; int has_value; } cases[] = {
+        {"repeat/append", "-I", 1}, {"repeat/count", "-v", 0}, {"repeat/last", "-l", 1},
+    };
+    for (int c = 0; c < 3; c++) {
+        for (int reps = 1000; reps <= REPEAT_MAX; reps *= 10) {
+            int argc = 1;
+            argv[0] = "bench";
+            for (int i = 0; i < reps; i++) {
+                argv[argc++] = (char *) cases[c].option;
+                if (cases[c].has_value) {
+                    argv[argc++] = "include/dir";
+                }
+            }
+            argv[argc] = NULL;
+
+            long rounds = iterations / reps + 1;
+            SAPParseResult res;
+            double start = now_sec();
+            for (long it = 0; it < rounds; it++) {
+                if (sap_parse(argc, argv, &res) != 0) {
+                    return 1;
+                }
+                sap_free_result(&res);
+            }
+            double seconds = now_sec() - start;
+
+            char name[64];
+            snprintf(name, sizeof(name), "%s/%d", cases[c].name, reps);
+            report(name, rounds * reps, seconds);
+        }
+    }
+
+    free_root_cmd();
+    return 0;
+}
+
+/* ---- repeatable flags: append and count ---- */
+
+/* ++++ flag constraints: the check cost by the number of constraints ++++ */
+
+static int bench_constraints(long iterations) {
+    static SAPCommand cmds[3];
+    static Flag flags[3][8];
+    static const int constraint_cnts[] = {0, 8, 64};
+    static const char shorthands[] = "abcdefgv";
+    char *argv[] = {"bench", NULL, "-a", "-c", "-e", "-g", "-v", "value", NULL};
+
+    init_root_cmd("bench", "constraint benchmark", NULL, nop_exec);
+    for (int c = 0; c < 3; c++) {
+        static char names[3][8];
+        snprintf(names[c], sizeof(names[c]), "cmd%d", constraint_cnts[c]);
+        init_sap_command(&cmds[c], names[c], "command with constraints", NULL, nop_exec);
+        for (int i = 0; i < 8; i++) {
+            static char flag_names[3][8][8];
+            snprintf(flag_names[c][i], sizeof(flag_names[c][i]), "flag%d", i);
+            init_flag(&flags[c][i], flag_names[c][i], shorthands[i], "flag", NULL);
+            set_flag_type(&flags[c][i], (i < 7) ? no_arg : single_arg);
+            add_flag(&cmds[c], &flags[c][i]);
+        }
+        /* satisfied constraints of all the kinds over the 8 flags */
+        for (int k = 0; k < constraint_cnts[c]; k++) {
+            Flag *a = &flags[c][(2 * k) % 8], *b = &flags[c][(2 * k + 2) % 8], *odd = &flags[c][(2 * k + 1) % 8];
+            switch (k % 4) {
+            case 0: add_flag_constraint(&cmds[c], constraint_required, (Flag *[]) {a, NULL}); break;
+            case 1: add_flag_constraint(&cmds[c], constraint_requires, (Flag *[]) {a, b, NULL}); break;
+            case 2: add_flag_constraint(&cmds[c], constraint_exclusive, (Flag *[]) {a, odd, NULL}); break;
+            case 3: add_flag_constraint(&cmds[c], constraint_one_of, (Flag *[]) {odd, a, NULL}); break;
+            }
+        }
+        add_subcmd(&rootCmd, &cmds[c]);
+    }
+
+    for (int c = 0; c < 3; c++) {
+        argv[1] = (char *) cmds[c].name;
+        SAPParseResult res;
+        double start = now_sec();
+        for (long it = 0; it < iterations; it++) {
+            if (sap_parse(8, argv, &res) != 0) {
+                fprintf(stderr, "the parse failed\n");
+                return 1;
+            }
+            sap_free_result(&res);
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "constraints/%d", constraint_cnts[c]);
+        report(name, iterations, now_sec() - start);
+    }
+
+    free_root_cmd();
+    return 0;
+}
+
+/* ---- flag constraints: the check cost by the number of constraints ---- */
+
+/* ++++ lazy subtrees: the startup of a 10k-command tree ++++ */
+
+#define LAZY_FANOUT 100         /* root -> 100 groups -> 100 leaves each */
+
+static SAPCommand lazyGroups[LAZY_FANOUT];
+static SAPCommand lazyLeaves[LAZY_FANOUT][LAZY_FANOUT];
+static Flag lazyFlags[LAZY_FANOUT][LAZY_FANOUT][2];
+static char lazyGroupNames[LAZY_FANOUT][16];
+static char lazyLeafNames[LAZY_FANOUT][16];
+
+static void build_lazy_group(SAPCommand *group) {
+    int g = (int) (group - lazyGroups);
+    for (int l = 0; l < LAZY_FANOUT; l++) {
+        SAPCommand *leaf = &lazyLeaves[g][l];
+        init_sap_command(leaf, lazyLeafNames[l], "a leaf command", NULL, nop_exec);
+        init_flag(&lazyFlags[g][l][0], "verbose", 'v', "print more", NULL);
+        set_flag_type(&lazyFlags[g][l][0], no_arg);
+        init_flag(&lazyFlags[g][l][1], "output", 'o', "the output file", NULL);
+        add_flag(leaf, &lazyFlags[g][l][0]);
+        add_flag(leaf, &lazyFlags[g][l][1]);
+        add_subcmd(group, leaf);
+    }
+}
+
+static int bench_lazy(long iterations) {
+    char *argv[] = {"bench", "group42", "leaf7", "-v", "-o", "out", NULL};
+
+    for (int i = 0; i < LAZY_FANOUT; i++) {
+        snprintf(lazyGroupNames[i], sizeof(lazyGroupNames[i]), "group%d", i);
+        snprintf(lazyLeafNames[i], sizeof(lazyLeafNames[i]), "leaf%d", i);
+    }
+
+    for (int lazy = 0; lazy < 2; lazy++) {
+        size_t tree_bytes = 0;
+        double start = now_sec();
+        for (long it = 0; it < iterations; it++) {
+            /* the whole startup: register the tree, dispatch one command line, tear it down */
+            init_root_cmd("bench", "lazy benchmark", NULL, nop_exec);
+            for (int g = 0; g < LAZY_FANOUT; g++) {
+                init_sap_command(&lazyGroups[g], lazyGroupNames[g], "a group of commands", NULL, nop_exec);
+                add_subcmd(&rootCmd, &lazyGroups[g]);   /* top-down, like the layout benchmark */
+                if (lazy) {
+                    set_cmd_builder(&lazyGroups[g], build_lazy_group);
+                } else {
+                    build_lazy_group(&lazyGroups[g]);
+                }
+            }
+
+            SAPParseResult res;
+            if (sap_parse(6, argv, &res) != 0 || res.cmd != &lazyLeaves[42][7]) {
+                fprintf(stderr, "the parse failed\n");
+                return 1;
+            }
+            sap_free_result(&res);
+            tree_bytes = sap_tree_bytes(&rootCmd);
+            free_root_cmd();
+        }
+        double seconds = now_sec() - start;
+
+        printf("%-32s %10d cmds %10zu bytes built\n", lazy ? "lazy/startup-lazy" : "lazy/startup-eager",
+               LAZY_FANOUT * LAZY_FANOUT + LAZY_FANOUT + 1, tree_bytes);
+        report(lazy ? "lazy/startup-lazy" : "lazy/startup-eager", iterations, seconds);
+    }
+    return 0;
+}
+
+/* ---- lazy subtrees: the startup of a 10k-command tree ---- */
+
+/* ++++ plugins: the startup with 200 plugins in the manifest ++++ */
+
+static int bench_plugins(long iterations) {
+    const int plugin_cnt = 200;
+    char manifest[] = "/tmp/scap_bench_XXXXXX";
+    int fd = mkstemp(manifest);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    FILE *fp = fdopen(fd, "w");
+    for (int i = 0; i < plugin_cnt; i++) {
+        /* the shared objects don't exist, they must never be opened */
+        fprintf(fp, "plugin plugin%d libplugin%d.so the plugin number %d\n", i, i, i);
+        fprintf(fp, "flag verbose v no_arg print more\n");
+        fprintf(fp, "flag output o single_arg the output file\n");
+        fprintf(fp, "default inputs - multi_arg the input files\n");
+    }
+    fclose(fp);
+
+    static SAPCommand builtin;
+    static Flag verbose;
+    char *argv[] = {"bench", "builtin", "-v", NULL};
+    char *help[] = {"bench", "help", NULL};
+    SAPOutput out;
+    sap_output_init(&out, discard_write, NULL);
+    sap_set_output(sap_out_channel, &out);
+
+    for (int with_plugins = 0; with_plugins < 2; with_plugins++) {
+        for (int is_help = 0; is_help < 2; is_help++) {
+            int loaded = 0;
+            double start = now_sec();
+            for (long it = 0; it < iterations; it++) {
+                /* the whole startup: register the tree, read the manifest, dispatch one command line */
+                init_root_cmd("bench", "plugin benchmark", NULL, nop_exec);
+                init_sap_command(&builtin, "builtin", "a builtin command", NULL, nop_exec);
+                init_flag(&verbose, "verbose", 'v', "print more", NULL);
+                set_flag_type(&verbose, no_arg);
+                add_flag(&builtin, &verbose);
+                add_subcmd(&rootCmd, &builtin);
+                SAPPluginSet *plugins = with_plugins ? sap_load_plugins(&rootCmd, manifest) : NULL;
+
+                if ((is_help ? do_parse_subcmd(2, help) : do_parse_subcmd(3, argv)) != 0) {
+                    fprintf(stderr, "the dispatch failed\n");
+                    return 1;
+                }
+                loaded += (plugins != NULL) ? sap_plugins_loaded(plugins) : 0;
+                free_root_cmd();
+                sap_free_plugins(plugins);
+            }
+            double seconds = now_sec() - start;
+
+            char name[64];
+            snprintf(name, sizeof(name), "plugins/%d-%s", with_plugins ? plugin_cnt : 0, is_help ? "help" : "dispatch");
+            report(name, iterations, seconds);
+            if (loaded != 0) {
+                fprintf(stderr, "a plugin is opened\n");
+                return 1;
+            }
+        }
+    }
+
+    sap_set_output(sap_out_channel, NULL);
+    sap_output_free(&out);
+    unlink(manifest);
+    return 0;
+}
+
+/* ---- plugins: the startup with 200 plugins in the manifest ---- */
+
+/* ++++ fallbacks: 32 flags resolved from the environment and a config file ++++ */
+
+#define FALLBACK_FLAGS 32
+
+static SAPCommand fallbackCmds[2];
+static Flag fallbackFlags[2][FALLBACK_FLAGS];
+static char fallbackNames[FALLBACK_FLAGS][16];
+static char fallbackEnvs[FALLBACK_FLAGS][24];
+
+static int bench_fallback(long iterations) {
+    char config[] = "/tmp/scap_bench_XXXXXX";
+    int fd = mkstemp(config);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    FILE *fp = fdopen(fd, "w");
+    for (int i = 0; i < FALLBACK_FLAGS; i += 2) {
+        fprintf(fp, "# the option number %d\nopt%d = value%d\n", i, i, i);
+    }
+    fclose(fp);
+
+    /* a realistic environment: 100 unrelated variables, 8 declared ones set */
+    char env_buf[32];
+    for (int i = 0; i < 100; i++) {
+        snprintf(env_buf, sizeof(env_buf), "BENCH_NOISE_%d", i);
+        setenv(env_buf, "noise", 1);
+    }
+    for (int i = 0; i < FALLBACK_FLAGS; i++) {
+        snprintf(fallbackNames[i], sizeof(fallbackNames[i]), "opt%d", i);
+        snprintf(fallbackEnvs[i], sizeof(fallbackEnvs[i]), "BENCH_OPT_%d", i);
+        if (i % 4 == 1) {
+            setenv(fallbackEnvs[i], "from-env", 1);
+        }
+    }
+
+    /* "plain" declares no fallback, in "run" every flag declares an env var and every other one a config key */
+    init_root_cmd("bench", "fallback benchmark", NULL, NULL);
+    for (int c = 0; c < 2; c++) {
+        init_sap_command(&fallbackCmds[c], c ? "run" : "plain", "run it", NULL, nop_exec);
+        for (int i = 0; i < FALLBACK_FLAGS; i++) {
+            init_flag(&fallbackFlags[c][i], fallbackNames[i], 0, "an option", NULL);
+            if (c) {
+                set_flag_env(&fallbackFlags[c][i], fallbackEnvs[i]);
+                set_flag_config_key(&fallbackFlags[c][i], (i % 2 == 0) ? fallbackNames[i] : NULL);
+            }
+            add_flag(&fallbackCmds[c], &fallbackFlags[c][i]);
+        }
+        add_subcmd(&rootCmd, &fallbackCmds[c]);
+    }
+    if (sap_load_config(config) != 0) {
+        fprintf(stderr, "the config can't be loaded\n");
+        return 1;
+    }
+    char *plain[] = {"bench", "plain", "--opt0", "x", "--opt3", "y", NULL};
+    char *run[] = {"bench", "run", "--opt0", "x", "--opt3", "y", NULL};
+
+    for (int mode = 0; mode < 3; mode++) {
+        long found = 0;
+        double start = now_sec();
+        for (long it = 0; it < iterations; it++) {
+            SAPParseResult res;
+            if (sap_parse(6, mode == 1 ? run : plain, &res) != 0) {
+                fprintf(stderr, "the parse failed\n");
+                return 1;
+            }
+            if (mode == 2) {
+                /* the naive resolution: one getenv per flag */
+                for (int i = 0; i < FALLBACK_FLAGS; i++) {
+                    found += getenv(fallbackEnvs[i]) != NULL;
+                }
+            } else {
+                found += sap_get_source(&res, "opt5") == source_env;
+            }
+            sap_free_result(&res);
+        }
+        double seconds = now_sec() - start;
+        report(mode == 0 ? "fallback/none" : (mode == 1 ? "fallback/env-config" : "fallback/getenv-per-flag"),
+               iterations, seconds);
+        if ((mode > 0) != (found > 0)) {
+            fprintf(stderr, "the env values are resolved wrongly\n");
+            return 1;
+        }
+    }
+
+    free_root_cmd();
+    unlink(config);
+    return 0;
+}
+
+/* ---- fallbacks: 32 flags resolved from the environment and a config file ---- */
+
+/* ++++ multi-call: the entry point of a 200-tool binary from argv[0] ++++ */
+
+#define MULTICALL_TOOLS 200
+
+static SAPCommand multicallTools[MULTICALL_TOOLS];
+static char multicallNames[MULTICALL_TOOLS][16];
+
+static int bench_multicall(long iterations) {
+    init_root_cmd("box", "multi-call benchmark", NULL, NULL);
+    for (int i = 0; i < MULTICALL_TOOLS; i++) {
+        snprintf(multicallNames[i], sizeof(multicallNames[i]), "tool%d", i);
+        init_sap_command(&multicallTools[i], multicallNames[i], "a tool", NULL, nop_exec);
+        add_subcmd(&rootCmd, &multicallTools[i]);
+    }
+    set_multi_call(&rootCmd, 1);
+
+    /* the last tool, the worst case of a walk over the children */
+    char *by_argv1[] = {"/usr/bin/box", "tool199", "-h", NULL};
+    char *by_argv0[] = {"/usr/bin/tool199", "-h", NULL};
+
+    for (int entry = 0; entry < 2; entry++) {
+        double start = now_sec();
+        for (long it = 0; it < iterations; it++) {
+            SAPParseResult res;
+            int ret = entry ? sap_parse(2, by_argv0, &res) : sap_parse(3, by_argv1, &res);
+            if (ret != 0 || res.cmd != &multicallTools[MULTICALL_TOOLS - 1]) {
+                fprintf(stderr, "the parse failed\n");
+                return 1;
+            }
+            sap_free_result(&res);
+        }
+        report(entry ? "multicall/argv0" : "multicall/argv1", iterations, now_sec() - start);
+    }
+
+    free_root_cmd();
+    return 0;
+}
+
+/* ---- multi-call: the entry point of a 200-tool binary from argv[0] ---- */
+
+/* ++++ telemetry: the per-parse overhead of the usage counters ++++ */
+
+static int bench_telemetry_loop(const char *name, long iterations, int argc, char *argv[]) {
+    double start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        SAPParseResult res;
+        if (sap_parse(argc, argv, &res) != 0) {
+            fprintf(stderr, "the parse failed\n");
+            return 1;
+        }
+        sap_free_result(&res);
+    }
+    report(name, iterations, now_sec() - start);
+    return 0;
+}
+
+static int bench_telemetry(long iterations) {
+    static SAPCommand build;
+    static Flag verbose, jobs, output;
+    init_root_cmd("bench", "telemetry benchmark", NULL, NULL);
+    init_sap_command(&build, "build", "build the targets", NULL, nop_exec);
+    init_flag(&verbose, "verbose", 'v', "print more", NULL);
+    set_flag_type(&verbose, no_arg);
+    init_flag(&jobs, "jobs", 'j', "the number of jobs", NULL);
+    init_flag(&output, "output", 'o', "the output file", NULL);
+    add_flag(&build, &verbose);
+    add_flag(&build, &jobs);
+    add_flag(&build, &output);
+    add_subcmd(&rootCmd, &build);
+    char *argv[] = {"bench", "build", "-v", "--jobs", "8", "-o", "out.bin", NULL};
+
+    char usage[] = "/tmp/scap_bench_XXXXXX";
+    int fd = mkstemp(usage);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    unlink(usage);      /* sap_telemetry_open creates it */
+
+    if (bench_telemetry_loop("telemetry/off", iterations, 7, argv) != 0) {
+        return 1;
+    }
+    if (sap_telemetry_open(usage) != 0) {
+        fprintf(stderr, "the telemetry file can't be opened\n");
+        return 1;
+    }
+    if (bench_telemetry_loop("telemetry/on", iterations, 7, argv) != 0) {
+        return 1;
+    }
+
+    /* 4 processes adding to the same counters of the shared file */
+    fflush(stdout);
+    for (int p = 0; p < 4; p++) {
+        if (fork() == 0) {
+            int ret = bench_telemetry_loop("telemetry/on-4-processes", iterations, 7, argv);
+            fflush(stdout);
+            _exit(ret);
+        }
+    }
+    int status, failed = 0;
+    while (wait(&status) > 0) {
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+
+    SAPMemBuf mem = {0};
+    SAPOutput out;
+    sap_output_mem(&out, &mem);
+    sap_telemetry_report(&out, 1);
+    sap_output_flush(&out);
+    long counted = (mem.data != NULL) ? atol(mem.data) : 0;
+    printf("%-32s %10ld counted %10ld parsed\n", "telemetry/aggregated", counted, iterations * 5);
+    sap_output_free(&out);
+    sap_mem_buf_free(&mem);
+
+    sap_telemetry_close();
+    free_root_cmd();
+    unlink(usage);
+    return failed || counted != iterations * 5;
+}
+
+/* ---- telemetry: the per-parse overhead of the usage counters ---- */
+
+/* ++++ rcu: the parse latency of the published tree versions, with and without a concurrent publisher ++++ */
+
+static int rcuPublishing = 0;   /* whether the publisher keeps running */
+static long rcuPublishCnt = 0;  /* the number of the publishes meanwhile */
+
+static int cmp_double(const void *a, const void *b) {
+    double da = *(const double *) a, db = *(const double *) b;
+    return (da > db) - (da < db);
+}
+
+static void *rcu_publisher(void *arg) {
+    SAPCommand *toggled = (SAPCommand *) arg;
+    for (long r = 0; __atomic_load_n(&rcuPublishing, __ATOMIC_ACQUIRE); r++) {
+        sap_tree_lock();
+        if (r % 2 == 0) {
+            add_subcmd(&rootCmd, toggled);
+        } else {
+            remove_subcmd(&rootCmd, toggled);
+        }
+        sap_tree_unlock();
+        sap_tree_publish();
+        rcuPublishCnt++;
+    }
+    return NULL;
+}
+
+/**
+ * @brief parse through the published versions, report the mean and the p50/p99 latencies of read_lock+parse+unlock.
+ */
+static int bench_rcu_loop(const char *name, long iterations, int argc, char *argv[], double *lat) {
+    SAPRcuReader reader;
+    sap_rcu_register(&reader);
+    double start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        double t0 = now_sec();
+        const SAPTreeVersion *version = sap_rcu_read_lock(&reader);
+        SAPParseResult res;
+        int ret = sap_version_parse(version, argc, argv, &res);
+        sap_free_result(&res);
+        sap_rcu_read_unlock(&reader);
+        lat[it] = now_sec() - t0;
+        if (ret != 0) {
+            fprintf(stderr, "the parse failed\n");
+            return 1;
+        }
+    }
+    report(name, iterations, now_sec() - start);
+    sap_rcu_unregister(&reader);
+
+    qsort(lat, (size_t) iterations, sizeof(double), cmp_double);
+    printf("%-32s %10.1f ns p50 %10.1f ns p99 %10.1f ns max\n", name,
+           lat[iterations / 2] * 1e9, lat[iterations / 100 * 99] * 1e9, lat[iterations - 1] * 1e9);
+    return 0;
+}
+
+static int bench_rcu(long iterations) {
+    static SAPCommand build, toggled, tools[200];
+    static Flag verbose, jobs, output, tool_flags[200];
+    static char names[200][16];
+    init_root_cmd("bench", "rcu benchmark", NULL, NULL);
+    init_sap_command(&build, "build", "build the targets", NULL, nop_exec);
+    init_flag(&verbose, "verbose", 'v', "print more", NULL);
+    set_flag_type(&verbose, no_arg);
+    init_flag(&jobs, "jobs", 'j', "the number of jobs", NULL);
+    init_flag(&output, "output", 'o', "the output file", NULL);
+    add_flag(&build, &verbose);
+    add_flag(&build, &jobs);
+    add_flag(&build, &output);
+    add_subcmd(&rootCmd, &build);
+    for (int i = 0; i < 200; i++) {
+        snprintf(names[i], sizeof(names[i]), "tool%d", i);
+        init_sap_command(&tools[i], names[i], "a tool", NULL, nop_exec);
+        init_flag(&tool_flags[i], "level", 'l', "a number", "0");
+        add_flag(&tools[i], &tool_flags[i]);
+        add_subcmd(&rootCmd, &tools[i]);
+    }
+    init_sap_command(&toggled, "toggled", "added and removed by the publisher", NULL, nop_exec);
+    char *argv[] = {"bench", "build", "-v", "--jobs", "8", "-o", "out.bin", NULL};
+
+    double *lat = (double *) malloc(sizeof(double) * (size_t) iterations);
+    if (lat == NULL) {
+        return 1;
+    }
+    if (bench_telemetry_loop("rcu/tree-parse", iterations, 7, argv) != 0) {
+        return 1;
+    }
+
+    /* the publish of a 200-command tree */
+    long publishes = iterations / 1000;
+    double start = now_sec();
+    for (long it = 0; it < publishes; it++) {
+        sap_tree_publish();
+    }
+    report("rcu/publish-202-cmds", publishes, now_sec() - start);
+
+    if (bench_rcu_loop("rcu/version-parse", iterations, 7, argv, lat) != 0) {
+        return 1;
+    }
+
+    /* a publisher replacing the version all along, the readers never wait for it */
+    pthread_t publisher;
+    __atomic_store_n(&rcuPublishing, 1, __ATOMIC_RELEASE);
+    pthread_create(&publisher, NULL, rcu_publisher, &toggled);
+    int ret = bench_rcu_loop("rcu/version-parse-publishing", iterations, 7, argv, lat);
+    __atomic_store_n(&rcuPublishing, 0, __ATOMIC_RELEASE);
+    pthread_join(publisher, NULL);
+    printf("%-32s %10ld publishes meanwhile\n", "rcu/version-parse-publishing", rcuPublishCnt);
+
+    sap_rcu_synchronize();
+    free(lat);
+    free_root_cmd();
+    return ret;
+}
+
+/* ---- rcu: the parse latency of the published tree versions, with and without a concurrent publisher ---- */
+
+/* ++++ table: building a 10100-command tree by add_subcmd and by add_subcmd_table ++++ */
+
+#define TABLE_GROUPS 100
+#define TABLE_LEAVES 100
+#define TABLE_CMDS (TABLE_GROUPS * (TABLE_LEAVES + 1))
+
+static SAPCommand tableCmds[TABLE_CMDS];
+static Flag tableFlags[TABLE_CMDS * 2];
+static char tableNames[TABLE_CMDS][16];
+
+/**
+ * @brief initialize the commands and the flags, group g is tableCmds[g * (TABLE_LEAVES + 1)], its leaves follow it.
+ */
+static void table_init(void) {
+    init_root_cmd("bench", "table benchmark", NULL, NULL);
+    for (int i = 0; i < TABLE_CMDS; i++) {
+        init_sap_command(&tableCmds[i], tableNames[i], "a command", NULL, nop_exec);
+        init_flag(&tableFlags[2 * i], "level", 'l', "a number", "0");
+        init_flag(&tableFlags[2 * i + 1], "verbose", 'v', "print more", NULL);
+    }
+}
+
+static int bench_table(long iterations) {
+    static SAPCommand *cmds[TABLE_CMDS];
+    static int parents[TABLE_CMDS], owners[TABLE_CMDS * 2];
+    static Flag *flags[TABLE_CMDS * 2];
+    for (int i = 0; i < TABLE_CMDS; i++) {
+        int group = i / (TABLE_LEAVES + 1) * (TABLE_LEAVES + 1);
+        snprintf(tableNames[i], sizeof(tableNames[i]), (i == group) ? "group%d" : "leaf%d", i - group);
+        cmds[i] = &tableCmds[i];
+        parents[i] = (i == group) ? -1 : group;
+        for (int k = 0; k < 2; k++) {
+            flags[2 * i + k] = &tableFlags[2 * i + k];
+            owners[2 * i + k] = i;
+        }
+    }
+
+    /* the commands are initialized before each build, only the linking is timed */
+    double elapsed = 0;
+    for (long it = 0; it < iterations; it++) {
+        table_init();
+        double start = now_sec();
+        for (int i = 0; i < TABLE_CMDS; i++) {
+            add_flag(&tableCmds[i], &tableFlags[2 * i]);
+            add_flag(&tableCmds[i], &tableFlags[2 * i + 1]);
+            add_subcmd((parents[i] < 0) ? &rootCmd : &tableCmds[parents[i]], &tableCmds[i]);
+        }
+        elapsed += now_sec() - start;
+        free_root_cmd();
+    }
+    report("table/add_subcmd-top-down", iterations, elapsed);
+
+    /* the groups are filled first, then added to the root with their leaves */
+    elapsed = 0;
+    for (long it = 0; it < iterations; it++) {
+        table_init();
+        double start = now_sec();
+        for (int i = 0; i < TABLE_CMDS; i++) {
+            add_flag(&tableCmds[i], &tableFlags[2 * i]);
+            add_flag(&tableCmds[i], &tableFlags[2 * i + 1]);
+            if (parents[i] >= 0) {
+                add_subcmd(&tableCmds[parents[i]], &tableCmds[i]);
+            }
+        }
+        for (int g = 0; g < TABLE_CMDS; g += TABLE_LEAVES + 1) {
+            add_subcmd(&rootCmd, &tableCmds[g]);
+        }
+        elapsed += now_sec() - start;
+        free_root_cmd();
+    }
+    report("table/add_subcmd-bottom-up", iterations, elapsed);
+
+    elapsed = 0;
+    for (long it = 0; it < iterations; it++) {
+        table_init();
+        double start = now_sec();
+        int ret = add_subcmd_table(&rootCmd, cmds, parents, TABLE_CMDS, flags, owners, TABLE_CMDS * 2);
+        elapsed += now_sec() - start;
+        free_root_cmd();
+        if (ret != 0) {
+            fprintf(stderr, "the table is invalid\n");
+            return 1;
+        }
+    }
+    report("table/add_subcmd_table", iterations, elapsed);
+    return 0;
+}
+
+/* ---- table: building a 10100-command tree by add_subcmd and by add_subcmd_table ---- */
+
+/* ++++ aliases: a subcommand of 200 and its flag, by the names and by the aliases ++++ */
+
+#define ALIAS_TOOLS 200
+
+static SAPCommand aliasTools[ALIAS_TOOLS];
+static Flag aliasLevels[ALIAS_TOOLS];
+static char aliasNames[ALIAS_TOOLS][2][16];
+
+static int bench_aliases(long iterations) {
+    init_root_cmd("box", "aliases benchmark", NULL, NULL);
+    for (int i = 0; i < ALIAS_TOOLS; i++) {
+        snprintf(aliasNames[i][0], sizeof(aliasNames[i][0]), "tool%d", i);
+        snprintf(aliasNames[i][1], sizeof(aliasNames[i][1]), "t%d", i);
+        init_sap_command(&aliasTools[i], aliasNames[i][0], "a tool", NULL, nop_exec);
+        init_flag(&aliasLevels[i], "level", 'l', "a number", "0");
+        add_flag_alias(&aliasLevels[i], "lvl", 'L');
+        add_flag(&aliasTools[i], &aliasLevels[i]);
+        add_subcmd(&rootCmd, &aliasTools[i]);
+        add_cmd_alias(&aliasTools[i], aliasNames[i][1]);
+    }
+
+    /* the last tool, the worst case of a walk over the children */
+    static char *lines[][5] = {
+        {"box", "tool199", "--level", "3", NULL},
+        {"box", "t199", "--lvl", "3", NULL},
+        {"box", "t199", "-L", "3", NULL},
+    };
+    static const char *names[] = {"aliases/names", "aliases/long-aliases", "aliases/short-aliases"};
+    for (int c = 0; c < 3; c++) {
+        double start = now_sec();
+        for (long it = 0; it < iterations; it++) {
+            SAPParseResult res;
+            if (sap_parse(4, lines[c], &res) != 0 || res.cmd != &aliasTools[ALIAS_TOOLS - 1]
+                || strcmp((const char *) sap_get_value(&res, "level"), "3") != 0) {
+                fprintf(stderr, "the parse failed\n");
+                return 1;
+            }
+            sap_free_result(&res);
+        }
+        report(names[c], iterations, now_sec() - start);
+    }
+
+    free_root_cmd();
+    return 0;
+}
+
+/* ---- aliases: a subcommand of 200 and its flag, by the names and by the aliases ---- */
+
+/* ++++ positional: 40 arguments by the default flag and by the positional slots ++++ */
+
+#define POSITIONAL_ARGS 40
+
+static int bench_positional_loop(const char *name, long iterations, int argc, char *argv[]) {
+    double start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        SAPParseResult res;
+        if (sap_parse(argc, argv, &res) != 0) {
+            fprintf(stderr, "the parse failed\n");
+            return 1;
+        }
+        sap_free_result(&res);
+    }
+    report(name, iterations, now_sec() - start);
+    return 0;
+}
+
+static int bench_positional(long iterations) {
+    static SAPCommand dftCmd, slotCmd;
+    static Flag dftVerbose, slotVerbose, dftInputs;
+    static char tokens[POSITIONAL_ARGS][16];
+    init_root_cmd("bench", "positional benchmark", NULL, NULL);
+
+    /* the default flag takes all the arguments */
+    init_sap_command(&dftCmd, "dft", "a default flag", NULL, nop_exec);
+    init_flag(&dftVerbose, "verbose", 'v', "print more", NULL);
+    set_flag_type(&dftVerbose, no_arg);
+    init_flag(&dftInputs, "inputs", 'i', "the inputs", NULL);
+    set_flag_type(&dftInputs, multi_arg);
+    add_flag(&dftCmd, &dftVerbose);
+    add_default_flag(&dftCmd, &dftInputs);
+
+    /* 7 typed slots and a variadic tail */
+    init_sap_command(&slotCmd, "slots", "the positional slots", NULL, nop_exec);
+    init_flag(&slotVerbose, "verbose", 'v', "print more", NULL);
+    set_flag_type(&slotVerbose, no_arg);
+    add_flag(&slotCmd, &slotVerbose);
+    for (int i = 0; i < 7; i++) {
+        add_positional(&slotCmd, (i % 2 == 0) ? "name" : "count", "a slot", (i % 2 == 0) ? pos_string : pos_int, 1, 1);
+    }
+    add_positional(&slotCmd, "rest", "the tail", pos_string, 0, -1);
+    add_subcmd(&rootCmd, &dftCmd);
+    add_subcmd(&rootCmd, &slotCmd);
+
+    /* bench <cmd> -v arg... with 8 and with 40 arguments */
+    char *argv[POSITIONAL_ARGS + 4];
+    argv[0] = "bench";
+    argv[2] = "-v";
+    for (int i = 0; i < POSITIONAL_ARGS; i++) {
+        snprintf(tokens[i], sizeof(tokens[i]), (i % 2 == 0) ? "arg%d" : "%d", i);
+        argv[i + 3] = tokens[i];
+    }
+    argv[POSITIONAL_ARGS + 3] = NULL;
+
+    static const int arg_cnts[] = {8, POSITIONAL_ARGS};
+    for (int k = 0; k < 2; k++) {
+        char name[64];
+        argv[1] = "dft";
+        snprintf(name, sizeof(name), "positional/default-flag-%d", arg_cnts[k]);
+        if (bench_positional_loop(name, iterations, arg_cnts[k] + 3, argv) != 0) {
+            return 1;
+        }
+        argv[1] = "slots";
+        snprintf(name, sizeof(name), "positional/slots-%d", arg_cnts[k]);
+        if (bench_positional_loop(name, iterations, arg_cnts[k] + 3, argv) != 0) {
+            return 1;
+        }
+    }
+
+    free_root_cmd();
+    return 0;
+}
+
+/* ---- positional: 40 arguments by the default flag and by the positional slots ---- */
+
+/* ++++ passthrough: forwarding 100k arguments after "--" to a child process ++++ */
+
+#define PASSTHROUGH_ARGS 100000
+
+/**
+ * @brief spawn a command line and wait for it, the vector is copied first if $copy.
+ */
+static int spawn_wait(const SAPParseResult *res, int copy) {
+    pid_t pid;
+    int ret;
+    if (copy) {
+        /* what a wrapper without the slice does: a new vector for posix_spawnp */
+        char **args = (char **) malloc(sizeof(char *) * (res->tail_argc + 1));
+        memcpy(args, res->tail_argv, sizeof(char *) * (res->tail_argc + 1));
+        ret = posix_spawnp(&pid, args[0], NULL, NULL, args, environ);
+        free(args);
+    } else {
+        ret = sap_spawn_tail(res, &pid);
+    }
+    int status = 0;
+    if (ret != 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "the child failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int bench_passthrough(long iterations) {
+    static SAPCommand runCmd;
+    static Flag verbose, inputs;
+    static char *argv[PASSTHROUGH_ARGS + 6];
+    static char tokens[PASSTHROUGH_ARGS][8];
+    init_root_cmd("wrap", "passthrough benchmark", NULL, NULL);
+    init_sap_command(&runCmd, "run", "run a command", NULL, nop_exec);
+    init_flag(&verbose, "verbose", 'v', "print more", NULL);
+    set_flag_type(&verbose, no_arg);
+    init_flag(&inputs, "inputs", 'i', "the inputs", NULL);
+    set_flag_type(&inputs, multi_arg);
+    add_flag(&runCmd, &verbose);
+    add_default_flag(&runCmd, &inputs);
+    add_subcmd(&rootCmd, &runCmd);
+    set_cmd_passthrough(&runCmd, 1);
+
+    /* wrap run -v -- true arg... */
+    argv[0] = "wrap";
+    argv[1] = "run";
+    argv[2] = "-v";
+    argv[3] = "--";
+    argv[4] = "true";
+    for (int i = 0; i < PASSTHROUGH_ARGS; i++) {
+        snprintf(tokens[i], sizeof(tokens[i]), "a%d", i);
+        argv[i + 5] = tokens[i];
+    }
+    argv[PASSTHROUGH_ARGS + 5] = NULL;
+    const int argc = PASSTHROUGH_ARGS + 5;
+
+    /* the tail is sliced, the arguments after "--" aren't scanned */
+    SAPParseResult res;
+    double start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        if (sap_parse(argc, argv, &res) != 0 || res.tail_argc != PASSTHROUGH_ARGS + 1) {
+            fprintf(stderr, "the parse failed\n");
+            return 1;
+        }
+        sap_free_result(&res);
+    }
+    report("passthrough/parse-tail-100k", iterations, now_sec() - start);
+
+    /* the same arguments taken by the default flag, without "--" */
+    argv[3] = "true";
+    start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        if (sap_parse(argc - 1, argv, &res) != 0 || res.tail_argv != NULL) {
+            fprintf(stderr, "the parse failed\n");
+            return 1;
+        }
+        sap_free_result(&res);
+    }
+    report("passthrough/parse-default-flag-100k", iterations, now_sec() - start);
+    argv[3] = "--";
+
+    /* without the passthrough, the arguments after "--" are operands of the default flag */
+    set_cmd_passthrough(&runCmd, 0);
+    start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        if (sap_parse(argc, argv, &res) != 0 || res.tail_argv != NULL) {
+            fprintf(stderr, "the parse failed\n");
+            return 1;
+        }
+        sap_free_result(&res);
+    }
+    report("passthrough/parse-operands-100k", iterations, now_sec() - start);
+    set_cmd_passthrough(&runCmd, 1);
+
+    for (int copy = 0; copy < 2; copy++) {
+        start = now_sec();
+        for (long it = 0; it < iterations; it++) {
+            sap_parse(argc, argv, &res);
+            int ret = spawn_wait(&res, copy);
+            sap_free_result(&res);
+            if (ret != 0) {
+                return 1;
+            }
+        }
+        report(copy ? "passthrough/copy-spawn-100k" : "passthrough/slice-spawn-100k", iterations, now_sec() - start);
+    }
+
+    free_root_cmd();
+    return 0;
+}
+
+/* ---- passthrough: forwarding 100k arguments after "--" to a child process ---- */
+
+/* ++++ cache: a skewed workload of 4000 distinct command lines, parsed and through the cache ++++ */
+
+#define CACHE_SERVICES 16
+#define CACHE_LINES 4000
+#define CACHE_TOKENS 20
+#define CACHE_SEQ 65536     /* the length of the sampled sequence, replayed */
+
+static SAPCommand cacheServices[CACHE_SERVICES];
+static Flag cacheFlags[CACHE_SERVICES][8];
+static char cacheNames[CACHE_SERVICES][16];
+static char cacheTokens[CACHE_LINES][6][24];
+
+#define CACHE_BLOCK 4096    /* the configurations take turns by blocks, so a drift of the machine hits them all alike */
+
+/**
+ * @brief run a block of the sequence, from the position of the configuration, through sap_parse or the cache.
+ *
+ * @return double   - the seconds of the block, < 0 if a parse fails.
+ */
+static double bench_cache_block(SAPParseCache *cache, char *lines[][CACHE_TOKENS + 1], const int *seq, long *pos, long cnt) {
+    double start = now_sec();
+    for (long it = 0; it < cnt; it++, (*pos)++) {
+        SAPParseResult res;
+        char **argv = lines[seq[*pos % CACHE_SEQ]];
+        int ret = (cache == NULL) ? sap_parse(CACHE_TOKENS, argv, &res) : sap_cache_parse(cache, CACHE_TOKENS, argv, &res);
+        if (ret != 0 || res.values[2] != argv[5] + 10) {
+            fprintf(stderr, "the parse failed\n");
+            return -1;
+        }
+        sap_free_result(&res);
+    }
+    return now_sec() - start;
+}
+
+static int bench_cache(long iterations) {
+    static char *lines[CACHE_LINES][CACHE_TOKENS + 1];
+    static int seq[CACHE_SEQ];
+    static const char *regions[] = {"eu", "us", "ap", NULL};
+    static const char *modes[] = {"fast", "safe", "dry", NULL};
+    init_root_cmd("gw", "cache benchmark", NULL, NULL);
+
+    /* 16 services of 8 flags, choices and repeated flags among them:
+     * gw <svc> -vv --region <r> --timeout=<t> -n <n> --mode <m> --label <l> x3 --header <h> <host> <host> */
+    for (int s = 0; s < CACHE_SERVICES; s++) {
+        snprintf(cacheNames[s], sizeof(cacheNames[s]), "svc%d", s);
+        init_sap_command(&cacheServices[s], cacheNames[s], "a service", NULL, nop_exec);
+        init_flag(&cacheFlags[s][0], "region", 'r', "the region", "eu");
+        set_flag_choices(&cacheFlags[s][0], regions);
+        init_flag(&cacheFlags[s][1], "timeout", 't', "the timeout", "30");
+        init_flag(&cacheFlags[s][2], "replicas", 'n', "the replicas", "1");
+        init_flag(&cacheFlags[s][3], "verbose", 'v', "print more", NULL);
+        set_flag_type(&cacheFlags[s][3], no_arg);
+        set_flag_repeat(&cacheFlags[s][3], repeat_count);
+        init_flag(&cacheFlags[s][4], "mode", 'm', "the mode", "fast");
+        set_flag_choices(&cacheFlags[s][4], modes);
+        init_flag(&cacheFlags[s][5], "label", 'l', "a label", NULL);
+        set_flag_repeat(&cacheFlags[s][5], repeat_append);
+        init_flag(&cacheFlags[s][6], "header", 'H', "a header", NULL);
+        init_flag(&cacheFlags[s][7], "hosts", 'T', "the hosts", NULL);
+        set_flag_type(&cacheFlags[s][7], multi_arg);
+        for (int f = 0; f < 7; f++) {
+            add_flag(&cacheServices[s], &cacheFlags[s][f]);
+        }
+        add_default_flag(&cacheServices[s], &cacheFlags[s][7]);
+        add_subcmd(&rootCmd, &cacheServices[s]);
+    }
+    for (int l = 0; l < CACHE_LINES; l++) {
+        snprintf(cacheTokens[l][0], sizeof(cacheTokens[l][0]), "--timeout=%d", l % 97);
+        snprintf(cacheTokens[l][1], sizeof(cacheTokens[l][1]), "%d", l % 5);
+        snprintf(cacheTokens[l][2], sizeof(cacheTokens[l][2]), "tier=%d", l % 3);
+        snprintf(cacheTokens[l][3], sizeof(cacheTokens[l][3]), "x-trace:%d", l);
+        snprintf(cacheTokens[l][4], sizeof(cacheTokens[l][4]), "host%d.example", l);
+        snprintf(cacheTokens[l][5], sizeof(cacheTokens[l][5]), "host%d.example", l + 1);
+        char *line[CACHE_TOKENS + 1] = {"gw", cacheNames[l % CACHE_SERVICES], "-vv", "--region", (char *) regions[l % 3],
+                                        cacheTokens[l][0], "-n", cacheTokens[l][1], "--mode", (char *) modes[l % 3],
+                                        "--label", "app=web", "--label", cacheTokens[l][2], "-l", "zone=a",
+                                        "--header", cacheTokens[l][3], cacheTokens[l][4], cacheTokens[l][5], NULL};
+        memcpy(lines[l], line, sizeof(line));
+    }
+
+    /* zipf(1.0) over the lines, by the inverse of its cdf */
+    static double cdf[CACHE_LINES];
+    double sum = 0;
+    for (int l = 0; l < CACHE_LINES; l++) {
+        sum += 1.0 / (l + 1);
+        cdf[l] = sum;
+    }
+    uint64_t rng = 88172645463325252ULL;
+    for (int i = 0; i < CACHE_SEQ; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        double u = (double) (rng >> 11) / 9007199254740992.0 * sum;
+        int lo = 0, hi = CACHE_LINES - 1;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (cdf[mid] < u) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        seq[i] = lo;
+    }
+
+    /* 4096 holds every line, its hits cost what a hit costs */
+    static const int capacities[] = {0, 256, 1024, 4096};
+    SAPParseCache *caches[4] = {NULL};
+    double seconds[4] = {0};
+    long pos[4] = {0};
+    for (int k = 1; k < 4; k++) {
+        caches[k] = sap_cache_create(capacities[k]);
+    }
+    for (long done = 0; done < iterations; done += CACHE_BLOCK) {
+        long cnt = (iterations - done < CACHE_BLOCK) ? iterations - done : CACHE_BLOCK;
+        for (int k = 0; k < 4; k++) {
+            double block = bench_cache_block(caches[k], lines, seq, &pos[k], cnt);
+            if (block < 0) {
+                return 1;
+            }
+            seconds[k] += block;
+        }
+    }
+
+    report("cache/parse-zipf-4000", iterations, seconds[0]);
+    for (int k = 1; k < 4; k++) {
+        char name[64];
+        snprintf(name, sizeof(name), "cache/cached-%d-zipf-4000", capacities[k]);
+        report(name, iterations, seconds[k]);
+        SAPCacheStats stats;
+        sap_cache_stats(caches[k], &stats);
+        printf("%-32s %10.1f %% hits %10llu evictions %10llu bypassed\n", name, 100.0 * (double) stats.hits / (double) stats.lookups,
+               (unsigned long long) stats.evictions, (unsigned long long) stats.bypassed);
+        sap_cache_free(caches[k]);
+    }
+
+    free_root_cmd();
+    return 0;
+}
+
+/* ---- cache: a skewed workload of 4000 distinct command lines, parsed and through the cache ---- */
+
+/* ++++ getopt shim: scap vs glibc on a large option set ++++ */
+
+static int bench_getopt(long iterations) {
+    enum { option_cnt = 200, arg_cnt = 41 };
+    static char names[option_cnt][16];
+    static struct option glibc_longopts[option_cnt + 1];
+    static SAPOption sap_longopts[option_cnt + 1];
+
+    for (int i = 0; i < option_cnt; i++) {
+        snprintf(names[i], sizeof(names[i]), "option-%03d", i);
+        int has_arg = (i % 2 == 0) ? no_argument : required_argument;
+        glibc_longopts[i] = (struct option) {names[i], has_arg, NULL, 256 + i};
+        sap_longopts[i] = (SAPOption) {names[i], has_arg, NULL, 256 + i};
+    }
+
+    /* 40 long options spread over the set, the odd ones take an argument */
+    char *argv_tpl[arg_cnt + 1];
+    static char tokens[arg_cnt][32];
+    argv_tpl[0] = "bench";
+    for (int i = 1; i < arg_cnt; i++) {
+        int opt = (i * 37) % option_cnt;
+        if (opt % 2 == 0) {
+            snprintf(tokens[i], sizeof(tokens[i]), "--%s", names[opt]);
+        } else {
+            snprintf(tokens[i], sizeof(tokens[i]), "--%s=value", names[opt]);
+        }
+        argv_tpl[i] = tokens[i];
+    }
+    argv_tpl[arg_cnt] = NULL;
+    char *argv[arg_cnt + 1];
+
+    double start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        memcpy(argv, argv_tpl, sizeof(argv_tpl));
+        optind = 0;
+        while (getopt_long(arg_cnt, argv, "ab", glibc_longopts, NULL) != -1) {
+        }
+    }
+    report("getopt/glibc-200-opts", iterations, now_sec() - start);
+
+    SAPGetopt *st = (SAPGetopt *) malloc(sizeof(SAPGetopt));
+    sap_getopt_init(st);
+    start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        memcpy(argv, argv_tpl, sizeof(argv_tpl));
+        st->optind = 0;
+        int opt;
+        while ((opt = sap_getopt_long(st, arg_cnt, argv, "ab", sap_longopts, NULL)) != -1) {
+            if (opt == '?') {
+                fprintf(stderr, "sap_getopt_long failed to parse\n");
+                return 1;
+            }
+        }
+    }
+    report("getopt/scap-200-opts", iterations, now_sec() - start);
+
+    sap_getopt_free(st);
+    free(st);
+    return 0;
+}
+
+/* ---- getopt shim: scap vs glibc on a large option set ---- */
+
+int main(int argc, char *argv[]) {
+    const char *which = (argc > 1) ? argv[1] : "short";
+    long iterations = (argc > 2) ? atol(argv[2]) : 1000000;
+
+    if (strcmp(which, "short") == 0) {
+        return bench_short(iterations);
+    } else if (strcmp(which, "async") == 0) {
+        return bench_async(iterations / 10);
+    } else if (strcmp(which, "layout") == 0) {
+        return bench_layout(iterations / 100000);
+    } else if (strcmp(which, "errors") == 0) {
+        return bench_errors(iterations);
+    } else if (strcmp(which, "incremental") == 0) {
+        return bench_incremental(iterations / 100000);
+    } else if (strcmp(which, "serialize") == 0) {
+        return bench_serialize(iterations);
+    } else if (strcmp(which, "choices") == 0) {
+        return bench_choices(iterations);
+    } else if (strcmp(which, "repeat") == 0) {
+        return bench_repeat(iterations);
+    } else if (strcmp(which, "constraints") == 0) {
+        return bench_constraints(iterations);
+    } else if (strcmp(which, "lazy") == 0) {
+        return bench_lazy(iterations / 10000);
+    } else if (strcmp(which, "plugins") == 0) {
+        return bench_plugins(iterations / 1000);
+    } else if (strcmp(which, "fallback") == 0) {
+        return bench_fallback(iterations / 10);
+    } else if (strcmp(which, "multicall") == 0) {
+        return bench_multicall(iterations);
+    } else if (strcmp(which, "telemetry") == 0) {
+        return bench_telemetry(iterations);
+    } else if (strcmp(which, "rcu") == 0) {
+        return bench_rcu(iterations);
+    } else if (strcmp(which, "table") == 0) {
+        return bench_table(iterations / 10000);
+    } else if (strcmp(which, "aliases") == 0) {
+        return bench_aliases(iterations);
+    } else if (strcmp(which, "positional") == 0) {
+        return bench_positional(iterations);
+    } else if (strcmp(which, "passthrough") == 0) {
+        return bench_passthrough(iterations / 10000);
+    } else if (strcmp(which, "cache") == 0) {
+        return bench_cache(iterations);
+    } else if (strcmp(which, "getopt") == 0) {
+        return bench_getopt(iterations / 10);
+    }
+
+    fprintf(stderr, "Unknown benchmark: %s\n", which);
+    return 1;
+}
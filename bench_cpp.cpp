@@ -0,0 +1,193 @@
+/**
+ * @file bench_cpp.cpp
+ * @brief used to benchmark the c++ wrapper scap.hpp against the c api
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: bench_cpp [case] [iterations]
+ * the same command lines are parsed and dispatched through the c api and through the wrapper.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <scap.hpp>
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, long iterations, double seconds) {
+    printf("%-32s %10ld iters %10.1f ns/iter %12.0f iters/s\n",
+           name, iterations, seconds * 1e9 / (double) iterations, (double) iterations / seconds);
+}
+
+static char *argvLine[] = {
+    (char *) "bench", (char *) "build", (char *) "-v", (char *) "--jobs", (char *) "8",
+    (char *) "-o", (char *) "out.bin", (char *) "a.c", (char *) "b.c", nullptr
+};
+static const int argcLine = 9;
+static volatile long sink = 0;     /* keeps the reads of the values */
+
+/* ++++ the c api ++++ */
+
+static int c_build_exec(SAPCommand *caller) {
+    long jobs = strtol((const char *) get_flag(caller, "jobs")->value, nullptr, 10);
+    const char *output = (const char *) get_flag(caller, "output")->value;
+    char **inputs = (char **) caller->default_flag->value;
+    sink += jobs + (long) strlen(output) + (get_flag(caller, "verbose")->value != nullptr) + (inputs[1] != nullptr);
+    return 0;
+}
+
+static int bench_c_api(long iterations) {
+    static SAPCommand build;
+    static Flag verbose, jobs, output, inputs;
+    init_root_cmd("bench", "wrapper benchmark", nullptr, nullptr);
+    init_sap_command(&build, "build", "build the targets", nullptr, c_build_exec);
+    init_flag(&verbose, "verbose", 'v', "print more", nullptr);
+    set_flag_type(&verbose, no_arg);
+    init_flag(&jobs, "jobs", 'j', "the number of jobs", nullptr);
+    init_flag(&output, "output", 'o', "the output file", nullptr);
+    init_flag(&inputs, "inputs", 'i', "the input files", nullptr);
+    set_flag_type(&inputs, multi_arg);
+    add_flag(&build, &verbose);
+    add_flag(&build, &jobs);
+    add_flag(&build, &output);
+    add_default_flag(&build, &inputs);
+    add_subcmd(&rootCmd, &build);
+
+    double start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        SAPParseResult res;
+        if (sap_parse(argcLine, argvLine, &res) != 0) {
+            fprintf(stderr, "the parse failed\n");
+            return 1;
+        }
+        long n = strtol((const char *) sap_get_value(&res, "jobs"), nullptr, 10);
+        const char *out = (const char *) sap_get_value(&res, "output");
+        char **in = (char **) sap_get_value(&res, "inputs");
+        sink += n + (long) strlen(out) + (sap_get_value(&res, "verbose") != nullptr) + (in[1] != nullptr);
+        sap_free_result(&res);
+    }
+    report("wrapper/c-parse-get", iterations, now_sec() - start);
+
+    /* the positions of the flags are known to the caller, the values are read directly */
+    int pos_verbose = 0, pos_jobs = 0, pos_output = 0, pos_inputs = 0;
+    for (int i = 0; i < build.flag_cnt; i++) {
+        pos_verbose = (build.flags[i] == &verbose) ? i : pos_verbose;
+        pos_jobs = (build.flags[i] == &jobs) ? i : pos_jobs;
+        pos_output = (build.flags[i] == &output) ? i : pos_output;
+        pos_inputs = (build.flags[i] == &inputs) ? i : pos_inputs;
+    }
+    start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        SAPParseResult res;
+        if (sap_parse(argcLine, argvLine, &res) != 0) {
+            fprintf(stderr, "the parse failed\n");
+            return 1;
+        }
+        long n = strtol((const char *) res.values[pos_jobs], nullptr, 10);
+        const char *out = (const char *) res.values[pos_output];
+        char **in = (char **) res.values[pos_inputs];
+        sink += n + (long) strlen(out) + (res.values[pos_verbose] != nullptr) + (in[1] != nullptr);
+        sap_free_result(&res);
+    }
+    report("wrapper/c-parse-values", iterations, now_sec() - start);
+
+    /* the reads alone, from a single result */
+    SAPParseResult res;
+    sap_parse(argcLine, argvLine, &res);
+    start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        char **in = (char **) res.values[pos_inputs];
+        sink += (long) (intptr_t) res.values[pos_jobs] + (long) (intptr_t) res.values[pos_output]
+                + (res.values[pos_verbose] != nullptr) + (in[1] != nullptr);
+        __asm__ volatile("" : : "r"(&res) : "memory");  /* the values are read again every iteration */
+    }
+    report("wrapper/c-values-only", iterations, now_sec() - start);
+    sap_free_result(&res);
+
+    start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        if (do_parse_subcmd(argcLine, argvLine) != 0) {
+            fprintf(stderr, "the dispatch failed\n");
+            return 1;
+        }
+    }
+    report("wrapper/c-dispatch", iterations, now_sec() - start);
+
+    free_root_cmd();
+    return 0;
+}
+
+/* ---- the c api ---- */
+
+/* ++++ the wrapper ++++ */
+
+static int bench_wrapper(long iterations) {
+    scap::Root root("bench", "wrapper benchmark");
+    scap::Command build("build", "build the targets");
+    scap::Flag<bool> verbose("verbose", 'v', "print more");
+    scap::Flag<int> jobs("jobs", 'j', "the number of jobs", 1);
+    scap::Flag<std::string_view> output("output", 'o', "the output file", "a.out");
+    scap::Flag<scap::Args> inputs("inputs", 'i', "the input files");
+
+    build.add(verbose).add(jobs).add(output).add_default(inputs);
+    build.on([&] {
+        sink += jobs.value() + (long) output.value().size() + verbose.value() + (inputs.value().size() > 1);
+        return 0;
+    });
+    root.add(build);
+
+    double start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        scap::Result res = root.parse(argcLine, argvLine);
+        if (!res) {
+            fprintf(stderr, "the parse failed\n");
+            return 1;
+        }
+        sink += res[jobs] + (long) res[output].size() + res[verbose] + (res[inputs].size() > 1);
+    }
+    report("wrapper/cpp-parse-get", iterations, now_sec() - start);
+
+    /* the reads alone, the raw values as c-values-only reads them */
+    scap::Result once = root.parse(argcLine, argvLine);
+    start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        char **in = static_cast<char **>(once.raw_value(inputs));
+        sink += (long) (intptr_t) once.raw_value(jobs) + (long) (intptr_t) once.raw_value(output)
+                + (once.raw_value(verbose) != nullptr) + (in[1] != nullptr);
+        __asm__ volatile("" : : "r"(&once) : "memory");
+    }
+    report("wrapper/cpp-values-only", iterations, now_sec() - start);
+
+    start = now_sec();
+    for (long it = 0; it < iterations; it++) {
+        if (root.run(argcLine, argvLine) != 0) {
+            fprintf(stderr, "the dispatch failed\n");
+            return 1;
+        }
+    }
+    report("wrapper/cpp-dispatch", iterations, now_sec() - start);
+    return 0;
+}
+
+/* ---- the wrapper ---- */
+
+int main(int argc, char *argv[]) {
+    const char *which = (argc > 1) ? argv[1] : "wrapper";
+    long iterations = (argc > 2) ? atol(argv[2]) : 1000000;
+
+    if (strcmp(which, "wrapper") == 0) {
+        return bench_c_api(iterations) || bench_wrapper(iterations);
+    }
+
+    fprintf(stderr, "Unknown benchmark: %s\n", which);
+    return 1;
+}
@@ -15,12 +15,49 @@
 #define SCAP_ARG_PARSER_H
 
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* ++++ configs ++++ */
 
+/* the configs can also be overridden when compiling, e.g. -DMAX_CMD_COUNT=20000 */
+#ifndef MAX_SUBCMD_COUNT
 #define MAX_SUBCMD_COUNT 5  /* the max number of a command's subcommands */
+#endif
+#ifndef MAX_CMD_DEPTH
 #define MAX_CMD_DEPTH 5     /* the max depth of command tree */
+#endif
+#ifndef MAX_CMD_COUNT
 #define MAX_CMD_COUNT 15    /* the max number of commands */
+#endif
+#ifndef MAX_OPT_COUNT
 #define MAX_OPT_COUNT 10    /* the max number of options in a single command or subcommand */
+#endif
+#ifndef MAX_ALIAS_COUNT
+#define MAX_ALIAS_COUNT 4   /* the max number of the aliases of a command or a flag */
+#endif
+#ifndef MAX_POS_COUNT
+#define MAX_POS_COUNT 8     /* the max number of the positional slots of a command */
+#endif
+
+#ifndef SAP_OUTPUT_BUF_SIZE
+#define SAP_OUTPUT_BUF_SIZE 4096    /* the initial size of the batch buffer of an output */
+#endif
+#ifndef SAP_ARENA_CHUNK_SIZE
+#define SAP_ARENA_CHUNK_SIZE 1024   /* the size of the first chunk of the arena of a parse result */
+#endif
+#ifndef SAP_TELEMETRY_SLOTS
+#define SAP_TELEMETRY_SLOTS 4096    /* the number of the counters of a telemetry file, a power of 2 */
+#endif
+
+#define SAP_NIL UINT32_MAX  /* the null value of the 32-bit indices */
+#define SAP_MASK_WORDS ((MAX_OPT_COUNT + 63) / 64)  /* the number of the words of a bitmask over the flags of a command */
 
 /* ---- configs ---- */
 
@@ -43,6 +80,68 @@ typedef enum {
     no_arg = 2          /* the flag(option) doesn't receive any argument */
 } FlagType;
 
+typedef enum {
+    pos_string = 0,     /* any argument */
+    pos_int = 1,        /* a decimal integer in the range of long */
+    pos_float = 2       /* a floating-point number, as accepted by strtod */
+} PositionalType;
+
+typedef enum {
+    repeat_last = 0,    /* a repeated flag keeps the last value (default) */
+    repeat_count = 1,   /* a no_arg flag counts its occurrences, the value points to the count (an int) */
+    repeat_append = 2   /* the values of a repeated single_arg or multi_arg flag are appended to a single list */
+} FlagRepeat;
+
+typedef enum {
+    constraint_required = 0,    /* all the flags must be given */
+    constraint_exclusive = 1,   /* at most one of the flags can be given */
+    constraint_one_of = 2,      /* at least one of the flags must be given */
+    constraint_requires = 3     /* if the first flag is given, all the others must be given */
+} FlagConstraint;
+
+typedef enum {
+    source_default = 0,     /* the default value, the flag isn't given */
+    source_config = 1,      /* the value of the config key of the flag in the loaded config file */
+    source_env = 2,         /* the value of the environment variable of the flag */
+    source_argv = 3         /* the command line */
+} SAPValueSource;
+
+typedef enum {
+    parse_ok = 0,           /* the parse succeeds */
+    unknown_arg = 1,        /* an unknown option, or an option with bad syntax */
+    too_many_args = 2,      /* an argument that no flag receives */
+    too_few_args = 3,       /* a flag misses its argument(s) */
+    illegal_equal = 4,      /* "--flag=value" for a no_arg or multi_arg flag */
+    ambiguous_arg = 5,      /* a prefix of several long options */
+    unknown_cmd = 6,        /* an unknown command */
+    invalid_choice = 7,     /* a value not in the choices of a choice flag */
+    violated_constraint = 8,/* the given flags violate a constraint of the command */
+    invalid_type = 9        /* a positional argument not of the type of its slot */
+} ParseErr;
+
+typedef enum {
+    expect_nothing = 0,     /* no more argument is expected */
+    expect_flag = 1,        /* a known option is expected */
+    expect_arg = 2,         /* the argument of a single_arg flag is expected */
+    expect_args = 3,        /* at least one argument of a multi_arg flag is expected */
+    expect_no_value = 4,    /* the flag doesn't receive a value after '=' */
+    expect_cmd = 5,         /* a known command is expected */
+    expect_choice = 6,      /* one of the choices of the flag is expected */
+    expect_positional = 7,  /* the argument(s) of a required positional slot are expected */
+    expect_typed = 8        /* an argument of the type of the positional slot is expected */
+} ExpectedKind;
+
+typedef enum {
+    sap_no_argument = 0,        /* same as no_argument of <getopt.h> */
+    sap_required_argument = 1,  /* same as required_argument of <getopt.h> */
+    sap_optional_argument = 2   /* same as optional_argument of <getopt.h> */
+} SAPOptionArg;
+
+typedef enum {
+    sap_out_channel = 0,    /* help and messages, stdout by default */
+    sap_err_channel = 1     /* errors and warnings, stderr by default */
+} SAPChannel;
+
 /* ---- enum definition ---- */
 
 
@@ -51,38 +150,250 @@ typedef enum {
 
 typedef struct {
     const char *flag_name;  /* both the flag name and the long option */
-    char shorthand;         /* the short option */
     const char *usage;      /* the usage description of the flag */
     void *value;            /* the default value and parsed value of this flag (detailed introduction is in interfaces.md) */
+    void *dft_value;        /* the default value of this flag, kept unchanged by the parses */
     FlagType type;          /* the flag type in (single_arg, multi_arg, no_arg) */
+    struct SAPChoiceTable_ *choices;    /* the compiled choices of a choice flag, NULL if any value is accepted */
+    struct SAPAliases_ *aliases;        /* the extra long names and shorthands, NULL if none */
+    const char *env_name;   /* the environment variable supplying the value if not given, NULL if none */
+    const char *config_key; /* the key of the config file supplying the value if not given, NULL if none */
+    uint32_t name_id;       /* the interned id of flag_name, see sap_name_id */
+    char shorthand;         /* the short option (placed last to fill the padding) */
+    unsigned char repeat;   /* the FlagRepeat of the flag, see set_flag_repeat */
 } Flag;
 
+typedef struct {
+    uint64_t bits[SAP_MASK_WORDS];  /* bit i is cmd->flags[i] */
+} SAPFlagMask;
+
 typedef struct TreeNode_ {
     int child_cnt;
     int depth;
     struct TreeNode_ *parent;
-    struct TreeNode_ **children;
+    struct TreeNode_ **children;    /* allocated on the first appended child, NULL for leaf commands */
+    int in_block;                   /* whether children is a part of a shared block (add_subcmd_table, a tree version), not freed by itself */
 } TreeNode;
 
+struct SAPParseResult_;
+struct SAPCompletion_;
+
 typedef struct SAPCommand_ {
     const char *name;           /* the name of the command */
+    uint32_t name_id;           /* the interned id of the name, see sap_name_id */
     const char *short_desc;     /* the short description of the command */
     const char *long_desc;      /* the long description of the command */
     int flag_cnt;               /* the number of flags(options) in the command */
     int parse_by_self;          /* whether the cmd_exec parses argc&argv itself (default 0) */
     int (*exec_self_parse)(struct SAPCommand_ *caller, int argc, char *argv[]); /* be called when parse_by_self is to set 1 */
     int (*exec)(struct SAPCommand_ *caller);    /* be called when parse_by_self is to set 0 */
+    void (*exec_async)(struct SAPParseResult_ *res, struct SAPCompletion_ *done);  /* be called by sap_exec_async if set */
     Flag *default_flag;         /* the default flag, unassigned arguments will be assigned default_flag's argument */
     Flag *flags[MAX_OPT_COUNT]; /* the flags of this SAPCommand */
     TreeNode tree_node;         /* the tree node of this command, used to manage the command tree */
+    struct SAPFlagIndex_ *flag_index;   /* the lookup index of the flags, built lazily by the parser */
+    struct SAPChildIndex_ *child_index; /* the lookup index of the subcommands by name id, built lazily by the parser */
+    int prefix_match;           /* whether unambiguous prefixes of long options are accepted (read from the root of the tree) */
+    int multi_call;             /* whether the basename of argv[0] selects a subcommand (read from the root command) */
+    int passthrough;            /* whether the arguments after "--" are the tail instead of operands (default 0) */
+    struct SAPConstraintSet_ *constraints;  /* the constraints of the flags, compiled into bitmasks when sealed */
+    void (*builder)(struct SAPCommand_ *cmd);   /* adds the flags and subcommands on the first descent, NULL once built */
+    void *ctx;                  /* the context of the handler, unused by the library (e.g. the object of a binding) */
+    const struct SAPCommand_ *origin;   /* the command itself, or the command a tree version copied it from */
+    struct SAPAliases_ *aliases;        /* the extra names of the command, NULL if none */
+    struct SAPPositionals_ *positionals;    /* the positional slots, NULL if the arguments go to the default flag */
 } SAPCommand;
 
+typedef struct {
+    ParseErr code;          /* parse_ok if the parse succeeds */
+    ExpectedKind expected;  /* what was expected at the error */
+    int argv_idx;           /* the index of the erroneous argument in the whole argv */
+    int byte_offset;        /* the offset of the erroneous byte in the argument (e.g. 'x' of "-vxf" is 2) */
+    uint32_t flag_id;       /* the name id of the flag (or the positional slot) involved, SAP_NIL if none */
+} SAPParseError;
+
+typedef struct {
+    struct SAPArenaChunk_ *chunks;  /* the allocated chunks, the newest first */
+    char *cur;                  /* the free space of the newest chunk */
+    char *end;                  /* the end of the newest chunk */
+} SAPArena;
+
+typedef struct SAPParseResult_ {
+    SAPCommand *cmd;            /* the resolved command, NULL if the command is unknown */
+    int argc;                   /* the number of the arguments of the command (argv[0] is the command name) */
+    char **argv;                /* the arguments of the command, pointing into the parsed argv */
+    int argv_offset;            /* the index of argv[0] in the whole argv */
+    SAPParseError err;          /* the error of the parse, err.code is parse_ok if it succeeds */
+    SAPArena arena;             /* the memory of the result (argument lists, counts), freed by sap_free_result */
+    SAPFlagMask given;          /* the flags given on the command line, by the environment or the config (not restored by sap_read_record) */
+    SAPFlagMask from_env;       /* the given flags whose values come from the environment */
+    SAPFlagMask from_config;    /* the given flags whose values come from the config file */
+    void *values[MAX_OPT_COUNT];    /* values[i] is the value of cmd->flags[i], same meaning as Flag.value */
+    int pos_cnt;                /* the number of the positional arguments */
+    void *positionals[MAX_POS_COUNT];   /* positionals[i] is the value of the slot i, see sap_get_positional */
+    int tail_argc;              /* the number of the arguments after "--", 0 if none */
+    char **tail_argv;           /* the arguments after "--" of a passthrough command, a slice of the parsed argv (no copy), NULL if none */
+} SAPParseResult;
+
+typedef struct {
+    int slot;                   /* the slot receiving the next positional argument */
+    int fill;                   /* the number of the arguments the slot has received */
+    int extra_idx;              /* the argv index of the first argument beyond the slots, 0 if none */
+    int bad_idx;                /* the argv index of the first argument not of the type of its slot, 0 if none */
+    int bad_slot;               /* the slot of that argument */
+} SAPPosCursor;
+
+typedef struct {
+    SAPParseResult res;         /* the result of the tokens consumed so far */
+    int pos;                    /* the number of the consumed tokens of argv */
+    int resolving;              /* whether the command path is still being resolved */
+    int pending;                /* the index (in res.cmd->flags) of the flag expecting value(s), -1 if none */
+    int pending_idx;            /* the argv index of the option of the pending flag */
+    int pending_off;            /* the byte offset of the pending flag in its option */
+    int pending_cnt;            /* the number of the values the pending flag has received */
+    int pending_discard;        /* whether the values of the pending flag are overridden by the default flag ones */
+    int dft_pos;                /* the index of the default flag in res.cmd->flags, -1 if none */
+    int positional_cnt;         /* the number of the arguments given to the default flag */
+    int extra_idx;              /* the argv index of the first argument no flag receives, 0 if none */
+    int bad_choice_idx;         /* the argv index of the first argument of the default flag out of its choices, 0 if none */
+    int list_len[MAX_OPT_COUNT];    /* the lengths of the argument lists, or the counts of the repeat_count flags */
+    int list_cap[MAX_OPT_COUNT];    /* the capacities of the lists, 0 if the list isn't allocated */
+    SAPPosCursor pos_cursor;    /* the assignment of the positional arguments to the slots */
+    int pos_cap;                /* the capacity of the list of the variadic slot, 0 if it isn't allocated */
+    int tail_idx;               /* the argv index of the first argument after "--" of a passthrough command, 0 if none */
+    int operands_only;          /* whether "--" was given to a command without passthrough, the rest are operands */
+} SAPParseState;
+
+typedef struct SAPCompletion_ SAPCompletion;    /* the completion token of an asynchronous execution */
+
+typedef struct SAPExecutor_ {
+    /* run task(arg) sometime, on any thread */
+    void (*submit)(struct SAPExecutor_ *executor, void (*task)(void *arg), void *arg);
+} SAPExecutor;
+
+typedef struct {
+    uint32_t offset;        /* the offset of the string in the buffer of the pool */
+    uint32_t len;           /* the length of the string */
+    uint64_t hash;          /* the 64-bit hash of the string */
+} SAPStrEntry;
+
+typedef struct {
+    char *buf;              /* all the strings, each one is null-terminated */
+    size_t buf_len;
+    size_t buf_cap;
+    SAPStrEntry *entries;   /* entries[id] describes the string with the id */
+    uint32_t cnt;           /* the number of strings */
+    uint32_t entry_cap;
+    uint32_t *slots;        /* the open addressing hash table, id + 1 of each string, 0 means empty */
+    uint32_t slot_cap;      /* the number of slots, a power of 2 */
+} SAPStrPool;
+
+typedef struct {
+    uint32_t name;          /* the string id of the name */
+    uint32_t parent;        /* the index of the parent command, SAP_NIL for the root */
+    uint32_t first_child;   /* the children are cmds[first_child, first_child + child_cnt) */
+    uint32_t first_flag;    /* the flags are flag_refs[first_flag, first_flag + flag_cnt) */
+    uint16_t child_cnt;
+    uint16_t flag_cnt;
+} SAPCompactCmd;
+
+typedef struct {
+    uint32_t short_desc;    /* the string id of the short description */
+    uint32_t long_desc;     /* the string id of the long description, SAP_NIL if none */
+} SAPCompactDesc;
+
+typedef struct {
+    uint32_t name;          /* the string id of the flag name */
+    uint32_t usage;         /* the string id of the usage */
+    uint8_t shorthand;      /* the short option, 0 if none */
+    uint8_t type;           /* the FlagType */
+} SAPCompactFlag;
+
+typedef struct {
+    uint32_t cmd_cnt;
+    uint32_t flag_cnt;          /* the number of unique flags (a persist flag is stored once) */
+    uint32_t flag_ref_cnt;
+    SAPCompactCmd *cmds;        /* in breadth-first order, cmds[0] is the root */
+    SAPCompactDesc *descs;      /* descs[i] belongs to cmds[i], kept out of the array walked by the lookups */
+    SAPCompactFlag *flags;
+    uint32_t *flag_refs;        /* the indices in $flags */
+    SAPStrPool strs;            /* the interned names and descriptions */
+} SAPCompactTree;
+
+typedef size_t (*SAPWriteFn)(void *ctx, const char *data, size_t len);
+
+typedef struct SAPOutput_ {
+    SAPWriteFn write;   /* writes the batched data out, returns the number of bytes written */
+    void *ctx;          /* the context of write */
+    char *buf;          /* the batch buffer, allocated on the first output and reused */
+    size_t len;         /* the length of the batched data */
+    size_t cap;         /* the capacity of buf */
+    size_t total;       /* the number of the bytes written to the output so far */
+} SAPOutput;
+
+typedef struct {
+    char *data;         /* the captured output, null-terminated */
+    size_t len;
+    size_t cap;
+} SAPMemBuf;
+
+typedef struct {
+    const char *name;   /* the long option name */
+    int has_arg;        /* SAPOptionArg */
+    int *flag;          /* if not NULL, *flag is set to val and 0 is returned */
+    int val;            /* the value returned (or stored to *flag) */
+} SAPOption;            /* the same layout as struct option of <getopt.h> */
+
+typedef struct {
+    /* the same meaning as the globals of <getopt.h>, but per parser */
+    int optind;         /* the index of the next element of argv, 0 reinitializes the parser */
+    int opterr;         /* whether the errors are reported to sap_err_channel */
+    int optopt;         /* the option character (or val) of the erroneous option */
+    char *optarg;       /* the argument of the option */
+
+    /* the private state */
+    char *nextchar;             /* the rest of the current short option cluster */
+    int first_nonopt;           /* the non-options skipped over are argv[first_nonopt, last_nonopt) */
+    int last_nonopt;
+    int ordering;               /* permute, require order ('+') or return in order ('-') */
+    const char *optstring;      /* the option strings the table is built from */
+    const SAPOption *longopts;
+    SAPCommand table;           /* the flag table of the options, looked up by scap's flag index */
+    Flag flags[MAX_OPT_COUNT];
+    unsigned char has_arg[MAX_OPT_COUNT];   /* SAPOptionArg of flags[i] */
+    int long_idx[MAX_OPT_COUNT];            /* the index of flags[i] in longopts, -1 for a short option */
+} SAPGetopt;
+
+typedef struct SAPPluginSet_ SAPPluginSet;   /* the plugins loaded from a manifest */
+
+typedef struct SAPRcuReader_ {
+    uint64_t epoch;                 /* the epoch the reader entered at, 0 while it's quiescent */
+    struct SAPRcuReader_ *next;     /* the next registered reader */
+} SAPRcuReader;
+
+typedef struct SAPTreeVersion_ SAPTreeVersion;  /* an immutable version of the command tree */
+
+typedef struct SAPParseCache_ SAPParseCache;    /* the cached parse results of the repeated command lines */
+
+typedef struct {
+    uint64_t lookups;           /* the parses through sap_cache_parse, the bypassed ones included */
+    uint64_t hits;              /* the parses answered by a cached result, the hit rate is hits / lookups */
+    uint64_t bypassed;          /* the parses not looked up, while the hit rate was too low for the cache to pay */
+    uint64_t evictions;         /* the least recently used results dropped for the new ones */
+    int entries;                /* the number of the cached results */
+    int capacity;               /* the max number of the cached results */
+} SAPCacheStats;
+
 /* ---- structs definition ---- */
 
 
 
 typedef int (*CmdExec)(SAPCommand *caller);
 typedef int (*CmdExecWithArg)(SAPCommand *caller, int argc, char *argv[]);
+typedef void (*CmdExecAsync)(SAPParseResult *res, SAPCompletion *done);
+typedef void (*CmdBuilder)(SAPCommand *cmd);
+typedef void (*SAPDoneCallback)(SAPParseResult *res, int ret, void *ctx);
+typedef void (*SAPErrorSink)(const SAPParseResult *res, void *ctx);
 
 extern SAPCommand rootCmd;
 // extern int g_cmd_cnt;
@@ -122,14 +433,33 @@ SAPCommand *add_flag(SAPCommand *cmd, Flag *flag);
  * this function is used to add a default flag to the specified SAPCommand structure.
  * if the command already contains the maximum number of flags, the function returns NULL.
  * otherwise, it adds the flag to the command's flag list and set the field $default_flag, then a pointer to the command.
+ * a command with positional slots (see add_positional) has no default flag, the function returns NULL.
  *
  * @param cmd           - a pointer to the SAPCommand structure to which the flag will be added.
  * @param flag          - a pointer to the flag to be added.
  * @return SAPCommand*  - if the addition is successful, returns a pointer to the SAPCommand structure;
- *                        if the command already contains the maximum number of flags, returns NULL.
+ *                        if the command already contains the maximum number of flags or positional slots, returns NULL.
  */
 SAPCommand *add_default_flag(SAPCommand *cmd, Flag *flag);
 
+/**
+ * @brief append a positional slot to a command, the arguments which aren't options fill the slots in order.
+ *
+ * a slot receives from $min_cnt to $max_cnt arguments: (1, 1) is a required argument, (0, 1) an optional one,
+ * and a slot with $max_cnt other than 1 is a variadic tail, -1 for unbounded. the optional slots follow the required
+ * ones, and only the last slot may be variadic. the slots replace the default flag of the command.
+ *
+ * @param[in] cmd       - the command.
+ * @param[in] name      - the name of the slot, shown by the help and the errors.
+ * @param[in] usage     - the usage description of the slot.
+ * @param[in] type      - the type the arguments are checked against, they're kept as strings.
+ * @param[in] min_cnt   - the min number of the arguments of the slot.
+ * @param[in] max_cnt   - the max number of the arguments of the slot, -1 for unbounded.
+ * @return int          - the index of the slot, -1 if it breaks the rules above, the command has a default flag,
+ *                        or it has MAX_POS_COUNT slots already.
+ */
+int add_positional(SAPCommand *cmd, const char *name, const char *usage, PositionalType type, int min_cnt, int max_cnt);
+
 /**
  * @brief add a persist flag to the specified command and its all progeny
  *
@@ -155,6 +485,122 @@ int add_persist_flag(SAPCommand *cmd, Flag *flag);
  */
 void set_flag_type(Flag *flag, FlagType type);
 
+/**
+ * @brief make a single_arg or multi_arg flag a choice flag, which only accepts the given values.
+ *
+ * the choices are compiled into a perfect hash, so a value is checked with one hash and one comparison.
+ * a value out of the choices is rejected by the parse with invalid_choice, and the message lists the choices.
+ * the parsed values are replaced by the canonical strings of the choices, whose ids are got in O(1) by sap_choice_id.
+ * the default value of a single_arg flag, if any, must be one of the choices.
+ *
+ * @param[in] flag      - the flag, its type should be set before.
+ * @param[in] choices   - the NULL-terminated array of the choices (at most 255, no duplicates), copied by the call.
+ *                        NULL to accept any value again.
+ * @note the compiled choices are freed by free_root_cmd.
+ */
+void set_flag_choices(Flag *flag, const char *choices[]);
+
+/**
+ * @brief get the id (the index in the array given to set_flag_choices) of a value of a choice flag.
+ *
+ * @param[in] flag      - the choice flag.
+ * @param[in] value     - a value of the flag, e.g. the value of a single_arg flag or an element of the list of a multi_arg flag.
+ * @return int          - the id, O(1) for the values given by the parse, or -1 if the value isn't a choice of the flag.
+ */
+int sap_choice_id(const Flag *flag, const char *value);
+
+/**
+ * @brief set how a flag given several times is parsed.
+ *
+ * repeat_last (default): the last occurrence wins.
+ * repeat_count: a no_arg flag counts its occurrences ("-vvv" or "-v -v -v"), the value points to the count (an int),
+ * which is 1 for a single occurrence, so *(int *) value is valid in both cases.
+ * repeat_append: the values of all the occurrences of a single_arg or multi_arg flag are appended in order to a single
+ * NULL-terminated list ("-I a -I b", "--include a b --include c"), so the value of a single_arg flag is a list as well.
+ * the arguments given to a default flag in this mode are appended too, a single_arg one accepts any number of them.
+ *
+ * the occurrences are accumulated in chunks from the arena of the parse result, without reallocation,
+ * so every occurrence costs amortised O(1).
+ *
+ * @param[in] flag      - the flag, its type should be set before.
+ * @param[in] repeat    - the mode, repeat_count for no_arg flags only, repeat_append for the others only.
+ */
+void set_flag_repeat(Flag *flag, FlagRepeat repeat);
+
+/**
+ * @brief let an environment variable supply the value of a flag that isn't given on the command line.
+ *
+ * the precedence is: default < config file < environment < command line, resolved once after the flags are parsed.
+ * environ is scanned once per parse, each variable is looked up in a hashed index of the names declared by the command.
+ * a single_arg value is the text of the variable, a multi_arg value is the text split by whitespace,
+ * a no_arg flag is given unless the text is empty, "0", "false", "no" or "off" (a repeat_count one takes a number).
+ * the value of a choice flag must be one of the choices.
+ *
+ * @param[in] flag      - the flag, set it before the first parse.
+ * @param[in] env_name  - the name of the variable, it must outlive the flag, NULL to unset.
+ */
+void set_flag_env(Flag *flag, const char *env_name);
+
+/**
+ * @brief let a key of the config file (sap_load_config) supply the value of a flag, see set_flag_env.
+ *
+ * @param[in] flag      - the flag, set it before the first parse.
+ * @param[in] key       - the key, it must outlive the flag, NULL to unset.
+ */
+void set_flag_config_key(Flag *flag, const char *key);
+
+/**
+ * @brief add an extra long name and/or shorthand to a flag, e.g. the old name of a renamed flag.
+ *
+ * the aliases are extra entries of the flag index of a command, resolved by the same lookups as the name and the
+ * shorthand (prefix matching abbreviates the extra names too). the help lists them beside the name, and the shorthand
+ * check warns about their collisions as well. the flag indices of the commands holding the flag are rebuilt.
+ *
+ * @param[in] flag      - the flag.
+ * @param[in] name      - the extra long name, it must outlive the flag, NULL if none.
+ * @param[in] shorthand - the extra shorthand, '\0' if none.
+ * @return int          - 0 if succeed, -1 if the flag has MAX_ALIAS_COUNT aliases already.
+ */
+int add_flag_alias(Flag *flag, const char *name, char shorthand);
+
+/**
+ * @brief map a config file, the values of its keys are the fallbacks of the flags with config keys.
+ *
+ * the file is made of "key = value" lines, '#' and ';' start comment lines, a value can be quoted with "".
+ * the file is memory-mapped privately and parsed in place, the values point into the mapping,
+ * so free the results before the config is replaced or freed. the last value of a repeated key wins.
+ *
+ * @param[in] path  - the path of the config file, it replaces the loaded one.
+ * @return int      - 0 if succeed, -1 if the file can't be mapped (the loaded config is kept).
+ */
+int sap_load_config(const char *path);
+
+/**
+ * @brief unmap the loaded config file, free_root_cmd does it as well.
+ */
+void sap_free_config(void);
+
+/**
+ * @brief add a constraint on the flags of a command, checked after the flags are parsed.
+ *
+ * constraint_required: all the flags must be given.
+ * constraint_exclusive: at most one of the flags can be given.
+ * constraint_one_of: at least one of the flags must be given.
+ * constraint_requires: if flags[0] is given, all the other flags must be given.
+ *
+ * the constraints are compiled into bitmasks over the flag indices when the tree is sealed (the first parse),
+ * so a parse is checked by a few word-wide operations. a violated constraint fails the parse with
+ * violated_constraint, the message names the constraint and its flags.
+ * a flag counts as given if it appears on the command line (or receives the arguments of a default flag).
+ *
+ * @param[in] cmd       - the command, the flags must be added to it before the first parse.
+ * @param[in] kind      - the kind of the constraint.
+ * @param[in] flags     - the NULL-terminated array of the flags (copied by the call), at least two for constraint_requires.
+ * @return int          - the index of the constraint in the command.
+ * @note the constraints are freed by free_root_cmd.
+ */
+int add_flag_constraint(SAPCommand *cmd, FlagConstraint kind, Flag *flags[]);
+
 /**
  * @brief retrieve a flag by its name from a given command.
  *
@@ -164,6 +610,26 @@ void set_flag_type(Flag *flag, FlagType type);
  */
 Flag *get_flag(SAPCommand *cmd, const char *flag_name);
 
+/**
+ * @brief retrieve a flag by the interned id of its name from a given command.
+ *
+ * @param[in] cmd       - pointer to the SAPCommand structure.
+ * @param[in] name_id   - the interned id of the flag name, see sap_name_id.
+ * @return Flag*        - pointer to the matching flag, or NULL if not found.
+ */
+Flag *get_flag_by_id(SAPCommand *cmd, uint32_t name_id);
+
+/**
+ * @brief get the interned id of a command name or a flag name.
+ *
+ * all the names are interned by init_flag and init_sap_command, the same name always has the same id,
+ * so the handlers can compare the ids (e.g. flag->name_id == sap_name_id("verbose"), computed once) instead of the names.
+ *
+ * @param[in] name  - the name.
+ * @return uint32_t - the id, or SAP_NIL if no command or flag has the name.
+ */
+uint32_t sap_name_id(const char *name);
+
 /**
  * @brief retrieve a flag by its shorthand character from a given command.
  *
@@ -173,6 +639,55 @@ Flag *get_flag(SAPCommand *cmd, const char *flag_name);
  */
 Flag *get_flag_by_shorthand(SAPCommand *cmd, char shorthand);
 
+/**
+ * @brief enable or disable the prefix matching of long options in a command tree.
+ *
+ * when enabled, an unambiguous prefix of a long option is accepted as the option (e.g. "--verb" for "--verbose"),
+ * just as GNU getopt_long does. an exact name always wins, and an ambiguous prefix is reported with all its candidates.
+ * the lookup is a binary search over the sorted flag names of the command.
+ *
+ * @param[in] root      - the root command of the tree, the setting applies to all the commands in the tree.
+ * @param[in] enable    - nonzero to enable, 0 to disable (default).
+ */
+void set_prefix_match(SAPCommand *root, int enable);
+
+/**
+ * @brief enable or disable the multi-call dispatch of the root command, busybox style.
+ *
+ * when enabled, a binary invoked by the name of a subcommand of the root (e.g. through a symlink "ls" -> "box")
+ * runs the subcommand as if it were given as argv[1]: "ls -l /tmp" is parsed as "box ls -l /tmp".
+ * the basename of argv[0] is hashed once and looked up in the dispatch index of the root, no name is compared.
+ * an argv[0] naming no subcommand (e.g. "box" itself) is parsed as usual. the help command is never an entry point.
+ * sap_parse, do_parse_subcmd and the incremental parse all honor it, argv[0] is the name of the selected command.
+ *
+ * @param[in] root      - the root command, multi-call only applies to the root.
+ * @param[in] enable    - nonzero to enable, 0 to disable (default).
+ */
+void set_multi_call(SAPCommand *root, int enable);
+
+/**
+ * @brief let the arguments after "--" of a command be the tail of the result instead of its operands.
+ *
+ * by default "--" ends the options as POSIX says: the arguments after it are operands, given to the positional slots
+ * or the default flag even if they start with '-'. a wrapper command (e.g. "wrap run -v -- make -j8") enables
+ * the passthrough, then the arguments after "--" are left as they are in res.tail_argc/tail_argv for sap_spawn_tail.
+ *
+ * @param[in] cmd       - the command, the setting isn't inherited by its subcommands.
+ * @param[in] enable    - nonzero to enable, 0 to disable (default).
+ */
+void set_cmd_passthrough(SAPCommand *cmd, int enable);
+
+/**
+ * @brief create a symlink to the binary for each entry point of a multi-call binary (the subcommands of the root).
+ *
+ * an existing symlink with the same name is replaced, any other existing file fails the call.
+ *
+ * @param[in] dir       - the directory of the links, created if it doesn't exist.
+ * @param[in] target    - the path of the binary that the links point to, better absolute.
+ * @return int          - the number of links created, -1 if failed (errno is set).
+ */
+int sap_make_links(const char *dir, const char *target);
+
 /* ++++ functions of Flags ---- */
 
 
@@ -182,11 +697,140 @@ Flag *get_flag_by_shorthand(SAPCommand *cmd, char shorthand);
 
 
 
+/* ++++ functions of SAPStrPool ++++ */
+
+/**
+ * @brief intern a string, a string is stored only once in a pool.
+ *
+ * @param[in] pool  - the string pool, zero-initialized before the first use.
+ * @param[in] str   - the string, not necessarily null-terminated.
+ * @param[in] len   - the length of the string.
+ * @return uint32_t - the id of the string, the same string always has the same id in a pool.
+ */
+uint32_t sap_str_intern(SAPStrPool *pool, const char *str, size_t len);
+
+/**
+ * @brief find the id of a string in a pool.
+ *
+ * @return uint32_t - the id of the string, or SAP_NIL if it's not interned.
+ */
+uint32_t sap_str_find(const SAPStrPool *pool, const char *str, size_t len);
+
+/**
+ * @brief get the interned string with the id, NULL if the id is SAP_NIL.
+ */
+const char *sap_str_get(const SAPStrPool *pool, uint32_t id);
+
+/**
+ * @brief free the memory of a string pool.
+ */
+void sap_str_pool_free(SAPStrPool *pool);
+
+/* ---- functions of SAPStrPool ---- */
+
+
+
+/* ++++ functions of SAPCompactTree ++++ */
+
+/**
+ * @brief build the compact representation of a command tree.
+ *
+ * the compact tree stores 32-bit indices instead of pointers, the names and descriptions are interned,
+ * the descriptions are stored out-of-line, the children and the flags of a command are ranges of shared arrays.
+ * the compact tree is only a read-only lookup snapshot (e.g. for the completions or the tools walking a large tree),
+ * the parser never uses it and it doesn't change with the pointer tree, take a new snapshot after a change.
+ *
+ * @param[in] root          - the root command of the tree.
+ * @return SAPCompactTree*  - the compact tree, free it with sap_compact_free.
+ */
+SAPCompactTree *sap_compact_build(SAPCommand *root);
+
+/**
+ * @brief find a command by the names of the path (without the root name).
+ *
+ * @param[in] tree      - the compact tree.
+ * @param[in] cmd_names - the names, ends with NULL or an option.
+ * @param[out] out_idx  - the number of names consumed (can be NULL).
+ * @return uint32_t     - the index of the deepest matching command in tree->cmds.
+ */
+uint32_t sap_compact_find(const SAPCompactTree *tree, char *cmd_names[], int *out_idx);
+
+/**
+ * @brief find a flag of a command by its name.
+ *
+ * @return uint32_t - the index of the flag in tree->flags, or SAP_NIL if not found.
+ */
+uint32_t sap_compact_find_flag(const SAPCompactTree *tree, uint32_t cmd, const char *flag_name);
+
+/**
+ * @brief the number of bytes used by a compact tree.
+ */
+size_t sap_compact_bytes(const SAPCompactTree *tree);
+
+/**
+ * @brief the number of bytes used by a pointer tree: commands, children arrays, flag indices and unique flags.
+ */
+size_t sap_tree_bytes(SAPCommand *root);
+
+/**
+ * @brief free a compact tree.
+ */
+void sap_compact_free(SAPCompactTree *tree);
+
+/* ---- functions of SAPCompactTree ---- */
+
+
+
 /* ++++ functions of cmd_exec ++++ */
 
 int void_exec(SAPCommand *caller);
 int void_self_parse_exec(SAPCommand *caller, int argc, char *argv[]);
 
+/**
+ * @brief execute a parsed command asynchronously.
+ *
+ * if the command has an asynchronous handler (set_cmd_async_exec), the handler is scheduled on $executor
+ * and receives the parse result and a completion token, it calls sap_complete(done, ret) when it finishes,
+ * maybe from another thread. otherwise (no asynchronous handler, self-parse command, parse error or help flag)
+ * the command is executed synchronously on the calling thread, just like do_parse_subcmd.
+ * an unknown command is reported through the error sink and completes with -1.
+ * $on_done is called exactly once in all cases.
+ *
+ * @param[in] executor  - the executor to run the handler on, e.g. sap_inline_executor() or a thread pool.
+ * @param[in] res       - the result of sap_parse, it must stay alive until $on_done is called.
+ * @param[in] on_done   - called with the return value of the handler, can be NULL.
+ * @param[in] ctx       - the context passed to $on_done.
+ */
+void sap_exec_async(SAPExecutor *executor, SAPParseResult *res, SAPDoneCallback on_done, void *ctx);
+
+/**
+ * @brief complete an asynchronous execution, the token is freed after the callback returns.
+ *
+ * @param[in] done  - the completion token received by the asynchronous handler.
+ * @param[in] ret   - the return value of the handler.
+ */
+void sap_complete(SAPCompletion *done, int ret);
+
+/**
+ * @brief get the executor that runs the tasks immediately on the submitting thread.
+ */
+SAPExecutor *sap_inline_executor(void);
+
+/**
+ * @brief create a thread pool executor.
+ *
+ * @param[in] thread_cnt    - the number of the worker threads.
+ * @return SAPExecutor*     - the thread pool, or NULL if no thread can be created.
+ */
+SAPExecutor *sap_thread_pool_create(int thread_cnt);
+
+/**
+ * @brief run all the queued tasks, then stop the workers and free the thread pool.
+ *
+ * @param[in] executor  - the thread pool created by sap_thread_pool_create.
+ */
+void sap_thread_pool_destroy(SAPExecutor *executor);
+
 /* ---- functions of cmd_exec ---- */
 
 
@@ -251,6 +895,52 @@ void set_cmd_self_parse(SAPCommand *cmd, CmdExecWithArg self_parse_exec);
  */
 SAPCommand *add_subcmd(SAPCommand *parent, SAPCommand *child);
 
+/**
+ * @brief add an extra name to a command, e.g. "rm" for "remove".
+ *
+ * the alias is an extra entry of the child index of the parent pointing at the command, so a subcommand
+ * is resolved by one probe whatever name it's given by. the help lists the aliases beside the name.
+ *
+ * @param[in] cmd       - the command.
+ * @param[in] alias     - the extra name, it must outlive the command.
+ * @return int          - 0 if succeed, -1 if the command has MAX_ALIAS_COUNT aliases already.
+ */
+int add_cmd_alias(SAPCommand *cmd, const char *alias);
+
+/**
+ * @brief remove a subcommand (and its subtree) from its parent, the order of the other subcommands is kept.
+ *
+ * the commands of the subtree no longer count against MAX_CMD_COUNT, they can be initialized and added again.
+ * a published tree version still refers to them until it's reclaimed, see sap_tree_publish.
+ *
+ * @param[in] parent    - the parent command.
+ * @param[in] child     - the subcommand to remove.
+ * @return SAPCommand*  - the parent, NULL if the child isn't a subcommand of the parent.
+ */
+SAPCommand *remove_subcmd(SAPCommand *parent, SAPCommand *child);
+
+/**
+ * @brief add a whole subtree from tables in one linear pass, instead of an add_subcmd and an add_flag per entry.
+ *
+ * cmds[i] becomes the last subcommand of cmds[parents[i]], or of $parent if parents[i] is -1, so a parent comes
+ * before its children (parents[i] < i). flags[k] is added to cmds[owners[k]]. the commands are initialized and
+ * not in a tree, the table is validated before anything is changed. the depths are computed once from the
+ * parents', and the children arrays of the new commands share a single allocation.
+ *
+ * @param[in] parent    - the command the subtree is added to.
+ * @param[in] cmds      - the commands.
+ * @param[in] parents   - parents[i] is the index of the parent of cmds[i] in the table, -1 for $parent.
+ * @param[in] cmd_cnt   - the number of the commands.
+ * @param[in] flags     - the flags, may be NULL if flag_cnt is 0.
+ * @param[in] owners    - owners[k] is the index of the command of flags[k] in the table.
+ * @param[in] flag_cnt  - the number of the flags.
+ * @return int          - 0 if succeed, -1 if the table is invalid (a bad index, a command in a tree or given twice,
+ *                        more than MAX_SUBCMD_COUNT subcommands or MAX_OPT_COUNT flags, deeper than MAX_CMD_DEPTH)
+ *                        or the memory can't be allocated.
+ */
+int add_subcmd_table(SAPCommand *parent, SAPCommand *cmds[], const int parents[], int cmd_cnt,
+                     Flag *flags[], const int owners[], int flag_cnt);
+
 /**
  * @brief parse and execute subcommands based on command-line arguments
  *
@@ -264,6 +954,300 @@ SAPCommand *add_subcmd(SAPCommand *parent, SAPCommand *child);
  */
 int do_parse_subcmd(int argc, char *argv[]);
 
+/**
+ * @brief set the asynchronous handler of a command, which is called by sap_exec_async.
+ *
+ * @param[in] cmd           - pointer to the SAPCommand structure.
+ * @param[in] exec_async    - the handler, it reads the values from the parse result and calls sap_complete when it finishes.
+ */
+void set_cmd_async_exec(SAPCommand *cmd, CmdExecAsync exec_async);
+
+/**
+ * @brief register the builder of a lazy command, which populates the command on demand.
+ *
+ * the builder adds the flags and the subcommands of $cmd (add_flag, add_subcmd, set_cmd_builder ...)
+ * when the parser descends into $cmd, or when its help or a full tree (sap_compact_build) needs them.
+ * the subtrees that are never invoked are never built, so the startup cost follows the invoked path.
+ * the persist flags are added to the built subcommands as well.
+ *
+ * @param[in] cmd       - pointer to the SAPCommand structure, its name and descriptions are set already.
+ * @param[in] builder   - the builder, it's called at most once.
+ */
+void set_cmd_builder(SAPCommand *cmd, CmdBuilder builder);
+
+/**
+ * @brief run the builder of a lazy command now, nothing is done if the command is built already.
+ *
+ * @param[in] cmd   - pointer to the SAPCommand structure.
+ */
+void sap_build_cmd(SAPCommand *cmd);
+
+/**
+ * @brief resolve the command and parse its flags without executing it.
+ *
+ * the values are stored into the result instead of the flags, so the handlers of different parses
+ * can run concurrently. the command tree must not be modified after the first parse.
+ * the function itself is not thread-safe, parse on a single thread.
+ *
+ * @param[in] argc  - the number of command-line arguments
+ * @param[in] argv  - the array of command-line arguments, it must outlive the result
+ * @param[out] res  - the parse result, free it with sap_free_result
+ * @return int      - 0 if succeed, -1 if the command is unknown (res->cmd == NULL) or the flags are invalid
+ */
+int sap_parse(int argc, char *argv[], SAPParseResult *res);
+
+/**
+ * @brief free the memory allocated by sap_parse for a parse result.
+ *
+ * @param[in] res   - the parse result.
+ */
+void sap_free_result(SAPParseResult *res);
+
+/**
+ * @brief get the value of a flag from a parse result.
+ *
+ * @param[in] res       - the parse result.
+ * @param[in] flag_name - the name of the flag.
+ * @return void*        - the value (same meaning as Flag.value), or NULL if the flag isn't given and has no default value.
+ */
+void *sap_get_value(const SAPParseResult *res, const char *flag_name);
+
+/**
+ * @brief get the id of the value of a single_arg choice flag from a parse result.
+ *
+ * @param[in] res       - the parse result.
+ * @param[in] flag_name - the name of the flag.
+ * @return int          - the id of the value (see sap_choice_id), or -1 if the flag has no value or isn't a choice flag.
+ */
+int sap_get_choice(const SAPParseResult *res, const char *flag_name);
+
+/**
+ * @brief get the source of the value of a flag from a parse result.
+ *
+ * @param[in] res       - the parse result.
+ * @param[in] flag_name - the name of the flag.
+ * @return SAPValueSource - where the value comes from, source_default if the flag isn't given (or is unknown).
+ */
+SAPValueSource sap_get_source(const SAPParseResult *res, const char *flag_name);
+
+/**
+ * @brief get the value of a positional slot from a parse result.
+ *
+ * @param[in] res       - the parse result.
+ * @param[in] slot      - the index of the slot, as returned by add_positional.
+ * @return void*        - the argument (char *) of a slot taking one, the NULL-terminated list (char **) of a variadic
+ *                        slot, or NULL if the slot receives nothing.
+ */
+void *sap_get_positional(const SAPParseResult *res, int slot);
+
+/**
+ * @brief spawn the tail of a parse result (a passthrough command, see set_cmd_passthrough) as a child process,
+ * tail_argv[0] is searched in PATH.
+ *
+ * the slice is handed to posix_spawnp as it is, so the parsed argv must be NULL-terminated as the argv of main.
+ * the child inherits the environment and the file descriptors.
+ *
+ * @param[in] res       - the parse result.
+ * @param[out] pid      - the process id of the child, wait for it with waitpid.
+ * @return int          - 0 if the child is spawned, EINVAL if the tail is empty or missing, or the error of posix_spawnp.
+ */
+int sap_spawn_tail(const SAPParseResult *res, pid_t *pid);
+
+/**
+ * @brief write a parse result as a JSON object (command path, flag values, positional slots, tail, error) to an output.
+ *
+ * e.g. {"cmd":["git","commit"],"flags":{"all":true,"message":"fix","file":["a","b"],"author":null}}
+ * the strings are escaped, the output isn't flushed, so many results can be batched.
+ *
+ * @param[in] res       - the parse result.
+ * @param[in,out] out   - the output.
+ * @return size_t       - the number of bytes written.
+ */
+size_t sap_write_json(const SAPParseResult *res, SAPOutput *out);
+
+/**
+ * @brief write a parse result as a compact length-prefixed binary record to an output.
+ *
+ * the record starts with its length (32-bit little-endian), see docs/interfaces.md for the layout.
+ * the output isn't flushed, so many results can be batched.
+ *
+ * @param[in] res       - the parse result.
+ * @param[in,out] out   - the output.
+ * @return size_t       - the number of bytes written.
+ */
+size_t sap_write_record(const SAPParseResult *res, SAPOutput *out);
+
+/**
+ * @brief read a binary record back into a parse result of the current command tree, to replay it.
+ *
+ * the values point into $data, which must outlive the result. the argument lists are kept in
+ * the arena of the result, free it with sap_free_result.
+ *
+ * @param[in] data      - the record.
+ * @param[in] len       - the number of the available bytes.
+ * @param[out] res      - the parse result.
+ * @param[out] used     - the length of the record (can be NULL), to read the next one.
+ * @return int          - 0 if succeed, -1 if the record is truncated, malformed or doesn't match the tree.
+ */
+int sap_read_record(const char *data, size_t len, SAPParseResult *res, size_t *used);
+
+/**
+ * @brief initialize a getopt parser: optind = 1, opterr = 1.
+ */
+void sap_getopt_init(SAPGetopt *st);
+
+/**
+ * @brief the reentrant getopt, the options are looked up through scap's flag index.
+ *
+ * same as getopt of glibc (including the permutation of argv, '+', '-' and ':' of optstring),
+ * except that the state is kept in $st and POSIXLY_CORRECT isn't read.
+ *
+ * @return int - the option character, -1 at the end, '?' or ':' for an error (st->optopt is set).
+ */
+int sap_getopt(SAPGetopt *st, int argc, char *argv[], const char *optstring);
+
+/**
+ * @brief the reentrant getopt_long, the long options are looked up by binary search.
+ *
+ * @param[in] longopts      - the long options, terminated by an all-zero entry, struct option of <getopt.h> can be cast.
+ * @param[out] longindex    - the index of the matched long option (can be NULL).
+ */
+int sap_getopt_long(SAPGetopt *st, int argc, char *argv[], const char *optstring, const SAPOption *longopts, int *longindex);
+
+/**
+ * @brief free the flag table of a getopt parser.
+ */
+void sap_getopt_free(SAPGetopt *st);
+
+/**
+ * @brief begin an incremental parse, the tokens are fed by sap_parse_feed as they are typed.
+ *
+ * @param[out] st   - the parse state, free it with sap_parse_state_free.
+ */
+void sap_parse_begin(SAPParseState *st);
+
+/**
+ * @brief feed the new tokens of a growing command line, only argv[st->pos, argc) are parsed.
+ *
+ * the tokens already fed must be unchanged (begin again if one of them is edited), a token should be
+ * fed when it's complete. st->res holds the result so far, and st->pending the flag expecting value(s).
+ *
+ * @param[in,out] st    - the parse state.
+ * @param[in] argc      - the number of the tokens of the line, not less than st->pos.
+ * @param[in] argv      - the tokens of the line, argv[0] is the name of the root command.
+ * @return int          - 0 if the tokens are valid so far, -1 if there's an error (st->res.err, sticky).
+ */
+int sap_parse_feed(SAPParseState *st, int argc, char *argv[]);
+
+/**
+ * @brief end an incremental parse, a pending flag without value is an error now.
+ *
+ * @param[in,out] st    - the parse state.
+ * @return int          - 0 if succeed, -1 if there's an error (st->res.err).
+ */
+int sap_parse_end(SAPParseState *st);
+
+/**
+ * @brief free the memory allocated by an incremental parse.
+ */
+void sap_parse_state_free(SAPParseState *st);
+
+/**
+ * @brief initialize an output writing through a callback, the data is batched in a buffer.
+ *
+ * @param[out] out  - the output.
+ * @param[in] write - the callback writing the batched data out.
+ * @param[in] ctx   - the context of the callback.
+ */
+void sap_output_init(SAPOutput *out, SAPWriteFn write, void *ctx);
+
+/**
+ * @brief initialize an output writing to a file descriptor.
+ */
+void sap_output_fd(SAPOutput *out, int fd);
+
+/**
+ * @brief initialize an output writing to a FILE *.
+ */
+void sap_output_file(SAPOutput *out, FILE *fp);
+
+/**
+ * @brief initialize an output appending to a growable memory buffer.
+ *
+ * @param[out] out  - the output.
+ * @param[in] mem   - the memory buffer, zero-initialized or reused, free it by sap_mem_buf_free.
+ */
+void sap_output_mem(SAPOutput *out, SAPMemBuf *mem);
+
+/**
+ * @brief append data to an output, it's written out when the buffer is full or flushed.
+ */
+void sap_output_write(SAPOutput *out, const char *data, size_t len);
+
+/**
+ * @brief write the batched data of an output out.
+ */
+void sap_output_flush(SAPOutput *out);
+
+/**
+ * @brief flush an output and free its batch buffer, the output can still be used.
+ */
+void sap_output_free(SAPOutput *out);
+
+/**
+ * @brief free the memory of a memory buffer.
+ */
+void sap_mem_buf_free(SAPMemBuf *mem);
+
+/**
+ * @brief set the output of a channel, all the output of the library goes through the outputs of the channels.
+ *
+ * @param[in] channel   - sap_out_channel (help and messages) or sap_err_channel (errors and warnings).
+ * @param[in] out       - the output, it must live until it's replaced, NULL restores the default (stdout / stderr).
+ */
+void sap_set_output(SAPChannel channel, SAPOutput *out);
+
+/**
+ * @brief get the current output of a channel.
+ */
+SAPOutput *sap_get_output(SAPChannel channel);
+
+/**
+ * @brief set the sink that reports the parse errors of do_parse_subcmd (and sap_exec_async).
+ *
+ * the parse itself never prints, the error is stored in the parse result (res->err) and handed to the sink.
+ *
+ * @param[in] sink  - the sink, NULL restores the default one (writing to the output of sap_err_channel).
+ * @param[in] ctx   - the context passed to the sink.
+ */
+void sap_set_error_sink(SAPErrorSink sink, void *ctx);
+
+/**
+ * @brief the error sink writing the formatted error to a file descriptor with a single write.
+ *
+ * @param[in] res   - the failed parse result.
+ * @param[in] ctx   - the file descriptor, as (void *) (intptr_t) fd.
+ */
+void sap_fd_error_sink(const SAPParseResult *res, void *ctx);
+
+/**
+ * @brief the error sink writing the formatted error to a FILE * with a single fwrite.
+ *
+ * @param[in] res   - the failed parse result.
+ * @param[in] ctx   - the FILE *, NULL for stderr.
+ */
+void sap_file_error_sink(const SAPParseResult *res, void *ctx);
+
+/**
+ * @brief format the error of a failed parse result into a buffer, without printf.
+ *
+ * @param[in] res       - the failed parse result.
+ * @param[out] buf      - the buffer, the message is truncated (and always null-terminated) if it's too small.
+ * @param[in] size      - the size of the buffer.
+ * @return size_t       - the length of the whole message, as snprintf.
+ */
+size_t sap_format_error(const SAPParseResult *res, char *buf, size_t size);
+
 /**
  * @brief free the memory allocated for the root command and its subcommands
  *
@@ -274,8 +1258,252 @@ int do_parse_subcmd(int argc, char *argv[]);
  */
 void free_root_cmd();
 
+/**
+ * @brief remove a command (and its subtree) from the tree, and free the memory the library allocated for them.
+ *
+ * the indices, constraints, aliases, positional slots and children arrays of the commands are freed, the
+ * commands are detached from each other, so each of them can be freed later in any order (a binding freeing
+ * the commands in its destructors). the flags are left to free_flag, they may be shared with other commands.
+ *
+ * @param[in] cmd   - the command, not the root command (see free_root_cmd), attached or not.
+ */
+void free_sap_command(SAPCommand *cmd);
+
+/**
+ * @brief remove a flag from every command of the tree holding it, and free its choices and aliases.
+ *
+ * the constraints on the flag are removed from the commands, a persist flag isn't added to the lazy commands
+ * any more. free_root_cmd frees the choices and aliases of the flags still in the tree, so this is for a flag
+ * freed before the tree (a binding freeing the flags in its destructors).
+ *
+ * @param[in] flag  - the flag, added to commands or not.
+ */
+void free_flag(Flag *flag);
+
 /* ---- global frame functions will be called by user ---- */
 
 
 
+/* ++++ functions of plugins ++++ */
+
+#define SAP_PLUGIN_ENTRY "sap_plugin_exec"  /* the symbol of the handler exported by a plugin, a CmdExec */
+
+/**
+ * @brief add the plugin commands listed in a manifest to a command, their shared objects are opened on dispatch.
+ *
+ * the manifest is read at once, each plugin is a line followed by the lines of its flags:
+ *
+ *     # comment
+ *     plugin <name> <shared object> <short description>
+ *     flag <name> <shorthand|-> <no_arg|single_arg|multi_arg> <usage>
+ *     default <name> <shorthand|-> <no_arg|single_arg|multi_arg> <usage>
+ *
+ * the path of a shared object is relative to the directory of the manifest unless it's absolute.
+ * a plugin command is a lazy command (set_cmd_builder), its flags are added from the manifest when it's needed,
+ * and the shared object is opened when the command is executed, so the help never opens one.
+ * the shared object exports SAP_PLUGIN_ENTRY, which is called as the handler of the command.
+ *
+ * @param[in] parent            - the command the plugins are added to.
+ * @param[in] manifest_path     - the path of the manifest.
+ * @return SAPPluginSet*        - the plugins, NULL if the manifest can't be read. the invalid lines are warned and skipped.
+ *
+ * @note free the plugins by sap_free_plugins after free_root_cmd, the command tree refers to them.
+ */
+SAPPluginSet *sap_load_plugins(SAPCommand *parent, const char *manifest_path);
+
+/**
+ * @brief the number of the shared objects opened so far.
+ */
+int sap_plugins_loaded(const SAPPluginSet *set);
+
+/**
+ * @brief close the shared objects and free the plugins, call it after free_root_cmd.
+ */
+void sap_free_plugins(SAPPluginSet *set);
+
+/* ---- functions of plugins ---- */
+
+
+
+/* ++++ functions of telemetry ++++ */
+
+/**
+ * @brief open (or create) a shared telemetry file, then every successful sap_parse counts its usage in it.
+ *
+ * the file holds SAP_TELEMETRY_SLOTS counters keyed by name: one per command ("prog net ping") and
+ * one per flag of a command ("prog net ping --count"). it's mapped shared, so the short-lived processes
+ * using the same file aggregate their counts lock-free. a command claims its counters once per file,
+ * then a parse costs a relaxed atomic add for the command and one for each given flag.
+ * the counting is off until a file is opened, the file stays open across the trees.
+ *
+ * @param[in] path  - the path of the file, created if it doesn't exist, it replaces the open one.
+ * @return int      - 0 if succeed, -1 if the file can't be mapped or isn't a telemetry file (the open one is kept).
+ */
+int sap_telemetry_open(const char *path);
+
+/**
+ * @brief unmap the telemetry file, the counting is off again.
+ */
+void sap_telemetry_close(void);
+
+/**
+ * @brief write the most used commands and flags of the open telemetry file to an output, one "count  name" per line.
+ *
+ * @param[in] out       - the output.
+ * @param[in] top_n     - the number of the entries to write, 0 for all.
+ * @return int          - the number of the entries written, -1 if no telemetry file is open.
+ */
+int sap_telemetry_report(SAPOutput *out, int top_n);
+
+/**
+ * @brief add the reporting command of the telemetry to a command, it writes the top entries (--top, default 10).
+ *
+ * @param[in] parent    - the parent command, usually the root.
+ * @param[in] name      - the name of the reporting command (e.g. "usage").
+ * @return SAPCommand*  - the parent, NULL if the command can't be added. the command is allocated per call
+ *                        and freed by free_root_cmd.
+ */
+SAPCommand *add_telemetry_cmd(SAPCommand *parent, const char *name);
+
+/* ---- functions of telemetry ---- */
+
+
+
+/* ++++ functions of tree versions ++++ */
+
+/**
+ * @brief serialize the writers of the command tree (add_subcmd, remove_subcmd, add_flag, ...) against each other.
+ *
+ * the writers mutate the tree in place, the readers of other threads parse published versions instead.
+ */
+void sap_tree_lock(void);
+
+/**
+ * @brief release the lock taken by sap_tree_lock.
+ */
+void sap_tree_unlock(void);
+
+/**
+ * @brief publish an immutable version of the current command tree, atomically replacing the published one.
+ *
+ * the version is a copy of the commands (with their flag and child indices built), the child arrays and the names,
+ * the lazy commands are built first. the flags themselves are shared, don't change a published flag.
+ * the readers inside sap_rcu_read_lock keep parsing the version they got, a replaced version is reclaimed
+ * once every reader that might hold it has left (epoch-based reclamation), so the publish never waits.
+ * call it outside sap_tree_lock, it takes the lock itself.
+ *
+ * @return uint64_t - the number of the new version, from 1.
+ */
+uint64_t sap_tree_publish(void);
+
+/**
+ * @brief wait until the replaced versions are reclaimed, then the commands removed before the publish can be freed.
+ */
+void sap_rcu_synchronize(void);
+
+/**
+ * @brief register a reader (one per thread), before its first sap_rcu_read_lock.
+ */
+void sap_rcu_register(SAPRcuReader *reader);
+
+/**
+ * @brief unregister a reader, outside its read-side critical section.
+ */
+void sap_rcu_unregister(SAPRcuReader *reader);
+
+/**
+ * @brief enter a read-side critical section and get the published version, lock-free and wait-free.
+ *
+ * the version stays valid until sap_rcu_read_unlock, even if a newer one is published. not reentrant.
+ *
+ * @param[in] reader            - the registered reader of the calling thread.
+ * @return const SAPTreeVersion* - the published version, NULL if none is published.
+ */
+const SAPTreeVersion *sap_rcu_read_lock(SAPRcuReader *reader);
+
+/**
+ * @brief leave the read-side critical section, the results of the version must not be used after it.
+ */
+void sap_rcu_read_unlock(SAPRcuReader *reader);
+
+/**
+ * @brief parse a command line against a tree version, as sap_parse does against the tree. thread-safe.
+ *
+ * res->cmd is the copy in the version, res->cmd->origin is the command of the tree.
+ *
+ * @param[in] version   - the version got by sap_rcu_read_lock.
+ * @param[in] argc      - the number of arguments.
+ * @param[in] argv      - the arguments, argv[0] is the program name.
+ * @param[out] res      - the result, free it by sap_free_result before sap_rcu_read_unlock.
+ * @return int          - 0 if succeed, -1 if there's an error (res->err).
+ */
+int sap_version_parse(const SAPTreeVersion *version, int argc, char *argv[], SAPParseResult *res);
+
+/**
+ * @brief the number of a tree version, as returned by sap_tree_publish.
+ */
+uint64_t sap_version_gen(const SAPTreeVersion *version);
+
+/**
+ * @brief the copy of the root command in a tree version, e.g. to print its help. read-only.
+ */
+const SAPCommand *sap_version_root(const SAPTreeVersion *version);
+
+/* ---- functions of tree versions ---- */
+
+
+
+/* ++++ functions of parse cache ++++ */
+
+/**
+ * @brief create a cache of the parse results against the tree, for the command lines repeated over and over.
+ *
+ * a command line is keyed by the hash of its tokens and their lengths, it's cached when it's parsed the second time
+ * (so the lines seen once don't evict the repeated ones), and the cache keeps the most recently used results
+ * up to its capacity. a hit skips the command lookup and the parse of the flags,
+ * the cached values are rebased onto the new argv, then the environment, the config and the constraints
+ * are checked as by sap_parse. a miss costs the hash on top of the parse, so it pays with a high hit rate:
+ * while fewer than 3/4 of the lookups hit, the lines are parsed directly and only a sample of them is looked up.
+ * the cache is for a frozen tree: clear it after the tree changes.
+ * it isn't thread-safe, use one cache per thread.
+ *
+ * @param[in] capacity      - the max number of the cached results, > 0.
+ * @return SAPParseCache*   - the cache, free it by sap_cache_free.
+ */
+SAPParseCache *sap_cache_create(int capacity);
+
+/**
+ * @brief parse a command line as sap_parse does, through the cache.
+ *
+ * only the successful parses are cached, the erroneous command lines are parsed every time.
+ *
+ * @param[in] cache     - the cache.
+ * @param[in] argc      - the number of arguments.
+ * @param[in] argv      - the arguments, argv[0] is the program name.
+ * @param[out] res      - the result, the same as sap_parse's (the values point into argv), free it by sap_free_result.
+ * @return int          - 0 if succeed, -1 if there's an error (res->err).
+ */
+int sap_cache_parse(SAPParseCache *cache, int argc, char *argv[], SAPParseResult *res);
+
+/**
+ * @brief get the counters of a cache, e.g. its hit rate.
+ */
+void sap_cache_stats(const SAPParseCache *cache, SAPCacheStats *stats);
+
+/**
+ * @brief drop the cached results and the lines seen once (the counters are kept), required after the tree changes.
+ */
+void sap_cache_clear(SAPParseCache *cache);
+
+/**
+ * @brief free a cache and its results, the results got from it are independent of it.
+ */
+void sap_cache_free(SAPParseCache *cache);
+
+/* ---- functions of parse cache ---- */
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* !SCAP_ARG_PARSER_H */
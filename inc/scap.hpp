@@ -0,0 +1,446 @@
+/**
+ * @file ./inc/scap.hpp
+ * @brief a header-only c++17 wrapper of scap.h
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * the commands and the flags wrap the structures of scap.h in place, nothing is copied or converted
+ * until a value is read. the value of a Flag<T> is converted by FlagTraits<T>, specialise it for your types.
+ * the root of the tree frees the tree when it's destroyed, in place of free_root_cmd, and a command or a flag
+ * destroyed before it removes itself from the tree, so they can be declared in any order.
+ */
+
+#ifndef SCAP_ARG_PARSER_HPP
+#define SCAP_ARG_PARSER_HPP
+
+#include <atomic>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include <scap.h>
+
+namespace scap {
+
+/* ++++ converters of the flag values ++++ */
+
+/**
+ * @brief the arguments of a multi_arg flag, a view over the null-terminated list of the parse.
+ */
+class Args {
+public:
+    class iterator {
+    public:
+        explicit iterator(char **p) : p_(p) {}
+        std::string_view operator*() const { return std::string_view(*p_); }
+        iterator &operator++() { ++p_; return *this; }
+        bool operator!=(const iterator &other) const { return p_ != other.p_; }
+    private:
+        char **p_;
+    };
+
+    Args() = default;
+    explicit Args(char **list) : list_(list) {
+        while (list_ != nullptr && list_[cnt_] != nullptr) {
+            cnt_++;
+        }
+    }
+    iterator begin() const { return iterator(list_); }
+    iterator end() const { return iterator(list_ + cnt_); }
+    size_t size() const { return cnt_; }
+    bool empty() const { return cnt_ == 0; }
+    std::string_view operator[](size_t i) const { return std::string_view(list_[i]); }
+
+private:
+    char **list_ = nullptr;
+    size_t cnt_ = 0;
+};
+
+/**
+ * @brief the number of the occurrences of a repeat_count flag (-vvv).
+ */
+struct Count {
+    int n = 0;
+    operator int() const { return n; }
+};
+
+/**
+ * @brief the conversion of the raw value (Flag.value) of a flag into T.
+ *
+ * a specialisation gives the type and the repeat mode of the flag, and
+ * `static bool convert(void *raw, T &out)` which converts a raw value that isn't NULL
+ * (NULL means the flag isn't given) and returns false if the text is malformed.
+ */
+template <typename T, typename Enable = void>
+struct FlagTraits;
+
+template <>
+struct FlagTraits<bool> {
+    static constexpr FlagType type = no_arg;
+    static constexpr FlagRepeat repeat = repeat_last;
+    static bool convert(void *raw, bool &out) {
+        out = (raw != nullptr);
+        return true;
+    }
+};
+
+template <>
+struct FlagTraits<Count> {
+    static constexpr FlagType type = no_arg;
+    static constexpr FlagRepeat repeat = repeat_count;
+    static bool convert(void *raw, Count &out) {
+        out.n = *static_cast<int *>(raw);
+        return true;
+    }
+};
+
+template <>
+struct FlagTraits<std::string_view> {
+    static constexpr FlagType type = single_arg;
+    static constexpr FlagRepeat repeat = repeat_last;
+    static bool convert(void *raw, std::string_view &out) {
+        out = std::string_view(static_cast<const char *>(raw));
+        return true;
+    }
+};
+
+template <>
+struct FlagTraits<Args> {
+    static constexpr FlagType type = multi_arg;
+    static constexpr FlagRepeat repeat = repeat_last;
+    static bool convert(void *raw, Args &out) {
+        out = Args(static_cast<char **>(raw));
+        return true;
+    }
+};
+
+template <typename T>
+struct FlagTraits<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>> {
+    static constexpr FlagType type = single_arg;
+    static constexpr FlagRepeat repeat = repeat_last;
+    static bool convert(void *raw, T &out) {
+        const char *str = static_cast<const char *>(raw);
+        const char *end = str + std::strlen(str);
+        auto [ptr, ec] = std::from_chars(str, end, out);
+        return ec == std::errc() && ptr == end;
+    }
+};
+
+template <typename T>
+struct FlagTraits<T, std::enable_if_t<std::is_floating_point_v<T>>> {
+    static constexpr FlagType type = single_arg;
+    static constexpr FlagRepeat repeat = repeat_last;
+    static bool convert(void *raw, T &out) {
+        const char *str = static_cast<const char *>(raw);
+        char *end = nullptr;
+        out = static_cast<T>(std::strtold(str, &end));
+        return end != str && *end == '\0';
+    }
+};
+
+/* ---- converters of the flag values ---- */
+
+
+
+/* ++++ flags and commands ++++ */
+
+class Result;
+
+/**
+ * @brief a flag whose value is read as T, it's removed from the commands of the tree when it's destroyed.
+ */
+template <typename T>
+class Flag {
+public:
+    using Traits = FlagTraits<T>;
+
+    Flag(const char *name, char shorthand, const char *usage, T dft = T()) : dft_(std::move(dft)) {
+        init_flag(&raw_, name, shorthand, usage, nullptr);
+        set_flag_type(&raw_, Traits::type);
+        if (Traits::repeat != repeat_last) {
+            set_flag_repeat(&raw_, Traits::repeat);
+        }
+    }
+    Flag(const Flag &) = delete;
+    Flag &operator=(const Flag &) = delete;
+    ~Flag() { free_flag(&raw_); }
+
+    /**
+     * @brief the value of the flag exposed to the running handler, the default if it isn't given or malformed.
+     */
+    T value() const { return convert(raw_.value); }
+
+    /**
+     * @brief whether the value exposed to the running handler is well-formed (true if it isn't given).
+     */
+    bool valid() const { return valid(raw_.value); }
+
+    T convert(void *raw) const {
+        T out;
+        return (raw != nullptr && Traits::convert(raw, out)) ? out : dft_;
+    }
+    bool valid(void *raw) const {
+        T out;
+        return raw == nullptr || Traits::convert(raw, out);
+    }
+
+    ::Flag *raw() { return &raw_; }
+    const ::Flag *raw() const { return &raw_; }
+
+private:
+    friend class Result;
+
+    ::Flag raw_;
+    T dft_;
+    mutable std::atomic<int> pos_{0};   /* the position in the flags of the last command it was read from */
+};
+
+/**
+ * @brief the handler of a command stored without std::function, a lambda is called through a function pointer.
+ */
+class Command;
+
+class Handler {
+public:
+    Handler() = default;
+    Handler(const Handler &) = delete;
+    Handler &operator=(const Handler &) = delete;
+    ~Handler() { reset(); }
+
+    template <typename F>
+    void bind(F &&f) {
+        using Fn = std::decay_t<F>;
+        reset();
+        obj_ = new Fn(std::forward<F>(f));
+        call_ = [](void *obj, Command &cmd) -> int {
+            Fn &fn = *static_cast<Fn *>(obj);
+            if constexpr (std::is_invocable_v<Fn &, Command &>) {
+                return fn(cmd);
+            } else {
+                return fn();
+            }
+        };
+        destroy_ = [](void *obj) { delete static_cast<Fn *>(obj); };
+    }
+
+    int operator()(Command &cmd) const { return (call_ == nullptr) ? 0 : call_(obj_, cmd); }
+
+private:
+    void reset() {
+        if (destroy_ != nullptr) {
+            destroy_(obj_);
+        }
+        obj_ = nullptr;
+        call_ = nullptr;
+        destroy_ = nullptr;
+    }
+
+    void *obj_ = nullptr;
+    int (*call_)(void *obj, Command &cmd) = nullptr;
+    void (*destroy_)(void *obj) = nullptr;
+};
+
+/**
+ * @brief a command of the tree, it's removed from the tree with its subcommands when it's destroyed.
+ */
+class Command {
+public:
+    Command(const char *name, const char *short_desc, const char *long_desc = nullptr) : cmd_(&own_) {
+        init_sap_command(cmd_, name, short_desc, long_desc, nullptr);
+    }
+    Command(const Command &) = delete;
+    Command &operator=(const Command &) = delete;
+    ~Command() {
+        if (cmd_ == &own_) {
+            free_sap_command(cmd_);     /* the root is freed by Root */
+        }
+    }
+
+    Command &add(Command &sub) {
+        add_subcmd(cmd_, sub.cmd_);
+        return *this;
+    }
+    template <typename T>
+    Command &add(Flag<T> &flag) {
+        add_flag(cmd_, flag.raw());
+        return *this;
+    }
+    template <typename T>
+    Command &add_default(Flag<T> &flag) {
+        add_default_flag(cmd_, flag.raw());
+        return *this;
+    }
+
+    /**
+     * @brief bind the handler, a callable taking a Command & or nothing and returning int.
+     */
+    template <typename F>
+    Command &on(F &&handler) {
+        handler_.bind(std::forward<F>(handler));
+        cmd_->ctx = this;
+        cmd_->exec = exec_thunk;
+        return *this;
+    }
+
+    std::string_view name() const { return std::string_view(cmd_->name); }
+    SAPCommand *raw() { return cmd_; }
+    const SAPCommand *raw() const { return cmd_; }
+
+protected:
+    explicit Command(SAPCommand *cmd) : cmd_(cmd) {}
+
+private:
+    static int exec_thunk(SAPCommand *caller) {
+        Command *self = static_cast<Command *>(caller->ctx);
+        return self->handler_(*self);
+    }
+
+    SAPCommand own_;
+    SAPCommand *cmd_;
+    Handler handler_;
+};
+
+/* ---- flags and commands ---- */
+
+
+
+/* ++++ parse results ++++ */
+
+/**
+ * @brief the result of a parse, move-only, the memory is freed by the destructor.
+ *
+ * the values refer to argv, which must outlive the result.
+ */
+class Result {
+public:
+    Result() { std::memset(&res_, 0, sizeof(res_)); }
+    Result(int argc, char *argv[]) { sap_parse(argc, argv, &res_); }
+    Result(const Result &) = delete;
+    Result &operator=(const Result &) = delete;
+    Result(Result &&other) noexcept : res_(other.res_) { std::memset(&other.res_, 0, sizeof(other.res_)); }
+    Result &operator=(Result &&other) noexcept {
+        if (this != &other) {
+            sap_free_result(&res_);
+            res_ = other.res_;
+            std::memset(&other.res_, 0, sizeof(other.res_));
+        }
+        return *this;
+    }
+    ~Result() { sap_free_result(&res_); }
+
+    bool ok() const { return res_.cmd != nullptr && res_.err.code == parse_ok; }
+    explicit operator bool() const { return ok(); }
+    const SAPParseError &error() const { return res_.err; }
+    std::string error_message() const {
+        std::string msg(sap_format_error(&res_, nullptr, 0), '\0');
+        sap_format_error(&res_, msg.data(), msg.size() + 1);
+        return msg;
+    }
+    const SAPCommand *command() const { return res_.cmd; }
+
+    /**
+     * @brief whether the flag is given, false if it doesn't belong to the parsed command.
+     */
+    template <typename T>
+    bool has(const Flag<T> &flag) const { return raw_value(flag) != nullptr; }
+
+    /**
+     * @brief the value of the flag, the default if it isn't given, malformed or doesn't belong to the parsed command.
+     */
+    template <typename T>
+    T get(const Flag<T> &flag) const { return flag.convert(raw_value(flag)); }
+    template <typename T>
+    T operator[](const Flag<T> &flag) const { return get(flag); }
+
+    template <typename T>
+    bool valid(const Flag<T> &flag) const { return flag.valid(raw_value(flag)); }
+
+    /**
+     * @brief execute the parsed command on the calling thread (or report the error), return the handler's result.
+     */
+    int exec() {
+        int ret = -1;
+        sap_exec_async(sap_inline_executor(), &res_, [](SAPParseResult *, int r, void *ctx) {
+            *static_cast<int *>(ctx) = r;
+        }, &ret);
+        return ret;
+    }
+
+    /**
+     * @brief the raw value of the flag (as Flag.value), nullptr if it doesn't belong to the parsed command.
+     */
+    template <typename T>
+    void *raw_value(const Flag<T> &flag) const {
+        const SAPCommand *cmd = res_.cmd;
+        if (cmd == nullptr) {
+            return nullptr;
+        }
+        /* the position the flag was found at last time, checked by the pointer of the flag */
+        int pos = flag.pos_.load(std::memory_order_relaxed);
+        if (pos < cmd->flag_cnt && cmd->flags[pos] == flag.raw()) {
+            return res_.values[pos];
+        }
+        for (int i = 0; i < cmd->flag_cnt; i++) {
+            if (cmd->flags[i] == flag.raw()) {
+                flag.pos_.store(i, std::memory_order_relaxed);
+                return res_.values[i];
+            }
+        }
+        return nullptr;
+    }
+
+    SAPParseResult *raw() { return &res_; }
+    const SAPParseResult *raw() const { return &res_; }
+
+private:
+    SAPParseResult res_;
+};
+
+/* ---- parse results ---- */
+
+
+
+/* ++++ root of the tree ++++ */
+
+/**
+ * @brief the root command, there's a single root at a time, the tree is freed when it's destroyed.
+ */
+class Root : public Command {
+public:
+    Root(const char *name, const char *short_desc, const char *long_desc = nullptr)
+        : Command((init_root_cmd(name, short_desc, long_desc, nullptr), &rootCmd)) {}
+    Root(const Root &) = delete;
+    Root &operator=(const Root &) = delete;
+    ~Root() { free_root_cmd(); }
+
+    /**
+     * @brief add a persist flag to all the commands of the tree, add it after the subcommands.
+     */
+    template <typename T>
+    Root &persist(Flag<T> &flag) {
+        add_persist_flag(raw(), flag.raw());
+        return *this;
+    }
+
+    /**
+     * @brief parse without executing.
+     */
+    Result parse(int argc, char *argv[]) { return Result(argc, argv); }
+
+    /**
+     * @brief parse and execute, as do_parse_subcmd.
+     */
+    int run(int argc, char *argv[]) { return do_parse_subcmd(argc, argv); }
+};
+
+/* ---- root of the tree ---- */
+
+} /* namespace scap */
+
+#endif /* !SCAP_ARG_PARSER_HPP */
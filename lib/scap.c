@@ -8,10 +8,22 @@
  */
 
 #include <assert.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <spawn.h>
+#include <stdarg.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <scap.h>
 
@@ -19,25 +31,514 @@
 SAPCommand rootCmd;                 /* the global root command */
 static SAPCommand helpCmd;          /* the help command */
 static int g_cmd_cnt = 0;           /* the number of commands */
+static int is_sealed = 0;           /* whether the help command is added to the root command */
 static Flag helpFlag;               /* the help flag */
 static const int IS_PROVIDED = 1;   /* the flag is provided */
-static enum {
-    normal = 0,
-    unknown_arg = 1,
-    too_many_args = 2,
-    too_few_args = 3,
-    illegal_equal = 4
-} parse_err = normal;
+static __thread SAPParseError parseErr;    /* the error of the running parse, argv_idx is filled by sap_parse */
+static void output_error_sink(const SAPParseResult *res, void *ctx);
+static SAPErrorSink errorSink = output_error_sink;      /* reports the parse errors */
+static void *errorSinkCtx = NULL;
+static SAPOutput dftOutputs[2];     /* the default outputs of the channels, stdout and stderr */
+static SAPOutput *outputs[2];       /* the outputs of the channels, NULL means the default */
+static SAPParseResult lastResult;   /* the result of the last do_parse_subcmd */
+extern char **environ;
+static Flag *persistFlags[MAX_OPT_COUNT];   /* the persist flags, added to the lazy commands when they are built */
+static int persistCnt = 0;          /* the number of the persist flags */
+
+#if MAX_OPT_COUNT > 255
+#error "MAX_OPT_COUNT must be less than 256, the flag index stores the indices in unsigned char"
+#endif
+#if (SAP_TELEMETRY_SLOTS & (SAP_TELEMETRY_SLOTS - 1)) != 0
+#error "SAP_TELEMETRY_SLOTS must be a power of 2"
+#endif
+
+typedef struct {
+    const char *name;                       /* the name of the flag or an extra long name of it */
+    int flag;                               /* the index in flags of the flag it names */
+} SAPFlagName;
+
+typedef struct SAPFlagIndex_ {
+    unsigned char by_shorthand[256];        /* shorthand -> (index in flags + 1), 0 means unused */
+    int name_cnt;                           /* the number of the long names, the extra ones included */
+    SAPFlagName *by_name;                   /* the long names sorted, in the block of the index after the aliases */
+    uint32_t name_ids[MAX_OPT_COUNT];       /* name_ids[i] is the interned name id of flags[i] */
+    int fallback_cnt;                       /* the number of the flags with an environment variable or a config key */
+    unsigned char fallbacks[MAX_OPT_COUNT]; /* the indices in flags of them */
+    int env_cnt;                            /* the number of the flags with an environment variable */
+    uint32_t env_hashes[MAX_OPT_COUNT];     /* env_hashes[i] is the hash of the environment variable of flags[i] */
+    unsigned char env_slots[256];           /* hash -> (index in flags + 1) of the environment variables, 0 means empty */
+    uint32_t usage_gen;                     /* the generation of the telemetry file the counters belong to, 0 if none */
+    uint64_t *usage[MAX_OPT_COUNT + 1];     /* the counters of the command (usage[0]) and of flags[i] (usage[i + 1]) */
+    int alias_cnt;                          /* the number of the extra long names of the flags */
+    struct {
+        uint32_t name_id;                   /* the interned id of the extra name */
+        int flag;                           /* the index in flags of the flag it names */
+    } aliases[];                            /* the extra names, looked up after name_ids */
+} SAPFlagIndex;
+
+typedef struct SAPAliases_ {
+    int cnt;                                /* the number of the aliases */
+    const char *names[MAX_ALIAS_COUNT];     /* the extra names, NULL for a shorthand only alias of a flag */
+    uint32_t name_ids[MAX_ALIAS_COUNT];     /* the interned ids of the names, SAP_NIL for NULL */
+    char shorthands[MAX_ALIAS_COUNT];       /* the extra shorthands of a flag, '\0' if none */
+} SAPAliases;
+
+typedef struct SAPPositionals_ {
+    int cnt;                                /* the number of the slots */
+    struct {
+        const char *name;                   /* the name of the slot */
+        const char *usage;                  /* the usage description of the slot */
+        uint32_t name_id;                   /* the interned id of the name, reported by the errors */
+        PositionalType type;                /* the type of the arguments */
+        int min_cnt;                        /* the min number of the arguments */
+        int max_cnt;                        /* the max number of the arguments, -1 for unbounded */
+    } slots[MAX_POS_COUNT];
+} SAPPositionals;
+
+typedef struct SAPChildIndex_ {
+    int bits;               /* the hash table has (1 << bits) slots, at least twice the names of the children */
+    struct {
+        uint32_t name_id;   /* the name or an alias of the child */
+        int child;          /* the index in children + 1, 0 means empty */
+    } slots[];
+} SAPChildIndex;
+
+typedef struct {
+    const char *key;        /* the key, terminated in the mapping */
+    uint64_t hash;          /* the hash of the key */
+    const char *value;      /* the value, terminated in the mapping */
+} SAPConfigEntry;
+
+typedef struct {
+    char *map;              /* the private mapping of the config file, NULL if none is loaded */
+    size_t len;             /* the length of the mapping */
+    uint32_t cnt;           /* the number of the entries */
+    SAPConfigEntry *entries;    /* the entries in the order of the file */
+    int bits;               /* the hash table has (1 << bits) slots */
+    uint32_t *slots;        /* slot -> (index in entries + 1), 0 means empty */
+} SAPConfig;
+
+static SAPConfig loadedConfig;      /* the config file supplying the values of the flags with config keys */
+
+#define SAP_USAGE_MAGIC 0x3145535550415353ULL   /* "SSAPUSE1" */
+
+typedef struct {
+    uint64_t key;           /* the hash of the name, 0 means free, claimed by a compare-and-swap */
+    uint64_t count;         /* the number of the uses, incremented by a relaxed atomic add */
+    uint32_t named;         /* set (release) once the name is written */
+    char name[44];          /* "<command path>" or "<command path> --<flag>", truncated */
+} SAPUsageSlot;             /* a cache line */
+
+typedef struct {
+    uint64_t magic;         /* SAP_USAGE_MAGIC, set by the first process mapping the file */
+    char reserved[56];
+    SAPUsageSlot slots[];   /* SAP_TELEMETRY_SLOTS slots, open addressing by the key */
+} SAPUsageFile;
+
+static SAPUsageFile *usageFile;     /* the shared mapping of the telemetry file, NULL if it's not open */
+static uint32_t usageGen = 0;       /* the generation of the open telemetry file, 0 if none */
+static uint32_t usageOpens = 0;     /* the number of the files opened, the generations */
+
+typedef struct SAPChoiceTable_ {
+    uint64_t seed;          /* the seed of the perfect hash */
+    int bits;               /* the hash table has (1 << bits) slots */
+    int cnt;                /* the number of the choices */
+    const char **names;     /* the canonical strings by id, names[id][-1] holds the id */
+    const char *pool;       /* the canonical strings, a value inside it is canonical */
+    size_t pool_len;        /* the length of the pool */
+    unsigned char *slots;   /* slot -> (id + 1), 0 means empty */
+} SAPChoiceTable;
+
+typedef struct {
+    FlagConstraint kind;    /* the kind of the constraint */
+    int flag_cnt;           /* the number of the flags */
+    Flag **flags;           /* the flags, as declared */
+    SAPFlagMask mask;       /* the flags (flags[1..] for constraint_requires), compiled */
+} SAPConstraint;
+
+typedef struct SAPConstraintSet_ {
+    int cnt;                /* the number of the constraints */
+    int cap;                /* the capacity of items */
+    SAPConstraint *items;   /* the constraints in the declaration order */
+    int compiled;           /* whether the masks match the current flags of the command */
+    int one_of_cnt;         /* the number of the distinct masks of the constraint_one_of constraints */
+    SAPFlagMask *one_of;    /* the distinct masks of the constraint_one_of constraints, at least one bit of each must be given */
+    SAPFlagMask required;   /* the flags of all the constraint_required constraints */
+    SAPFlagMask involved;   /* the flags with needs or conflicts */
+    SAPFlagMask needs[MAX_OPT_COUNT];       /* needs[i]: the flags required by flags[i] */
+    SAPFlagMask conflicts[MAX_OPT_COUNT];   /* conflicts[i]: the flags exclusive with flags[i] */
+} SAPConstraintSet;
+
+static inline void mask_set(SAPFlagMask *mask, int i) {
+    mask->bits[i / 64] |= (uint64_t) 1 << (i % 64);
+}
+
+static inline int mask_test(const SAPFlagMask *mask, int i) {
+    return (int) ((mask->bits[i / 64] >> (i % 64)) & 1);
+}
+
+static uint64_t hash_str(const char *str, size_t len);
+static void build_cmd(SAPCommand *cmd);
+static void free_versions(void);
+static int get_flag_pos(const SAPCommand *cmd, const Flag *flag);
+static SAPCommand **collect_cmds_bfs(SAPCommand *root, int build, uint32_t *out_cnt);
+
+/* run the builder of a lazy command before its flags or subcommands are read */
+static inline void ensure_built(SAPCommand *cmd) {
+    if (cmd->builder != NULL) {
+        build_cmd(cmd);
+    }
+}
+
+static SAPStrPool namePool;         /* the interned names of the commands and flags */
+static __thread const SAPStrPool *versionNames = NULL;  /* the names of the tree version parsed by the thread */
+
+/* the names the running parse looks up: those of the tree version it parses, otherwise the live ones */
+static inline const SAPStrPool *name_pool(void) {
+    return (versionNames != NULL) ? versionNames : &namePool;
+}
+
+/* ++++ functions of output ++++ */
+
+static size_t fd_write(void *ctx, const char *data, size_t len) {
+    int fd = (int) (intptr_t) ctx;
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = write(fd, data + written, len - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        written += (size_t) n;
+    }
+    return written;
+}
+
+static size_t file_write(void *ctx, const char *data, size_t len) {
+    FILE *fp = (FILE *) ctx;
+    size_t written = fwrite(data, 1, len, fp);
+    fflush(fp);
+    return written;
+}
+
+static size_t mem_write(void *ctx, const char *data, size_t len) {
+    SAPMemBuf *mem = (SAPMemBuf *) ctx;
+    if (mem->len + len + 1 > mem->cap) {
+        size_t new_cap = (mem->cap == 0) ? SAP_OUTPUT_BUF_SIZE : mem->cap;
+        while (mem->len + len + 1 > new_cap) {
+            new_cap *= 2;
+        }
+        char *new_data = (char *) realloc(mem->data, new_cap);
+        if (new_data == NULL) {
+            return 0;
+        }
+        mem->data = new_data;
+        mem->cap = new_cap;
+    }
+    memcpy(mem->data + mem->len, data, len);
+    mem->len += len;
+    mem->data[mem->len] = '\0';
+    return len;
+}
+
+void sap_output_init(SAPOutput *out, SAPWriteFn write_fn, void *ctx) {
+    assert(out != NULL);
+    assert(write_fn != NULL);
+    out->write = write_fn;
+    out->ctx = ctx;
+    out->buf = NULL;
+    out->len = 0;
+    out->cap = 0;
+    out->total = 0;
+}
+
+void sap_output_fd(SAPOutput *out, int fd) {
+    sap_output_init(out, fd_write, (void *) (intptr_t) fd);
+}
+
+void sap_output_file(SAPOutput *out, FILE *fp) {
+    assert(fp != NULL);
+    sap_output_init(out, file_write, fp);
+}
+
+void sap_output_mem(SAPOutput *out, SAPMemBuf *mem) {
+    assert(mem != NULL);
+    sap_output_init(out, mem_write, mem);
+}
+
+void sap_output_flush(SAPOutput *out) {
+    assert(out != NULL);
+    if (out->len > 0) {
+        out->write(out->ctx, out->buf, out->len);   /* the data that can't be written is dropped */
+        out->len = 0;
+    }
+}
+
+/**
+ * @brief make sure the buffer of an output has room for $len more bytes, flushing or growing it.
+ *
+ * @return int - 0 if succeed, -1 if the buffer can't be allocated.
+ */
+static int output_reserve(SAPOutput *out, size_t len) {
+    if (out->len + len <= out->cap) {
+        return 0;
+    }
+    sap_output_flush(out);
+    if (len <= out->cap) {
+        return 0;
+    }
+
+    size_t new_cap = (out->cap == 0) ? SAP_OUTPUT_BUF_SIZE : out->cap;
+    while (new_cap < len) {
+        new_cap *= 2;
+    }
+    char *new_buf = (char *) realloc(out->buf, new_cap);
+    if (new_buf == NULL) {
+        return -1;
+    }
+    out->buf = new_buf;
+    out->cap = new_cap;
+    return 0;
+}
+
+void sap_output_write(SAPOutput *out, const char *data, size_t len) {
+    assert(out != NULL);
+    assert(data != NULL || len == 0);
+
+    out->total += len;
+    if (out->cap > 0 && len > out->cap) {
+        /* larger than the whole buffer, write it through */
+        sap_output_flush(out);
+        out->write(out->ctx, data, len);
+        return;
+    }
+    if (output_reserve(out, len) != 0) {
+        return;
+    }
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+}
+
+/**
+ * @brief append data to an output, the inlined fast path of sap_output_write when the buffer has room.
+ */
+static inline void out_put(SAPOutput *out, const char *data, size_t len) {
+    if (len <= out->cap - out->len) {
+        memcpy(out->buf + out->len, data, len);
+        out->len += len;
+        out->total += len;
+    } else {
+        sap_output_write(out, data, len);
+    }
+}
+
+void sap_output_free(SAPOutput *out) {
+    assert(out != NULL);
+    sap_output_flush(out);
+    free(out->buf);
+    out->buf = NULL;
+    out->cap = 0;
+}
+
+void sap_mem_buf_free(SAPMemBuf *mem) {
+    assert(mem != NULL);
+    free(mem->data);
+    mem->data = NULL;
+    mem->len = 0;
+    mem->cap = 0;
+}
+
+SAPOutput *sap_get_output(SAPChannel channel) {
+    assert(channel == sap_out_channel || channel == sap_err_channel);
+
+    if (outputs[channel] == NULL) {
+        if (dftOutputs[channel].write == NULL) {
+            sap_output_file(&dftOutputs[channel], (channel == sap_out_channel) ? stdout : stderr);
+        }
+        outputs[channel] = &dftOutputs[channel];
+    }
+    return outputs[channel];
+}
+
+void sap_set_output(SAPChannel channel, SAPOutput *out) {
+    sap_output_flush(sap_get_output(channel));
+    outputs[channel] = out;
+}
+
+/**
+ * @brief format into the batch buffer of an output, as printf.
+ */
+static void out_printf(SAPOutput *out, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    va_list args_retry;
+    va_copy(args_retry, args);
+
+    int len = vsnprintf((out->buf != NULL) ? out->buf + out->len : NULL, out->cap - out->len, fmt, args);
+    if (len >= 0 && (size_t) len >= out->cap - out->len) {
+        /* not enough room (including the null terminator), make it and format again */
+        if (output_reserve(out, (size_t) len + 1) == 0) {
+            len = vsnprintf(out->buf + out->len, out->cap - out->len, fmt, args_retry);
+        } else {
+            len = -1;
+        }
+    }
+    if (len > 0) {
+        out->len += (size_t) len;
+        out->total += (size_t) len;
+    }
+
+    va_end(args_retry);
+    va_end(args);
+}
+
+/* ---- functions of output ---- */
+
+
+
+/* ++++ functions of SAPArena ++++ */
+
+typedef struct SAPArenaChunk_ {
+    struct SAPArenaChunk_ *next;    /* the older chunk */
+    size_t size;                    /* the size of the data */
+    max_align_t data[];             /* the allocations */
+} SAPArenaChunk;
+
+#define ARENA_MAX_CHUNK_SIZE ((size_t) 1 << 20)     /* the chunks stop doubling at this size */
+
+static inline size_t align_max(size_t size) {
+    return (size + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t);
+}
+
+/**
+ * @brief allocate memory from an arena, it's freed all at once by arena_free.
+ *
+ * the chunks double in size, so there are O(log n) of them, and nothing is ever moved.
+ */
+static void *arena_alloc(SAPArena *arena, size_t size) {
+    size = align_max(size);
+    if ((size_t) (arena->end - arena->cur) < size) {
+        size_t chunk_size = (arena->chunks == NULL) ? SAP_ARENA_CHUNK_SIZE : arena->chunks->size * 2;
+        if (chunk_size > ARENA_MAX_CHUNK_SIZE) {
+            chunk_size = ARENA_MAX_CHUNK_SIZE;
+        }
+        if (chunk_size < size) {
+            chunk_size = size;
+        }
+        SAPArenaChunk *chunk = (SAPArenaChunk *) malloc(sizeof(SAPArenaChunk) + chunk_size);
+        assert(chunk != NULL);
+        chunk->next = arena->chunks;
+        chunk->size = chunk_size;
+        arena->chunks = chunk;
+        arena->cur = (char *) chunk->data;
+        arena->end = arena->cur + chunk_size;
+    }
+    void *ptr = arena->cur;
+    arena->cur += size;
+    return ptr;
+}
+
+/**
+ * @brief give an empty arena a first chunk of the given size, for a caller knowing how much it allocates.
+ *
+ * a small chunk stays in the per-thread cache of malloc, the default first chunk is just above it.
+ */
+static void arena_reserve(SAPArena *arena, size_t size) {
+    assert(arena->chunks == NULL);
+    size = align_max(size);
+    SAPArenaChunk *chunk = (SAPArenaChunk *) malloc(sizeof(SAPArenaChunk) + size);
+    assert(chunk != NULL);
+    chunk->next = NULL;
+    chunk->size = size;
+    arena->chunks = chunk;
+    arena->cur = (char *) chunk->data;
+    arena->end = arena->cur + size;
+}
+
+static void arena_free(SAPArena *arena) {
+    SAPArenaChunk *chunk = arena->chunks;
+    while (chunk != NULL) {
+        SAPArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+    arena->cur = arena->end = NULL;
+}
+
+typedef struct SAPArgChunk_ {
+    struct SAPArgChunk_ *next;      /* the next chunk */
+    int cnt;                        /* the number of the arguments in the chunk */
+    int cap;                        /* the capacity of the chunk */
+    char *args[];
+} SAPArgChunk;
+
+typedef struct {
+    SAPArgChunk *head;              /* the first chunk, NULL if nothing is appended */
+    SAPArgChunk *tail;              /* the last chunk */
+    int total;                      /* the number of the arguments, or the occurrences of a repeat_count flag */
+} SAPArgChain;
+
+#define ARG_CHUNK_MAX_CAP 4096      /* the chunks of a chain stop doubling at this capacity */
+
+/**
+ * @brief append an argument to a chain, a full chunk is followed by a new one twice as large.
+ */
+static void chain_push(SAPArena *arena, SAPArgChain *chain, char *arg) {
+    if (chain->tail == NULL || chain->tail->cnt == chain->tail->cap) {
+        int cap = (chain->tail == NULL) ? 8 : chain->tail->cap * 2;
+        if (cap > ARG_CHUNK_MAX_CAP) {
+            cap = ARG_CHUNK_MAX_CAP;
+        }
+        SAPArgChunk *chunk = (SAPArgChunk *) arena_alloc(arena, sizeof(SAPArgChunk) + sizeof(char *) * cap);
+        chunk->next = NULL;
+        chunk->cnt = 0;
+        chunk->cap = cap;
+        if (chain->tail == NULL) {
+            chain->head = chunk;
+        } else {
+            chain->tail->next = chunk;
+        }
+        chain->tail = chunk;
+    }
+    chain->tail->args[chain->tail->cnt++] = arg;
+    chain->total++;
+}
+
+/**
+ * @brief gather the arguments of a chain into a NULL-terminated list, every argument is copied once.
+ */
+static char **chain_list(SAPArena *arena, const SAPArgChain *chain) {
+    char **list = (char **) arena_alloc(arena, sizeof(char *) * (chain->total + 1));
+    char **p_list = list;
+    for (const SAPArgChunk *chunk = chain->head; chunk != NULL; chunk = chunk->next) {
+        memcpy(p_list, chunk->args, sizeof(char *) * chunk->cnt);
+        p_list += chunk->cnt;
+    }
+    *p_list = NULL;
+    return list;
+}
+
+/* ---- functions of SAPArena ---- */
 
 /* ++++ functions of Flags ++++ */
 
 void init_flag(Flag *flag, const char *flag_name, const char shorthand, const char *usage, void *dft_val) {
     assert(flag != NULL);
     flag->flag_name = flag_name;
+    flag->name_id = sap_str_intern(&namePool, flag_name, strlen(flag_name));
     flag->shorthand = shorthand;
     flag->usage = usage;
     flag->value = dft_val;
+    flag->dft_value = dft_val;
     flag->type = single_arg;
+    flag->choices = NULL;
+    flag->aliases = NULL;
+    flag->env_name = NULL;
+    flag->config_key = NULL;
+    flag->repeat = repeat_last;
 }
 
 SAPCommand *add_flag(SAPCommand *cmd, Flag *flag) {
@@ -51,11 +552,21 @@ SAPCommand *add_flag(SAPCommand *cmd, Flag *flag) {
     }
     /* add the flag to the command's flag list and increment the flag counter */
     cmd->flags[cmd->flag_cnt++] = flag;
+    /* the index is out of date now, it will be rebuilt on the next lookup */
+    free(cmd->flag_index);
+    cmd->flag_index = NULL;
+    if (cmd->constraints != NULL) {
+        cmd->constraints->compiled = 0;     /* so are the masks of the constraints */
+    }
     /* return the command pointer */
     return cmd;
 }
 
 SAPCommand *add_default_flag(SAPCommand *cmd, Flag *flag) {
+    /* the positional slots replace the default flag */
+    if (cmd->positionals != NULL) {
+        return NULL;
+    }
     /* call the add_flag function and check the return value */
     if (add_flag(cmd, flag) == NULL) {
         /* if the add_flag function returns NULL, return NULL */
@@ -66,6 +577,47 @@ SAPCommand *add_default_flag(SAPCommand *cmd, Flag *flag) {
     return cmd;
 }
 
+int add_positional(SAPCommand *cmd, const char *name, const char *usage, PositionalType type, int min_cnt, int max_cnt) {
+    assert(cmd != NULL);
+    assert(name != NULL);
+    assert(min_cnt >= 0);
+
+    if (cmd->default_flag != NULL || (max_cnt != -1 && (max_cnt < 1 || max_cnt < min_cnt))) {
+        return -1;
+    }
+    SAPPositionals *schema = cmd->positionals;
+    if (schema != NULL && schema->cnt > 0) {
+        const int last = schema->cnt - 1;
+        if (schema->cnt == MAX_POS_COUNT || schema->slots[last].max_cnt != 1 || (schema->slots[last].min_cnt == 0 && min_cnt > 0)) {
+            /* full, after a variadic tail, or a required slot after an optional one */
+            return -1;
+        }
+    }
+    if (schema == NULL) {
+        schema = (SAPPositionals *) calloc(1, sizeof(SAPPositionals));
+        assert(schema != NULL);
+        cmd->positionals = schema;
+    }
+
+    int slot = schema->cnt++;
+    schema->slots[slot].name = name;
+    schema->slots[slot].usage = usage;
+    schema->slots[slot].name_id = sap_str_intern(&namePool, name, strlen(name));
+    schema->slots[slot].type = type;
+    schema->slots[slot].min_cnt = min_cnt;
+    schema->slots[slot].max_cnt = max_cnt;
+    return slot;
+}
+
+static int has_flag(Flag *const flags[], int cnt, const Flag *flag) {
+    for (int i = 0; i < cnt; i++) {
+        if (flags[i] == flag) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 int add_persist_flag(SAPCommand *cmd, Flag *flag) {
     assert(cmd != NULL);
     assert(flag != NULL);
@@ -76,6 +628,11 @@ int add_persist_flag(SAPCommand *cmd, Flag *flag) {
     int stack_select = 0;                   /* select the available stack*/
     int fail_cnt = 0;
 
+    /* remember the flag, the subcommands of the lazy commands don't exist yet */
+    if (!has_flag(persistFlags, persistCnt, flag) && persistCnt < MAX_OPT_COUNT) {
+        persistFlags[persistCnt++] = flag;
+    }
+
     /* push the root into stack */
     stack[++top[stack_select]][stack_select] = &(rootCmd.tree_node);
 
@@ -109,156 +666,654 @@ void set_flag_type(Flag *flag, FlagType type) {
     /* if the flag already has a value and the new type is multi-argument */
     if (flag->value != NULL && type == multi_arg) {
         /* print a warning message */
-        printf("Warning: the flag %s is already set, but its type is changed to multi_arg\n", flag->flag_name);
+        SAPOutput *err_out = sap_get_output(sap_err_channel);
+        out_printf(err_out, "Warning: the flag %s is already set, but its type is changed to multi_arg\n", flag->flag_name);
+        sap_output_flush(err_out);
         /* set the flag's value to NULL */
         flag->value = NULL;
+        flag->dft_value = NULL;
     }
     /* NOTE: test the no_arg when value is set */
     /* set the flag's type */
     flag->type = type;
 }
 
-Flag *get_flag(SAPCommand *cmd, const char *flag_name) {
-    assert(cmd != NULL);       /* ensure the command is not NULL. */
-    assert(flag_name != NULL); /* ensure the flag name is not NULL. */
+void set_flag_repeat(Flag *flag, FlagRepeat repeat) {
+    assert(flag != NULL);
+    /* only no_arg flags are counted, and only the flags receiving values are appended */
+    assert(repeat == repeat_last || (repeat == repeat_count) == (flag->type == no_arg));
+    flag->repeat = (unsigned char) repeat;
+}
 
-    /* iterate through all flags in the command */
-    for (int i = 0; i < cmd->flag_cnt; i++) {
-        /* compare the flag name with the current flag */
-        if (strcmp(cmd->flags[i]->flag_name, flag_name) == 0) {
-            return cmd->flags[i]; // Return the matching flag.
-        }
-    }
-    return NULL; /* return NULL if no matching flag is found */
+void set_flag_env(Flag *flag, const char *env_name) {
+    assert(flag != NULL);
+    flag->env_name = env_name;
 }
 
-Flag *get_flag_by_shorthand(SAPCommand *cmd, char shorthand) {
-    assert(cmd != NULL);       /* ensure the command is not NULL */
-    assert(shorthand != '\0'); /* ensure the shorthand character is valid */
+void set_flag_config_key(Flag *flag, const char *key) {
+    assert(flag != NULL);
+    flag->config_key = key;
+}
 
-    /* iterate through all flags in the command */
-    for (int i = 0; i < cmd->flag_cnt; i++) {
-        /* compare the shorthand character with the current flag */
-        if (cmd->flags[i]->shorthand == shorthand) {
-            return cmd->flags[i]; /* return the matching flag */
-        }
+/**
+ * @brief append an alias to the aliases of a command or a flag, allocated on the first one.
+ *
+ * @return int - 0 if succeed, -1 if there're MAX_ALIAS_COUNT aliases already.
+ */
+static int append_alias(SAPAliases **aliases, const char *name, char shorthand) {
+    if (*aliases == NULL) {
+        *aliases = (SAPAliases *) calloc(1, sizeof(SAPAliases));
+        assert(*aliases != NULL);
+    }
+    SAPAliases *list = *aliases;
+    if (list->cnt == MAX_ALIAS_COUNT) {
+        return -1;
     }
-    return NULL; /* return NULL if no matching flag is found */
+    list->names[list->cnt] = name;
+    list->name_ids[list->cnt] = (name == NULL) ? SAP_NIL : sap_str_intern(&namePool, name, strlen(name));
+    list->shorthands[list->cnt] = shorthand;
+    list->cnt++;
+    return 0;
 }
 
-/* ---- functions of Flags ----*/
-
-
-
-/* ++++ functions of TreeNode ++++ */
-
-static void init_tree_node(TreeNode *node) {
-    if (node == NULL) {
-        return;
+int add_flag_alias(Flag *flag, const char *name, char shorthand) {
+    assert(flag != NULL);
+    assert(name != NULL || shorthand != '\0');
+    if (append_alias(&flag->aliases, name, shorthand) != 0) {
+        return -1;
     }
 
-    node->child_cnt = 0;
-    node->depth = 0;
-    node->parent = NULL;
+    /* the flag indices of the commands holding the flag are out of date now */
+    uint32_t cmd_cnt;
+    SAPCommand **cmds = collect_cmds_bfs(&rootCmd, 0, &cmd_cnt);
+    for (uint32_t i = 0; i < cmd_cnt; i++) {
+        if (cmds[i]->flag_index != NULL && get_flag_pos(cmds[i], flag) >= 0) {
+            free(cmds[i]->flag_index);
+            cmds[i]->flag_index = NULL;
+        }
+    }
+    free(cmds);
+    return 0;
+}
 
-    node->children = (TreeNode **) calloc(sizeof(TreeNode *), MAX_SUBCMD_COUNT);
+/**
+ * @brief the slot of a hashed string in a choice table of (1 << bits) slots.
+ */
+static uint32_t choice_slot(uint64_t hash, uint64_t seed, int bits) {
+    return (uint32_t) (((hash ^ seed) * 0xff51afd7ed558ccdULL) >> (64 - bits));
 }
 
-static int get_max_depth(TreeNode *node) {
-    int max_depth = 0;
-    if (node == NULL) { /* this branch won't be executed */
-        return max_depth;
+/**
+ * @brief find the seed of a perfect hash of the choices, the table grows until one is found.
+ *
+ * @param[in] hashes    - the hashes of the choices.
+ * @param[in] cnt       - the number of the choices.
+ * @param[out] out_bits - the size of the table, in bits.
+ * @return uint64_t     - the seed.
+ */
+static uint64_t choice_find_seed(const uint64_t hashes[], int cnt, int *out_bits) {
+    int bits = 1;
+    while ((1 << bits) < 2 * cnt) {
+        bits++;
     }
 
-    /* get the max depth of all children */
-    for (int i = 0; i < node->child_cnt; i++) {
-        int child_depth = get_max_depth(node->children[i]);
-        if (child_depth > max_depth) {
-            max_depth = child_depth;
+    for (; ; bits++) {
+        assert(bits <= 24);
+        unsigned char *used = (unsigned char *) malloc((size_t) 1 << bits);
+        assert(used != NULL);
+        for (uint64_t k = 0; k < 64; k++) {
+            uint64_t seed = k * 0x9e3779b97f4a7c15ULL;
+            int i = 0;
+            memset(used, 0, (size_t) 1 << bits);
+            while (i < cnt && !used[choice_slot(hashes[i], seed, bits)]) {
+                used[choice_slot(hashes[i], seed, bits)] = 1;
+                i++;
+            }
+            if (i == cnt) {
+                free(used);
+                *out_bits = bits;
+                return seed;
+            }
         }
+        free(used);
     }
-    return max_depth + 1;
 }
 
-// static void recursive_adjust_depth(int depth2add, TreeNode *node) {
-//     if (node == NULL) {
-//         return;
-//     }
-//     node->depth += depth2add;
-//     for (int i = 0; i < node->child_cnt; i++) {
-//         recursive_adjust_depth(depth2add, node->children[i]);
-//     }
-// }
+/**
+ * @brief look up a value in the choices.
+ *
+ * @return const char* - the canonical string of the choice, NULL if the value isn't a choice.
+ */
+static const char *lookup_choice(const SAPChoiceTable *table, const char *value) {
+    int slot = table->slots[choice_slot(hash_str(value, strlen(value)), table->seed, table->bits)];
+    if (slot == 0 || strcmp(table->names[slot - 1], value) != 0) {
+        return NULL;
+    }
+    return table->names[slot - 1];
+}
 
-static void non_recursive_adjust_depth(int depth2add, TreeNode *node) {
-    if (node == NULL) return;
+void set_flag_choices(Flag *flag, const char *choices[]) {
+    assert(flag != NULL);
+    assert(flag->type != no_arg);
 
-    /* use stack instead of recursion */
-    TreeNode *stack[MAX_CMD_DEPTH];  /* the maximum depth of the tree is MAX_CMD_DEPTH */
-    int top = -1;
+    free(flag->choices);
+    flag->choices = NULL;
+    if (choices == NULL) {
+        return;
+    }
 
-    stack[++top] = node;  /* push the root node */
-    while (top >= 0) {
-        TreeNode *current = stack[top--];
-        current->depth += depth2add + 1;
+    int cnt = 0;
+    size_t pool_len = 0;
+    while (choices[cnt] != NULL) {
+        pool_len += strlen(choices[cnt]) + 2;   /* the id byte, the string and its terminator */
+        cnt++;
+    }
+    assert(cnt > 0 && cnt <= 255);
 
-        for (int i = 0; i < current->child_cnt; i++) {
-            stack[++top] = current->children[i];    /* push the children nodes */
+    uint64_t hashes[cnt];
+    for (int i = 0; i < cnt; i++) {
+        hashes[i] = hash_str(choices[i], strlen(choices[i]));
+        for (int j = 0; j < i; j++) {
+            assert(strcmp(choices[i], choices[j]) != 0);    /* the duplicated choices have no perfect hash */
         }
     }
-}
-
-static int adjust_depth_with_add(int depth2add, TreeNode *subtree_root) {
-    if (subtree_root == NULL) {
-        return 0;
+    int bits;
+    uint64_t seed = choice_find_seed(hashes, cnt, &bits);
+
+    /* the table, the names, the slots and the pool are in a single block */
+    size_t slot_cnt = (size_t) 1 << bits;
+    SAPChoiceTable *table = (SAPChoiceTable *) malloc(sizeof(SAPChoiceTable) + sizeof(char *) * cnt + slot_cnt + pool_len);
+    assert(table != NULL);
+    table->seed = seed;
+    table->bits = bits;
+    table->cnt = cnt;
+    table->names = (const char **) (table + 1);
+    table->slots = (unsigned char *) (table->names + cnt);
+    table->pool = (const char *) (table->slots + slot_cnt);
+    table->pool_len = pool_len;
+    memset(table->slots, 0, slot_cnt);
+
+    char *p_pool = (char *) table->pool;
+    for (int i = 0; i < cnt; i++) {
+        size_t len = strlen(choices[i]);
+        *p_pool++ = (char) i;
+        memcpy(p_pool, choices[i], len + 1);
+        table->names[i] = p_pool;
+        table->slots[choice_slot(hashes[i], seed, bits)] = (unsigned char) (i + 1);
+        p_pool += len + 1;
     }
-    if (get_max_depth(subtree_root) + depth2add > MAX_CMD_DEPTH) {
-        return -1;
+    flag->choices = table;
+
+    /* the default value is canonical as the parsed ones */
+    if (flag->type == single_arg && flag->dft_value != NULL) {
+        const char *dft = lookup_choice(table, (const char *) flag->dft_value);
+        assert(dft != NULL);    /* the default value must be one of the choices */
+        if (flag->value == flag->dft_value) {
+            flag->value = (void *) dft;
+        }
+        flag->dft_value = (void *) dft;
     }
-
-    /* adjust all the depth or not */
-    non_recursive_adjust_depth(depth2add, subtree_root);
-    return 1;
 }
 
-static int adjust_depth(TreeNode *parent, TreeNode *subtree_root) {
-    return adjust_depth_with_add(parent->depth, subtree_root);
-}
+int sap_choice_id(const Flag *flag, const char *value) {
+    assert(flag != NULL);
 
-static TreeNode *append_child(TreeNode *parent, TreeNode *child) {
-    if (parent == NULL ||
-        child == NULL ||
-        parent->child_cnt >= MAX_SUBCMD_COUNT
-    ) {
-        return NULL;
+    const SAPChoiceTable *table = flag->choices;
+    if (table == NULL || value == NULL) {
+        return -1;
     }
-    assert(parent->children != NULL);
-    if (adjust_depth(parent, child) != 1) {
-        return NULL;
+    if (value > table->pool && value < table->pool + table->pool_len) {
+        return (unsigned char) value[-1];       /* a canonical string */
     }
-    child->parent = parent;
-    parent->children[parent->child_cnt++] = child;
-
-    return parent;
+    const char *name = lookup_choice(table, value);
+    return (name == NULL) ? -1 : (unsigned char) name[-1];
 }
 
-static void free_node_tree(TreeNode *root) {
-    if (root == NULL) {
-        return;
-    }
-
-    for (int i = 0; i < root->child_cnt; i++) {
-        free_node_tree(root->children[i]);
+/**
+ * @brief insert a long name into the sorted names of a flag index.
+ *
+ * insertion sort, the former entry stays in front when names are duplicated, so the names of the flags
+ * (inserted first) stay in front of the extra names.
+ */
+static void insert_flag_name(SAPFlagIndex *index, const char *name, int flag) {
+    int j = index->name_cnt++;
+    while (j > 0 && strcmp(index->by_name[j - 1].name, name) > 0) {
+        index->by_name[j] = index->by_name[j - 1];
+        j--;
     }
-
-    free(root->children);
+    index->by_name[j] = (SAPFlagName) {name, flag};
 }
 
-/* ---- functions of TreeNode ---- */
+/**
+ * @brief get the lookup index of the flags of a command, build it if it's not built yet.
+ *
+ * @param cmd               - the command whose flags are indexed
+ * @return SAPFlagIndex*    - the index of the flags
+ */
+static SAPFlagIndex *get_flag_index(SAPCommand *cmd) {
+    assert(cmd != NULL);
 
+    if (cmd->flag_index != NULL) {
+        return cmd->flag_index;
+    }
 
+    int alias_cnt = 0;
+    for (int i = 0; i < cmd->flag_cnt; i++) {
+        alias_cnt += (cmd->flags[i]->aliases == NULL) ? 0 : cmd->flags[i]->aliases->cnt;
+    }
+    /* the aliases, then the sorted names, in the block of the index */
+    SAPFlagIndex *index = NULL;
+    size_t alias_size = sizeof(index->aliases[0]) * (size_t) alias_cnt;
+    size_t name_size = sizeof(SAPFlagName) * (size_t) (cmd->flag_cnt + alias_cnt);
+    index = (SAPFlagIndex *) calloc(1, sizeof(SAPFlagIndex) + alias_size + name_size);
+    assert(index != NULL);
+    index->by_name = (SAPFlagName *) ((char *) (index + 1) + alias_size);
 
-/* ++++ functions of SAPCommand ++++ */
+    for (int i = 0; i < cmd->flag_cnt; i++) {
+        unsigned char ch = (unsigned char) cmd->flags[i]->shorthand;
+        /* the former flag wins when shorthands are duplicated (check_shorthand warns about it) */
+        if (ch != '\0' && index->by_shorthand[ch] == 0) {
+            index->by_shorthand[ch] = (unsigned char) (i + 1);
+        }
+        index->name_ids[i] = cmd->flags[i]->name_id;
+        insert_flag_name(index, cmd->flags[i]->flag_name, i);
+
+        /* the flags with fallbacks, and the hashed names of the environment variables */
+        const Flag *flag = cmd->flags[i];
+        if (flag->env_name != NULL || flag->config_key != NULL) {
+            index->fallbacks[index->fallback_cnt++] = (unsigned char) i;
+        }
+        if (flag->env_name != NULL) {
+            uint64_t hash = hash_str(flag->env_name, strlen(flag->env_name));
+            unsigned slot = (unsigned) hash & 255;
+            while (index->env_slots[slot] != 0) {
+                slot = (slot + 1) & 255;    /* never full, there're less than 256 flags */
+            }
+            index->env_slots[slot] = (unsigned char) (i + 1);
+            index->env_hashes[i] = (uint32_t) hash;
+            index->env_cnt++;
+        }
+    }
+
+    /* the aliases after all the names and shorthands, so they never shadow them */
+    for (int i = 0; i < cmd->flag_cnt; i++) {
+        const SAPAliases *aliases = cmd->flags[i]->aliases;
+        for (int k = 0; aliases != NULL && k < aliases->cnt; k++) {
+            unsigned char ch = (unsigned char) aliases->shorthands[k];
+            if (ch != '\0' && index->by_shorthand[ch] == 0) {
+                index->by_shorthand[ch] = (unsigned char) (i + 1);
+            }
+            if (aliases->name_ids[k] != SAP_NIL) {
+                index->aliases[index->alias_cnt].name_id = aliases->name_ids[k];
+                index->aliases[index->alias_cnt++].flag = i;
+                insert_flag_name(index, aliases->names[k], i);
+            }
+        }
+    }
+
+    cmd->flag_index = index;
+    return index;
+}
+
+/**
+ * @brief find a flag by the interned id of its name or of an alias, in the entries of the index.
+ *
+ * @return int - the index of the flag in flags, -1 if none has the name.
+ */
+static int find_flag_entry(const SAPFlagIndex *index, int flag_cnt, uint32_t name_id) {
+    if (name_id == SAP_NIL) {
+        return -1;
+    }
+    for (int i = 0; i < flag_cnt; i++) {
+        if (index->name_ids[i] == name_id) {
+            return i;
+        }
+    }
+    for (int k = 0; k < index->alias_cnt; k++) {
+        if (index->aliases[k].name_id == name_id) {
+            return index->aliases[k].flag;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief find the range of the long names (the extra ones included) starting with the given prefix.
+ *
+ * the range is located by two binary searches on the sorted names of the index.
+ *
+ * @param[in] cmd       - the command whose flags are searched.
+ * @param[in] prefix    - the prefix of the flag name, not necessarily null-terminated.
+ * @param[in] len       - the length of the prefix.
+ * @param[out] out_lo   - the first position (in index->by_name) of the range.
+ * @param[out] out_hi   - the position after the last one of the range.
+ */
+static void get_flag_range(SAPCommand *cmd, const char *prefix, size_t len, int *out_lo, int *out_hi) {
+    SAPFlagIndex *index = get_flag_index(cmd);
+    #define NAME_AT(pos) index->by_name[pos].name
+    int lo = 0, hi = index->name_cnt;
+
+    /* the first name not less than the prefix */
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strncmp(NAME_AT(mid), prefix, len) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *out_lo = lo;
+
+    /* the first name greater than the prefix (and not starting with it) */
+    hi = index->name_cnt;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strncmp(NAME_AT(mid), prefix, len) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *out_hi = lo;
+    #undef NAME_AT
+}
+
+/**
+ * @brief record the error of the running parse, the index of the argument is filled by sap_parse.
+ *
+ * @param[in] code          - the error code.
+ * @param[in] expected      - what was expected at the error.
+ * @param[in] byte_offset   - the offset of the erroneous byte in the argument.
+ * @param[in] flag          - the flag involved, NULL if none.
+ */
+static void set_parse_err(ParseErr code, ExpectedKind expected, int byte_offset, const Flag *flag) {
+    parseErr.code = code;
+    parseErr.expected = expected;
+    parseErr.byte_offset = byte_offset;
+    parseErr.flag_id = (flag == NULL) ? SAP_NIL : flag->name_id;
+}
+
+/**
+ * @brief check a value given to a flag against its choices.
+ *
+ * @param[in] flag          - the flag.
+ * @param[in] value         - the value.
+ * @param[in] byte_offset   - the offset of the value in its argument, for the error.
+ * @return char*            - the canonical string of the choice, the value itself if the flag isn't a choice flag,
+ *                            or NULL if the value isn't a choice (the parse error is set).
+ */
+static char *check_choice(const Flag *flag, char *value, int byte_offset) {
+    if (flag->choices == NULL) {
+        return value;
+    }
+    const char *name = lookup_choice(flag->choices, value);
+    if (name == NULL) {
+        set_parse_err(invalid_choice, expect_choice, byte_offset, flag);
+    }
+    return (char *) name;
+}
+
+/**
+ * @brief look up a flag by its long option name, or by an unambiguous prefix of it.
+ *
+ * @param[in] cmd           - the command whose flags are searched.
+ * @param[in] name          - the name (after "--"), not necessarily null-terminated.
+ * @param[in] len           - the length of the name.
+ * @param[in] allow_prefix  - whether an unambiguous prefix is accepted.
+ * @return int             - the index of the matching flag in cmd->flags, or -1 if it's unknown or ambiguous (the parse error is set).
+ */
+static int lookup_long_flag(SAPCommand *cmd, const char *name, size_t len, int allow_prefix) {
+    SAPFlagIndex *index = get_flag_index(cmd);
+
+    /* the exact name: hash the argument once, then compare the interned ids */
+    uint32_t id = sap_str_find(name_pool(), name, len);
+    int i = find_flag_entry(index, cmd->flag_cnt, id);
+    if (i >= 0) {
+        return i;
+    }
+    if (!allow_prefix) {
+        set_parse_err(unknown_arg, expect_flag, 2, NULL);
+        return -1;
+    }
+
+    /* the unambiguous prefix: every name in the range starts with it, and none equals it */
+    int lo, hi;
+    get_flag_range(cmd, name, len, &lo, &hi);
+    if (lo == hi) {
+        set_parse_err(unknown_arg, expect_flag, 2, NULL);
+        return -1;
+    }
+
+    /* the names of a single flag (its name and aliases, or a flag added twice) aren't ambiguous */
+    int first = index->by_name[lo].flag;
+    for (int pos = lo + 1; pos < hi; pos++) {
+        if (cmd->flags[index->by_name[pos].flag] != cmd->flags[first]) {
+            set_parse_err(ambiguous_arg, expect_flag, 2, NULL);
+            return -1;
+        }
+    }
+    return first;
+}
+
+/**
+ * @brief whether unambiguous prefixes of long options are accepted in the tree of the command.
+ */
+static int is_prefix_match_on(const SAPCommand *cmd) {
+    while (cmd->tree_node.parent != NULL) {
+        cmd = node2cmd(cmd->tree_node.parent);
+    }
+    return cmd->prefix_match;
+}
+
+void set_prefix_match(SAPCommand *root, int enable) {
+    assert(root != NULL);
+    root->prefix_match = (enable != 0);
+}
+
+void set_multi_call(SAPCommand *root, int enable) {
+    assert(root != NULL);
+    root->multi_call = (enable != 0);
+}
+
+void set_cmd_passthrough(SAPCommand *cmd, int enable) {
+    assert(cmd != NULL);
+    cmd->passthrough = (enable != 0);
+}
+
+Flag *get_flag(SAPCommand *cmd, const char *flag_name) {
+    assert(cmd != NULL);       /* ensure the command is not NULL. */
+    assert(flag_name != NULL); /* ensure the flag name is not NULL. */
+
+    return get_flag_by_id(cmd, sap_name_id(flag_name));
+}
+
+Flag *get_flag_by_id(SAPCommand *cmd, uint32_t name_id) {
+    assert(cmd != NULL);
+    ensure_built(cmd);
+
+    if (name_id == SAP_NIL) {
+        return NULL;
+    }
+
+    /* compare the interned ids instead of the names, the aliases included */
+    int i = find_flag_entry(get_flag_index(cmd), cmd->flag_cnt, name_id);
+    return (i < 0) ? NULL : cmd->flags[i];
+}
+
+uint32_t sap_name_id(const char *name) {
+    assert(name != NULL);
+    return sap_str_find(name_pool(), name, strlen(name));
+}
+
+Flag *get_flag_by_shorthand(SAPCommand *cmd, char shorthand) {
+    assert(cmd != NULL);       /* ensure the command is not NULL */
+    assert(shorthand != '\0'); /* ensure the shorthand character is valid */
+    ensure_built(cmd);
+
+    /* look up the shorthand table instead of iterating through all flags */
+    SAPFlagIndex *index = get_flag_index(cmd);
+    int slot = index->by_shorthand[(unsigned char) shorthand];
+    return (slot == 0) ? NULL : cmd->flags[slot - 1];
+}
+
+/* ---- functions of Flags ----*/
+
+
+
+/* ++++ functions of TreeNode ++++ */
+
+static void init_tree_node(TreeNode *node) {
+    if (node == NULL) {
+        return;
+    }
+
+    node->child_cnt = 0;
+    node->depth = 0;
+    node->parent = NULL;
+
+    node->children = NULL;  /* allocated by append_child, leaf commands don't carry it */
+    node->in_block = 0;
+}
+
+static int get_max_depth(TreeNode *node) {
+    int max_depth = 0;
+    if (node == NULL) { /* this branch won't be executed */
+        return max_depth;
+    }
+
+    /* get the max depth of all children */
+    for (int i = 0; i < node->child_cnt; i++) {
+        int child_depth = get_max_depth(node->children[i]);
+        if (child_depth > max_depth) {
+            max_depth = child_depth;
+        }
+    }
+    return max_depth + 1;
+}
+
+/**
+ * @brief set the depths of a subtree from the depth of its root, absolute so a subtree can be moved again.
+ *
+ * a depth-first walk, the stack holds one node per level, so it's bounded by the height (checked before).
+ */
+static void set_subtree_depth(TreeNode *node, int depth) {
+    TreeNode *stack[MAX_CMD_DEPTH];
+    int next[MAX_CMD_DEPTH];    /* next[k]: the next child of stack[k] to visit */
+    int top = 0;
+
+    node->depth = depth;
+    stack[0] = node;
+    next[0] = 0;
+    while (top >= 0) {
+        TreeNode *current = stack[top];
+        if (next[top] == current->child_cnt) {
+            top--;
+            continue;
+        }
+        TreeNode *child = current->children[next[top]++];
+        child->depth = current->depth + 1;
+        stack[++top] = child;
+        next[top] = 0;
+    }
+}
+
+static int adjust_depth(TreeNode *parent, TreeNode *subtree_root) {
+    /* the call stacks of the commands hold MAX_CMD_DEPTH levels, the root included */
+    if (get_max_depth(subtree_root) + parent->depth >= MAX_CMD_DEPTH) {
+        return -1;
+    }
+    set_subtree_depth(subtree_root, parent->depth + 1);
+    return 1;
+}
+
+/* the capacity of a children array of cnt children: the power of 2 not less than cnt, capped by MAX_SUBCMD_COUNT */
+static int child_cap(int cnt) {
+    int cap = 1;
+    while (cap < cnt) {
+        cap *= 2;
+    }
+    return (cap > MAX_SUBCMD_COUNT) ? MAX_SUBCMD_COUNT : cap;
+}
+
+typedef struct SAPChildBlock_ {
+    struct SAPChildBlock_ *next;
+    TreeNode *slots[];          /* the children arrays of the commands added by add_subcmd_table */
+} SAPChildBlock;
+
+static SAPChildBlock *childBlocks = NULL;   /* the blocks of the tables added, freed by free_root_cmd */
+
+/**
+ * @brief make room for cnt children, the children array is moved out of its block if it's a part of one.
+ *
+ * @return int - 0 if succeed, -1 if it can't be allocated.
+ */
+static int reserve_children(TreeNode *node, int cnt) {
+    TreeNode **children;
+    size_t size = sizeof(TreeNode *) * (size_t) child_cap(cnt);
+    if (node->in_block) {
+        /* a part of a block isn't reallocated by itself */
+        children = (TreeNode **) malloc(size);
+        if (children != NULL) {
+            memcpy(children, node->children, sizeof(TreeNode *) * (size_t) node->child_cnt);
+        }
+    } else {
+        children = (TreeNode **) realloc(node->children, size);
+    }
+    if (children == NULL) {
+        return -1;
+    }
+    node->children = children;
+    node->in_block = 0;
+    return 0;
+}
+
+static TreeNode *append_child(TreeNode *parent, TreeNode *child) {
+    if (parent == NULL ||
+        child == NULL ||
+        parent->child_cnt >= MAX_SUBCMD_COUNT
+    ) {
+        return NULL;
+    }
+    if (adjust_depth(parent, child) != 1) {
+        return NULL;
+    }
+
+    /* the capacity of children is the power of 2 not less than child_cnt (capped by MAX_SUBCMD_COUNT) */
+    int cnt = parent->child_cnt;
+    if ((cnt == 0 || (cnt & (cnt - 1)) == 0) && reserve_children(parent, cnt + 1) != 0) {
+        return NULL;
+    }
+
+    child->parent = parent;
+    parent->children[parent->child_cnt++] = child;
+
+    return parent;
+}
+
+static void free_node_tree(TreeNode *root) {
+    if (root == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < root->child_cnt; i++) {
+        free_node_tree(root->children[i]);
+    }
+
+    if (!root->in_block) {
+        free(root->children);   /* the blocks are freed as a whole */
+    }
+    /* the node is detached, a command outliving the tree sees no parent and no children */
+    root->children = NULL;
+    root->in_block = 0;
+    root->child_cnt = 0;
+    root->parent = NULL;
+}
+
+/* ---- functions of TreeNode ---- */
+
+
+
+/* ++++ functions of SAPCommand ++++ */
 
 SAPCommand *get_parent_cmd(SAPCommand cmd) {
     if (cmd.tree_node.parent == NULL) {
@@ -276,7 +1331,7 @@ static int get_child_cmd_cnt(SAPCommand *cmd) {
     return cmd->tree_node.child_cnt;
 }
 
-static void get_cmd_stack(SAPCommand *cmd, SAPCommand *call_stack[MAX_SUBCMD_COUNT]) {
+static void get_cmd_stack(SAPCommand *cmd, SAPCommand *call_stack[MAX_CMD_DEPTH]) {
     assert(cmd != NULL);
     assert(call_stack != NULL);
     int depth = cmd->tree_node.depth;
@@ -290,26 +1345,109 @@ static void get_cmd_stack(SAPCommand *cmd, SAPCommand *call_stack[MAX_SUBCMD_COU
     }
 }
 
-static SAPCommand *find_sap_consider_flags_without_sub_root(SAPCommand *cmd, char *cmd_names[], int *out_idx) {
-    #define not_stack_select (((stack_select) == 0)? 1: 0)
-    TreeNode *stack[MAX_CMD_COUNT][2];      /* two stack cosplay a queue */
-    TreeNode *stack_top = NULL;
-    SAPCommand *crt_cmd = NULL;
-    int top[2] = {-1, -1};                  /* the top ptr of the two stack */
-    int stack_select = 0;                   /* select the available stack*/
-    int idx = 0;
+/**
+ * @brief the slot of a name id in a child index of (1 << bits) slots.
+ */
+static uint32_t child_slot(uint32_t name_id, int bits) {
+    return (name_id * 0x9E3779B1u) >> (32 - bits);
+}
 
-    assert(cmd!= NULL);
-    assert(cmd_names != NULL);
+/**
+ * @brief insert a name of a child into a child index, the former entry wins when names are duplicated.
+ */
+static void insert_child_entry(SAPChildIndex *index, uint32_t name_id, int child) {
+    uint32_t mask = (1u << index->bits) - 1;
+    uint32_t slot = child_slot(name_id, index->bits);
+    while (index->slots[slot].child != 0 && index->slots[slot].name_id != name_id) {
+        slot = (slot + 1) & mask;   /* linear probing */
+    }
+    if (index->slots[slot].child == 0) {
+        index->slots[slot].name_id = name_id;
+        index->slots[slot].child = child + 1;
+    }
+}
+
+/**
+ * @brief get the lookup index of the subcommands of a command, build it if it's not built yet.
+ *
+ * @param cmd               - the command whose subcommands are indexed, it must be built.
+ * @return SAPChildIndex*   - the index of the subcommands, their aliases included
+ */
+static SAPChildIndex *get_child_index(SAPCommand *cmd) {
+    if (cmd->child_index != NULL) {
+        return cmd->child_index;
+    }
 
+    /* the names of the children, then their aliases as extra entries pointing at the same children */
+    int entry_cnt = cmd->tree_node.child_cnt;
     for (int i = 0; i < cmd->tree_node.child_cnt; i++) {
-        stack[++top[stack_select]][stack_select] = cmd->tree_node.children[i];
+        const SAPAliases *aliases = node2cmd(cmd->tree_node.children[i])->aliases;
+        entry_cnt += (aliases == NULL) ? 0 : aliases->cnt;
+    }
+    int bits = 2;
+    while ((1 << bits) < entry_cnt * 2) {
+        bits++;
     }
+    SAPChildIndex *index = (SAPChildIndex *) calloc(1, sizeof(SAPChildIndex) + sizeof(index->slots[0]) * ((size_t) 1 << bits));
+    assert(index != NULL);
+    index->bits = bits;
 
-    while (top[stack_select] >= 0) {
-        stack_top = stack[top[stack_select]][stack_select];
-        crt_cmd = node2cmd(stack_top);   /* current command */
+    for (int i = 0; i < cmd->tree_node.child_cnt; i++) {
+        insert_child_entry(index, node2cmd(cmd->tree_node.children[i])->name_id, i);
+    }
+    for (int i = 0; i < cmd->tree_node.child_cnt; i++) {
+        const SAPAliases *aliases = node2cmd(cmd->tree_node.children[i])->aliases;
+        for (int k = 0; aliases != NULL && k < aliases->cnt; k++) {
+            insert_child_entry(index, aliases->name_ids[k], i);
+        }
+    }
 
+    cmd->child_index = index;
+    return index;
+}
+
+/**
+ * @brief find a subcommand by the interned id of its name or of an alias, one probe of the child index.
+ *
+ * @return SAPCommand* - the built subcommand, NULL if the command has no subcommand of the name.
+ */
+static SAPCommand *find_child_by_id(SAPCommand *cmd, uint32_t name_id) {
+    ensure_built(cmd);
+    if (name_id == SAP_NIL || cmd->tree_node.child_cnt == 0) {
+        return NULL;        /* no command has the name */
+    }
+
+    SAPChildIndex *index = get_child_index(cmd);
+    uint32_t mask = (1u << index->bits) - 1;
+    for (uint32_t slot = child_slot(name_id, index->bits); index->slots[slot].child != 0; slot = (slot + 1) & mask) {
+        if (index->slots[slot].name_id == name_id) {
+            SAPCommand *child = node2cmd(cmd->tree_node.children[index->slots[slot].child - 1]);
+            ensure_built(child);    /* the caller descends into the child */
+            return child;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief find a subcommand by name through the child index, O(1) whatever the number of the subcommands.
+ *
+ * @return SAPCommand* - the built subcommand, NULL if the command has no subcommand of the name.
+ */
+static SAPCommand *find_child(SAPCommand *cmd, const char *name) {
+    ensure_built(cmd);      /* the names of the subcommands of a lazy command are interned by its builder */
+    return find_child_by_id(cmd, sap_name_id(name));
+}
+
+static SAPCommand *find_sap_consider_flags_without_sub_root(SAPCommand *cmd, char *cmd_names[], int *out_idx) {
+    SAPCommand *level = cmd;    /* the command whose subcommand is looked up */
+    int idx = 0;
+
+    assert(cmd!= NULL);
+    assert(cmd_names != NULL);
+
+    ensure_built(cmd);
+    while (1) {
         if (cmd_names[idx] == NULL || cmd_names[idx][0] == '-') {
             /* if the depth is out of range or the argv[depth] is an option */
             /**
@@ -317,731 +1455,5342 @@ static SAPCommand *find_sap_consider_flags_without_sub_root(SAPCommand *cmd, cha
              * 1. the command have subcmd but is not provided
              * 2. the command have subcmd but an option is provided instead of subcmd
              */
-            SAPCommand *parent_cmd = get_parent_cmd(*crt_cmd);
-            /* exec the parent cmd, consequently depth decrease */
             if (out_idx != NULL) {
                 *out_idx = idx - 1;
             }
-            return parent_cmd;
+            return level;
         }
 
-        if (strcmp(crt_cmd->name, cmd_names[idx]) != 0) {
-            /* if current cmd isn't our target cmd or root cmd */
-            if (--top[stack_select] < 0) {
-                /* pop and judge whether the stack is empty */
-                stack_select = not_stack_select;    /* switch the stack */
-                idx++;
-            }   /* top[stack_select] == -1 */
-            continue;
-        }   /* if current cmd isn't our target cmd */
-
-        /* ++++ if current cmd is our target cmd ++++ */
-
-        if (stack_top->child_cnt == 0) {
+        /* one probe of the child index per level, the aliases are entries of it as well */
+        SAPCommand *crt_cmd = find_child(level, cmd_names[idx]);
+        if (crt_cmd == NULL) {
+            break;
+        }
+        if (crt_cmd->tree_node.child_cnt == 0) {
             /* exit of leaf nodes */
             if (out_idx != NULL) {
                 *out_idx = idx;
             }
             return crt_cmd;
         }   /* exit of leaf nodes */
-
-        /* ++++ non-leaf node ++++ */
-
-        for (int i = 0; i < stack_top->child_cnt; i++) {
-            /* push the subcmds into the other stack */
-            stack[++top[not_stack_select]][not_stack_select] = stack_top->children[i];
-        }
-
-        top[stack_select] = -1;
-        stack_select = not_stack_select;
-        idx++;
-
-        /* ---- non-leaf node ---- */
-        /* ---- if current cmd is our target cmd ---- */
-    #undef not_stack_select
-    }
+        level = crt_cmd;
+        idx++;
+    }
 
     /* ++++ exit of unknown cmds ++++ */
     if (out_idx != NULL) {
-        *out_idx = idx - 1;
+        *out_idx = idx;
     }
 
-    if (get_parent_cmd(*crt_cmd)->default_flag != NULL) {
-        *out_idx -= 1;
-        return get_parent_cmd(*crt_cmd);
+    if (level->default_flag != NULL || level->positionals != NULL) {
+        /* the unknown argument is a value of the default flag, or a positional argument */
+        if (out_idx != NULL) {
+            *out_idx -= 1;
+        }
+        return level;
     }
 
     return NULL;
 }
 
 static SAPCommand *find_sap_without_sub_root(SAPCommand *cmd, char *cmd_names[], int *out_idx) {
-    #define not_stack_select (((stack_select) == 0)? 1: 0)
-    TreeNode *stack[MAX_CMD_COUNT][2];      /* two stack cosplay a queue */
-    int top[2] = {-1, -1};                  /* the top ptr of the two stack */
-    int stack_select = 0;                   /* select the available stack*/
+    SAPCommand *level = cmd;    /* the command whose subcommand is looked up */
     int depth = 0;
 
     assert(cmd != NULL);
     assert(cmd_names != NULL);
 
-    for (int i = 0; i < cmd->tree_node.child_cnt; i++) {
-        stack[++top[stack_select]][stack_select] = cmd->tree_node.children[i];
-    }
-
-    while (top[stack_select] >= 0) {
-        TreeNode *stack_top = stack[top[stack_select]][stack_select];
-        SAPCommand *crt_cmd = node2cmd(stack_top);   /* current command */
-
+    ensure_built(cmd);
+    while (1) {
         if (cmd_names[depth] == NULL || cmd_names[depth][0] == '-') {
-            /* if the depth is out of range or the argv[depth] is an option */
-            /**
-             * that is:
-             * 1. the command have subcmd but is not provided
-             * 2. the command have subcmd but an option is provided instead of subcmd
-             */
-            SAPCommand *parent_cmd = get_parent_cmd(*crt_cmd);
-            /* exec the parent cmd, consequently depth decrease */
+            /* the command have subcmd but none is provided, exec the command itself */
             if (out_idx != NULL) {
                 *out_idx = depth - 1;
             }
-            return parent_cmd;
+            return level;
         }
 
-        if (strcmp(crt_cmd->name, cmd_names[depth]) != 0) {
-            /* if current cmd isn't our target cmd or root cmd */
-            if (--top[stack_select] < 0) {
-                /* pop and then judge whether the stack is empty */
-                stack_select = not_stack_select;    /* switch the stack */
-                depth++;
-            }   /* top[stack_select] == -1 */
-            continue;
-        }   /* if current cmd isn't our target cmd */
-
-        /* ++++ if current cmd is our target cmd ++++ */
-
-        if (stack_top->child_cnt == 0) {
+        SAPCommand *crt_cmd = find_child(level, cmd_names[depth]);
+        if (crt_cmd == NULL) {
+            break;
+        }
+        if (crt_cmd->tree_node.child_cnt == 0) {
             /* exit of leaf nodes */
             if (out_idx != NULL) {
                 *out_idx = depth;
             }
             return crt_cmd;
         }   /* exit of leaf nodes */
+        level = crt_cmd;
+        depth++;
+    }
 
-        /* ++++ non-leaf node ++++ */
+    /* ++++ exit of unknown cmds ++++ */
+    if (out_idx != NULL) {
+        *out_idx = depth;
+    }
+    return NULL;
+}
 
-        for (int i = 0; i < stack_top->child_cnt; i++) {
-            /* push the subcmds into the other stack */
-            stack[++top[not_stack_select]][not_stack_select] = stack_top->children[i];
+/**
+ * @brief find the appropriate SAPCommand based on command names.
+ *
+ * this function descends the command tree level by level, a probe of the child index
+ * per level, to find the matching command. It performs strict command matching without
+ * considering default flags, returning NULL when an unknown command is encountered.
+ *
+ * @param[in] cmd           - a pointer to the root SAPCommand to start searching from.
+ * @param[in] cmd_names     - an array of command name strings to match against.
+ * @param[out] out_idx      - a pointer to store the index of the found command in cmd_names (can be NULL).
+ * @return SAPCommand* returns a pointer to the matching command, or NULL if no
+ *                    exact match is found.
+ *
+ * NOTE: the first element of $cmd_names must be corresponding to $cmd, but it will be ignored by the realization
+ */
+static SAPCommand *find_sap(SAPCommand *cmd, char *cmd_names[], int *out_idx) {
+    SAPCommand *ret = find_sap_without_sub_root(cmd, cmd_names + 1, out_idx);
+    if (out_idx != NULL) {
+        *out_idx += 1;
+    }
+    return ret;
+}
+
+/**
+ * @brief find the appropriate SAPCommand based on command names, considering default flags.
+ *
+ * this function descends the command tree level by level, a probe of the child index
+ * per level, to find the matching command. When an unknown command is encountered, it checks
+ * if the parent command has a default flag. If so, it returns the parent command
+ * to allow the unknown argument to be processed as value of the default flag.
+ *
+ * @param[in] cmd           - a pointer to the root SAPCommand to start searching from.
+ * @param[in] cmd_names     - an array of command name strings to match against.
+ * @param[out] out_idx      - a pointer to store the index of the found command in cmd_names (can be NULL).
+ * @return SAPCommand* returns a pointer to the matching command, or the parent
+ *                    command if it has a default flag, or NULL if no match is found.
+ *
+ * NOTE: the first element of $cmd_names must be corresponding to $cmd, but it will be ignored by the realization
+ */
+static SAPCommand *find_sap_consider_flags(SAPCommand *cmd, char *cmd_names[], int *out_idx) {
+    SAPCommand *ret = find_sap_consider_flags_without_sub_root(cmd, cmd_names + 1, out_idx);
+    if (out_idx != NULL) {
+        *out_idx += 1;
+    }
+    return ret;
+}
+
+/**
+ * @brief the entry point of a multi-call binary: the subcommand of the root named by the basename of argv[0].
+ *
+ * @param[in] root      - the root command, of the tree or of a tree version.
+ * @param[in] arg0      - argv[0].
+ * @return SAPCommand*  - the built subcommand, NULL if multi-call is off or argv[0] names no subcommand.
+ */
+static SAPCommand *find_entry_cmd(SAPCommand *root, const char *arg0) {
+    if (root->multi_call == 0) {
+        return NULL;
+    }
+    const char *base = strrchr(arg0, '/');
+    SAPCommand *entry = find_child(root, (base == NULL) ? arg0 : base + 1);
+    return (entry != NULL && entry->origin == &helpCmd) ? NULL : entry;
+}
+
+typedef enum {
+    error_option = -1,
+    normal_arg = 0,
+    short_option = 1,
+    long_option = 2,
+    long_option_with_equal = 3,
+    end_of_options = 4,
+} ArgType;
+
+static ArgType get_option_type(const char *arg) {
+    if (
+        (arg[0] == '-' && arg[1] == '\0') ||                        /* '-'      short option without flag name */
+        (arg[0] == '-' && arg[1] == '-' && arg[2] == '=')           /* '--='    long option with only equal */
+    ) {                                             /* if the arg is an error option */
+        return error_option;
+    } else if (arg[0] == '-' && arg[1] == '-' && arg[2] == '\0') {  /* '--' ends the options */
+        return end_of_options;
+    } else if (arg[0] == '-' && arg[1] == '-') {    /* if the arg is a long option */
+        if (strchr(arg, '=') != NULL) {             /* if the arg is a long option with '=' */
+            return long_option_with_equal;
         }
+        return long_option;
+    } else if (arg[0] == '-' && arg[1] != '\0') {   /* if the arg is a short option or a cluster of them ('-rvf') */
+        return short_option;
+    } else {                                        /* if the arg is a normal arg */
+        return normal_arg;
+    }
+}
 
-        top[stack_select] = -1;
-        stack_select = not_stack_select;
-        depth++;
+/**
+ * @brief mark a no_arg flag as provided, a repeat_count flag counts the occurrence in $chain.
+ */
+static void mark_provided(const Flag *flag, void **value, SAPArgChain *chain, SAPArena *arena) {
+    if (flag->repeat != repeat_count) {
+        /* set its value to the address of IS_PROVIDED */
+        *value = (void *) &IS_PROVIDED;
+        return;
+    }
+    if (chain->total++ == 0) {
+        *value = arena_alloc(arena, sizeof(int));
+    }
+    *(int *) *value = chain->total;
+}
 
-        /* ---- non-leaf node ---- */
-        /* ---- if current cmd is our target cmd ---- */
-    #undef not_stack_select
+/**
+ * @brief assign the argument(s) of the command line to a flag.
+ *
+ * no_arg flags are marked as provided, single_arg flags take the attached argument or the next one,
+ * multi_arg flags take the attached argument (if any) and all the following normal args.
+ * the arguments of a repeat_append flag are appended to its chain, the list is made after the parse.
+ *
+ * @param[in] flag          - the flag to be assigned.
+ * @param[out] value        - the value slot of the flag in the parse result.
+ * @param[in,out] chain     - the accumulated arguments (or count) of the flag.
+ * @param[in,out] arena     - the arena of the parse result.
+ * @param[in] attached      - the argument attached to a short option (e.g. "file" of "-ofile"), NULL if none.
+ * @param[in] argc          - the number of command line arguments.
+ * @param[in] argv          - the array of command line arguments.
+ * @param[in,out] p_argv    - the index of the option, it's moved to the last consumed argument.
+ * @return int              - 0 if succeed, -1 if there are too few arguments or a value isn't a choice of the flag
+ *                            (the parse error is set, $p_argv is the erroneous argument).
+ */
+static int assign_flag(const Flag *flag, void **value, SAPArgChain *chain, SAPArena *arena,
+                       char *attached, const int argc, char *argv[], int *p_argv) {
+    if (flag->type == no_arg) {
+        mark_provided(flag, value, chain, arena);
+        return 0;
     }
 
-    /* ++++ exit of unknown cmds ++++ */
-    if (out_idx != NULL) {
-        *out_idx = depth - 1;
+    char *choice;
+    if (flag->type == single_arg) {
+        if (attached != NULL) {
+            choice = check_choice(flag, attached, (int) (attached - argv[*p_argv]));
+        } else if (*p_argv + 1 >= argc || get_option_type(argv[*p_argv + 1]) != normal_arg) {
+            set_parse_err(too_few_args, expect_arg, 0, flag);
+            return -1;
+        } else {
+            choice = check_choice(flag, argv[++(*p_argv)], 0);
+        }
+        if (choice == NULL) {
+            return -1;
+        }
+        if (flag->repeat == repeat_append) {
+            chain_push(arena, chain, choice);
+        } else {
+            *value = choice;
+        }
+        return 0;
     }
-    return NULL;
+
+    /* multi_arg: collect the arguments until an option is encountered */
+    int arg_cnt = 0;
+    char *arg_stack[(flag->repeat == repeat_append) ? 1 : argc + 1];
+    #define COLLECT_ARG(arg, byte_offset)                                   \
+        do {                                                                \
+            if ((choice = check_choice(flag, (arg), (byte_offset))) == NULL) {  \
+                return -1;                                                  \
+            }                                                               \
+            if (flag->repeat == repeat_append) {                            \
+                chain_push(arena, chain, choice);                           \
+            } else {                                                        \
+                arg_stack[arg_cnt] = choice;                                \
+            }                                                               \
+            arg_cnt++;                                                      \
+        } while (0)
+    if (attached != NULL) {
+        COLLECT_ARG(attached, (int) (attached - argv[*p_argv]));
+    }
+    while (*p_argv + 1 < argc && get_option_type(argv[*p_argv + 1]) == normal_arg) {
+        COLLECT_ARG(argv[++(*p_argv)], 0);
+    }
+    #undef COLLECT_ARG
+
+    if (arg_cnt == 0) {
+        set_parse_err(too_few_args, expect_args, 0, flag);
+        return -1;
+    }
+    if (flag->repeat == repeat_append) {
+        return 0;
+    }
+
+    /* copy the collected arguments to the flag's value, the list of a former occurrence stays in the arena */
+    char **arg_list = (char **) arena_alloc(arena, sizeof(char *) * (arg_cnt + 1));
+    memcpy(arg_list, arg_stack, sizeof(char *) * arg_cnt);
+    /* add NULL to the end of the argument list as a terminator */
+    arg_list[arg_cnt] = NULL;
+    *value = arg_list;
+    return 0;
+}
+
+/**
+ * @brief get the position of a flag in the flags of a command.
+ *
+ * @return int - the index in cmd->flags, or -1 if the flag doesn't belong to the command.
+ */
+static int get_flag_pos(const SAPCommand *cmd, const Flag *flag) {
+    for (int i = 0; i < cmd->flag_cnt; i++) {
+        if (cmd->flags[i] == flag) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief check an argument against the type of a positional slot.
+ */
+static inline int check_pos_type(PositionalType type, const char *arg) {
+    if (type == pos_int) {
+        /* an optional sign and decimal digits, checked by hand as strtol is several times slower */
+        const char *p_ch = arg + (*arg == '-' || *arg == '+');
+        unsigned long limit = (*arg == '-') ? (unsigned long) LONG_MAX + 1 : (unsigned long) LONG_MAX;
+        unsigned long value = 0;
+        if (*p_ch == '\0') {
+            return 0;
+        }
+        for (; *p_ch != '\0'; p_ch++) {
+            unsigned long digit = (unsigned long) (unsigned char) (*p_ch - '0');
+            if (digit > 9 || value > (limit - digit) / 10) {
+                return 0;   /* not a digit, or out of the range of long */
+            }
+            value = value * 10 + digit;
+        }
+        return 1;
+    }
+    if (type == pos_float) {
+        char *end = NULL;
+        errno = 0;
+        (void) strtod(arg, &end);
+        return end != arg && *end == '\0' && errno != ERANGE;
+    }
+    return 1;
+}
+
+/**
+ * @brief take the slot of the next positional argument, the errors are recorded in the cursor and reported at the end.
+ *
+ * @param[in] schema    - the positional slots of the command.
+ * @param[in] cur       - the cursor, moved to the next slot when the slot is full.
+ * @param[in] arg       - the argument.
+ * @param[in] idx       - the argv index of the argument.
+ * @return int          - the slot receiving the argument, -1 if it's beyond the slots.
+ */
+static inline int pos_assign(const SAPPositionals *schema, SAPPosCursor *cur, const char *arg, int idx) {
+    int slot = cur->slot;
+    if (slot == schema->cnt) {
+        if (cur->extra_idx == 0) {
+            cur->extra_idx = idx;
+        }
+        return -1;
+    }
+    if (cur->bad_idx == 0 && !check_pos_type(schema->slots[slot].type, arg)) {
+        cur->bad_idx = idx;
+        cur->bad_slot = slot;
+    }
+    if (++cur->fill == schema->slots[slot].max_cnt) {
+        cur->slot++;
+        cur->fill = 0;
+    }
+    return slot;
 }
 
 /**
- * @brief find the appropriate SAPCommand based on command names.
- *
- * this function traverses the command tree using a breadth-first search approach
- * to find the matching command. It performs strict command matching without
- * considering default flags, returning NULL when an unknown command is encountered.
- *
- * @param[in] cmd           - a pointer to the root SAPCommand to start searching from.
- * @param[in] cmd_names     - an array of command name strings to match against.
- * @param[out] out_idx      - a pointer to store the index of the found command in cmd_names (can be NULL).
- * @return SAPCommand* returns a pointer to the matching command, or NULL if no
- *                    exact match is found.
+ * @brief report the errors of the positional arguments once they're all assigned, in the order of the default flag:
+ * the arguments beyond the slots, the arguments of wrong types, then the missing arguments.
+ *
+ * @param[in] schema    - the positional slots of the command.
+ * @param[in] cur       - the cursor after the last argument.
+ * @param[in] end_idx   - the argv index reported for a missing argument, the end of argv.
+ * @return int          - 0 if there's no error, else the argv index of the error (parseErr is set).
+ */
+static int pos_finish(const SAPPositionals *schema, const SAPPosCursor *cur, int end_idx) {
+    if (cur->extra_idx != 0) {
+        set_parse_err(too_many_args, expect_nothing, 0, NULL);
+        return cur->extra_idx;
+    }
+    if (cur->bad_idx != 0) {
+        set_parse_err(invalid_type, expect_typed, 0, NULL);
+        parseErr.flag_id = schema->slots[cur->bad_slot].name_id;
+        return cur->bad_idx;
+    }
+    /* the required slots come first, the first one short of arguments is reported */
+    for (int slot = cur->slot; slot < schema->cnt; slot++) {
+        if (schema->slots[slot].min_cnt > ((slot == cur->slot) ? cur->fill : 0)) {
+            set_parse_err(too_few_args, expect_positional, 0, NULL);
+            parseErr.flag_id = schema->slots[slot].name_id;
+            return end_idx;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief parse the flags (options) in the command line arguments.
+ *
+ * this function iterates through the command line arguments, identifies the flags,
+ * and sets the values for the corresponding flags based on their types (no argument,
+ * single argument, or multiple arguments). If an unknown flag or an error option is
+ * encountered, it returns the index of that option in the argv array.
+ *
+ * the values are stored into res->values (values[i] belongs to cmd->flags[i]) instead of the flags,
+ * so the flags which are shared by the commands and the parses are never modified.
+ *
+ * short options can be clustered in POSIX style: "-rvf" equals "-r -v -f", and the rest
+ * of a cluster after a flag receiving argument(s) is its argument ("-ofile" equals "-o file").
+ * every character of a cluster is resolved through the shorthand table of the command.
+ *
+ * the arguments which aren't options fill the positional slots of the command in the same pass, into res->positionals,
+ * or go to the default flag if the command has no slots.
+ *
+ * @param cmd a pointer to the SAPCommand structure representing the command whose
+ *            flags are to be parsed.
+ * @param argc the number of command line arguments.
+ * @param argv the array of command line arguments.
+ * @param res the parse result: its value slots are initialized with the default values, the given flags
+ *            are marked in res->given, and the argument lists are allocated from res->arena.
+ * @return int returns 0 if the parsing is successful. If an error option is found,
+ *             it returns the index of that option in the argv array.
+ */
+static int parse_flags(SAPCommand *cmd, const int argc, char *argv[], SAPParseResult *res) {
+    /* Ensure that the input parameters are not null and argc is greater than 0 */
+    assert(cmd != NULL);
+    assert(argc > 0);
+    assert(argv != NULL);
+    assert(res != NULL);
+
+    void **values = res->values;
+    SAPArena *arena = &res->arena;
+    SAPFlagMask *given = &res->given;
+
+    int p_argv = 1;
+    int unused_arg[argc];
+    int unused_cnt = 0;
+    int allow_prefix = is_prefix_match_on(cmd);
+    SAPFlagIndex *index = get_flag_index(cmd);  /* built before the handlers run, they only read it */
+    SAPArgChain chains[MAX_OPT_COUNT];          /* the occurrences of the repeatable flags */
+    memset(chains, 0, sizeof(SAPArgChain) * cmd->flag_cnt);
+    int dft_pos = (cmd->default_flag != NULL) ? get_flag_pos(cmd, cmd->default_flag) : -1;
+    int dft_append = (dft_pos >= 0 && cmd->default_flag->repeat == repeat_append);
+    const SAPPositionals *schema = cmd->positionals;
+    SAPPosCursor pos = {0};
+    char **pos_tail = NULL;                     /* the list of the variadic slot, sized by the rest of argv */
+    int tail_len = 0;
+    int operands_only = 0;                      /* whether "--" was given, the rest are operands */
+
+    while (p_argv < argc) {
+        #define CRT_ARGV argv[p_argv]
+        switch (operands_only ? normal_arg : get_option_type(CRT_ARGV))
+        {
+        case error_option:
+            set_parse_err(unknown_arg, expect_flag, 0, NULL);
+            return p_argv;
+        case end_of_options:
+            if (!cmd->passthrough) {
+                operands_only = 1;  /* the rest are operands, even if they start with '-' */
+                break;
+            }
+            /* the rest is passed through untouched, as a slice of argv */
+            res->tail_argv = argv + p_argv + 1;
+            res->tail_argc = argc - p_argv - 1;
+            p_argv = argc;
+            continue;
+        case short_option: {
+            /* resolve each character of the cluster through the shorthand table */
+            for (char *p_ch = CRT_ARGV + 1; *p_ch != '\0'; p_ch++) {
+                int slot = index->by_shorthand[(unsigned char) *p_ch];
+                if (slot == 0) {    /* unknown flag */
+                    set_parse_err(unknown_arg, expect_flag, (int) (p_ch - CRT_ARGV), NULL);
+                    return p_argv;
+                }
+
+                const Flag *flag = cmd->flags[slot - 1];
+                mask_set(given, slot - 1);
+                if (flag->type == no_arg) {
+                    mark_provided(flag, &values[slot - 1], &chains[slot - 1], arena);
+                    continue;
+                }
+
+                /* the rest of the cluster is the argument of the flag */
+                if (assign_flag(flag, &values[slot - 1], &chains[slot - 1], arena,
+                                (p_ch[1] != '\0') ? p_ch + 1 : NULL, argc, argv, &p_argv) != 0) {
+                    if (parseErr.code == too_few_args) {
+                        parseErr.byte_offset = (int) (p_ch - CRT_ARGV);     /* the flag missing its argument */
+                    }
+                    return p_argv;
+                }
+                break;
+            }
+            break;
+        }
+        case long_option: {
+            int i = lookup_long_flag(cmd, CRT_ARGV + 2, strlen(CRT_ARGV + 2), allow_prefix);
+            if (i < 0) {                /* unknown or ambiguous flag */
+                return p_argv;
+            }
+            mask_set(given, i);
+            if (assign_flag(cmd->flags[i], &values[i], &chains[i], arena, NULL, argc, argv, &p_argv) != 0) {
+                return p_argv;
+            }
+            break;
+        }
+        case long_option_with_equal: {
+            char *p_equal_ch = strchr(CRT_ARGV, '=');
+            assert(p_equal_ch != NULL);
+
+            char *flag2parse = CRT_ARGV + 2;
+            long flag2parse_len = p_equal_ch - flag2parse; /* extract the flag name */
+
+            int i = lookup_long_flag(cmd, flag2parse, (size_t) flag2parse_len, allow_prefix);
+            if (i < 0) {                /* unknown or ambiguous flag */
+                return p_argv;
+            }
+            if (cmd->flags[i]->type != single_arg) {
+                set_parse_err(illegal_equal, expect_no_value, (int) (p_equal_ch - CRT_ARGV), cmd->flags[i]);
+                return p_argv;
+            }
+            /* set the value after the equal sign as the flag's value */
+            char *choice = check_choice(cmd->flags[i], p_equal_ch + 1, (int) (p_equal_ch + 1 - CRT_ARGV));
+            if (choice == NULL) {
+                return p_argv;
+            }
+            mask_set(given, i);
+            if (cmd->flags[i]->repeat == repeat_append) {
+                chain_push(arena, &chains[i], choice);
+            } else {
+                values[i] = choice;
+            }
+            break;
+        }
+
+        default:
+            /* if the arg is a normal arg */
+            if (schema != NULL) {
+                /* assigned to its slot right away, the slots are checked once all the arguments are seen */
+                int slot = pos_assign(schema, &pos, CRT_ARGV, p_argv);
+                if (slot >= 0) {
+                    if (schema->slots[slot].max_cnt == 1) {
+                        res->positionals[slot] = CRT_ARGV;
+                    } else {
+                        if (pos_tail == NULL) {
+                            /* a single allocation, no argument after it is longer than the rest of argv */
+                            pos_tail = (char **) arena_alloc(arena, sizeof(char *) * (argc - p_argv + 1));
+                        }
+                        pos_tail[tail_len++] = CRT_ARGV;
+                    }
+                    res->pos_cnt++;
+                }
+                break;
+            }
+            if (dft_append) {
+                /* appended in order with the values given by the option of the default flag */
+                char *choice = check_choice(cmd->default_flag, CRT_ARGV, 0);
+                if (choice == NULL) {
+                    return p_argv;
+                }
+                chain_push(arena, &chains[dft_pos], choice);
+                mask_set(given, dft_pos);
+                break;
+            }
+            unused_arg[unused_cnt++] = p_argv;
+            break;
+        }
+
+        p_argv++;
+    }
+
+    #undef CRT_ARGV
+
+    /* the appended values are gathered once, each is copied a single time */
+    for (int i = 0; i < cmd->flag_cnt; i++) {
+        if (chains[i].total > 0 && cmd->flags[i]->repeat == repeat_append) {
+            values[i] = chain_list(arena, &chains[i]);
+        }
+    }
+
+    if (schema != NULL) {
+        if (pos_tail != NULL) {
+            /* the variadic tail is the last slot */
+            pos_tail[tail_len] = NULL;
+            res->positionals[schema->cnt - 1] = pos_tail;
+        }
+        return pos_finish(schema, &pos, argc);
+    }
+
+    /* if the unused args are more than 0 */
+    if (unused_cnt > 0) {
+        if (dft_pos < 0 || cmd->default_flag->type == no_arg) {
+            /* if the default flag not set */
+            set_parse_err(too_many_args, expect_nothing, 0, cmd->default_flag);
+            return unused_arg[0];
+        } else if (unused_cnt > 1 && cmd->default_flag->type == single_arg) {
+            /* if the default flag is single arg */
+            set_parse_err(too_many_args, expect_nothing, 0, cmd->default_flag);
+            return unused_arg[1];
+        } else if (cmd->default_flag->type == multi_arg) {
+            /* if the default flag is multi arg */
+            char **arg_stack = (char **) arena_alloc(arena, sizeof(char *) * (unused_cnt + 1));
+            for (int ii = 0; ii < unused_cnt; ii++) {
+                if ((arg_stack[ii] = check_choice(cmd->default_flag, argv[unused_arg[ii]], 0)) == NULL) {
+                    return unused_arg[ii];
+                }
+            }
+            arg_stack[unused_cnt] = NULL;
+            values[dft_pos] = arg_stack;
+            mask_set(given, dft_pos);
+        } else if (unused_cnt == 1 && cmd->default_flag->type == single_arg) {
+            /* if the default flag is single arg */
+            char *choice = check_choice(cmd->default_flag, argv[unused_arg[0]], 0);
+            if (choice == NULL) {
+                return unused_arg[0];
+            }
+            values[dft_pos] = choice;
+            mask_set(given, dft_pos);
+        }
+    }
+
+    if (dft_pos >= 0 && cmd->default_flag->type == no_arg && chains[dft_pos].total == 0) {
+        /* if the default flag is no arg and it isn't counted */
+        values[dft_pos] = (void *) &IS_PROVIDED;
+    }
+    // if (cmd->default_flag != NULL && cmd->default_flag->type == multi_arg && cmd->default_flag->value == NULL) {
+    //     /* if the default flag is multi arg and the value is NULL */
+    //     set_parse_err(too_few_args, expect_args, 0, cmd->default_flag);
+    //     return 1;
+    // }
+
+    return 0;
+}
+
+void print_cmd_help(SAPCommand *cmd) {
+    SAPCommand *call_stack[MAX_CMD_DEPTH];
+
+    assert(cmd != NULL);
+    ensure_built(cmd);      /* the subcommands are listed by name, they stay unbuilt */
+    get_cmd_stack(cmd, call_stack);
+    SAPOutput *out = sap_get_output(sap_out_channel);
+
+    out_printf(out, "Description: %s\n\n", cmd->short_desc);
+    if (cmd->long_desc!= NULL) {
+        out_printf(out, "%s\n\n", cmd->long_desc);
+    }
+
+    /* TODO: modify the Usage print */
+    out_printf(out, "Usage: %s", cmd->name);
+    if (cmd->tree_node.child_cnt != 0) {
+        out_printf(out, " [command]");
+    }
+    if (cmd->flag_cnt != 0) {
+        out_printf(out, " [options]");
+    }
+    const SAPPositionals *schema = cmd->positionals;
+    for (int i = 0; schema != NULL && i < schema->cnt; i++) {
+        /* <required> [optional] <variadic>... */
+        int required = schema->slots[i].min_cnt > 0;
+        out_printf(out, required ? " <%s>" : " [%s]", schema->slots[i].name);
+        if (schema->slots[i].max_cnt != 1) {
+            out_printf(out, "...");
+        }
+    }
+    out_printf(out, "\n\n");
+
+    /* print the positional arguments */
+    if (schema != NULL && schema->cnt != 0) {
+        static const char *type_names[] = {"string", "int", "float"};
+        out_printf(out, "Arguments:\n");
+        for (int i = 0; i < schema->cnt; i++) {
+            out_printf(out, "  %s\t%s (%s", schema->slots[i].name,
+                       (schema->slots[i].usage != NULL) ? schema->slots[i].usage : "", type_names[schema->slots[i].type]);
+            if (schema->slots[i].max_cnt == -1) {
+                out_printf(out, ", at least %d", schema->slots[i].min_cnt);
+            } else if (schema->slots[i].max_cnt != 1) {
+                out_printf(out, ", %d to %d", schema->slots[i].min_cnt, schema->slots[i].max_cnt);
+            } else if (schema->slots[i].min_cnt == 0) {
+                out_printf(out, ", optional");
+            }
+            out_printf(out, ")\n");
+        }
+        out_printf(out, "\n");
+    }
+
+    /* print the available subcmds */
+    if (cmd->tree_node.child_cnt != 0) {
+        out_printf(out, "Available Commands:\n");
+        for (int i = 0; i < cmd->tree_node.child_cnt; i++) {
+            SAPCommand *sub_cmd = node2cmd(cmd->tree_node.children[i]);
+            out_printf(out, "  %s", sub_cmd->name);
+            for (int k = 0; sub_cmd->aliases != NULL && k < sub_cmd->aliases->cnt; k++) {
+                out_printf(out, ", %s", sub_cmd->aliases->names[k]);
+            }
+            out_printf(out, "\t%s\n", sub_cmd->short_desc);
+        }
+        out_printf(out, "\n");
+    }
+
+    /* print the available flags */
+    if (cmd->flag_cnt != 0) {
+        out_printf(out, "Flags:\n");
+        for (int i = 0; i < cmd->flag_cnt; i++) {
+            const SAPAliases *aliases = cmd->flags[i]->aliases;
+            out_printf(out, "  ");
+            if (cmd->flags[i]->shorthand != '\0') {
+                out_printf(out, "-%c, ", cmd->flags[i]->shorthand);
+            }
+            for (int k = 0; aliases != NULL && k < aliases->cnt; k++) {
+                /* the shorthands first, then the long names, as the primary ones */
+                if (aliases->shorthands[k] != '\0') {
+                    out_printf(out, "-%c, ", aliases->shorthands[k]);
+                }
+            }
+            out_printf(out, "--%s", cmd->flags[i]->flag_name);
+            for (int k = 0; aliases != NULL && k < aliases->cnt; k++) {
+                if (aliases->names[k] != NULL) {
+                    out_printf(out, ", --%s", aliases->names[k]);
+                }
+            }
+            out_printf(out, "\t%s", cmd->flags[i]->usage);
+            if (cmd->flags[i]->choices != NULL) {
+                /* the choices in the order of their ids */
+                const SAPChoiceTable *table = cmd->flags[i]->choices;
+                for (int id = 0; id < table->cnt; id++) {
+                    out_printf(out, "%s%s", (id == 0) ? " (" : "|", table->names[id]);
+                }
+                out_printf(out, ")");
+            }
+            if (cmd->default_flag == cmd->flags[i]) {
+                out_printf(out, "\t- default flag");
+            }
+            out_printf(out, "\n");
+            /* BUG: when options are provided, the default value will be changed */
+            // if (cmd->flags[i]->value != NULL) {
+            //     out_printf(out, "    Default: %s\n", (const char *) cmd->flags[i]->value);
+            // }
+        }
+        out_printf(out, "\n");
+    }
+
+    if (get_child_cmd_cnt(cmd) > 0) {
+        int p_stack = 0;
+        out_printf(out, "Use \"");
+        while (call_stack[p_stack] != cmd) {
+            out_printf(out, "%s ", call_stack[p_stack]->name);
+            p_stack++;
+        }
+        out_printf(out, "%s [command] --help\" for more help\n", cmd->name);
+    }
+    sap_output_flush(out);  /* the whole help goes out at once */
+}
+
+/* ---- functions of SAPCommand ---- */
+
+
+
+/* ++++ functions of constraints ++++ */
+
+int add_flag_constraint(SAPCommand *cmd, FlagConstraint kind, Flag *flags[]) {
+    assert(cmd != NULL);
+    assert(flags != NULL && flags[0] != NULL);
+
+    if (cmd->constraints == NULL) {
+        cmd->constraints = (SAPConstraintSet *) calloc(1, sizeof(SAPConstraintSet));
+        assert(cmd->constraints != NULL);
+    }
+    SAPConstraintSet *set = cmd->constraints;
+    if (set->cnt == set->cap) {
+        set->cap = (set->cap == 0) ? 4 : set->cap * 2;
+        set->items = (SAPConstraint *) realloc(set->items, sizeof(SAPConstraint) * set->cap);
+        assert(set->items != NULL);
+    }
+
+    SAPConstraint *item = &set->items[set->cnt];
+    item->kind = kind;
+    item->flag_cnt = 0;
+    while (flags[item->flag_cnt] != NULL) {
+        item->flag_cnt++;
+    }
+    assert(kind != constraint_requires || item->flag_cnt >= 2);
+    item->flags = (Flag **) malloc(sizeof(Flag *) * item->flag_cnt);
+    assert(item->flags != NULL);
+    memcpy(item->flags, flags, sizeof(Flag *) * item->flag_cnt);
+
+    set->compiled = 0;
+    return set->cnt++;
+}
+
+/**
+ * @brief compile the constraints of a command into bitmasks over the indices of its flags.
+ *
+ * the required flags are merged into one mask, and the "requires" and "exclusive" constraints into
+ * a mask of needed and a mask of conflicting flags per flag, so checking a parse doesn't depend on
+ * the number of these constraints.
+ */
+static void compile_constraints(SAPCommand *cmd) {
+    SAPConstraintSet *set = cmd->constraints;
+    if (set == NULL || set->compiled) {
+        return;
+    }
+
+    memset(&set->required, 0, sizeof(SAPFlagMask));
+    memset(&set->involved, 0, sizeof(SAPFlagMask));
+    memset(set->needs, 0, sizeof(SAPFlagMask) * cmd->flag_cnt);
+    memset(set->conflicts, 0, sizeof(SAPFlagMask) * cmd->flag_cnt);
+    free(set->one_of);
+    set->one_of = (SAPFlagMask *) malloc(sizeof(SAPFlagMask) * set->cnt);
+    assert(set->one_of != NULL);
+    set->one_of_cnt = 0;
+
+    for (int k = 0; k < set->cnt; k++) {
+        SAPConstraint *item = &set->items[k];
+        int pos[item->flag_cnt];
+        memset(&item->mask, 0, sizeof(SAPFlagMask));
+        for (int j = 0; j < item->flag_cnt; j++) {
+            pos[j] = get_flag_pos(cmd, item->flags[j]);
+            assert(pos[j] >= 0);    /* the flags of a constraint must belong to the command */
+            if (item->kind != constraint_requires || j > 0) {
+                mask_set(&item->mask, pos[j]);
+            }
+        }
+
+        switch (item->kind) {
+        case constraint_required:
+            for (int w = 0; w < SAP_MASK_WORDS; w++) {
+                set->required.bits[w] |= item->mask.bits[w];
+            }
+            break;
+        case constraint_requires:
+            for (int w = 0; w < SAP_MASK_WORDS; w++) {
+                set->needs[pos[0]].bits[w] |= item->mask.bits[w];
+            }
+            mask_set(&set->involved, pos[0]);
+            break;
+        case constraint_exclusive:
+            for (int j = 0; j < item->flag_cnt; j++) {
+                for (int w = 0; w < SAP_MASK_WORDS; w++) {
+                    set->conflicts[pos[j]].bits[w] |= item->mask.bits[w];
+                }
+                set->conflicts[pos[j]].bits[pos[j] / 64] &= ~((uint64_t) 1 << (pos[j] % 64));
+                mask_set(&set->involved, pos[j]);
+            }
+            break;
+        case constraint_one_of: {
+            int j = 0;
+            while (j < set->one_of_cnt && memcmp(&set->one_of[j], &item->mask, sizeof(SAPFlagMask)) != 0) {
+                j++;
+            }
+            if (j == set->one_of_cnt) {
+                set->one_of[set->one_of_cnt++] = item->mask;
+            }
+            break;
+        }
+        }
+    }
+    set->compiled = 1;
+}
+
+/**
+ * @brief whether a constraint is violated by the given flags.
+ */
+static int is_violated(const SAPConstraint *item, const SAPFlagMask *given, const SAPCommand *cmd) {
+    int given_cnt = 0, missing_cnt = 0;
+    for (int w = 0; w < SAP_MASK_WORDS; w++) {
+        given_cnt += __builtin_popcountll(given->bits[w] & item->mask.bits[w]);
+        missing_cnt += __builtin_popcountll(~given->bits[w] & item->mask.bits[w]);
+    }
+
+    switch (item->kind) {
+    case constraint_required:
+        return missing_cnt > 0;
+    case constraint_exclusive:
+        return given_cnt > 1;
+    case constraint_one_of:
+        return given_cnt == 0;
+    case constraint_requires:
+        return missing_cnt > 0 && mask_test(given, get_flag_pos(cmd, item->flags[0]));
+    }
+    return 0;
+}
+
+/**
+ * @brief find the first violated constraint of the command in the declaration order.
+ *
+ * @return int - the index of the constraint, -1 if none is violated.
+ */
+static int find_violated_constraint(const SAPCommand *cmd, const SAPFlagMask *given) {
+    const SAPConstraintSet *set = cmd->constraints;
+    for (int k = 0; set != NULL && k < set->cnt; k++) {
+        if (is_violated(&set->items[k], given, cmd)) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief check the given flags of a parse against the constraints of the command.
+ *
+ * @return int - 0 if they are satisfied, -1 if one is violated (the parse error is set).
+ */
+static int check_constraints(SAPCommand *cmd, const SAPFlagMask *given) {
+    SAPConstraintSet *set = cmd->constraints;
+    if (set == NULL) {
+        return 0;
+    }
+    compile_constraints(cmd);
+
+    /* the word-wide checks: the missing required flags, the needed and the conflicting flags of the given ones */
+    uint64_t violated = 0;
+    for (int w = 0; w < SAP_MASK_WORDS; w++) {
+        violated |= set->required.bits[w] & ~given->bits[w];
+        uint64_t active = given->bits[w] & set->involved.bits[w];
+        while (active != 0) {
+            int i = w * 64 + __builtin_ctzll(active);
+            active &= active - 1;
+            for (int v = 0; v < SAP_MASK_WORDS; v++) {
+                violated |= (set->needs[i].bits[v] & ~given->bits[v]) | (set->conflicts[i].bits[v] & given->bits[v]);
+            }
+        }
+    }
+    for (int k = 0; violated == 0 && k < set->one_of_cnt; k++) {
+        uint64_t hit = 0;
+        for (int w = 0; w < SAP_MASK_WORDS; w++) {
+            hit |= set->one_of[k].bits[w] & given->bits[w];
+        }
+        violated = (hit == 0);
+    }
+    if (violated == 0) {
+        return 0;
+    }
+
+    /* name the first violated constraint, and its first missing (or conflicting) flag */
+    const SAPConstraint *item = &set->items[find_violated_constraint(cmd, given)];
+    int expect_more = (item->kind != constraint_exclusive);
+    const Flag *flag = item->flags[0];
+    for (int j = (item->kind == constraint_requires) ? 1 : 0; item->kind != constraint_one_of && j < item->flag_cnt; j++) {
+        if (mask_test(given, get_flag_pos(cmd, item->flags[j])) != expect_more) {
+            flag = item->flags[j];
+            break;
+        }
+    }
+    set_parse_err(violated_constraint, expect_more ? expect_flag : expect_nothing, 0, flag);
+    return -1;
+}
+
+/* ---- functions of constraints ---- */
+
+
+
+/* ++++ functions of fallbacks ++++ */
+
+static int config_slot_of(const SAPConfig *config, const char *key, size_t len, uint64_t hash) {
+    uint32_t mask = ((uint32_t) 1 << config->bits) - 1;
+    uint32_t slot = (uint32_t) hash & mask;
+    while (config->slots[slot] != 0) {
+        const SAPConfigEntry *entry = &config->entries[config->slots[slot] - 1];
+        if (entry->hash == hash && strncmp(entry->key, key, len) == 0 && entry->key[len] == '\0') {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return (int) slot;
+}
+
+/**
+ * @brief look up a key of the loaded config file.
+ *
+ * @return const char* - the value in the mapping, NULL if the key isn't found.
+ */
+static const char *config_find(const char *key) {
+    if (loadedConfig.cnt == 0) {
+        return NULL;
+    }
+    size_t len = strlen(key);
+    int slot = config_slot_of(&loadedConfig, key, len, hash_str(key, len));
+    uint32_t idx = loadedConfig.slots[slot];
+    return (idx == 0) ? NULL : loadedConfig.entries[idx - 1].value;
+}
+
+static char *trim_end(char *begin, char *end) {
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+        end--;
+    }
+    *end = '\0';
+    return begin;
+}
+
+void sap_free_config(void) {
+    if (loadedConfig.map != NULL) {
+        munmap(loadedConfig.map, loadedConfig.len);
+    }
+    free(loadedConfig.entries);
+    free(loadedConfig.slots);
+    memset(&loadedConfig, 0, sizeof(SAPConfig));
+}
+
+int sap_load_config(const char *path) {
+    assert(path != NULL);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    char *map = NULL;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    size_t len = (size_t) st.st_size;
+    if (len > 0) {
+        /**
+         * the file is mapped privately over a zeroed region one byte longer, so the last line is terminated
+         * even if it ends at a page boundary. the mapping is terminated in place, the file is never written.
+         */
+        map = (char *) mmap(NULL, len + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED || mmap(map, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            if (map != MAP_FAILED) {
+                munmap(map, len + 1);
+            }
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+
+    sap_free_config();
+    SAPConfig *config = &loadedConfig;
+    config->map = map;
+    config->len = len + 1;
+
+    /* the entries are bounded by the lines, the table keeps its load factor under 1/2 */
+    uint32_t line_cnt = 1;
+    for (size_t i = 0; i < len; i++) {
+        line_cnt += (map[i] == '\n');
+    }
+    config->entries = (SAPConfigEntry *) malloc(sizeof(SAPConfigEntry) * line_cnt);
+    assert(config->entries != NULL);
+    config->bits = 1;
+    while (((uint32_t) 1 << config->bits) < 2 * line_cnt) {
+        config->bits++;
+    }
+    config->slots = (uint32_t *) calloc((size_t) 1 << config->bits, sizeof(uint32_t));
+    assert(config->slots != NULL);
+
+    char *end = map + len;
+    for (char *line = map; line < end; ) {
+        char *eol = (char *) memchr(line, '\n', (size_t) (end - line));
+        if (eol == NULL) {
+            eol = end;  /* the last line ends at the extra zero byte of the mapping */
+        }
+        char *next = eol + 1;
+        *eol = '\0';
+
+        line += strspn(line, " \t");
+        char *equal = strchr(line, '=');
+        if (*line == '#' || *line == ';' || equal == NULL || equal == line) {
+            line = next;
+            continue;   /* comments, blank lines and lines without keys */
+        }
+        char *key = trim_end(line, equal);
+        char *value = equal + 1;
+        value += strspn(value, " \t");
+        value = trim_end(value, eol);
+        size_t value_len = strlen(value);
+        if (value_len >= 2 && value[0] == '"' && value[value_len - 1] == '"') {
+            value[value_len - 1] = '\0';
+            value++;
+        }
+
+        size_t key_len = strlen(key);
+        uint64_t hash = hash_str(key, key_len);
+        int slot = config_slot_of(config, key, key_len, hash);
+        if (config->slots[slot] != 0) {
+            config->entries[config->slots[slot] - 1].value = value;     /* the last value wins */
+        } else {
+            config->entries[config->cnt] = (SAPConfigEntry) {key, hash, value};
+            config->slots[slot] = ++config->cnt;
+        }
+        line = next;
+    }
+    return 0;
+}
+
+static int is_false_text(const char *text) {
+    static const char *falses[] = {"", "0", "false", "no", "off"};
+    for (size_t i = 0; i < sizeof(falses) / sizeof(falses[0]); i++) {
+        if (strcasecmp(text, falses[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief split a text by whitespace into a list of the arena, the text is copied since it may be read-only.
+ */
+static char **split_to_list(SAPArena *arena, const char *text, int *out_cnt) {
+    size_t len = strlen(text);
+    char *copy = (char *) arena_alloc(arena, len + 1);
+    memcpy(copy, text, len + 1);
+    char **list = (char **) arena_alloc(arena, sizeof(char *) * (len / 2 + 2));
+    int cnt = 0;
+    for (char *p = copy; *p != '\0'; ) {
+        p += strspn(p, " \t\r\n");
+        if (*p == '\0') {
+            break;
+        }
+        list[cnt++] = p;
+        p += strcspn(p, " \t\r\n");
+        if (*p != '\0') {
+            *p++ = '\0';
+        }
+    }
+    list[cnt] = NULL;
+    *out_cnt = cnt;
+    return list;
+}
+
+/**
+ * @brief the text supplying the value of a flag that isn't given on the command line.
+ */
+static const char *fallback_text(const Flag *flag, SAPValueSource source) {
+    if (source == source_env) {
+        return getenv(flag->env_name);
+    }
+    return (source == source_config) ? config_find(flag->config_key) : NULL;
+}
+
+/**
+ * @brief assign the text of a fallback to the value of the flag at $pos.
+ *
+ * @return int - 0 if succeed, -1 if the text isn't a choice of the flag (the parse error is set).
+ */
+static int assign_fallback(SAPParseResult *res, int pos, const char *text) {
+    const Flag *flag = res->cmd->flags[pos];
+    void **value = &res->values[pos];
+
+    if (flag->type == no_arg) {
+        if (flag->repeat == repeat_count) {
+            char *end;
+            long cnt = strtol(text, &end, 10);
+            cnt = (end != text && *end == '\0') ? cnt : !is_false_text(text);
+            if (cnt <= 0) {
+                return 1;
+            }
+            *value = arena_alloc(&res->arena, sizeof(int));
+            *(int *) *value = (int) cnt;
+        } else if (is_false_text(text)) {
+            return 1;
+        } else {
+            *value = (void *) &IS_PROVIDED;
+        }
+        return 0;
+    }
+
+    int cnt = 1;
+    char **list = NULL;
+    if (flag->type == multi_arg) {
+        list = split_to_list(&res->arena, text, &cnt);
+        if (cnt == 0) {
+            return 1;
+        }
+    } else if (flag->repeat == repeat_append) {
+        list = (char **) arena_alloc(&res->arena, sizeof(char *) * 2);
+        list[0] = (char *) text;
+        list[1] = NULL;
+    }
+    if (flag->choices != NULL) {
+        /* the values are replaced by the canonical strings as the ones from the command line */
+        for (int i = 0; i < cnt; i++) {
+            const char *canonical = lookup_choice(flag->choices, (list != NULL) ? list[i] : text);
+            if (canonical == NULL) {
+                set_parse_err(invalid_choice, expect_choice, 0, flag);
+                return -1;
+            }
+            if (list != NULL) {
+                list[i] = (char *) canonical;
+            } else {
+                text = canonical;
+            }
+        }
+    }
+    *value = (list != NULL) ? (void *) list : (void *) text;
+    return 0;
+}
+
+/**
+ * @brief resolve the values of the flags not given on the command line from the environment and the config file.
+ *
+ * environ is scanned once, each variable is looked up in the hashed names of the flags of the command.
+ *
+ * @return int - 0 if succeed, -1 if a value isn't a choice of its flag (the parse error is set).
+ */
+static int resolve_fallbacks(SAPParseResult *res) {
+    SAPCommand *cmd = res->cmd;
+    SAPFlagIndex *index = get_flag_index(cmd);
+    if (index->fallback_cnt == 0) {
+        return 0;
+    }
+
+    const char *env_texts[MAX_OPT_COUNT];
+    for (int k = 0; k < index->fallback_cnt; k++) {
+        env_texts[index->fallbacks[k]] = NULL;
+    }
+    for (char **env = environ; index->env_cnt > 0 && env != NULL && *env != NULL; env++) {
+        const char *equal = strchr(*env, '=');
+        if (equal == NULL) {
+            continue;
+        }
+        size_t len = (size_t) (equal - *env);
+        uint32_t hash = (uint32_t) hash_str(*env, len);
+        for (unsigned slot = hash & 255; index->env_slots[slot] != 0; slot = (slot + 1) & 255) {
+            int i = index->env_slots[slot] - 1;
+            const char *name = cmd->flags[i]->env_name;
+            if (index->env_hashes[i] == hash && strncmp(name, *env, len) == 0 && name[len] == '\0') {
+                env_texts[i] = equal + 1;
+            }
+        }
+    }
+
+    for (int k = 0; k < index->fallback_cnt; k++) {
+        int i = index->fallbacks[k];
+        if (mask_test(&res->given, i)) {
+            continue;   /* the command line wins */
+        }
+        const char *text = env_texts[i];
+        SAPFlagMask *from = &res->from_env;
+        if (text == NULL && cmd->flags[i]->config_key != NULL) {
+            text = config_find(cmd->flags[i]->config_key);
+            from = &res->from_config;
+        }
+        if (text == NULL) {
+            continue;
+        }
+        mask_set(from, i);
+        int ret = assign_fallback(res, i, text);
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret == 0) {
+            mask_set(&res->given, i);
+        } else {
+            from->bits[i / 64] &= ~((uint64_t) 1 << (i % 64));     /* a false text, the flag isn't given */
+        }
+    }
+    return 0;
+}
+
+/* ---- functions of fallbacks ---- */
+
+
+
+/* ++++ functions of telemetry ++++ */
+
+int sap_telemetry_open(const char *path) {
+    assert(path != NULL);
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    size_t len = sizeof(SAPUsageFile) + sizeof(SAPUsageSlot) * SAP_TELEMETRY_SLOTS;
+    struct stat st;
+    /* the concurrent creators truncate to the same size, which never clears the counters */
+    if (fstat(fd, &st) != 0 || (st.st_size == 0 && ftruncate(fd, (off_t) len) != 0) ||
+        (st.st_size != 0 && (size_t) st.st_size != len)) {
+        close(fd);
+        return -1;
+    }
+    SAPUsageFile *file = (SAPUsageFile *) mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        return -1;
+    }
+    uint64_t magic = 0;
+    if (!__atomic_compare_exchange_n(&file->magic, &magic, SAP_USAGE_MAGIC, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) &&
+        magic != SAP_USAGE_MAGIC) {
+        munmap(file, len);  /* not a telemetry file */
+        return -1;
+    }
+
+    sap_telemetry_close();
+    usageFile = file;
+    usageGen = ++usageOpens;
+    return 0;
+}
+
+void sap_telemetry_close(void) {
+    if (usageFile != NULL) {
+        munmap(usageFile, sizeof(SAPUsageFile) + sizeof(SAPUsageSlot) * SAP_TELEMETRY_SLOTS);
+    }
+    usageFile = NULL;
+    usageGen = 0;
+}
+
+/**
+ * @brief find the counter of a name in the telemetry file, claim a slot for it if it's new.
+ *
+ * @return uint64_t* - the counter, NULL if the file is full.
+ */
+static uint64_t *usage_counter(const char *name, size_t len) {
+    uint64_t key = hash_str(name, len);
+    key += (key == 0);      /* 0 means a free slot */
+    uint32_t mask = SAP_TELEMETRY_SLOTS - 1;
+    uint32_t slot = (uint32_t) key & mask;
+
+    for (uint32_t probe = 0; probe < SAP_TELEMETRY_SLOTS; probe++, slot = (slot + 1) & mask) {
+        SAPUsageSlot *usage = &usageFile->slots[slot];
+        uint64_t cur = __atomic_load_n(&usage->key, __ATOMIC_ACQUIRE);
+        if (cur == 0 && __atomic_compare_exchange_n(&usage->key, &cur, key, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            size_t name_len = (len < sizeof(usage->name)) ? len : sizeof(usage->name) - 1;
+            memcpy(usage->name, name, name_len);
+            usage->name[name_len] = '\0';
+            __atomic_store_n(&usage->named, 1, __ATOMIC_RELEASE);
+            return &usage->count;
+        }
+        if (cur == key) {   /* claimed by this or another process, maybe just now */
+            return &usage->count;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief write the path of a command from the root ("prog net ping") into a buffer.
+ *
+ * @return size_t - the length of the path, truncated to size - 1.
+ */
+static size_t cmd_path(const SAPCommand *cmd, char *buf, size_t size) {
+    size_t len = 0;
+    if (cmd->tree_node.parent != NULL) {
+        len = cmd_path(node2cmd(cmd->tree_node.parent), buf, size);
+        if (len + 1 < size) {
+            buf[len++] = ' ';
+        }
+    }
+    int ret = snprintf(buf + len, size - len, "%s", cmd->name);
+    len += (size_t) ret;
+    return (len < size) ? len : size - 1;
+}
+
+/**
+ * @brief resolve the counters of a command and its flags in the open telemetry file, once per file.
+ */
+static void resolve_usage(SAPCommand *cmd, SAPFlagIndex *index) {
+    char name[256];
+    size_t len = cmd_path(cmd, name, sizeof(name));
+    index->usage[0] = usage_counter(name, len);
+    for (int i = 0; i < cmd->flag_cnt; i++) {
+        int ret = snprintf(name + len, sizeof(name) - len, " --%s", cmd->flags[i]->flag_name);
+        size_t flag_len = len + (size_t) ret;
+        index->usage[i + 1] = usage_counter(name, (flag_len < sizeof(name)) ? flag_len : sizeof(name) - 1);
+    }
+    index->usage_gen = usageGen;
+}
+
+/**
+ * @brief count the resolved command and the given flags of a successful parse, a relaxed atomic add each.
+ */
+static void count_usage(const SAPParseResult *res) {
+    SAPFlagIndex *index = get_flag_index(res->cmd);
+    if (index->usage_gen != usageGen) {
+        if (versionNames != NULL) {
+            return;     /* a tree version published before the file was opened, it's immutable */
+        }
+        resolve_usage(res->cmd, index);
+    }
+
+    if (index->usage[0] != NULL) {
+        __atomic_fetch_add(index->usage[0], 1, __ATOMIC_RELAXED);
+    }
+    for (int w = 0; w < SAP_MASK_WORDS; w++) {
+        for (uint64_t bits = res->given.bits[w]; bits != 0; bits &= bits - 1) {
+            uint64_t *counter = index->usage[w * 64 + __builtin_ctzll(bits) + 1];
+            if (counter != NULL) {
+                __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+}
+
+typedef struct {
+    uint64_t count;
+    const char *name;
+} SAPUsageEntry;
+
+static int cmp_usage_entry(const void *a, const void *b) {
+    const SAPUsageEntry *x = (const SAPUsageEntry *) a, *y = (const SAPUsageEntry *) b;
+    if (x->count != y->count) {
+        return (x->count < y->count) ? 1 : -1;  /* the most used first */
+    }
+    return strcmp(x->name, y->name);
+}
+
+int sap_telemetry_report(SAPOutput *out, int top_n) {
+    assert(out != NULL);
+    if (usageFile == NULL) {
+        return -1;
+    }
+
+    SAPUsageEntry *entries = (SAPUsageEntry *) malloc(sizeof(SAPUsageEntry) * SAP_TELEMETRY_SLOTS);
+    assert(entries != NULL);
+    int cnt = 0;
+    for (uint32_t i = 0; i < SAP_TELEMETRY_SLOTS; i++) {
+        SAPUsageSlot *usage = &usageFile->slots[i];
+        if (__atomic_load_n(&usage->named, __ATOMIC_ACQUIRE)) {
+            entries[cnt].count = __atomic_load_n(&usage->count, __ATOMIC_RELAXED);
+            entries[cnt].name = usage->name;
+            cnt++;
+        }
+    }
+    qsort(entries, (size_t) cnt, sizeof(SAPUsageEntry), cmp_usage_entry);
+
+    if (top_n > 0 && top_n < cnt) {
+        cnt = top_n;
+    }
+    for (int i = 0; i < cnt; i++) {
+        out_printf(out, "%12llu  %s\n", (unsigned long long) entries[i].count, entries[i].name);
+    }
+    free(entries);
+    return cnt;
+}
+
+typedef struct SAPUsageCmd_ {
+    struct SAPUsageCmd_ *next;
+    SAPCommand cmd;             /* the reporting command of the telemetry */
+    Flag top_flag;              /* its --top flag */
+} SAPUsageCmd;
+
+static SAPUsageCmd *usageCmds = NULL;   /* the reporting commands added, freed by free_root_cmd */
+
+static int usage_exec(SAPCommand *caller) {
+    long top_n = strtol((const char *) get_flag(caller, "top")->value, NULL, 10);
+    if (sap_telemetry_report(sap_get_output(sap_out_channel), (int) top_n) < 0) {
+        out_printf(sap_get_output(sap_err_channel), "No usage telemetry is open\n");
+        return -1;
+    }
+    return 0;
+}
+
+SAPCommand *add_telemetry_cmd(SAPCommand *parent, const char *name) {
+    assert(parent != NULL);
+    assert(name != NULL);
+
+    /* a command per call, so it can be added to several commands or trees */
+    SAPUsageCmd *usage = (SAPUsageCmd *) malloc(sizeof(SAPUsageCmd));
+    assert(usage != NULL);
+    init_sap_command(&usage->cmd, name, "Show the most used commands and flags", NULL, usage_exec);
+    init_flag(&usage->top_flag, "top", 'n', "the number of the entries to show, 0 for all", "10");
+    add_flag(&usage->cmd, &usage->top_flag);
+    if (add_subcmd(parent, &usage->cmd) == NULL) {
+        free(usage);
+        return NULL;
+    }
+    usage->next = usageCmds;
+    usageCmds = usage;
+    return parent;
+}
+
+/* ---- functions of telemetry ---- */
+
+
+
+/* ++++ functions of cmd_exec ++++ */
+
+int void_exec(SAPCommand *caller) {
+    assert(caller != NULL);
+
+    SAPOutput *out = sap_get_output(sap_out_channel);
+    out_printf(out, "The command %s haven't been allocate function\n", caller->name);
+    sap_output_flush(out);
+
+    return 1;
+}
+
+int void_self_parse_exec(SAPCommand *caller, int argc, char *argv[]) {
+    assert(caller != NULL);
+    assert(argv != NULL);
+
+    SAPOutput *out = sap_get_output(sap_out_channel);
+    out_printf(out, "The command %s haven't been allocate function\n", caller->name);
+    out_printf(out, "argc: %d\n", argc);
+    for (int i = 0; i < argc; i++) {
+        out_printf(out, "argv[%d]: %s\n", i, argv[i]);
+    }
+    sap_output_flush(out);
+
+    return 1;
+}
+
+static int help_exec(SAPCommand *caller) {
+    /* verify the caller */
+    assert(caller != NULL);
+    assert(strcmp("help", caller->name) == 0);
+
+    Flag *cmd_flag = get_flag(caller, "cmd");
+
+    assert(cmd_flag != NULL);
+    if (cmd_flag->value == NULL) {
+        print_cmd_help(&rootCmd);
+    } else {
+        int depth_cmd2get_help = 0;
+        SAPCommand *cmd2get_help = find_sap_without_sub_root(&rootCmd, (char **) cmd_flag->value, &depth_cmd2get_help);
+        if (cmd2get_help == NULL) {
+            /* report it as an unknown command of a parse of the arguments of help */
+            SAPParseResult res;
+            memset(&res, 0, sizeof(SAPParseResult));
+            res.argv = (char **) cmd_flag->value;
+            while (res.argv[res.argc] != NULL) {
+                res.argc++;
+            }
+            res.err.code = unknown_cmd;
+            res.err.expected = expect_cmd;
+            res.err.argv_idx = depth_cmd2get_help;
+            res.err.flag_id = SAP_NIL;
+            errorSink(&res, errorSinkCtx);
+            return -1;
+        }
+        print_cmd_help(cmd2get_help);
+    }
+
+    return 0;
+}
+
+typedef struct {
+    char *buf;      /* the buffer, NULL to only measure */
+    size_t size;    /* the size of the buffer */
+    size_t len;     /* the length of the whole message */
+} ErrMsg;
+
+static void err_msg_append(ErrMsg *msg, const char *str, size_t len) {
+    if (msg->len + 1 < msg->size) {
+        size_t room = msg->size - 1 - msg->len;
+        memcpy(msg->buf + msg->len, str, (len < room) ? len : room);
+    }
+    msg->len += len;
+}
+
+static void err_msg_puts(ErrMsg *msg, const char *str) {
+    err_msg_append(msg, str, strlen(str));
+}
+
+/**
+ * @brief name the first violated constraint of a parse and list its flags.
+ */
+static void err_msg_constraint(ErrMsg *msg, const SAPParseResult *res) {
+    static const char *kind_names[] = {
+        [constraint_required] = ", required flags missing:",
+        [constraint_exclusive] = ", mutually exclusive flags given:",
+        [constraint_one_of] = ", one of the flags is required:",
+        [constraint_requires] = " requires:",
+    };
+    int k = (res->cmd == NULL) ? -1 : find_violated_constraint(res->cmd, &res->given);
+    if (k < 0) {
+        return;
+    }
+
+    const SAPConstraint *item = &res->cmd->constraints->items[k];
+    if (item->kind == constraint_requires) {
+        err_msg_puts(msg, ", --");
+        err_msg_puts(msg, item->flags[0]->flag_name);
+    }
+    err_msg_puts(msg, kind_names[item->kind]);
+    for (int j = (item->kind == constraint_requires) ? 1 : 0; j < item->flag_cnt; j++) {
+        int given = mask_test(&res->given, get_flag_pos(res->cmd, item->flags[j]));
+        /* the missing flags of required and requires, the given ones of exclusive, all of one_of */
+        if (
+            (item->kind == constraint_exclusive && !given) ||
+            ((item->kind == constraint_required || item->kind == constraint_requires) && given)
+        ) {
+            continue;
+        }
+        err_msg_puts(msg, " --");
+        err_msg_puts(msg, item->flags[j]->flag_name);
+    }
+}
+
+size_t sap_format_error(const SAPParseResult *res, char *buf, size_t size) {
+    assert(res != NULL);
+    assert(buf != NULL || size == 0);
+
+    ErrMsg msg = { buf, size, 0 };
+    int idx = res->err.argv_idx - res->argv_offset;     /* the index in res->argv */
+    const char *arg = (idx >= 0 && idx < res->argc) ? res->argv[idx] : "";
+
+    switch (res->err.code) {
+    case unknown_arg:
+        err_msg_puts(&msg, "Argument unrecognized: ");
+        break;
+    case too_many_args:
+        err_msg_puts(&msg, "Too many arguments: ");
+        break;
+    case too_few_args:
+        err_msg_puts(&msg, "Too few arguments: ");
+        break;
+    case illegal_equal:
+        err_msg_puts(&msg, "Illegal option: ");
+        break;
+    case ambiguous_arg:
+        err_msg_puts(&msg, "Ambiguous option: ");
+        break;
+    case unknown_cmd:
+        err_msg_puts(&msg, "Unknown command: ");
+        break;
+    case invalid_choice:
+        err_msg_puts(&msg, "Invalid value: ");
+        break;
+    case violated_constraint:
+        err_msg_puts(&msg, "Constraint violated in command: ");
+        break;
+    case invalid_type:
+        err_msg_puts(&msg, "Invalid value: ");
+        break;
+    default:
+        err_msg_puts(&msg, "Unknown error occurs on: ");
+        break;
+    }
+    err_msg_puts(&msg, arg);
+
+    if (res->err.code == ambiguous_arg) {
+        /* list all the candidates of the ambiguous prefix */
+        const char *name = arg + 2;
+        const char *p_equal_ch = strchr(name, '=');
+        size_t len = (p_equal_ch != NULL) ? (size_t) (p_equal_ch - name) : strlen(name);
+        int lo, hi;
+        get_flag_range(res->cmd, name, len, &lo, &hi);
+        err_msg_puts(&msg, ", possibilities:");
+        for (int pos = lo; pos < hi; pos++) {
+            err_msg_puts(&msg, " --");
+            err_msg_puts(&msg, res->cmd->flag_index->by_name[pos].name);
+        }
+    } else if (res->err.code == invalid_choice) {
+        /* list all the choices of the flag */
+        const Flag *flag = get_flag_by_id(res->cmd, res->err.flag_id);
+        int pos = (flag != NULL) ? get_flag_pos(res->cmd, flag) : -1;
+        if (res->err.argv_idx < 0 && pos >= 0) {
+            /* the value comes from the environment or the config file */
+            int from_env = mask_test(&res->from_env, pos);
+            const char *text = fallback_text(flag, from_env ? source_env : source_config);
+            err_msg_puts(&msg, (text != NULL) ? text : "");
+            err_msg_puts(&msg, from_env ? " (environment variable " : " (config key ");
+            err_msg_puts(&msg, from_env ? flag->env_name : flag->config_key);
+            err_msg_puts(&msg, ")");
+        }
+        err_msg_puts(&msg, ", choices:");
+        for (int i = 0; flag != NULL && flag->choices != NULL && i < flag->choices->cnt; i++) {
+            err_msg_puts(&msg, " ");
+            err_msg_puts(&msg, flag->choices->names[i]);
+        }
+    } else if (res->err.code == violated_constraint) {
+        err_msg_constraint(&msg, res);
+    } else if (res->err.code == invalid_type || res->err.expected == expect_positional) {
+        /* the slot the argument(s) belong to */
+        const char *name = sap_str_get(name_pool(), res->err.flag_id);
+        err_msg_puts(&msg, (res->err.code == invalid_type) ? ", expected by <" : "missing <");
+        err_msg_puts(&msg, (name != NULL) ? name : "");
+        err_msg_puts(&msg, ">");
+    } else if (res->err.code == unknown_cmd) {
+        err_msg_puts(&msg, ". See '");
+        err_msg_puts(&msg, rootCmd.name);
+        err_msg_puts(&msg, " help'.");
+    }
+    err_msg_append(&msg, "\n", 1);
+
+    if (size > 0) {
+        buf[(msg.len < size) ? msg.len : size - 1] = '\0';
+    }
+    return msg.len;
+}
+
+/**
+ * @brief format the error into a stack buffer, falling back to the heap for a long message.
+ *
+ * @return char * - the message, free it if it's not $stack_buf.
+ */
+static char *format_error_buffered(const SAPParseResult *res, char *stack_buf, size_t size, size_t *out_len) {
+    *out_len = sap_format_error(res, stack_buf, size);
+    if (*out_len < size) {
+        return stack_buf;
+    }
+    char *heap_buf = (char *) malloc(*out_len + 1);
+    assert(heap_buf != NULL);
+    sap_format_error(res, heap_buf, *out_len + 1);
+    return heap_buf;
+}
+
+void sap_fd_error_sink(const SAPParseResult *res, void *ctx) {
+    char stack_buf[256];
+    size_t len;
+    char *msg = format_error_buffered(res, stack_buf, sizeof(stack_buf), &len);
+
+    fd_write(ctx, msg, len);
+
+    if (msg != stack_buf) {
+        free(msg);
+    }
+}
+
+void sap_file_error_sink(const SAPParseResult *res, void *ctx) {
+    char stack_buf[256];
+    size_t len;
+    char *msg = format_error_buffered(res, stack_buf, sizeof(stack_buf), &len);
+
+    fwrite(msg, 1, len, (ctx != NULL) ? (FILE *) ctx : stderr);
+
+    if (msg != stack_buf) {
+        free(msg);
+    }
+}
+
+/**
+ * @brief the default error sink, formatting the error into the output of sap_err_channel.
+ */
+static void output_error_sink(const SAPParseResult *res, void *ctx) {
+    (void) ctx;
+    SAPOutput *out = sap_get_output(sap_err_channel);
+
+    /* without a buffer yet only measure the message, as out_printf does */
+    size_t len = sap_format_error(res, (out->buf != NULL) ? out->buf + out->len : NULL, out->cap - out->len);
+    if (len >= out->cap - out->len) {
+        /* not enough room (including the null terminator), make it and format again */
+        if (output_reserve(out, len + 1) != 0) {
+            return;
+        }
+        len = sap_format_error(res, out->buf + out->len, out->cap - out->len);
+    }
+    out->len += len;
+    out->total += len;
+    sap_output_flush(out);
+}
+
+void sap_set_error_sink(SAPErrorSink sink, void *ctx) {
+    if (sink == NULL) {
+        errorSink = output_error_sink;
+        errorSinkCtx = NULL;
+    } else {
+        errorSink = sink;
+        errorSinkCtx = ctx;
+    }
+}
+
+static int call_exec(SAPParseResult *res) {
+    SAPCommand *caller = res->cmd;
+    assert(caller!= NULL);
+
+    if (caller->parse_by_self == 1) {
+        assert(caller->exec_self_parse != NULL);
+        return caller->exec_self_parse(caller, res->argc, res->argv);
+    }
+
+    if (res->err.code != parse_ok) {
+        errorSink(res, errorSinkCtx);
+        return -1;
+    }
+
+    /* expose the parsed values through the flags, the handlers only receive the command */
+    for (int i = 0; i < caller->flag_cnt; i++) {
+        caller->flags[i]->value = res->values[i];
+    }
+
+    if (helpFlag.value != NULL) {
+        /* if the help flag is provided */
+        print_cmd_help(caller);
+        return 0;
+    }
+
+    return caller->exec(caller);
+}
+
+struct SAPCompletion_ {
+    SAPParseResult *res;        /* the parse result handed to the handler */
+    SAPDoneCallback on_done;    /* called when the handler completes */
+    void *ctx;                  /* the context of on_done */
+};
+
+void sap_complete(SAPCompletion *done, int ret) {
+    assert(done != NULL);
+
+    if (done->on_done != NULL) {
+        done->on_done(done->res, ret, done->ctx);
+    }
+    free(done);
+}
+
+static void async_exec_task(void *arg) {
+    SAPCompletion *done = (SAPCompletion *) arg;
+    done->res->cmd->exec_async(done->res, done);
+}
+
+void sap_exec_async(SAPExecutor *executor, SAPParseResult *res, SAPDoneCallback on_done, void *ctx) {
+    assert(executor != NULL);
+    assert(res != NULL);
+
+    if (res->cmd == NULL) {
+        /* report the unknown command as do_parse_subcmd does, nothing to execute */
+        errorSink(res, errorSinkCtx);
+        if (on_done != NULL) {
+            on_done(res, -1, ctx);
+        }
+        return;
+    }
+
+    int help_pos = get_flag_pos(res->cmd, &helpFlag);
+    if (
+        res->cmd->exec_async == NULL || res->cmd->parse_by_self == 1 || res->err.code != parse_ok ||
+        (help_pos >= 0 && res->values[help_pos] != NULL)
+    ) {
+        /* errors, help and the synchronous handlers are run on the calling thread */
+        int ret = call_exec(res);
+        if (on_done != NULL) {
+            on_done(res, ret, ctx);
+        }
+        return;
+    }
+
+    SAPCompletion *done = (SAPCompletion *) malloc(sizeof(SAPCompletion));
+    assert(done != NULL);
+    done->res = res;
+    done->on_done = on_done;
+    done->ctx = ctx;
+    executor->submit(executor, async_exec_task, done);
+}
+
+/* ---- functions of cmd_exec ---- */
+
+
+
+/* ++++ functions of executors ++++ */
+
+static void inline_submit(SAPExecutor *executor, void (*task)(void *arg), void *arg) {
+    (void) executor;
+    task(arg);
+}
+
+static SAPExecutor inlineExecutor = { inline_submit };  /* runs the tasks on the submitting thread */
+
+SAPExecutor *sap_inline_executor(void) {
+    return &inlineExecutor;
+}
+
+typedef struct SAPTask_ {
+    void (*task)(void *arg);
+    void *arg;
+    struct SAPTask_ *next;
+} SAPTask;
+
+typedef struct {
+    SAPExecutor executor;       /* the interface, must be the first member */
+    pthread_mutex_t lock;       /* protects the task queue and $stopping */
+    pthread_cond_t not_empty;   /* signaled when a task is queued or the pool is stopping */
+    SAPTask *head;              /* the task queue, popped from the head */
+    SAPTask *tail;
+    int stopping;               /* the workers exit once the queue is drained */
+    int thread_cnt;
+    pthread_t *threads;
+} SAPThreadPool;
+
+static void pool_submit(SAPExecutor *executor, void (*task)(void *arg), void *arg) {
+    SAPThreadPool *pool = (SAPThreadPool *) executor;
+    SAPTask *node = (SAPTask *) malloc(sizeof(SAPTask));
+    assert(node != NULL);
+    node->task = task;
+    node->arg = arg;
+    node->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail == NULL) {
+        pool->head = node;
+    } else {
+        pool->tail->next = node;
+    }
+    pool->tail = node;
+    pthread_cond_signal(&pool->not_empty);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void *pool_worker(void *arg) {
+    SAPThreadPool *pool = (SAPThreadPool *) arg;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->head == NULL && !pool->stopping) {
+            pthread_cond_wait(&pool->not_empty, &pool->lock);
+        }
+        SAPTask *node = pool->head;
+        if (node == NULL) {     /* stopping and drained */
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        pool->head = node->next;
+        if (pool->head == NULL) {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        node->task(node->arg);
+        free(node);
+    }
+}
+
+SAPExecutor *sap_thread_pool_create(int thread_cnt) {
+    assert(thread_cnt > 0);
+
+    SAPThreadPool *pool = (SAPThreadPool *) calloc(1, sizeof(SAPThreadPool));
+    assert(pool != NULL);
+    pool->executor.submit = pool_submit;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->not_empty, NULL);
+    pool->threads = (pthread_t *) malloc(sizeof(pthread_t) * thread_cnt);
+    assert(pool->threads != NULL);
+
+    for (int i = 0; i < thread_cnt; i++) {
+        if (pthread_create(&pool->threads[i], NULL, pool_worker, pool) != 0) {
+            break;
+        }
+        pool->thread_cnt++;
+    }
+
+    if (pool->thread_cnt == 0) {
+        sap_thread_pool_destroy(&pool->executor);
+        return NULL;
+    }
+    return &pool->executor;
+}
+
+void sap_thread_pool_destroy(SAPExecutor *executor) {
+    SAPThreadPool *pool = (SAPThreadPool *) executor;
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->not_empty);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_cnt; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->not_empty);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+/* ---- functions of executors ---- */
+
+
+
+/* ++++ functions for initialization ++++ */
+
+static void add_helpcmd() {
+    init_sap_command(&helpCmd, "help", "Display this help message", NULL, help_exec);
+    // set_cmd_self_parse(&helpCmd, help_exec);
+    set_flag_type(&helpFlag, no_arg);
+    add_subcmd(&rootCmd, &helpCmd);
+}
+
+static void check_shorthand(SAPCommand *root) {
+    #define not_stack_select (((stack_select) == 0)? 1: 0)
+    TreeNode *stack[MAX_CMD_COUNT][2];      /* two stack cosplay a queue */
+    int top[2] = {-1, -1};                  /* the top ptr of the two stack */
+    int stack_select = 0;                   /* select the available stack*/
+    SAPOutput *err_out = sap_get_output(sap_err_channel);
+
+    /* push the root into stack */
+    stack[++top[stack_select]][stack_select] = &(root->tree_node);
+
+    while (top[stack_select] >= 0) {
+        TreeNode *stack_top = stack[top[stack_select]][stack_select];
+        SAPCommand *crt_cmd = node2cmd(stack_top);   /* current command */
+        SAPCommand *call_stack[MAX_CMD_DEPTH];
+        get_cmd_stack(crt_cmd, call_stack);
+        Flag *ch_occupied[256] = {0};
+        for (int i = 0; i < crt_cmd->flag_cnt; i++) {
+            /* the primary shorthand (k == -1), then the shorthands of the aliases */
+            const SAPAliases *aliases = crt_cmd->flags[i]->aliases;
+            for (int k = -1; k < ((aliases == NULL) ? 0 : aliases->cnt); k++) {
+                char shorthand = (k < 0) ? crt_cmd->flags[i]->shorthand : aliases->shorthands[k];
+                if (shorthand == '\0') {
+                    continue;
+                }
+                int char_idx = (unsigned char) shorthand;
+                if (ch_occupied[char_idx] == crt_cmd->flags[i]) {
+                    continue;   /* the flag repeats its own shorthand, harmless */
+                }
+                if (ch_occupied[char_idx] != NULL) {
+                    int j = 0;
+                    out_printf(err_out, "In command: ");
+                    while (call_stack[j] != crt_cmd) {
+                        out_printf(err_out, "%s ", call_stack[j]->name);
+                        j++;
+                    }
+                    out_printf(err_out, "%s\n", crt_cmd->name);
+                    out_printf(err_out, "Warning: shorthand '%c' is already occupied by %s\n", shorthand, ch_occupied[char_idx]->flag_name);
+                } else {
+                    ch_occupied[char_idx] = crt_cmd->flags[i];
+                }
+            }
+        }
+
+        for (int i = 0; i < stack_top->child_cnt; i++) {
+            /* push the subcmds into the other stack */
+            stack[++top[not_stack_select]][not_stack_select] = stack_top->children[i];
+        }
+
+        if (--top[stack_select] < 0) {
+            /* pop and judge whether the stack is empty */
+            stack_select = not_stack_select;    /* switch the stack */
+        }
+
+        /* ---- non-leaf node ---- */
+    }
+    sap_output_flush(err_out);
+    #undef not_stack_select
+}
+
+/* ---- functions for initialization ----*/
+
+
+
+/* ++++ functions of SAPStrPool ++++ */
+
+/**
+ * @brief the 64-bit FNV-1a hash of a string.
+ */
+static uint64_t hash_str(const char *str, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char) str[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief find the slot of a string in the hash table of a pool.
+ *
+ * @return uint32_t - the slot holding the string, or the empty slot where it should be inserted.
+ */
+static uint32_t pool_probe(const SAPStrPool *pool, const char *str, size_t len, uint64_t hash) {
+    uint32_t mask = pool->slot_cap - 1;
+    uint32_t pos = (uint32_t) hash & mask;
+
+    while (pool->slots[pos] != 0) {
+        const SAPStrEntry *entry = &pool->entries[pool->slots[pos] - 1];
+        if (entry->hash == hash && entry->len == len && memcmp(pool->buf + entry->offset, str, len) == 0) {
+            break;
+        }
+        pos = (pos + 1) & mask;     /* linear probing */
+    }
+    return pos;
+}
+
+static void pool_grow_slots(SAPStrPool *pool) {
+    uint32_t new_cap = (pool->slot_cap == 0) ? 64 : pool->slot_cap * 2;
+    uint32_t *slots = (uint32_t *) calloc(new_cap, sizeof(uint32_t));
+    assert(slots != NULL);
+
+    free(pool->slots);
+    pool->slots = slots;
+    pool->slot_cap = new_cap;
+
+    /* rehash all the strings */
+    for (uint32_t id = 0; id < pool->cnt; id++) {
+        uint32_t pos = (uint32_t) pool->entries[id].hash & (new_cap - 1);
+        while (pool->slots[pos] != 0) {
+            pos = (pos + 1) & (new_cap - 1);
+        }
+        pool->slots[pos] = id + 1;
+    }
+}
+
+uint32_t sap_str_intern(SAPStrPool *pool, const char *str, size_t len) {
+    assert(pool != NULL);
+    assert(str != NULL);
+
+    /* keep the load factor under 1/2 */
+    if ((pool->cnt + 1) * 2 > pool->slot_cap) {
+        pool_grow_slots(pool);
+    }
+
+    uint64_t hash = hash_str(str, len);
+    uint32_t pos = pool_probe(pool, str, len, hash);
+    if (pool->slots[pos] != 0) {
+        return pool->slots[pos] - 1;    /* already interned */
+    }
+
+    if (pool->cnt == pool->entry_cap) {
+        pool->entry_cap = (pool->entry_cap == 0) ? 64 : pool->entry_cap * 2;
+        pool->entries = (SAPStrEntry *) realloc(pool->entries, sizeof(SAPStrEntry) * pool->entry_cap);
+        assert(pool->entries != NULL);
+    }
+    if (pool->buf_len + len + 1 > pool->buf_cap) {
+        while (pool->buf_len + len + 1 > pool->buf_cap) {
+            pool->buf_cap = (pool->buf_cap == 0) ? 1024 : pool->buf_cap * 2;
+        }
+        pool->buf = (char *) realloc(pool->buf, pool->buf_cap);
+        assert(pool->buf != NULL);
+    }
+
+    SAPStrEntry *entry = &pool->entries[pool->cnt];
+    entry->offset = (uint32_t) pool->buf_len;
+    entry->len = (uint32_t) len;
+    entry->hash = hash;
+    memcpy(pool->buf + pool->buf_len, str, len);
+    pool->buf[pool->buf_len + len] = '\0';
+    pool->buf_len += len + 1;
+
+    pool->slots[pos] = ++pool->cnt;
+    return pool->cnt - 1;
+}
+
+uint32_t sap_str_find(const SAPStrPool *pool, const char *str, size_t len) {
+    assert(pool != NULL);
+    assert(str != NULL);
+
+    if (pool->cnt == 0) {
+        return SAP_NIL;
+    }
+    uint32_t pos = pool_probe(pool, str, len, hash_str(str, len));
+    return (pool->slots[pos] == 0) ? SAP_NIL : pool->slots[pos] - 1;
+}
+
+const char *sap_str_get(const SAPStrPool *pool, uint32_t id) {
+    assert(pool != NULL);
+    if (id == SAP_NIL) {
+        return NULL;
+    }
+    assert(id < pool->cnt);
+    return pool->buf + pool->entries[id].offset;
+}
+
+void sap_str_pool_free(SAPStrPool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    free(pool->buf);
+    free(pool->entries);
+    free(pool->slots);
+    memset(pool, 0, sizeof(SAPStrPool));
+}
+
+/* ---- functions of SAPStrPool ---- */
+
+
+
+/* ++++ functions of SAPCompactTree ++++ */
+
+static uint32_t intern_nullable(SAPStrPool *pool, const char *str) {
+    return (str == NULL) ? SAP_NIL : sap_str_intern(pool, str, strlen(str));
+}
+
+/**
+ * @brief collect the commands of a tree in breadth-first order, so the children of a command are contiguous.
+ *
+ * @param[in] root      - the root command of the tree.
+ * @param[in] build     - whether the lazy commands are built, otherwise only the built part is collected.
+ * @param[out] out_cnt  - the number of commands.
+ * @return SAPCommand** - the commands, free it after use.
+ */
+static SAPCommand **collect_cmds_bfs(SAPCommand *root, int build, uint32_t *out_cnt) {
+    uint32_t cap = 64, cnt = 0;
+    SAPCommand **queue = (SAPCommand **) malloc(sizeof(SAPCommand *) * cap);
+    assert(queue != NULL);
+
+    queue[cnt++] = root;
+    for (uint32_t head = 0; head < cnt; head++) {
+        if (build) {
+            ensure_built(queue[head]);
+        }
+        TreeNode *node = &queue[head]->tree_node;
+        if (cnt + node->child_cnt > cap) {
+            while (cnt + node->child_cnt > cap) {
+                cap *= 2;
+            }
+            queue = (SAPCommand **) realloc(queue, sizeof(SAPCommand *) * cap);
+            assert(queue != NULL);
+        }
+        for (int i = 0; i < node->child_cnt; i++) {
+            queue[cnt++] = node2cmd(node->children[i]);
+        }
+    }
+
+    *out_cnt = cnt;
+    return queue;
+}
+
+static int cmp_ptr(const void *a, const void *b) {
+    uintptr_t pa = (uintptr_t) *(void * const *) a, pb = (uintptr_t) *(void * const *) b;
+    return (pa > pb) - (pa < pb);
+}
+
+/**
+ * @brief sort the flags of all the commands by address and drop the duplicated ones.
+ *
+ * @return uint32_t - the number of unique flags left in $flags.
+ */
+static uint32_t unique_flags(Flag **flags, uint32_t cnt) {
+    uint32_t uniq = 0;
+    qsort(flags, cnt, sizeof(Flag *), cmp_ptr);
+    for (uint32_t i = 0; i < cnt; i++) {
+        if (uniq == 0 || flags[uniq - 1] != flags[i]) {
+            flags[uniq++] = flags[i];
+        }
+    }
+    return uniq;
+}
+
+SAPCompactTree *sap_compact_build(SAPCommand *root) {
+    assert(root != NULL);
+
+    uint32_t cmd_cnt = 0, ref_cnt = 0;
+    SAPCommand **cmds = collect_cmds_bfs(root, 1, &cmd_cnt);
+    for (uint32_t i = 0; i < cmd_cnt; i++) {
+        ref_cnt += (uint32_t) cmds[i]->flag_cnt;
+    }
+
+    SAPCompactTree *tree = (SAPCompactTree *) calloc(1, sizeof(SAPCompactTree));
+    assert(tree != NULL);
+    tree->cmd_cnt = cmd_cnt;
+    tree->flag_ref_cnt = ref_cnt;
+    tree->cmds = (SAPCompactCmd *) malloc(sizeof(SAPCompactCmd) * cmd_cnt);
+    tree->descs = (SAPCompactDesc *) malloc(sizeof(SAPCompactDesc) * cmd_cnt);
+    tree->flag_refs = (uint32_t *) malloc(sizeof(uint32_t) * (ref_cnt + 1));
+    assert(tree->cmds != NULL && tree->descs != NULL && tree->flag_refs != NULL);
+
+    /* the unique flags, sorted by address to map the flag pointers to indices */
+    Flag **uniq = (Flag **) malloc(sizeof(Flag *) * (ref_cnt + 1));
+    assert(uniq != NULL);
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < cmd_cnt; i++) {
+        for (int j = 0; j < cmds[i]->flag_cnt; j++) {
+            uniq[pos++] = cmds[i]->flags[j];
+        }
+    }
+    tree->flag_cnt = unique_flags(uniq, ref_cnt);
+    tree->flags = (SAPCompactFlag *) malloc(sizeof(SAPCompactFlag) * (tree->flag_cnt + 1));
+    assert(tree->flags != NULL);
+    for (uint32_t i = 0; i < tree->flag_cnt; i++) {
+        tree->flags[i].name = intern_nullable(&tree->strs, uniq[i]->flag_name);
+        tree->flags[i].usage = intern_nullable(&tree->strs, uniq[i]->usage);
+        tree->flags[i].shorthand = (uint8_t) uniq[i]->shorthand;
+        tree->flags[i].type = (uint8_t) uniq[i]->type;
+    }
+
+    /* the children of cmds[i] follow the children of cmds[0..i) in breadth-first order */
+    uint32_t next_child = 1;
+    pos = 0;
+    tree->cmds[0].parent = SAP_NIL;     /* the others are set by their parents, which come first */
+    for (uint32_t i = 0; i < cmd_cnt; i++) {
+        SAPCompactCmd *ccmd = &tree->cmds[i];
+        ccmd->name = intern_nullable(&tree->strs, cmds[i]->name);
+        ccmd->child_cnt = (uint16_t) cmds[i]->tree_node.child_cnt;
+        ccmd->first_child = next_child;
+        ccmd->flag_cnt = (uint16_t) cmds[i]->flag_cnt;
+        ccmd->first_flag = pos;
+        for (uint32_t c = next_child; c < next_child + ccmd->child_cnt; c++) {
+            tree->cmds[c].parent = i;
+        }
+        next_child += ccmd->child_cnt;
+
+        tree->descs[i].short_desc = intern_nullable(&tree->strs, cmds[i]->short_desc);
+        tree->descs[i].long_desc = intern_nullable(&tree->strs, cmds[i]->long_desc);
+
+        for (int j = 0; j < cmds[i]->flag_cnt; j++) {
+            Flag **found = (Flag **) bsearch(&cmds[i]->flags[j], uniq, tree->flag_cnt, sizeof(Flag *), cmp_ptr);
+            assert(found != NULL);
+            tree->flag_refs[pos++] = (uint32_t) (found - uniq);
+        }
+    }
+
+    free(uniq);
+    free(cmds);
+    return tree;
+}
+
+uint32_t sap_compact_find(const SAPCompactTree *tree, char *cmd_names[], int *out_idx) {
+    assert(tree != NULL);
+    assert(cmd_names != NULL);
+
+    uint32_t crt = 0;
+    int idx = 0;
+
+    while (cmd_names[idx] != NULL && cmd_names[idx][0] != '-') {
+        /* an unknown name can't be a command */
+        uint32_t name = sap_str_find(&tree->strs, cmd_names[idx], strlen(cmd_names[idx]));
+        if (name == SAP_NIL) {
+            break;
+        }
+
+        const SAPCompactCmd *ccmd = &tree->cmds[crt];
+        uint32_t next = SAP_NIL;
+        for (uint32_t c = ccmd->first_child; c < ccmd->first_child + ccmd->child_cnt; c++) {
+            if (tree->cmds[c].name == name) {   /* compare the ids instead of the strings */
+                next = c;
+                break;
+            }
+        }
+        if (next == SAP_NIL) {
+            break;
+        }
+        crt = next;
+        idx++;
+    }
+
+    if (out_idx != NULL) {
+        *out_idx = idx;
+    }
+    return crt;
+}
+
+uint32_t sap_compact_find_flag(const SAPCompactTree *tree, uint32_t cmd, const char *flag_name) {
+    assert(tree != NULL);
+    assert(cmd < tree->cmd_cnt);
+    assert(flag_name != NULL);
+
+    uint32_t name = sap_str_find(&tree->strs, flag_name, strlen(flag_name));
+    if (name == SAP_NIL) {
+        return SAP_NIL;
+    }
+
+    const SAPCompactCmd *ccmd = &tree->cmds[cmd];
+    for (uint32_t r = ccmd->first_flag; r < ccmd->first_flag + ccmd->flag_cnt; r++) {
+        if (tree->flags[tree->flag_refs[r]].name == name) {
+            return tree->flag_refs[r];
+        }
+    }
+    return SAP_NIL;
+}
+
+size_t sap_compact_bytes(const SAPCompactTree *tree) {
+    assert(tree != NULL);
+
+    return sizeof(SAPCompactTree) +
+        (sizeof(SAPCompactCmd) + sizeof(SAPCompactDesc)) * tree->cmd_cnt +
+        sizeof(SAPCompactFlag) * tree->flag_cnt +
+        sizeof(uint32_t) * tree->flag_ref_cnt +
+        tree->strs.buf_cap +
+        sizeof(SAPStrEntry) * tree->strs.entry_cap +
+        sizeof(uint32_t) * tree->strs.slot_cap;
+}
+
+size_t sap_tree_bytes(SAPCommand *root) {
+    assert(root != NULL);
+
+    uint32_t cmd_cnt = 0, ref_cnt = 0;
+    SAPCommand **cmds = collect_cmds_bfs(root, 0, &cmd_cnt);
+    size_t bytes = sizeof(SAPCommand) * cmd_cnt;
+
+    for (uint32_t i = 0; i < cmd_cnt; i++) {
+        int child_cnt = cmds[i]->tree_node.child_cnt;
+        if (child_cnt > 0) {
+            /* the capacity of the children array, see append_child */
+            int cap = 1;
+            while (cap < child_cnt) {
+                cap *= 2;
+            }
+            bytes += sizeof(TreeNode *) * ((cap > MAX_SUBCMD_COUNT) ? MAX_SUBCMD_COUNT : cap);
+        }
+        if (cmds[i]->flag_index != NULL) {
+            bytes += sizeof(SAPFlagIndex);
+        }
+        if (cmds[i]->child_index != NULL) {
+            bytes += sizeof(SAPChildIndex) + sizeof(int) * ((size_t) 1 << cmds[i]->child_index->bits);
+        }
+        ref_cnt += (uint32_t) cmds[i]->flag_cnt;
+    }
+
+    /* the flags shared by several commands are counted once */
+    Flag **flags = (Flag **) malloc(sizeof(Flag *) * (ref_cnt + 1));
+    assert(flags != NULL);
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < cmd_cnt; i++) {
+        for (int j = 0; j < cmds[i]->flag_cnt; j++) {
+            flags[pos++] = cmds[i]->flags[j];
+        }
+    }
+    bytes += sizeof(Flag) * unique_flags(flags, ref_cnt);
+
+    free(flags);
+    free(cmds);
+    return bytes;
+}
+
+void sap_compact_free(SAPCompactTree *tree) {
+    if (tree == NULL) {
+        return;
+    }
+    free(tree->cmds);
+    free(tree->descs);
+    free(tree->flags);
+    free(tree->flag_refs);
+    sap_str_pool_free(&tree->strs);
+    free(tree);
+}
+
+/* ---- functions of SAPCompactTree ---- */
+
+
+
+/* ++++ global frame functions that will be called by user ++++ */
+
+void init_root_cmd(const char *name, const char *short_desc, const char *long_desc, CmdExec exec) {
+    /* init the help flag */
+    init_flag(&helpFlag, "help", 'h', "Display the help message", NULL);
+    /* call init_sap_cmd to init root cmd */
+    init_sap_command(&rootCmd, name, short_desc, long_desc, exec);
+}
+
+void init_sap_command(SAPCommand *cmd, const char *name, const char *short_desc, const char *long_desc, CmdExec exec) {
+    assert(cmd != NULL);                /* ensure the command pointer is not null */
+    ++g_cmd_cnt;
+    assert(g_cmd_cnt <= MAX_CMD_COUNT); /* ensure the command count does not exceed the maximum limit */
+
+    cmd->name = name;                   /* set the command name */
+    cmd->name_id = sap_str_intern(&namePool, name, strlen(name));  /* intern the name */
+    cmd->short_desc = short_desc;       /* set the short description of the command */
+    cmd->long_desc = long_desc;         /* set the long description of the command */
+    cmd->flag_cnt = 0;                  /* initialize the flag count to 0 */
+    cmd->parse_by_self = 0;             /* set parse_by_self to 0 (default parse by the framework) */
+    cmd->default_flag = NULL;           /* initialize the default flag to null */
+    cmd->exec_self_parse = NULL;        /* initialize the self-parse execution function to null */
+    cmd->exec = (exec == NULL) ? void_exec : exec; /* set the execution function, use void_exec if null */
+    cmd->exec_async = NULL;             /* the command is executed synchronously by default */
+    cmd->flag_index = NULL;             /* the flag index is built on the first lookup */
+    cmd->child_index = NULL;            /* so is the child index */
+    cmd->prefix_match = 0;              /* only exact long options are accepted by default */
+    cmd->multi_call = 0;                /* argv[0] is only the name of the binary by default */
+    cmd->passthrough = 0;               /* the arguments after "--" are operands by default */
+    cmd->constraints = NULL;            /* no constraint on the flags by default */
+    cmd->builder = NULL;                /* the command is populated eagerly by default */
+    cmd->ctx = NULL;                    /* no context of the handler by default */
+    cmd->origin = cmd;                  /* a tree version refers to it from its copy */
+    cmd->aliases = NULL;                /* no extra names by default */
+    cmd->positionals = NULL;            /* the arguments go to the default flag by default */
+    add_flag(cmd, &helpFlag);           /* add the help flag to the command */
+
+    init_tree_node(&cmd->tree_node);    /* initialize the tree node for the command */
+}
+
+void set_cmd_self_parse(SAPCommand *cmd, CmdExecWithArg self_parse_exec) {
+    /* ensure the incoming command pointer is not null */
+    assert(cmd != NULL);
+    /* set the command to parse arguments by itself */
+    cmd->parse_by_self = 1;
+    /* if the provided self-parse execution function is null */
+    if (self_parse_exec == NULL) {
+        /* use the default void self-parse execution function */
+        cmd->exec_self_parse = void_self_parse_exec;
+    } else {
+        /* use the provided self-parse execution function */
+        cmd->exec_self_parse = self_parse_exec;
+    }
+}
+
+SAPCommand* add_subcmd(SAPCommand *parent, SAPCommand *child) {
+    /* ensure the parent command pointer is not null */
+    assert(parent!= NULL);
+    /* ensure the child command pointer is not null */
+    assert(child!= NULL);
+
+    /* attempt to append the child node to the parent node */
+    if (append_child(&parent->tree_node, &child->tree_node) == NULL) {
+        return NULL;
+    }
+    /* the child index is out of date now, it will be rebuilt on the next lookup */
+    free(parent->child_index);
+    parent->child_index = NULL;
+
+    return parent;
+}
+
+int add_cmd_alias(SAPCommand *cmd, const char *alias) {
+    assert(cmd != NULL);
+    assert(alias != NULL);
+    if (append_alias(&cmd->aliases, alias, '\0') != 0) {
+        return -1;
+    }
+    /* the child index of the parent is out of date now */
+    if (cmd->tree_node.parent != NULL) {
+        SAPCommand *parent = node2cmd(cmd->tree_node.parent);
+        free(parent->child_index);
+        parent->child_index = NULL;
+    }
+    return 0;
+}
+
+SAPCommand *remove_subcmd(SAPCommand *parent, SAPCommand *child) {
+    assert(parent != NULL);
+    assert(child != NULL);
+
+    TreeNode *node = &parent->tree_node;
+    int i = 0;
+    while (i < node->child_cnt && node->children[i] != &child->tree_node) {
+        i++;
+    }
+    if (i == node->child_cnt) {
+        return NULL;
+    }
+    memmove(&node->children[i], &node->children[i + 1], sizeof(TreeNode *) * (size_t) (node->child_cnt - i - 1));
+    node->child_cnt--;
+    child->tree_node.parent = NULL;
+    free(parent->child_index);
+    parent->child_index = NULL;
+
+    /* the indices of the subtree are rebuilt if it's added again, free_root_cmd no longer reaches them */
+    uint32_t cmd_cnt;
+    SAPCommand **cmds = collect_cmds_bfs(child, 0, &cmd_cnt);
+    for (uint32_t k = 0; k < cmd_cnt; k++) {
+        free(cmds[k]->flag_index);
+        cmds[k]->flag_index = NULL;
+        free(cmds[k]->child_index);
+        cmds[k]->child_index = NULL;
+    }
+    free(cmds);
+    g_cmd_cnt -= (int) cmd_cnt;
+    return parent;
+}
+
+/**
+ * @brief undo the first cnt commands linked by add_subcmd_table, when the next one can't be added.
+ */
+static void unlink_table(SAPCommand *parent, int top_cnt, SAPCommand *cmds[], int cnt, const int flag_end[]) {
+    for (int i = 0; i < cnt; i++) {
+        TreeNode *node = &cmds[i]->tree_node;
+        node->parent = NULL;
+        node->children = NULL;
+        node->in_block = 0;
+        node->child_cnt = 0;
+        node->depth = 0;
+        cmds[i]->flag_cnt -= flag_end[i] - ((i == 0) ? 0 : flag_end[i - 1]);
+    }
+    parent->tree_node.child_cnt = top_cnt;
+}
+
+int add_subcmd_table(SAPCommand *parent, SAPCommand *cmds[], const int parents[], int cmd_cnt,
+                     Flag *flags[], const int owners[], int flag_cnt) {
+    assert(parent != NULL);
+    assert(cmd_cnt == 0 || (cmds != NULL && parents != NULL));
+    assert(flag_cnt == 0 || (flags != NULL && owners != NULL));
+
+    /*
+     * validate the tables first, without reading the commands: the child counts and the depths of the commands,
+     * and the flags grouped by command (a counting sort). the commands are visited once, to check and link them.
+     */
+    int *scratch = (int *) calloc((size_t) cmd_cnt * 3 + (size_t) flag_cnt + 1, sizeof(int));
+    if (scratch == NULL) {
+        return -1;
+    }
+    int *child_cnt = scratch, *depth = scratch + cmd_cnt;
+    int *flag_end = scratch + 2 * cmd_cnt;  /* the flags of cmds[i] end at flag_end[i] in by_cmd */
+    int *by_cmd = flag_end + cmd_cnt + 1;
+    int top_cnt = parent->tree_node.child_cnt;
+    int ok = 1;
+    for (int i = 0; ok && i < cmd_cnt; i++) {
+        int p = parents[i];
+        ok = p >= -1 && p < i;
+        depth[i] = (!ok || p < 0) ? parent->tree_node.depth + 1 : depth[p] + 1;
+        ok = ok && depth[i] < MAX_CMD_DEPTH && ++*((p < 0) ? &top_cnt : &child_cnt[p]) <= MAX_SUBCMD_COUNT;
+    }
+    for (int k = 0; ok && k < flag_cnt; k++) {
+        ok = owners[k] >= 0 && owners[k] < cmd_cnt;
+        flag_end[ok ? owners[k] + 1 : 0]++;
+    }
+    for (int i = 0; ok && i < cmd_cnt; i++) {
+        ok = flag_end[i + 1] <= MAX_OPT_COUNT;
+        flag_end[i + 1] += flag_end[i];
+    }
+    for (int k = 0; ok && k < flag_cnt; k++) {
+        by_cmd[flag_end[owners[k]]++] = k;  /* from the start of the flags of the owner to their end */
+    }
+
+    /* the children arrays of the new commands, one block */
+    size_t slot_cnt = 0;
+    for (int i = 0; ok && i < cmd_cnt; i++) {
+        slot_cnt += (child_cnt[i] == 0) ? 0 : (size_t) child_cap(child_cnt[i]);
+    }
+    SAPChildBlock *block = NULL;
+    if (ok) {
+        block = (SAPChildBlock *) malloc(sizeof(SAPChildBlock) + sizeof(TreeNode *) * slot_cnt);
+        ok = block != NULL && (top_cnt == parent->tree_node.child_cnt || reserve_children(&parent->tree_node, top_cnt) == 0);
+    }
+    if (!ok) {
+        free(block);
+        free(scratch);
+        return -1;
+    }
+
+    /* the top of the tree of the parent can't be added under it */
+    const TreeNode *top = &parent->tree_node;
+    while (top->parent != NULL) {
+        top = top->parent;
+    }
+
+    /* check and link, a command given twice has a parent the second time; the parents come first */
+    TreeNode **slot = block->slots;
+    int old_cnt = parent->tree_node.child_cnt;
+    for (int i = 0, k = 0; i < cmd_cnt; i++) {
+        SAPCommand *cmd = cmds[i];
+        TreeNode *node = &cmd->tree_node;
+        int added = flag_end[i] - k;
+        if (node->parent != NULL || node->child_cnt != 0 || node == top || cmd->flag_cnt + added > MAX_OPT_COUNT) {
+            unlink_table(parent, old_cnt, cmds, i, flag_end);
+            free(block);
+            free(scratch);
+            return -1;
+        }
+        node->parent = (parents[i] < 0) ? &parent->tree_node : &cmds[parents[i]]->tree_node;
+        node->depth = depth[i];
+        if (!node->in_block) {
+            free(node->children);   /* an empty array left by the children removed before */
+        }
+        node->children = (child_cnt[i] == 0) ? NULL : slot;
+        node->in_block = child_cnt[i] != 0;
+        slot += (child_cnt[i] == 0) ? 0 : child_cap(child_cnt[i]);
+        node->parent->children[node->parent->child_cnt++] = node;
+        for (; k < flag_end[i]; k++) {
+            cmd->flags[cmd->flag_cnt++] = flags[by_cmd[k]];
+        }
+        free(cmd->flag_index);      /* as add_flag does */
+        cmd->flag_index = NULL;
+        if (cmd->constraints != NULL) {
+            cmd->constraints->compiled = 0;
+        }
+    }
+    block->next = childBlocks;
+    childBlocks = block;
+    free(parent->child_index);
+    parent->child_index = NULL;
+    free(scratch);
+    return 0;
+}
+
+void set_cmd_builder(SAPCommand *cmd, CmdBuilder builder) {
+    assert(cmd != NULL);
+    cmd->builder = builder;
+}
+
+void sap_build_cmd(SAPCommand *cmd) {
+    assert(cmd != NULL);
+    ensure_built(cmd);
+}
+
+/**
+ * @brief run the builder of a lazy command, then give the persist flags to the new commands of its subtree.
+ *
+ * @param[in] cmd   - the lazy command, its builder is cleared before the call, so it runs only once.
+ */
+static void build_cmd(SAPCommand *cmd) {
+    CmdBuilder builder = cmd->builder;
+    cmd->builder = NULL;
+    builder(cmd);
+
+    if (persistCnt > 0) {
+        uint32_t cmd_cnt;
+        SAPCommand **cmds = collect_cmds_bfs(cmd, 0, &cmd_cnt);
+        for (uint32_t i = 0; i < cmd_cnt; i++) {
+            for (int k = 0; k < persistCnt; k++) {
+                if (!has_flag(cmds[i]->flags, cmds[i]->flag_cnt, persistFlags[k])) {
+                    add_flag(cmds[i], persistFlags[k]);
+                }
+            }
+        }
+        free(cmds);
+    }
+    if (is_sealed) {
+        check_shorthand(cmd);   /* the rest of the tree was checked when sealed */
+    }
+}
+
+/**
+ * @brief add the help command to the root command and check the shorthands, only once.
+ */
+static void seal_root_cmd() {
+    if (is_sealed) {
+        return;
+    }
+
+    ensure_built(&rootCmd);
+
+    /* allocate memory for a flag to specify the command to get help */
+    /* the helpCmd's default flag */
+    Flag *cmd2get_help = (Flag *) malloc(sizeof(Flag));
+    init_flag(cmd2get_help, "cmd", 'c', "Specify the command to get help", NULL);   /* initialize the flag */
+    set_flag_type(cmd2get_help, multi_arg);
+    add_helpcmd();                              /* add the help subcommand to the root command */
+    // set_flag_type(cmd2get_help, multi_arg);
+    add_default_flag(&helpCmd, cmd2get_help);   /* add the flag to the help command as the default flag */
+    check_shorthand(&rootCmd);                  /* check the duplicate shorthand, the lazy commands are checked when built */
+
+    /* compile the constraints of all the built commands */
+    uint32_t cmd_cnt;
+    SAPCommand **cmds = collect_cmds_bfs(&rootCmd, 0, &cmd_cnt);
+    for (uint32_t i = 0; i < cmd_cnt; i++) {
+        compile_constraints(cmds[i]);
+    }
+    free(cmds);
+    is_sealed = 1;
+}
+
+/**
+ * @brief the first half of a parse: find the command and parse its arguments, the values aren't resolved from the fallbacks yet.
+ *
+ * @return int - 0 if succeed, -1 if there's an error (res->err).
+ */
+static int parse_argv_in_tree(SAPCommand *root, int argc, char *argv[], SAPParseResult *res) {
+    /* initialize the depth counter */
+    int depth = 0;
+
+    memset(res, 0, sizeof(SAPParseResult));
+
+    /* find the command to execute considering flags, from the entry point named by argv[0] if any */
+    SAPCommand *entry = find_entry_cmd(root, argv[0]);
+    if (entry == NULL) {
+        res->cmd = find_sap_consider_flags(root, argv, &depth);
+    } else if (entry->tree_node.child_cnt == 0) {
+        res->cmd = entry;       /* argv[0] is the name of the command */
+    } else {
+        res->cmd = find_sap_consider_flags(entry, argv, &depth);
+    }
+    if (res->cmd == NULL) {
+        /* unknown command, the result refers to the whole argv */
+        res->argc = argc;
+        res->argv = argv;
+        res->err.code = unknown_cmd;
+        res->err.expected = expect_cmd;
+        res->err.argv_idx = depth;
+        res->err.flag_id = SAP_NIL;
+        return -1;
+    }
+
+    res->argc = argc - depth;
+    res->argv_offset = depth;
+    res->argv = argv + depth;
+    if (res->cmd->parse_by_self == 1) {
+        return 0;   /* the arguments are parsed by the handler itself */
+    }
+
+    /* the values start with the defaults of the flags */
+    for (int i = 0; i < res->cmd->flag_cnt; i++) {
+        res->values[i] = res->cmd->flags[i]->dft_value;
+    }
+
+    parseErr.code = parse_ok;
+    int ret = parse_flags(res->cmd, res->argc, res->argv, res);
+    if (ret != 0 && parseErr.code != parse_ok) {
+        res->err = parseErr;
+        res->err.argv_idx = depth + ret;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief the second half of a parse: resolve the fallbacks, check the constraints and count the usage.
+ *
+ * @return int - 0 if succeed, -1 if there's an error (res->err).
+ */
+static int finish_parse(SAPParseResult *res) {
+    res->err.flag_id = SAP_NIL;     /* no flag is involved unless an error below names one */
+    if (res->cmd->parse_by_self == 1) {
+        if (usageGen != 0) {
+            count_usage(res);
+        }
+        return 0;
+    }
+    if (resolve_fallbacks(res) != 0) {
+        /* the value doesn't come from argv */
+        res->err = parseErr;
+        res->err.argv_idx = -1;
+        return -1;
+    }
+    if (check_constraints(res->cmd, &res->given) != 0) {
+        /* the constraint belongs to the command, the error points at its name */
+        res->err = parseErr;
+        res->err.argv_idx = res->argv_offset;
+        return -1;
+    }
+    if (usageGen != 0) {
+        count_usage(res);   /* opt-in, a relaxed atomic add per counter */
+    }
+    return 0;
+}
+
+/**
+ * @brief parse a command line against the tree of a root command, the live tree or a tree version.
+ */
+static int parse_in_tree(SAPCommand *root, int argc, char *argv[], SAPParseResult *res) {
+    if (parse_argv_in_tree(root, argc, argv, res) != 0) {
+        return -1;
+    }
+    return finish_parse(res);
+}
+
+int sap_parse(int argc, char *argv[], SAPParseResult *res) {
+    assert(argc > 0);
+    assert(argv != NULL);
+    assert(res != NULL);
+
+    seal_root_cmd();
+    return parse_in_tree(&rootCmd, argc, argv, res);
+}
+
+void sap_free_result(SAPParseResult *res) {
+    if (res == NULL) {
+        return;
+    }
+    /* the argument lists and the counts are allocated from the arena of the result */
+    arena_free(&res->arena);
+    res->cmd = NULL;
+}
+
+void *sap_get_value(const SAPParseResult *res, const char *flag_name) {
+    assert(res != NULL);
+    assert(flag_name != NULL);
+
+    if (res->cmd == NULL) {
+        return NULL;
+    }
+    Flag *flag = get_flag(res->cmd, flag_name);
+    return (flag == NULL) ? NULL : res->values[get_flag_pos(res->cmd, flag)];
+}
+
+int sap_get_choice(const SAPParseResult *res, const char *flag_name) {
+    assert(res != NULL);
+    assert(flag_name != NULL);
+
+    if (res->cmd == NULL) {
+        return -1;
+    }
+    Flag *flag = get_flag(res->cmd, flag_name);
+    if (flag == NULL || flag->type != single_arg || flag->repeat == repeat_append) {
+        return -1;
+    }
+    return sap_choice_id(flag, (const char *) res->values[get_flag_pos(res->cmd, flag)]);
+}
+
+void *sap_get_positional(const SAPParseResult *res, int slot) {
+    assert(res != NULL);
+    assert(slot >= 0 && slot < MAX_POS_COUNT);
+    return (res->cmd == NULL) ? NULL : res->positionals[slot];
+}
+
+int sap_spawn_tail(const SAPParseResult *res, pid_t *pid) {
+    assert(res != NULL);
+    assert(pid != NULL);
+
+    if (res->tail_argv == NULL || res->tail_argc == 0) {
+        return EINVAL;
+    }
+    assert(res->tail_argv[res->tail_argc] == NULL);     /* the slice ends where argv ends */
+    return posix_spawnp(pid, res->tail_argv[0], NULL, NULL, res->tail_argv, environ);
+}
+
+SAPValueSource sap_get_source(const SAPParseResult *res, const char *flag_name) {
+    assert(res != NULL);
+    assert(flag_name != NULL);
+
+    Flag *flag = (res->cmd == NULL) ? NULL : get_flag(res->cmd, flag_name);
+    int pos = (flag == NULL) ? -1 : get_flag_pos(res->cmd, flag);
+    if (pos < 0 || !mask_test(&res->given, pos)) {
+        return source_default;
+    }
+    if (mask_test(&res->from_env, pos)) {
+        return source_env;
+    }
+    return mask_test(&res->from_config, pos) ? source_config : source_argv;
+}
+
+/**
+ * @brief move an incremental parse to a command, its values start with the defaults of its flags.
+ */
+static void state_enter_cmd(SAPParseState *st, SAPCommand *cmd, int idx) {
+    st->res.cmd = cmd;
+    st->res.argv_offset = idx;
+    memset(&st->res.given, 0, sizeof(SAPFlagMask));
+    for (int i = 0; i < cmd->flag_cnt; i++) {
+        st->res.values[i] = cmd->flags[i]->dft_value;
+        st->list_len[i] = 0;
+        st->list_cap[i] = 0;
+    }
+    st->dft_pos = (cmd->default_flag != NULL) ? get_flag_pos(cmd, cmd->default_flag) : -1;
+    if (st->dft_pos >= 0 && cmd->default_flag->type == no_arg) {
+        st->res.values[st->dft_pos] = (void *) &IS_PROVIDED;
+    }
+    memset(&st->pos_cursor, 0, sizeof(SAPPosCursor));
+    memset(st->res.positionals, 0, sizeof(st->res.positionals));
+    st->res.pos_cnt = 0;
+    st->pos_cap = 0;
+}
+
+/**
+ * @brief record the error of an incremental parse at the argv index $idx.
+ *
+ * @return int - -1
+ */
+static int state_error(SAPParseState *st, int idx) {
+    st->res.err = parseErr;
+    st->res.err.argv_idx = idx;
+    return -1;
+}
+
+/**
+ * @brief append an argument to the argument list of a flag, the list is reused by a repeated flag.
+ *
+ * the list must be complete after every feed, so it grows by doubling in the arena of the result.
+ */
+static void state_append_arg(SAPParseState *st, int slot, char *arg) {
+    char **list = (char **) st->res.values[slot];
+    if (st->list_len[slot] + 2 > st->list_cap[slot]) {
+        int cap = (st->list_cap[slot] == 0) ? 4 : st->list_cap[slot] * 2;
+        char **grown = (char **) arena_alloc(&st->res.arena, sizeof(char *) * cap);
+        if (st->list_len[slot] > 0) {
+            memcpy(grown, list, sizeof(char *) * st->list_len[slot]);
+        }
+        list = grown;
+        st->list_cap[slot] = cap;
+    }
+    list[st->list_len[slot]++] = arg;
+    list[st->list_len[slot]] = NULL;
+    st->res.values[slot] = list;
+}
+
+/**
+ * @brief a no_arg flag is given, a repeat_count flag counts it in list_len.
+ */
+static void state_mark_provided(SAPParseState *st, int slot) {
+    mask_set(&st->res.given, slot);
+    if (st->res.cmd->flags[slot]->repeat != repeat_count) {
+        st->res.values[slot] = (void *) &IS_PROVIDED;
+        return;
+    }
+    if (st->list_len[slot]++ == 0) {
+        st->res.values[slot] = arena_alloc(&st->res.arena, sizeof(int));
+    }
+    *(int *) st->res.values[slot] = st->list_len[slot];
+}
+
+/**
+ * @brief a value is given to a single_arg flag.
+ */
+static void state_set_value(SAPParseState *st, int slot, char *arg) {
+    if (st->res.cmd->flags[slot]->repeat == repeat_append) {
+        state_append_arg(st, slot, arg);
+    } else {
+        st->res.values[slot] = arg;
+    }
+}
+
+/**
+ * @brief a flag receiving argument(s) is given, the following tokens are its values.
+ *
+ * @param[in] attached  - the argument attached to a short option, NULL if none.
+ * @return int          - 0 if succeed, -1 if the attached argument isn't a choice of the flag.
+ */
+static int state_expect(SAPParseState *st, int slot, int idx, int off, char *attached) {
+    mask_set(&st->res.given, slot);
+    st->pending = slot;
+    st->pending_idx = idx;
+    st->pending_off = off;
+    st->pending_cnt = 0;
+    /* as parse_flags, the arguments given to the default flag override the ones given by its option */
+    st->pending_discard = (slot == st->dft_pos && st->positional_cnt > 0);
+    if (!st->pending_discard && st->res.cmd->flags[slot]->repeat != repeat_append) {
+        st->list_len[slot] = 0;     /* a repeated multi_arg flag starts a new list */
+    }
+
+    if (attached == NULL) {
+        return 0;
+    }
+    attached = check_choice(st->res.cmd->flags[slot], attached, (int) (off + 1));
+    if (attached == NULL) {
+        return state_error(st, idx);
+    }
+    if (st->pending_discard) {
+        st->pending_cnt = 1;
+        st->pending = (st->res.cmd->flags[slot]->type == single_arg) ? -1 : slot;
+    } else if (st->res.cmd->flags[slot]->type == single_arg) {
+        state_set_value(st, slot, attached);
+        st->pending = -1;
+    } else {
+        state_append_arg(st, slot, attached);
+        st->pending_cnt = 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief the pending flag can't receive any more value, check it receives enough.
+ *
+ * @return int - 0 if succeed, -1 if there are too few arguments.
+ */
+static int state_close_pending(SAPParseState *st) {
+    int slot = st->pending;
+    st->pending = -1;
+    if (slot < 0 || st->pending_cnt > 0) {
+        return 0;
+    }
+    const Flag *flag = st->res.cmd->flags[slot];
+    set_parse_err(too_few_args, (flag->type == single_arg) ? expect_arg : expect_args, st->pending_off, flag);
+    return state_error(st, st->pending_idx);
+}
+
+/**
+ * @brief parse a single token of the flags of the resolved command, the token-at-a-time version of parse_flags.
+ *
+ * @return int - 0 if succeed, -1 if there's an error.
+ */
+static int state_feed_flag(SAPParseState *st, char *argv[], int idx) {
+    SAPCommand *cmd = st->res.cmd;
+    void **values = st->res.values;
+    char *arg = argv[idx];
+    ArgType type = st->operands_only ? normal_arg : get_option_type(arg);
+
+    if (st->pending >= 0) {
+        if (type == normal_arg) {
+            arg = check_choice(cmd->flags[st->pending], arg, 0);
+            if (arg == NULL) {
+                return state_error(st, idx);
+            }
+            if (st->pending_discard) {
+                st->pending_cnt++;
+                st->pending = (cmd->flags[st->pending]->type == single_arg) ? -1 : st->pending;
+            } else if (cmd->flags[st->pending]->type == single_arg) {
+                state_set_value(st, st->pending, arg);
+                st->pending = -1;
+            } else {
+                state_append_arg(st, st->pending, arg);
+                st->pending_cnt++;
+            }
+            return 0;
+        }
+        /* an option ends the arguments of the pending flag */
+        if (state_close_pending(st) != 0) {
+            return -1;
+        }
+    }
+
+    switch (type)
+    {
+    case error_option:
+        set_parse_err(unknown_arg, expect_flag, 0, NULL);
+        return state_error(st, idx);
+    case end_of_options:
+        if (!cmd->passthrough) {
+            st->operands_only = 1;  /* the rest are operands, even if they start with '-' */
+            return 0;
+        }
+        /* the rest is the tail, it isn't fed */
+        st->tail_idx = idx + 1;
+        return 0;
+    case short_option: {
+        SAPFlagIndex *index = get_flag_index(cmd);
+        for (char *p_ch = arg + 1; *p_ch != '\0'; p_ch++) {
+            int slot = index->by_shorthand[(unsigned char) *p_ch];
+            if (slot == 0) {    /* unknown flag */
+                set_parse_err(unknown_arg, expect_flag, (int) (p_ch - arg), NULL);
+                return state_error(st, idx);
+            }
+            if (cmd->flags[slot - 1]->type == no_arg) {
+                state_mark_provided(st, slot - 1);
+                continue;
+            }
+            /* the rest of the cluster is the argument of the flag */
+            return state_expect(st, slot - 1, idx, (int) (p_ch - arg), (p_ch[1] != '\0') ? p_ch + 1 : NULL);
+        }
+        return 0;
+    }
+    case long_option: {
+        int i = lookup_long_flag(cmd, arg + 2, strlen(arg + 2), is_prefix_match_on(cmd));
+        if (i < 0) {                /* unknown or ambiguous flag */
+            return state_error(st, idx);
+        }
+        if (cmd->flags[i]->type == no_arg) {
+            state_mark_provided(st, i);
+            return 0;
+        }
+        return state_expect(st, i, idx, 0, NULL);
+    }
+    case long_option_with_equal: {
+        char *p_equal_ch = strchr(arg, '=');
+        int i = lookup_long_flag(cmd, arg + 2, (size_t) (p_equal_ch - arg - 2), is_prefix_match_on(cmd));
+        if (i < 0) {                /* unknown or ambiguous flag */
+            return state_error(st, idx);
+        }
+        if (cmd->flags[i]->type != single_arg) {
+            set_parse_err(illegal_equal, expect_no_value, (int) (p_equal_ch - arg), cmd->flags[i]);
+            return state_error(st, idx);
+        }
+        char *choice = check_choice(cmd->flags[i], p_equal_ch + 1, (int) (p_equal_ch + 1 - arg));
+        if (choice == NULL) {
+            return state_error(st, idx);
+        }
+        mask_set(&st->res.given, i);
+        state_set_value(st, i, choice);
+        return 0;
+    }
+    default:
+        if (cmd->positionals != NULL) {
+            /* a positional argument, the list of the variadic tail must be complete after every feed */
+            const SAPPositionals *schema = cmd->positionals;
+            int slot = pos_assign(schema, &st->pos_cursor, arg, idx);
+            if (slot < 0) {
+                return 0;
+            }
+            if (schema->slots[slot].max_cnt == 1) {
+                st->res.positionals[slot] = arg;
+            } else {
+                char **list = (char **) st->res.positionals[slot];
+                int len = st->res.pos_cnt - slot;   /* the slots before it take one argument each */
+                if (len + 2 > st->pos_cap) {
+                    int cap = (st->pos_cap == 0) ? 4 : st->pos_cap * 2;
+                    char **grown = (char **) arena_alloc(&st->res.arena, sizeof(char *) * cap);
+                    if (len > 0) {
+                        memcpy(grown, list, sizeof(char *) * len);
+                    }
+                    list = grown;
+                    st->pos_cap = cap;
+                }
+                list[len] = arg;
+                list[len + 1] = NULL;
+                st->res.positionals[slot] = list;
+            }
+            st->res.pos_cnt++;
+            return 0;
+        }
+        /* a normal arg is given to the default flag */
+        if (st->dft_pos >= 0 && cmd->default_flag->repeat == repeat_append) {
+            /* appended in order with the values given by the option of the default flag */
+            char *choice = check_choice(cmd->default_flag, arg, 0);
+            if (choice == NULL) {
+                return state_error(st, idx);
+            }
+            state_append_arg(st, st->dft_pos, choice);
+            mask_set(&st->res.given, st->dft_pos);
+            return 0;
+        }
+        if (
+            st->dft_pos < 0 || cmd->default_flag->type == no_arg ||
+            (cmd->default_flag->type == single_arg && st->positional_cnt > 0)
+        ) {
+            /* as parse_flags, it's reported at the end if no other error occurs */
+            if (st->extra_idx == 0) {
+                st->extra_idx = idx;
+            }
+            return 0;
+        }
+        char *choice = check_choice(cmd->default_flag, arg, 0);
+        if (choice == NULL) {
+            /* as parse_flags, it's reported at the end if no other error occurs */
+            if (st->bad_choice_idx == 0) {
+                st->bad_choice_idx = idx;
+            }
+            choice = arg;
+        }
+        arg = choice;
+        mask_set(&st->res.given, st->dft_pos);
+        if (cmd->default_flag->type == single_arg) {
+            values[st->dft_pos] = arg;
+        } else {
+            if (st->positional_cnt == 0) {
+                st->list_len[st->dft_pos] = 0;
+            }
+            state_append_arg(st, st->dft_pos, arg);
+        }
+        st->positional_cnt++;
+        return 0;
+    }
+}
+
+/**
+ * @brief parse a single token of an incremental parse.
+ *
+ * @return int - 0 if succeed, -1 if there's an error.
+ */
+static int state_feed(SAPParseState *st, char *argv[], int idx) {
+    if (st->resolving) {
+        SAPCommand *cmd = st->res.cmd;
+        if (argv[idx][0] != '-') {
+            /* a subcommand, hash the name once and compare the interned ids */
+            SAPCommand *child = find_child(cmd, argv[idx]);
+            if (child != NULL) {
+                state_enter_cmd(st, child, idx);
+                st->resolving = (child->tree_node.child_cnt != 0);
+                return 0;
+            }
+            if (cmd->default_flag == NULL && cmd->positionals == NULL) {
+                /* unknown command, the result refers to the whole argv */
+                st->res.cmd = NULL;
+                st->res.argv_offset = 0;
+                set_parse_err(unknown_cmd, expect_cmd, 0, NULL);
+                return state_error(st, idx);
+            }
+        }
+        /* an option, or an argument of the default flag: the command is resolved */
+        st->resolving = 0;
+    }
+
+    if (st->res.cmd->parse_by_self == 1) {
+        /* the arguments are parsed by the handler itself */
+        return 0;
+    }
+    return state_feed_flag(st, argv, idx);
+}
+
+void sap_parse_begin(SAPParseState *st) {
+    assert(st != NULL);
+
+    seal_root_cmd();
+    memset(st, 0, sizeof(SAPParseState));
+    st->res.err.flag_id = SAP_NIL;
+    st->pending = -1;
+    state_enter_cmd(st, &rootCmd, 0);
+    st->resolving = (rootCmd.tree_node.child_cnt != 0);
+}
+
+int sap_parse_feed(SAPParseState *st, int argc, char *argv[]) {
+    assert(st != NULL);
+    assert(argv != NULL);
+    assert(argc >= st->pos);
+
+    int ret = (st->res.err.code == parse_ok) ? 0 : -1;
+    if (st->pos == 0 && argc > 0) {
+        st->pos = 1;    /* argv[0] is the root command, or the entry point of a multi-call binary */
+        SAPCommand *entry = find_entry_cmd(&rootCmd, argv[0]);
+        if (entry != NULL) {
+            state_enter_cmd(st, entry, 0);
+            st->resolving = (entry->tree_node.child_cnt != 0);
+        }
+    }
+    while (ret == 0 && st->pos < argc && st->tail_idx == 0) {
+        ret = state_feed(st, argv, st->pos++);
+    }
+    if (st->tail_idx != 0) {
+        /* the tail is taken as it is, it's sliced again as argv may move between the feeds */
+        st->pos = argc;
+        st->res.tail_argv = argv + st->tail_idx;
+        st->res.tail_argc = argc - st->tail_idx;
+    }
+
+    st->res.argv = argv + st->res.argv_offset;
+    st->res.argc = st->pos - st->res.argv_offset;
+    return ret;
+}
+
+int sap_parse_end(SAPParseState *st) {
+    assert(st != NULL);
+
+    if (st->res.err.code == parse_ok && st->pending >= 0) {
+        state_close_pending(st);
+    }
+    if (st->res.err.code == parse_ok && st->extra_idx != 0) {
+        set_parse_err(too_many_args, expect_nothing, 0, st->res.cmd->default_flag);
+        state_error(st, st->extra_idx);
+    }
+    if (st->res.err.code == parse_ok && st->bad_choice_idx != 0) {
+        set_parse_err(invalid_choice, expect_choice, 0, st->res.cmd->default_flag);
+        state_error(st, st->bad_choice_idx);
+    }
+    if (st->res.err.code == parse_ok && st->res.cmd->positionals != NULL && st->res.cmd->parse_by_self == 0) {
+        int idx = pos_finish(st->res.cmd->positionals, &st->pos_cursor, st->pos);
+        if (idx != 0) {
+            state_error(st, idx);
+        }
+    }
+    if (st->res.err.code == parse_ok && st->res.cmd->parse_by_self == 0 && resolve_fallbacks(&st->res) != 0) {
+        state_error(st, -1);
+    }
+    if (st->res.err.code == parse_ok && st->res.cmd->parse_by_self == 0 && check_constraints(st->res.cmd, &st->res.given) != 0) {
+        state_error(st, st->res.argv_offset);
+    }
+    return (st->res.err.code == parse_ok) ? 0 : -1;
+}
+
+void sap_parse_state_free(SAPParseState *st) {
+    assert(st != NULL);
+    sap_free_result(&st->res);
+}
+
+void set_cmd_async_exec(SAPCommand *cmd, CmdExecAsync exec_async) {
+    assert(cmd != NULL);
+    cmd->exec_async = exec_async;
+}
+
+int do_parse_subcmd(int argc, char *argv[]) {
+    /* the values of the last parse are referred by the flags until the next parse or free_root_cmd */
+    sap_free_result(&lastResult);
+
+    sap_parse(argc, argv, &lastResult);
+
+    /* if the command to execute is found */
+    if (lastResult.cmd != NULL) {
+        /* execute the command and return its result */
+        return call_exec(&lastResult);
+    } else {
+        /* report the unknown command */
+        errorSink(&lastResult, errorSinkCtx);
+        /* return -1 to indicate an unknown command */
+        return -1;
+    }
+}
+
+int sap_make_links(const char *dir, const char *target) {
+    assert(dir != NULL);
+    assert(target != NULL);
+
+    seal_root_cmd();
+    ensure_built(&rootCmd);
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        return -1;
+    }
+
+    int cnt = 0;
+    for (int i = 0; i < rootCmd.tree_node.child_cnt; i++) {
+        const SAPCommand *cmd = node2cmd(rootCmd.tree_node.children[i]);
+        if (cmd == &helpCmd) {
+            continue;   /* the help command isn't an entry point */
+        }
+
+        char path[4096];
+        if (snprintf(path, sizeof(path), "%s/%s", dir, cmd->name) >= (int) sizeof(path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        if (symlink(target, path) != 0) {
+            /* only a symlink is replaced, a regular file of the name may be something else */
+            struct stat st;
+            if (errno != EEXIST || lstat(path, &st) != 0 || !S_ISLNK(st.st_mode) ||
+                unlink(path) != 0 || symlink(target, path) != 0) {
+                return -1;
+            }
+        }
+        cnt++;
+    }
+    return cnt;
+}
+
+/**
+ * @brief free the memory the library allocated for a command: its indices, constraints, aliases and slots.
+ */
+static void free_cmd_memory(SAPCommand *cmd) {
+    free(cmd->flag_index);
+    cmd->flag_index = NULL;
+    free(cmd->child_index);
+    cmd->child_index = NULL;
+    if (cmd->constraints != NULL) {
+        for (int k = 0; k < cmd->constraints->cnt; k++) {
+            free(cmd->constraints->items[k].flags);
+        }
+        free(cmd->constraints->items);
+        free(cmd->constraints->one_of);
+        free(cmd->constraints);
+        cmd->constraints = NULL;
+    }
+    free(cmd->aliases);
+    cmd->aliases = NULL;
+    free(cmd->positionals);
+    cmd->positionals = NULL;
+}
+
+/**
+ * @brief free the memory the library allocated for a flag: its choices and aliases.
+ */
+static void free_flag_memory(Flag *flag) {
+    free(flag->choices);
+    flag->choices = NULL;
+    free(flag->aliases);
+    flag->aliases = NULL;
+}
+
+/**
+ * @brief remove a flag from a command, the flags after it move forward.
+ *
+ * @return int - 1 if the command held the flag, 0 otherwise.
+ */
+static int drop_flag(SAPCommand *cmd, const Flag *flag) {
+    int pos = get_flag_pos(cmd, flag);
+    if (pos < 0) {
+        return 0;
+    }
+    memmove(&cmd->flags[pos], &cmd->flags[pos + 1], sizeof(Flag *) * (size_t) (cmd->flag_cnt - pos - 1));
+    cmd->flag_cnt--;
+    if (cmd->default_flag == flag) {
+        cmd->default_flag = NULL;
+    }
+    free(cmd->flag_index);      /* the positions moved, as add_flag does */
+    cmd->flag_index = NULL;
+
+    /* the constraints on the flag go with it, the others are compiled again */
+    SAPConstraintSet *set = cmd->constraints;
+    if (set != NULL) {
+        int kept = 0;
+        for (int k = 0; k < set->cnt; k++) {
+            if (has_flag(set->items[k].flags, set->items[k].flag_cnt, flag)) {
+                free(set->items[k].flags);
+            } else {
+                set->items[kept++] = set->items[k];
+            }
+        }
+        set->cnt = kept;
+        set->compiled = 0;
+    }
+    return 1;
+}
+
+void free_flag(Flag *flag) {
+    assert(flag != NULL);
+
+    if (flag != &helpFlag) {
+        uint32_t cmd_cnt;
+        SAPCommand **cmds = collect_cmds_bfs(&rootCmd, 0, &cmd_cnt);
+        for (uint32_t i = 0; i < cmd_cnt; i++) {
+            drop_flag(cmds[i], flag);
+        }
+        free(cmds);
+    }
+    for (int k = 0; k < persistCnt; k++) {
+        if (persistFlags[k] == flag) {
+            memmove(&persistFlags[k], &persistFlags[k + 1], sizeof(Flag *) * (size_t) (persistCnt - k - 1));
+            persistCnt--;
+            break;
+        }
+    }
+    free_flag_memory(flag);
+}
+
+void free_sap_command(SAPCommand *cmd) {
+    assert(cmd != NULL);
+    assert(cmd != &rootCmd);    /* the root is freed by free_root_cmd */
+
+    if (cmd->tree_node.parent != NULL) {
+        remove_subcmd(node2cmd(cmd->tree_node.parent), cmd);
+    }
+    uint32_t cmd_cnt;
+    SAPCommand **cmds = collect_cmds_bfs(cmd, 0, &cmd_cnt);
+    for (uint32_t i = 0; i < cmd_cnt; i++) {
+        free_cmd_memory(cmds[i]);
+    }
+    free(cmds);
+    free_node_tree(&cmd->tree_node);
+}
+
+void free_root_cmd() {
+    sap_free_result(&lastResult);
+    free_versions();
+
+    #define not_stack_select (((stack_select) == 0)? 1: 0)
+    TreeNode *stack[MAX_CMD_COUNT][2];      /* two stack cosplay a queue */
+    int top[2] = {-1, -1};                  /* the top ptr of the two stack */
+    int stack_select = 0;                   /* select the available stack*/
+
+    /* push the root into stack */
+    stack[++top[stack_select]][stack_select] = &(rootCmd.tree_node);
+
+    while (top[stack_select] >= 0) {
+        TreeNode *stack_top = stack[top[stack_select]][stack_select];
+        SAPCommand *crt_cmd = node2cmd(stack_top);   /* current command */
+
+        free_cmd_memory(crt_cmd);
+        for (int i = 0; i < crt_cmd->flag_cnt; i++) {
+            /* a persist flag is shared by the commands, its choices are freed on the first visit */
+            free_flag_memory(crt_cmd->flags[i]);
+        }
+
+        for (int i = 0; i < stack_top->child_cnt; i++) {
+            /* push the subcmds into the other stack */
+            stack[++top[not_stack_select]][not_stack_select] = stack_top->children[i];
+        }
+
+        if (--top[stack_select] < 0) {
+            /* pop and judge whether the stack is empty */
+            stack_select = not_stack_select;    /* switch the stack */
+        }
+
+        /* ---- non-leaf node ---- */
+    }
+    #undef not_stack_select
+    free(helpCmd.default_flag);
+    helpCmd.default_flag = NULL;    /* allocated again by the next seal, a tree freed before it is sealed has none */
+    free_node_tree(&rootCmd.tree_node);
+    while (childBlocks != NULL) {
+        SAPChildBlock *block = childBlocks;
+        childBlocks = block->next;
+        free(block);
+    }
+    while (usageCmds != NULL) {
+        SAPUsageCmd *usage = usageCmds;
+        usageCmds = usage->next;
+        free(usage);
+    }
+    sap_str_pool_free(&namePool);       /* the name ids are invalid from now on */
+    sap_output_free(&dftOutputs[sap_out_channel]);  /* the default outputs allocate their buffers again if used */
+    sap_output_free(&dftOutputs[sap_err_channel]);
+    sap_free_config();
+    is_sealed = 0;
+    persistCnt = 0;
+    g_cmd_cnt = 0;                      /* the commands can be initialized again */
+}
+
+/* ---- global frame functions that will be called by user ---- */
+
+
+
+/* ++++ functions of tree versions ++++ */
+
+struct SAPTreeVersion_ {
+    uint64_t gen;               /* the number of the version, from 1 */
+    uint32_t cmd_cnt;           /* the number of the commands */
+    SAPCommand *cmds;           /* the copies of the commands in breadth-first order, cmds[0] is the root */
+    TreeNode **children;        /* the child arrays of all the copies, in the same order */
+    SAPStrPool names;           /* the copy of the interned names */
+    uint64_t retire_epoch;      /* the epoch it was replaced in, the readers entered after it never see it */
+    struct SAPTreeVersion_ *next_retired;   /* the next replaced version not reclaimed yet */
+};
+
+static pthread_mutex_t treeLock = PTHREAD_MUTEX_INITIALIZER;       /* serializes the writers and the publishes */
+static pthread_mutex_t readersLock = PTHREAD_MUTEX_INITIALIZER;    /* guards the list of the readers */
+static SAPTreeVersion *currentVersion = NULL;   /* the published version, read by the readers without a lock */
+static SAPTreeVersion *retiredVersions = NULL;  /* the replaced versions not reclaimed yet, guarded by treeLock */
+static SAPRcuReader *rcuReaders = NULL;         /* the registered readers, guarded by readersLock */
+static uint64_t rcuEpoch = 1;                   /* the global epoch, advanced by every publish */
+static uint64_t versionGen = 0;                 /* the number of the last published version */
+
+void sap_tree_lock(void) {
+    pthread_mutex_lock(&treeLock);
+}
+
+void sap_tree_unlock(void) {
+    pthread_mutex_unlock(&treeLock);
+}
+
+static void *memdup(const void *src, size_t size) {
+    void *dst = malloc((size == 0) ? 1 : size);
+    assert(dst != NULL);
+    if (size != 0) {
+        memcpy(dst, src, size);
+    }
+    return dst;
+}
+
+/**
+ * @brief copy the constraints of a command, compiled, so a version never compiles them again.
+ */
+static SAPConstraintSet *copy_constraints(SAPCommand *cmd) {
+    compile_constraints(cmd);
+    const SAPConstraintSet *set = cmd->constraints;
+    SAPConstraintSet *copy = (SAPConstraintSet *) memdup(set, sizeof(SAPConstraintSet));
+    copy->cap = set->cnt;
+    copy->items = (SAPConstraint *) memdup(set->items, sizeof(SAPConstraint) * set->cnt);
+    for (int k = 0; k < set->cnt; k++) {
+        copy->items[k].flags = (Flag **) memdup(set->items[k].flags, sizeof(Flag *) * set->items[k].flag_cnt);
+    }
+    copy->one_of = (SAPFlagMask *) memdup(set->one_of, sizeof(SAPFlagMask) * set->one_of_cnt);
+    return copy;
+}
+
+static void free_version(SAPTreeVersion *version) {
+    for (uint32_t i = 0; i < version->cmd_cnt; i++) {
+        SAPCommand *cmd = &version->cmds[i];
+        free(cmd->flag_index);
+        free(cmd->child_index);
+        if (cmd->constraints != NULL) {
+            for (int k = 0; k < cmd->constraints->cnt; k++) {
+                free(cmd->constraints->items[k].flags);
+            }
+            free(cmd->constraints->items);
+            free(cmd->constraints->one_of);
+            free(cmd->constraints);
+        }
+    }
+    free(version->cmds);
+    free(version->children);
+    sap_str_pool_free(&version->names);
+    free(version);
+}
+
+/**
+ * @brief copy the current command tree into an immutable version, with every index a parse needs built.
+ *
+ * the commands are copied in breadth-first order, so the children of a command are contiguous and the
+ * copied parents and children are found by the positions. called with treeLock held.
+ */
+static SAPTreeVersion *build_version(void) {
+    seal_root_cmd();
+
+    uint32_t cmd_cnt;
+    SAPCommand **cmds = collect_cmds_bfs(&rootCmd, 1, &cmd_cnt);
+    SAPTreeVersion *version = (SAPTreeVersion *) calloc(1, sizeof(SAPTreeVersion));
+    assert(version != NULL);
+    version->cmd_cnt = cmd_cnt;
+    version->cmds = (SAPCommand *) malloc(sizeof(SAPCommand) * cmd_cnt);
+    version->children = (TreeNode **) malloc(sizeof(TreeNode *) * cmd_cnt);
+    assert(version->cmds != NULL && version->children != NULL);
+
+    for (uint32_t i = 0; i < cmd_cnt; i++) {
+        SAPCommand *copy = &version->cmds[i];
+        *copy = *cmds[i];
+        copy->origin = cmds[i];
+        copy->flag_index = NULL;
+        copy->child_index = NULL;
+        copy->builder = NULL;
+        copy->constraints = (cmds[i]->constraints == NULL) ? NULL : copy_constraints(cmds[i]);
+    }
+    free(cmds);
+
+    /* relink the copies, the children of cmds[i] follow those of cmds[i - 1] */
+    version->cmds[0].tree_node.parent = NULL;
+    uint32_t next = 1;
+    for (uint32_t i = 0; i < cmd_cnt; i++) {
+        TreeNode *node = &version->cmds[i].tree_node;
+        node->children = (node->child_cnt == 0) ? NULL : &version->children[next - 1];
+        node->in_block = node->child_cnt != 0;     /* the children arrays of the copies are freed with the version */
+        for (int j = 0; j < node->child_cnt; j++, next++) {
+            version->children[next - 1] = &version->cmds[next].tree_node;
+            version->cmds[next].tree_node.parent = node;
+        }
+    }
+
+    /* the names, then the indices of the copies, so the readers never build anything */
+    version->names = namePool;
+    version->names.buf = (char *) memdup(namePool.buf, namePool.buf_len);
+    version->names.buf_cap = namePool.buf_len;
+    version->names.entries = (SAPStrEntry *) memdup(namePool.entries, sizeof(SAPStrEntry) * namePool.cnt);
+    version->names.entry_cap = namePool.cnt;
+    version->names.slots = (uint32_t *) memdup(namePool.slots, sizeof(uint32_t) * namePool.slot_cap);
+    for (uint32_t i = 0; i < cmd_cnt; i++) {
+        SAPFlagIndex *index = get_flag_index(&version->cmds[i]);
+        get_child_index(&version->cmds[i]);
+        if (usageGen != 0) {
+            resolve_usage(&version->cmds[i], index);
+        }
+    }
+    return version;
+}
+
+/**
+ * @brief free the replaced versions no reader can hold: those replaced before the oldest epoch a reader entered in.
+ *
+ * called with treeLock held.
+ */
+static void reclaim_versions(void) {
+    uint64_t oldest = UINT64_MAX;
+    pthread_mutex_lock(&readersLock);
+    for (SAPRcuReader *reader = rcuReaders; reader != NULL; reader = reader->next) {
+        uint64_t epoch = __atomic_load_n(&reader->epoch, __ATOMIC_SEQ_CST);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    pthread_mutex_unlock(&readersLock);
+
+    SAPTreeVersion **link = &retiredVersions;
+    while (*link != NULL) {
+        SAPTreeVersion *version = *link;
+        if (version->retire_epoch < oldest) {
+            *link = version->next_retired;
+            free_version(version);
+        } else {
+            link = &version->next_retired;
+        }
+    }
+}
+
+uint64_t sap_tree_publish(void) {
+    pthread_mutex_lock(&treeLock);
+    SAPTreeVersion *version = build_version();
+    uint64_t gen = version->gen = ++versionGen;    /* the version may be replaced and reclaimed once unlocked */
+
+    /* a reader entering after the epoch advances reads the new version */
+    SAPTreeVersion *old = __atomic_exchange_n(&currentVersion, version, __ATOMIC_SEQ_CST);
+    if (old != NULL) {
+        old->retire_epoch = __atomic_fetch_add(&rcuEpoch, 1, __ATOMIC_SEQ_CST);
+        old->next_retired = retiredVersions;
+        retiredVersions = old;
+    }
+    reclaim_versions();
+    pthread_mutex_unlock(&treeLock);
+    return gen;
+}
+
+void sap_rcu_synchronize(void) {
+    for (;;) {
+        pthread_mutex_lock(&treeLock);
+        reclaim_versions();
+        int done = (retiredVersions == NULL);
+        pthread_mutex_unlock(&treeLock);
+        if (done) {
+            return;
+        }
+        sched_yield();
+    }
+}
+
+void sap_rcu_register(SAPRcuReader *reader) {
+    assert(reader != NULL);
+    reader->epoch = 0;
+    pthread_mutex_lock(&readersLock);
+    reader->next = rcuReaders;
+    rcuReaders = reader;
+    pthread_mutex_unlock(&readersLock);
+}
+
+void sap_rcu_unregister(SAPRcuReader *reader) {
+    assert(reader != NULL);
+    assert(reader->epoch == 0);     /* outside the read-side critical section */
+    pthread_mutex_lock(&readersLock);
+    SAPRcuReader **link = &rcuReaders;
+    while (*link != NULL && *link != reader) {
+        link = &(*link)->next;
+    }
+    if (*link != NULL) {
+        *link = reader->next;
+    }
+    pthread_mutex_unlock(&readersLock);
+}
+
+const SAPTreeVersion *sap_rcu_read_lock(SAPRcuReader *reader) {
+    assert(reader != NULL);
+    /* announce the epoch before reading the version, a publish scanning the readers after it keeps the version */
+    __atomic_store_n(&reader->epoch, __atomic_load_n(&rcuEpoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&currentVersion, __ATOMIC_SEQ_CST);
+}
+
+void sap_rcu_read_unlock(SAPRcuReader *reader) {
+    assert(reader != NULL);
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+}
+
+int sap_version_parse(const SAPTreeVersion *version, int argc, char *argv[], SAPParseResult *res) {
+    assert(version != NULL);
+    assert(argc > 0);
+    assert(argv != NULL);
+    assert(res != NULL);
+
+    /* the indices of the version are built, the parse only reads it */
+    versionNames = &version->names;
+    int ret = parse_in_tree(&version->cmds[0], argc, argv, res);
+    versionNames = NULL;
+    return ret;
+}
+
+uint64_t sap_version_gen(const SAPTreeVersion *version) {
+    assert(version != NULL);
+    return version->gen;
+}
+
+const SAPCommand *sap_version_root(const SAPTreeVersion *version) {
+    assert(version != NULL);
+    return &version->cmds[0];
+}
+
+/**
+ * @brief free the published and the replaced versions, the readers must have left.
+ */
+static void free_versions(void) {
+    if (currentVersion != NULL) {
+        free_version(currentVersion);
+        currentVersion = NULL;
+    }
+    while (retiredVersions != NULL) {
+        SAPTreeVersion *version = retiredVersions;
+        retiredVersions = version->next_retired;
+        free_version(version);
+    }
+}
+
+/* ---- functions of tree versions ---- */
+
+
+
+/* ++++ functions of parse cache ++++ */
+
+typedef enum {
+    cached_default = 0, /* the default of the flag, NULL for a positional slot */
+    cached_ptr = 1,     /* another value not in argv (a choice, IS_PROVIDED), kept in the pointers of the entry */
+    cached_arg = 2,     /* a value in argv, kept as its token and its byte offset */
+    cached_list = 3,    /* a list of the values, kept as its items */
+    cached_count = 4    /* the count of a repeat_count flag */
+} CachedKind;
+
+typedef struct {
+    uint32_t kind : 3;  /* the CachedKind */
+    uint32_t idx : 29;  /* the pointer, the token (in the whole argv), the first item or the count, by the kind */
+    uint32_t off;       /* cached_arg: the byte offset in the token, cached_list: the number of the items */
+} SAPCachedValue;
+
+typedef struct SAPCacheEntry_ {
+    struct SAPCacheEntry_ *next;    /* the next entry of the bucket */
+    uint64_t hash;                  /* the hash of the key */
+    uint32_t key_len;               /* the bytes of the key */
+    int argc;                       /* the number of the tokens */
+    SAPCommand *cmd;                /* the resolved command */
+    int argv_offset;                /* the index of the command name in the whole argv */
+    int tail_idx;                   /* the index of the arguments after "--" in the whole argv, -1 if no "--" */
+    int pos_cnt;
+    int value_cnt;                  /* the values of the flags, then the positional slots */
+    uint32_t arena_size;            /* the bytes of the lists and the counts, allocated again by each hit */
+    SAPFlagMask given;              /* the flags given on the command line */
+    SAPCachedValue *values;
+    SAPCachedValue *items;          /* the items of the lists */
+    void **ptrs;                    /* the values kept as they are */
+    uint64_t used_at;               /* the lookup which moved it to the front of the LRU list */
+    struct SAPCacheEntry_ *newer;   /* the more recently used entry, NULL for the most recent */
+    struct SAPCacheEntry_ *older;   /* the less recently used entry, NULL for the least recent */
+    char key[];                     /* the tokens of the command line, each ended by its '\0' */
+} SAPCacheEntry;
+
+struct SAPParseCache_ {
+    int capacity;
+    int cnt;
+    uint32_t mask;                  /* the number of the buckets - 1 */
+    SAPCacheEntry **buckets;
+    uint64_t *seen;                 /* the hashes of the lines missed once, (mask + 1) * 4 of them */
+    SAPCacheEntry *newest;          /* the LRU list */
+    SAPCacheEntry *oldest;
+    uint32_t window;                /* the lookups of the current window */
+    uint32_t window_hits;
+    int bypass;                     /* the last window didn't pay, the lines but a sample are parsed directly */
+    int skipped;                    /* the lines parsed directly since the last sampled one */
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t bypassed;
+    uint64_t evictions;
+};
+
+#define CACHE_WINDOW 1024   /* the lookups over which the hit rate is measured */
+#define CACHE_SAMPLE 16     /* while bypassed, one line out of this many is still looked up */
+
+SAPParseCache *sap_cache_create(int capacity) {
+    assert(capacity > 0);
+
+    SAPParseCache *cache = (SAPParseCache *) calloc(1, sizeof(SAPParseCache));
+    assert(cache != NULL);
+    uint32_t bucket_cnt = 16;
+    while (bucket_cnt < (uint32_t) capacity) {
+        bucket_cnt <<= 1;
+    }
+    cache->capacity = capacity;
+    cache->mask = bucket_cnt - 1;
+    cache->buckets = (SAPCacheEntry **) calloc(bucket_cnt, sizeof(SAPCacheEntry *));
+    cache->seen = (uint64_t *) calloc((size_t) bucket_cnt * 4, sizeof(uint64_t));
+    assert(cache->buckets != NULL && cache->seen != NULL);
+    return cache;
+}
+
+static inline uint64_t mix_word(uint64_t hash, uint64_t word) {
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 29);
+}
+
+/**
+ * @brief load up to 8 bytes of a token as a word, two tokens of the same length are equal iff their words are.
+ *
+ * the loads overlap instead of reading past the token.
+ */
+static inline uint64_t load_word(const char *p, uint32_t len) {
+    uint64_t word;
+    if (len >= 8) {
+        memcpy(&word, p, sizeof(word));
+    } else if (len >= 4) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, sizeof(lo));
+        memcpy(&hi, p + len - 4, sizeof(hi));
+        word = ((uint64_t) hi << 32) | lo;
+    } else if (len > 0) {
+        word = ((uint64_t) (unsigned char) p[0] << 16) | ((uint64_t) (unsigned char) p[len / 2] << 8) | (unsigned char) p[len - 1];
+    } else {
+        word = 0;
+    }
+    return word;
+}
+
+/**
+ * @brief hash the tokens of a command line with their lengths, so "ab" "c" differs from "a" "bc".
+ *
+ * a token of up to 8 bytes is a single word and a single multiply, the longer ones are mixed 8 bytes at a time.
+ * the tokens are multiplied on their own before they're combined, so the multiplies overlap instead of forming a chain.
+ *
+ * @param[out] lens     - the lengths of the tokens.
+ * @param[out] key_len  - the length of the key: the bytes of the tokens and their terminators.
+ */
+static uint64_t hash_argv(int argc, char *argv[], uint32_t *lens, size_t *key_len) {
+    uint64_t hash = 14695981039346656037ULL;
+    size_t total = 0;
+    for (int i = 0; i < argc; i++) {
+        const char *p = argv[i];
+        uint32_t len = (uint32_t) strlen(p);
+        lens[i] = len;
+        uint64_t token;
+        if (len <= 8) {
+            token = load_word(p, len) + len;
+        } else {
+            /* the last word overlaps the previous one if the length isn't a multiple of 8 */
+            token = load_word(p + len - 8, 8) + len;
+            for (uint32_t k = 0; k + 8 < len; k += 8) {
+                token = mix_word(token, load_word(p + k, 8));
+            }
+        }
+        hash = ((hash << 23) | (hash >> 41)) ^ (token * 0x9E3779B97F4A7C15ULL);
+        total += len + 1;
+    }
+    *key_len = total;
+    return mix_word(hash, (uint64_t) argc);
+}
+
+/**
+ * @brief whether the key of an entry is the command line, the hashes are equal already.
+ *
+ * each token is compared with its terminator, so a longer token of the key doesn't match.
+ */
+static int key_equal(const SAPCacheEntry *entry, int argc, char *argv[], const uint32_t *lens, size_t key_len) {
+    if (entry->argc != argc || entry->key_len != key_len) {
+        return 0;
+    }
+    const char *key = entry->key;
+    for (int i = 0; i < argc; i++) {
+        if (memcmp(argv[i], key, lens[i] + 1) != 0) {
+            return 0;
+        }
+        key += lens[i] + 1;
+    }
+    return 1;
+}
+
+static void lru_unlink(SAPParseCache *cache, SAPCacheEntry *entry) {
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    } else {
+        cache->newest = entry->older;
+    }
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    } else {
+        cache->oldest = entry->newer;
+    }
+}
+
+static void lru_push(SAPParseCache *cache, SAPCacheEntry *entry) {
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest != NULL) {
+        cache->newest->newer = entry;
+    } else {
+        cache->oldest = entry;
+    }
+    cache->newest = entry;
+}
+
+static int list_len(char **list) {
+    int len = 0;
+    while (list[len] != NULL) {
+        len++;
+    }
+    return len;
+}
+
+/**
+ * @brief the kind of a value of a result, before the pointers are told from the arguments.
+ *
+ * @param[in] flag  - the flag of the value, NULL for a positional slot.
+ */
+static CachedKind value_kind(const Flag *flag, int variadic, void *value) {
+    if (value == NULL || (flag != NULL && value == flag->dft_value)) {
+        return (value == NULL && flag != NULL && flag->dft_value != NULL) ? cached_ptr : cached_default;
+    }
+    if (flag == NULL) {
+        return variadic ? cached_list : cached_arg;
+    }
+    if (flag->type == no_arg) {
+        return (flag->repeat == repeat_count && value != (void *) &IS_PROVIDED) ? cached_count : cached_ptr;
+    }
+    return (flag->type == multi_arg || flag->repeat == repeat_append) ? cached_list : cached_arg;
+}
+
+/**
+ * @brief encode a string of a result, the string in argv is kept as its token and its byte offset.
+ */
+static SAPCachedValue encode_str(void *value, int argc, char *argv[], const uint32_t *lens, void **ptrs, int *ptr_cnt) {
+    uintptr_t p = (uintptr_t) value;
+    for (int i = 0; i < argc; i++) {
+        uintptr_t start = (uintptr_t) argv[i];
+        if (p >= start && p <= start + lens[i]) {
+            return (SAPCachedValue) { cached_arg, (uint32_t) i, (uint32_t) (p - start) };
+        }
+    }
+    ptrs[*ptr_cnt] = value;
+    return (SAPCachedValue) { cached_ptr, (uint32_t) (*ptr_cnt)++, 0 };
+}
+
+/**
+ * @brief cache a successful parse, before its fallbacks are resolved, evicting the least recently used entry if full.
+ */
+static void cache_insert(SAPParseCache *cache, uint64_t hash, size_t key_len, int argc, char *argv[], const uint32_t *lens,
+                         const SAPParseResult *res) {
+    SAPCommand *cmd = res->cmd;
+    int flag_cnt = (cmd->parse_by_self == 1) ? 0 : cmd->flag_cnt;
+    int slot_cnt = (cmd->parse_by_self == 1 || cmd->positionals == NULL) ? 0 : cmd->positionals->cnt;
+    void *values[MAX_OPT_COUNT + MAX_POS_COUNT];
+    CachedKind kinds[MAX_OPT_COUNT + MAX_POS_COUNT];
+    int item_cnt = 0;
+    for (int i = 0; i < flag_cnt + slot_cnt; i++) {
+        if (i < flag_cnt) {
+            values[i] = res->values[i];
+            kinds[i] = value_kind(cmd->flags[i], 0, values[i]);
+        } else {
+            values[i] = res->positionals[i - flag_cnt];
+            kinds[i] = value_kind(NULL, cmd->positionals->slots[i - flag_cnt].max_cnt != 1, values[i]);
+        }
+        if (kinds[i] == cached_list) {
+            item_cnt += list_len((char **) values[i]);
+        }
+    }
+
+    /* the entry, its pointers, its values and its key in a single block, the pointers are as many as the values at most */
+    int value_cnt = flag_cnt + slot_cnt;
+    size_t ptrs_off = sizeof(SAPCacheEntry) + (key_len + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+    size_t values_off = ptrs_off + sizeof(void *) * (size_t) (value_cnt + item_cnt);
+    SAPCacheEntry *entry = (SAPCacheEntry *) malloc(values_off + sizeof(SAPCachedValue) * (size_t) (value_cnt + item_cnt));
+    assert(entry != NULL);
+    entry->ptrs = (void **) ((char *) entry + ptrs_off);
+    entry->values = (SAPCachedValue *) ((char *) entry + values_off);
+    entry->items = entry->values + value_cnt;
+    entry->key_len = (uint32_t) key_len;
+    entry->hash = hash;
+    entry->used_at = cache->lookups;
+    entry->argc = argc;
+    entry->cmd = cmd;
+    entry->argv_offset = res->argv_offset;
+    entry->tail_idx = (res->tail_argv != NULL) ? (int) (res->tail_argv - argv) : -1;
+    entry->pos_cnt = res->pos_cnt;
+    entry->given = res->given;
+    entry->value_cnt = value_cnt;
+
+    char *key = entry->key;
+    for (int i = 0; i < argc; i++) {
+        memcpy(key, argv[i], lens[i] + 1);
+        key += lens[i] + 1;
+    }
+
+    int item = 0, ptr_cnt = 0;
+    size_t arena_size = 0;
+    for (int i = 0; i < value_cnt; i++) {
+        SAPCachedValue *cached = &entry->values[i];
+        if (kinds[i] == cached_list) {
+            char **list = (char **) values[i];
+            *cached = (SAPCachedValue) { cached_list, (uint32_t) item, (uint32_t) list_len(list) };
+            arena_size += align_max(sizeof(char *) * (cached->off + 1));
+            for (uint32_t k = 0; k < cached->off; k++) {
+                entry->items[item++] = encode_str(list[k], argc, argv, lens, entry->ptrs, &ptr_cnt);
+            }
+        } else if (kinds[i] == cached_count) {
+            *cached = (SAPCachedValue) { cached_count, (uint32_t) *(int *) values[i], 0 };
+            arena_size += align_max(sizeof(int));
+        } else if (kinds[i] == cached_arg) {
+            *cached = encode_str(values[i], argc, argv, lens, entry->ptrs, &ptr_cnt);
+        } else if (kinds[i] == cached_ptr) {
+            entry->ptrs[ptr_cnt] = values[i];
+            *cached = (SAPCachedValue) { cached_ptr, (uint32_t) ptr_cnt++, 0 };
+        } else {
+            *cached = (SAPCachedValue) { cached_default, 0, 0 };
+        }
+    }
+    entry->arena_size = (uint32_t) arena_size;
+
+    if (cache->cnt == cache->capacity) {
+        /* evict the least recently used entry */
+        SAPCacheEntry *victim = cache->oldest;
+        lru_unlink(cache, victim);
+        SAPCacheEntry **link = &cache->buckets[victim->hash & cache->mask];
+        while (*link != victim) {
+            link = &(*link)->next;
+        }
+        *link = victim->next;
+        free(victim);
+        cache->cnt--;
+        cache->evictions++;
+    }
+    SAPCacheEntry **bucket = &cache->buckets[hash & cache->mask];
+    entry->next = *bucket;
+    *bucket = entry;
+    lru_push(cache, entry);
+    cache->cnt++;
+}
+
+static inline void *decode_str(const SAPCacheEntry *entry, SAPCachedValue cached, char *argv[]) {
+    return (cached.kind == cached_arg) ? argv[cached.idx] + cached.off : entry->ptrs[cached.idx];
+}
+
+/**
+ * @brief rebuild the result of a cached parse against the new argv, the lists and the counts are allocated again.
+ */
+static void cache_restore(const SAPCacheEntry *entry, char *argv[], SAPParseResult *res) {
+    memset(res, 0, sizeof(SAPParseResult));
+    res->cmd = entry->cmd;
+    res->argc = entry->argc - entry->argv_offset;
+    res->argv = argv + entry->argv_offset;
+    res->argv_offset = entry->argv_offset;
+    res->given = entry->given;
+    res->pos_cnt = entry->pos_cnt;
+    if (entry->tail_idx >= 0) {
+        res->tail_argv = argv + entry->tail_idx;
+        res->tail_argc = entry->argc - entry->tail_idx;
+    }
+
+    if (entry->arena_size > 0) {
+        arena_reserve(&res->arena, entry->arena_size);     /* a single allocation of the exact size */
+    }
+    int flag_cnt = (entry->cmd->parse_by_self == 1) ? 0 : entry->cmd->flag_cnt;
+    for (int i = 0; i < entry->value_cnt; i++) {
+        SAPCachedValue cached = entry->values[i];
+        void *value;
+        if (cached.kind == cached_default) {
+            value = (i < flag_cnt) ? entry->cmd->flags[i]->dft_value : NULL;
+        } else if (cached.kind == cached_list) {
+            char **list = (char **) arena_alloc(&res->arena, sizeof(char *) * (cached.off + 1));
+            for (uint32_t k = 0; k < cached.off; k++) {
+                list[k] = (char *) decode_str(entry, entry->items[cached.idx + k], argv);
+            }
+            list[cached.off] = NULL;
+            value = list;
+        } else if (cached.kind == cached_count) {
+            int *count = (int *) arena_alloc(&res->arena, sizeof(int));
+            *count = (int) cached.idx;
+            value = count;
+        } else {
+            value = decode_str(entry, cached, argv);
+        }
+        if (i < flag_cnt) {
+            res->values[i] = value;
+        } else {
+            res->positionals[i - flag_cnt] = value;
+        }
+    }
+}
+
+int sap_cache_parse(SAPParseCache *cache, int argc, char *argv[], SAPParseResult *res) {
+    assert(cache != NULL);
+    assert(argc > 0);
+    assert(argv != NULL);
+    assert(res != NULL);
+
+    seal_root_cmd();
+    cache->lookups++;
+    if (cache->bypass && ++cache->skipped < CACHE_SAMPLE) {
+        cache->bypassed++;
+        return parse_in_tree(&rootCmd, argc, argv, res);
+    }
+    cache->skipped = 0;
+    uint32_t lens_buf[32];
+    uint32_t *lens = (argc <= 32) ? lens_buf : (uint32_t *) malloc(sizeof(uint32_t) * (size_t) argc);
+    assert(lens != NULL);
+    size_t key_len;
+    uint64_t hash = hash_argv(argc, argv, lens, &key_len);
+    SAPCacheEntry *entry = cache->buckets[hash & cache->mask];
+    while (entry != NULL && (entry->hash != hash || !key_equal(entry, argc, argv, lens, key_len))) {
+        entry = entry->next;
+    }
+
+    int ret = 0, found = (entry != NULL);
+    if (entry != NULL) {
+        cache->hits++;
+        if (cache->lookups - entry->used_at > (uint64_t) cache->capacity / 4) {
+            /* moved once per capacity / 4 lookups at most: it stays among the newest quarter meanwhile,
+             * so it isn't evicted, and the hot entries aren't relinked on every hit */
+            lru_unlink(cache, entry);
+            lru_push(cache, entry);
+            entry->used_at = cache->lookups;
+        }
+        cache_restore(entry, argv, res);
+    } else if ((ret = parse_argv_in_tree(&rootCmd, argc, argv, res)) == 0) {
+        /* a line is cached when it's missed the second time, the lines seen once don't evict the repeated ones */
+        uint64_t *seen = &cache->seen[hash & ((uint64_t) cache->mask * 4 + 3)];
+        if (*seen == hash) {
+            found = (cache->cnt < cache->capacity);     /* still warming up, the next time it's a hit */
+            cache_insert(cache, hash, key_len, argc, argv, lens, res);
+        } else {
+            *seen = hash;
+        }
+    }
+    if (lens != lens_buf) {
+        free(lens);
+    }
+    cache->window_hits += found;
+    if (++cache->window == CACHE_WINDOW) {
+        /* a miss costs the hash and a bucket on top of the parse, below 3/4 of hits the cache costs more than
+         * it saves (about 70% on the benchmark), then it steps aside until a sampled window pays again.
+         * the first lines of a cold cache are new ones, there's no decision before capacity lookups */
+        if (cache->lookups >= (uint64_t) cache->capacity) {
+            cache->bypass = cache->window_hits * 4 < CACHE_WINDOW * 3;
+        }
+        cache->window = cache->window_hits = 0;
+    }
+    if (ret != 0) {
+        return -1;      /* the erroneous command lines aren't cached */
+    }
+    /* the environment and the config may change between the parses, they aren't cached */
+    return finish_parse(res);
+}
+
+void sap_cache_stats(const SAPParseCache *cache, SAPCacheStats *stats) {
+    assert(cache != NULL);
+    assert(stats != NULL);
+
+    stats->lookups = cache->lookups;
+    stats->hits = cache->hits;
+    stats->bypassed = cache->bypassed;
+    stats->evictions = cache->evictions;
+    stats->entries = cache->cnt;
+    stats->capacity = cache->capacity;
+}
+
+void sap_cache_clear(SAPParseCache *cache) {
+    assert(cache != NULL);
+
+    SAPCacheEntry *entry = cache->newest;
+    while (entry != NULL) {
+        SAPCacheEntry *older = entry->older;
+        free(entry);
+        entry = older;
+    }
+    memset(cache->buckets, 0, sizeof(SAPCacheEntry *) * ((size_t) cache->mask + 1));
+    memset(cache->seen, 0, sizeof(uint64_t) * ((size_t) cache->mask + 1) * 4);
+    cache->newest = cache->oldest = NULL;
+    cache->cnt = 0;
+    cache->window = cache->window_hits = 0;
+    cache->bypass = 0;
+}
+
+void sap_cache_free(SAPParseCache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    sap_cache_clear(cache);
+    free(cache->buckets);
+    free(cache->seen);
+    free(cache);
+}
+
+/* ---- functions of parse cache ---- */
+
+
+
+/* ++++ functions of plugins ++++ */
+
+typedef struct {
+    SAPCommand cmd;         /* the command of the plugin, the first member so the handler converts it back */
+    SAPPluginSet *set;      /* the set the plugin belongs to */
+    const char *so_path;    /* the path of the shared object, relative to the manifest directory if not absolute */
+    char *flag_lines;       /* the first flag line of the plugin in the manifest, parsed by the builder */
+    int flag_cnt;           /* the number of the flag lines */
+    Flag *flags;            /* the flags, allocated by the builder */
+    void *handle;           /* the shared object, opened on the first dispatch */
+    CmdExec entry;          /* the handler of the shared object */
+} SAPPlugin;
+
+struct SAPPluginSet_ {
+    char *manifest;         /* the content of the manifest, the names and descriptions point into it */
+    char *dir;              /* the directory of the manifest */
+    int cnt;                /* the number of the plugins */
+    int loaded;             /* the number of the opened shared objects */
+    SAPPlugin *plugins;     /* the plugins, their addresses are stable for the command tree */
+    pthread_mutex_t lock;   /* serialises the first dispatches, they may run on executors */
+};
+
+/**
+ * @brief split a manifest line into whitespace separated fields, the last field takes the rest of the line.
  *
- * NOTE: the first element of $cmd_names must be corresponding to $cmd, but it will be ignored by the realization
+ * @param[in,out] line  - the line, the fields are terminated in place.
+ * @param[out] fields   - the fields.
+ * @param[in] max       - the number of the fields wanted.
+ * @return int          - the number of the fields found.
  */
-static SAPCommand *find_sap(SAPCommand *cmd, char *cmd_names[], int *out_idx) {
-    SAPCommand *ret = find_sap_without_sub_root(cmd, cmd_names + 1, out_idx);
-    if (out_idx != NULL) {
-        *out_idx += 1;
+static int split_fields(char *line, char *fields[], int max) {
+    int cnt = 0;
+    char *p = line;
+    while (cnt < max) {
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        fields[cnt++] = p;
+        if (cnt == max) {
+            break;  /* the last field keeps its spaces */
+        }
+        while (*p != '\0' && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        if (*p != '\0') {
+            *p++ = '\0';
+        }
     }
-    return ret;
+    return cnt;
+}
+
+static int is_flag_line(const char *line) {
+    size_t len = strcspn(line, " \t");
+    return (len == 4 && strncmp(line, "flag", 4) == 0) || (len == 7 && strncmp(line, "default", 7) == 0);
 }
 
 /**
- * @brief find the appropriate SAPCommand based on command names, considering default flags.
- *
- * this function traverses the command tree using a breadth-first search approach
- * to find the matching command. When an unknown command is encountered, it checks
- * if the parent command has a default flag. If so, it returns the parent command
- * to allow the unknown argument to be processed as value of the default flag.
- *
- * @param[in] cmd           - a pointer to the root SAPCommand to start searching from.
- * @param[in] cmd_names     - an array of command name strings to match against.
- * @param[out] out_idx      - a pointer to store the index of the found command in cmd_names (can be NULL).
- * @return SAPCommand* returns a pointer to the matching command, or the parent
- *                    command if it has a default flag, or NULL if no match is found.
- *
- * NOTE: the first element of $cmd_names must be corresponding to $cmd, but it will be ignored by the realization
+ * @brief the builder of a plugin command, the flags are parsed from the manifest on the first descent.
  */
-static SAPCommand *find_sap_consider_flags(SAPCommand *cmd, char *cmd_names[], int *out_idx) {
-    SAPCommand *ret = find_sap_consider_flags_without_sub_root(cmd, cmd_names + 1, out_idx);
-    if (out_idx != NULL) {
-        *out_idx += 1;
+static void build_plugin(SAPCommand *cmd) {
+    SAPPlugin *plugin = (SAPPlugin *) cmd;
+    SAPOutput *err_out = sap_get_output(sap_err_channel);
+    if (plugin->flag_cnt == 0) {
+        return;
     }
-    return ret;
-}
 
-typedef enum {
-    error_option = -1,
-    normal_arg = 0,
-    short_option = 1,
-    long_option = 2,
-    long_option_with_equal = 3,
-} ArgType;
+    plugin->flags = (Flag *) calloc(plugin->flag_cnt, sizeof(Flag));
+    assert(plugin->flags != NULL);
 
-static ArgType get_option_type(const char *arg) {
-    if (
-        (arg[0] == '-' && arg[1] == '\0') ||                        /* '-'      short option without flag name */
-        (arg[0] == '-' && arg[1] != '-' && strlen(arg + 1) > 1) ||  /* '-long'  long option with only single hyphen */
-        (arg[0] == '-' && arg[1] == '-' && arg[2] == '=') ||        /* '--='    long option with only equal */
-        (arg[0] == '-' && arg[1] == '-' && arg[2] == '\0')          /* '--'     long option without flag name */
-    ) {                                             /* if the arg is an error option */
-        return error_option;
-    } else if (arg[0] == '-' && arg[1] == '-') {    /* if the arg is a long option */
-        if (strchr(arg, '=') != NULL) {             /* if the arg is a long option with '=' */
-            return long_option_with_equal;
+    char *line = plugin->flag_lines, *next;
+    for (int i = 0; i < plugin->flag_cnt; line = next) {
+        next = line + strlen(line) + 1;     /* before the fields are terminated */
+        line += strspn(line, " \t");
+        if (!is_flag_line(line)) {
+            continue;   /* comments and blank lines */
+        }
+
+        /* flag <name> <shorthand|-> <no_arg|single_arg|multi_arg> <usage> */
+        char *fields[5];
+        int is_default = (line[0] == 'd');
+        int cnt = split_fields(line, fields, 5);
+        Flag *flag = &plugin->flags[i++];
+        FlagType type;
+        if (cnt >= 4 && strcmp(fields[3], "no_arg") == 0) {
+            type = no_arg;
+        } else if (cnt >= 4 && strcmp(fields[3], "single_arg") == 0) {
+            type = single_arg;
+        } else if (cnt >= 4 && strcmp(fields[3], "multi_arg") == 0) {
+            type = multi_arg;
+        } else {
+            out_printf(err_out, "Warning: invalid flag of plugin %s: %s\n", cmd->name, (cnt >= 2) ? fields[1] : "");
+            continue;
+        }
+        char shorthand = (fields[2][0] == '-' || fields[2][1] != '\0') ? '\0' : fields[2][0];
+        init_flag(flag, fields[1], shorthand, (cnt == 5) ? fields[4] : "", NULL);
+        set_flag_type(flag, type);
+        if (is_default) {
+            add_default_flag(cmd, flag);
+        } else {
+            add_flag(cmd, flag);
         }
-        return long_option;
-    } else if (arg[0] == '-' && arg[1] != '\0') {   /* if the arg is a short option */
-        return short_option;
-    } else {                                        /* if the arg is a normal arg */
-        return normal_arg;
     }
+    sap_output_flush(err_out);
 }
 
 /**
- * @brief parse the flags (options) in the command line arguments.
- *
- * this function iterates through the command line arguments, identifies the flags,
- * and sets the values for the corresponding flags based on their types (no argument,
- * single argument, or multiple arguments). If an unknown flag or an error option is
- * encountered, it returns the index of that option in the argv array.
+ * @brief open the shared object of a plugin and resolve its handler, only once.
  *
- * @param cmd a pointer to the SAPCommand structure representing the command whose
- *            flags are to be parsed.
- * @param argc the number of command line arguments.
- * @param argv the array of command line arguments.
- * @return int returns 0 if the parsing is successful. If an error option is found,
- *             it returns the index of that option in the argv array.
+ * @return CmdExec  - the handler, NULL if the shared object can't be loaded (the reason is reported).
  */
-static int parse_flags(const SAPCommand *cmd, const int argc, char *argv[]) {
-    /* Ensure that the input parameters are not null and argc is greater than 0 */
-    assert(cmd != NULL);
-    assert(argc > 0);
-    assert(argv != NULL);
-
-    int p_argv = 1;
-    int unused_arg[argc];
-    int unused_cnt = 0;
-    int i = 0;
-
-    while (p_argv < argc) {
-        #define CRT_ARGV argv[p_argv]
-        switch (get_option_type(CRT_ARGV))
-        {
-        case error_option:
-            parse_err = unknown_arg;
-            return p_argv;
-        case short_option:
-        case long_option:
-            #define CRT_FLAG cmd->flags[i]
-            #define CRT_FLAGNAME CRT_FLAG->flag_name
-            for (i = 0; i < cmd->flag_cnt; i++) {
-                if (
-                    (CRT_ARGV[1] == '-' && strcmp(CRT_FLAGNAME, CRT_ARGV + 2) == 0) ||
-                    (CRT_ARGV[1] != '-' && CRT_ARGV[1] == CRT_FLAG->shorthand)
-                ) {
-                    if (CRT_FLAG->type == single_arg) {
-                        if (p_argv + 1 >= argc || get_option_type(argv[p_argv + 1]) != normal_arg) {
-                            parse_err = too_few_args;
-                            return p_argv;
-                        }
-                        CRT_FLAG->value = argv[++p_argv];
-                        break;
-                    } else if (CRT_FLAG->type == multi_arg) {
-                        int arg_cnt = 0;
-                        char *arg_stack[argc];
-                        while (++p_argv < argc) {
-                            if (get_option_type(argv[p_argv]) == normal_arg) {
-                                arg_stack[arg_cnt++] = argv[p_argv];
-                            } else {    /* if the next arg is an option */
-                                /* stop collecting when an option is encountered */
-                                break;
-                            }
-                        }
-
-                        /* copy the collected arguments to the flag's value */
-                        if (arg_cnt == 0) {
-                            parse_err = too_few_args;
-                            return p_argv - 1;
-                        }
-                        CRT_FLAG->value = (char **) malloc(sizeof(char *) * (arg_cnt + 1));
-                        for (int j = 0; j < arg_cnt; j++) {
-                            ((char **) CRT_FLAG->value)[j] = arg_stack[j];
-                        }
-                        /* add NULL to the end of the argument list as a terminator */
-                        ((char **) CRT_FLAG->value)[arg_cnt] = NULL;
-                        break;
-                    } else if (CRT_FLAG->type == no_arg) {
-                        /* if the flag is no-arg */
-                        /* set its value to the address of IS_PROVIDED */
-                        CRT_FLAG->value = (void *) &IS_PROVIDED;
-                        break;
+static CmdExec get_plugin_entry(SAPPlugin *plugin) {
+    SAPPluginSet *set = plugin->set;
+    pthread_mutex_lock(&set->lock);
+    if (plugin->entry == NULL) {
+        char path[4096];
+        if (plugin->so_path[0] == '/') {
+            snprintf(path, sizeof(path), "%s", plugin->so_path);
+        } else {
+            snprintf(path, sizeof(path), "%s/%s", set->dir, plugin->so_path);
+        }
 
-                    }
-                }
+        const char *reason = NULL;
+        if (plugin->handle == NULL) {
+            plugin->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+            if (plugin->handle != NULL) {
+                set->loaded++;
+            } else {
+                reason = dlerror();
             }
-            #undef CRT_FLAGNAME
-            #undef CRT_FLAG
-
-            if (i == cmd->flag_cnt) {   /* unknown flag */
-                parse_err = unknown_arg;
-                return p_argv;
+        }
+        if (plugin->handle != NULL) {
+            plugin->entry = (CmdExec) dlsym(plugin->handle, SAP_PLUGIN_ENTRY);
+            if (plugin->entry == NULL) {
+                reason = dlerror();
             }
+        }
+        if (plugin->entry == NULL) {
+            SAPOutput *err_out = sap_get_output(sap_err_channel);
+            out_printf(err_out, "Failed to load plugin %s: %s\n", plugin->cmd.name, (reason != NULL) ? reason : path);
+            sap_output_flush(err_out);
+        }
+    }
+    CmdExec entry = plugin->entry;
+    pthread_mutex_unlock(&set->lock);
+    return entry;
+}
 
-            break;
-        case long_option_with_equal: {
-            char *p_equal_ch = strchr(CRT_ARGV, '=');
-            assert(p_equal_ch != NULL);
-
-            char *flag2parse = CRT_ARGV + 2;
-            long flag2parse_len = p_equal_ch - flag2parse; /* extract the flag name */
+/**
+ * @brief the handler of all the plugin commands, it forwards to the handler of the shared object.
+ */
+static int plugin_exec(SAPCommand *caller) {
+    CmdExec entry = get_plugin_entry((SAPPlugin *) caller);
+    if (entry == NULL) {
+        return -1;
+    }
+    return entry(caller);
+}
 
-            #define CRT_FLAG cmd->flags[i]
-            #define CRT_FLAGNAME CRT_FLAG->flag_name
-
-            /* iterate through all the flags of the current command */
-            for (i = 0; i < cmd->flag_cnt; i++) {
-                /* check if the flag name matches */
-                if (
-                    strncmp(flag2parse, CRT_FLAGNAME, flag2parse_len) == 0 &&
-                    strlen(CRT_FLAGNAME) == (size_t) (flag2parse_len)
-                ) {
-                    if (CRT_FLAG->type == single_arg) {
-                        /*  if it matches, set the value after the equal sign as the flag's value */
-                        CRT_FLAG->value = p_equal_ch + 1;
-                        break;  /* break the inner loop once a matching flag is found */
-                    } else if (CRT_FLAG->type == no_arg || CRT_FLAG->type == multi_arg) {
-                        parse_err = illegal_equal;
-                        return p_argv;
-                    }
-                }
+/**
+ * @brief read the whole manifest into a null-terminated buffer.
+ */
+static char *read_manifest(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    char *buf = NULL;
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        long size = ftell(fp);
+        if (size >= 0 && fseek(fp, 0, SEEK_SET) == 0) {
+            buf = (char *) malloc((size_t) size + 1);
+            assert(buf != NULL);
+            if (fread(buf, 1, (size_t) size, fp) != (size_t) size) {
+                free(buf);
+                buf = NULL;
+            } else {
+                buf[size] = '\0';
             }
+        }
+    }
+    fclose(fp);
+    return buf;
+}
 
-            if (i == cmd->flag_cnt) {   /* unknown flag */
-                parse_err = unknown_arg;
-                return p_argv;
-            }
+SAPPluginSet *sap_load_plugins(SAPCommand *parent, const char *manifest_path) {
+    assert(parent != NULL);
+    assert(manifest_path != NULL);
 
-            #undef CRR_FLAG
-            #undef CRT_FLAGNAME
-            break;
+    char *manifest = read_manifest(manifest_path);
+    if (manifest == NULL) {
+        return NULL;
+    }
+
+    SAPPluginSet *set = (SAPPluginSet *) calloc(1, sizeof(SAPPluginSet));
+    assert(set != NULL);
+    set->manifest = manifest;
+    const char *slash = strrchr(manifest_path, '/');
+    size_t dir_len = (slash == NULL) ? 1 : (size_t) (slash - manifest_path);
+    set->dir = (char *) malloc(dir_len + 1);
+    assert(set->dir != NULL);
+    memcpy(set->dir, (slash == NULL) ? "." : manifest_path, dir_len);
+    set->dir[dir_len] = '\0';
+    pthread_mutex_init(&set->lock, NULL);
+
+    /* terminate the lines in place and count the plugins, so their addresses never change */
+    char *end = manifest + strlen(manifest), *next;
+    for (char *p = manifest; p < end; p++) {
+        if (*p == '\n' || *p == '\r') {
+            *p = '\0';
+        }
+    }
+    int plugin_cap = 0;
+    for (char *line = manifest; line < end; line += strlen(line) + 1) {
+        line += strspn(line, " \t");
+        plugin_cap += (strncmp(line, "plugin", 6) == 0);
+    }
+    set->plugins = (SAPPlugin *) calloc((plugin_cap > 0) ? plugin_cap : 1, sizeof(SAPPlugin));
+    assert(set->plugins != NULL);
+
+    SAPOutput *err_out = sap_get_output(sap_err_channel);
+    SAPPlugin *crt = NULL;
+    int line_no = 0;
+    for (char *line = manifest; line < end; line = next) {
+        next = line + strlen(line) + 1;
+        line_no++;
+        line += strspn(line, " \t");
+        if (*line == '\0' || *line == '#') {
+            continue;
+        }
+        if (is_flag_line(line)) {
+            if (crt != NULL && crt->flag_cnt++ == 0) {
+                /* only counted here, the builder parses the flags when the command is needed */
+                crt->flag_lines = line;
+            }
+            continue;
         }
 
-        default:
-            /* if the arg is a normal arg */
-            unused_arg[unused_cnt++] = p_argv;
-            break;
+        /* plugin <name> <shared object> <short description> */
+        char *fields[4];
+        int cnt = split_fields(line, fields, 4);
+        crt = NULL;
+        if (cnt < 3 || strcmp(fields[0], "plugin") != 0) {
+            out_printf(err_out, "Warning: invalid line %d of the manifest %s\n", line_no, manifest_path);
+            continue;
+        }
+        SAPPlugin *plugin = &set->plugins[set->cnt];
+        init_sap_command(&plugin->cmd, fields[1], (cnt == 4) ? fields[3] : "", NULL, plugin_exec);
+        plugin->set = set;
+        plugin->so_path = fields[2];
+        set_cmd_builder(&plugin->cmd, build_plugin);
+        if (add_subcmd(parent, &plugin->cmd) == NULL) {
+            out_printf(err_out, "Warning: too many subcommands, plugin %s is ignored\n", fields[1]);
+            continue;
         }
+        set->cnt++;
+        crt = plugin;
+    }
+    sap_output_flush(err_out);
+    return set;
+}
 
-        #undef CRT_ARGV
+int sap_plugins_loaded(const SAPPluginSet *set) {
+    assert(set != NULL);
+    return set->loaded;
+}
 
-        p_argv++;
+void sap_free_plugins(SAPPluginSet *set) {
+    if (set == NULL) {
+        return;
     }
-
-    /* if the unused args are more than 0 */
-    if (unused_cnt > 0) {
-        if (cmd->default_flag == NULL || cmd->default_flag->type == no_arg) {
-            /* if the default flag not set */
-            parse_err = too_many_args;
-            return unused_arg[0];
-        } else if (unused_cnt > 1 && cmd->default_flag->type == single_arg) {
-            /* if the default flag is single arg */
-            parse_err = too_many_args;
-            return unused_arg[1];
-        } else if (cmd->default_flag->type == multi_arg) {
-            /* if the default flag is multi arg */
-            char **arg_stack = (char **) malloc(sizeof(char *) * (unused_cnt + 1));
-            for (int ii = 0; ii < unused_cnt; ii++) {
-                arg_stack[ii] = argv[unused_arg[ii]];
-            }
-            arg_stack[unused_cnt] = NULL;
-            cmd->default_flag->value = arg_stack;
-        } else if (unused_cnt == 1 && cmd->default_flag->type == single_arg) {
-            /* if the default flag is single arg */
-            cmd->default_flag->value = argv[unused_arg[0]];
+    for (int i = 0; i < set->cnt; i++) {
+        if (set->plugins[i].handle != NULL) {
+            dlclose(set->plugins[i].handle);
         }
+        free(set->plugins[i].flags);
     }
+    pthread_mutex_destroy(&set->lock);
+    free(set->plugins);
+    free(set->dir);
+    free(set->manifest);
+    free(set);
+}
 
-    if (cmd->default_flag != NULL && cmd->default_flag->type == no_arg) {
-        /* if the default flag is no arg and the value is NULL */
-        cmd->default_flag->value = (void *) &IS_PROVIDED;
-    }
-    // if (cmd->default_flag != NULL && cmd->default_flag->type == multi_arg && cmd->default_flag->value == NULL) {
-    //     /* if the default flag is multi arg and the value is NULL */
-    //     parse_err = too_few_args;
-    //     return 1;
-    // }
+/* ---- functions of plugins ---- */
 
-    return 0;
-}
 
-void print_cmd_help(SAPCommand *cmd) {
-    SAPCommand *call_stack[MAX_CMD_DEPTH];
 
-    assert(cmd != NULL);
-    get_cmd_stack(cmd, call_stack);
+/* ++++ functions of serialisation ++++ */
 
-    printf("Description: %s\n\n", cmd->short_desc);
-    if (cmd->long_desc!= NULL) {
-        printf("%s\n\n", cmd->long_desc);
-    }
+static void out_uint(SAPOutput *out, uint32_t value) {
+    char digits[10];
+    int p = (int) sizeof(digits);
+    do {
+        digits[--p] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    out_put(out, digits + p, sizeof(digits) - p);
+}
 
-    /* TODO: modify the Usage print */
-    printf("Usage: %s", cmd->name);
-    if (cmd->tree_node.child_cnt != 0) {
-        printf(" [command]");
+/**
+ * @brief write a JSON string, the runs without special characters are copied at once.
+ */
+static void out_json_str(SAPOutput *out, const char *str) {
+    static const char hex[] = "0123456789abcdef";
+    const char *run = str;
+
+    out_put(out, "\"", 1);
+    for (const char *p = str; ; p++) {
+        unsigned char ch = (unsigned char) *p;
+        if (ch >= 0x20 && ch != '"' && ch != '\\') {
+            continue;
+        }
+        out_put(out, run, (size_t) (p - run));
+        if (ch == '\0') {
+            break;
+        }
+        run = p + 1;
+
+        char esc[6] = {'\\', (char) ch, 0, 0, 0, 0};
+        size_t esc_len = 2;
+        if (ch == '\n') {
+            esc[1] = 'n';
+        } else if (ch == '\t') {
+            esc[1] = 't';
+        } else if (ch == '\r') {
+            esc[1] = 'r';
+        } else if (ch < 0x20) {
+            /* the other control characters: \u00XX */
+            esc[1] = 'u';
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = hex[ch >> 4];
+            esc[5] = hex[ch & 0xf];
+            esc_len = 6;
+        }
+        out_put(out, esc, esc_len);
     }
-    if (cmd->flag_cnt != 0) {
-        printf(" [options]");
+    out_put(out, "\"", 1);
+}
+
+static void out_json_str_list(SAPOutput *out, char **list, int cnt) {
+    out_put(out, "[", 1);
+    for (int i = 0; (cnt < 0) ? list[i] != NULL : i < cnt; i++) {
+        if (i > 0) {
+            out_put(out, ",", 1);
+        }
+        out_json_str(out, list[i]);
     }
-    printf("\n\n");
+    out_put(out, "]", 1);
+}
 
-    /* print the available subcmds */
-    if (cmd->tree_node.child_cnt != 0) {
-        printf("Available Commands:\n");
-        for (int i = 0; i < cmd->tree_node.child_cnt; i++) {
-            SAPCommand *sub_cmd = node2cmd(cmd->tree_node.children[i]);
-            printf("  %s\t%s\n", sub_cmd->name, sub_cmd->short_desc);
+size_t sap_write_json(const SAPParseResult *res, SAPOutput *out) {
+    assert(res != NULL);
+    assert(out != NULL);
+
+    #define OUT_LIT(lit) out_put(out, lit, sizeof(lit) - 1)
+    size_t start = out->total;
+
+    const SAPCommand *cmd = res->cmd;
+    OUT_LIT("{\"cmd\":");
+    if (cmd == NULL) {
+        OUT_LIT("null");
+    } else {
+        SAPCommand *call_stack[MAX_CMD_DEPTH];
+        get_cmd_stack((SAPCommand *) cmd, call_stack);
+        OUT_LIT("[");
+        for (int i = 0; i <= cmd->tree_node.depth; i++) {
+            if (i > 0) {
+                OUT_LIT(",");
+            }
+            out_json_str(out, call_stack[i]->name);
         }
-        printf("\n");
+        OUT_LIT("]");
     }
 
-    /* print the available flags */
-    if (cmd->flag_cnt != 0) {
-        printf("Flags:\n");
+    OUT_LIT(",\"flags\":{");
+    if (cmd != NULL && cmd->parse_by_self == 0) {
         for (int i = 0; i < cmd->flag_cnt; i++) {
-            printf("  ");
-            if (cmd->flags[i]->shorthand != '\0') {
-                printf("-%c, ", cmd->flags[i]->shorthand);
+            if (i > 0) {
+                OUT_LIT(",");
             }
-            printf("--%s\t%s", cmd->flags[i]->flag_name, cmd->flags[i]->usage);
-            if (cmd->default_flag == cmd->flags[i]) {
-                printf("\t- default flag");
+            out_json_str(out, cmd->flags[i]->flag_name);
+            OUT_LIT(":");
+            void *value = res->values[i];
+            if (cmd->flags[i]->type == no_arg && cmd->flags[i]->repeat == repeat_count) {
+                /* a count, 0 if the flag isn't given, so the field always has the same type */
+                out_uint(out, (value != NULL) ? (uint32_t) *(const int *) value : 0);
+            } else if (cmd->flags[i]->type == no_arg) {
+                if (value != NULL) {
+                    OUT_LIT("true");
+                } else {
+                    OUT_LIT("false");
+                }
+            } else if (value == NULL) {
+                OUT_LIT("null");
+            } else if (cmd->flags[i]->type == single_arg && cmd->flags[i]->repeat != repeat_append) {
+                out_json_str(out, (const char *) value);
+            } else {
+                out_json_str_list(out, (char **) value, -1);
             }
-            printf("\n");
-            /* BUG: when options are provided, the default value will be changed */
-            // if (cmd->flags[i]->value != NULL) {
-            //     printf("    Default: %s\n", (const char *) cmd->flags[i]->value);
-            // }
         }
-        printf("\n");
     }
-
-    if (get_child_cmd_cnt(cmd) > 0) {
-        int p_stack = 0;
-        printf("Use \"");
-        while (call_stack[p_stack] != cmd) {
-            printf("%s ", call_stack[p_stack]->name);
-            p_stack++;
+    OUT_LIT("}");
+
+    const SAPPositionals *schema = (cmd != NULL && cmd->parse_by_self == 0) ? cmd->positionals : NULL;
+    if (schema != NULL) {
+        /* every slot by its name: a string for a slot taking one argument, an array for a variadic slot */
+        OUT_LIT(",\"positionals\":{");
+        for (int slot = 0; slot < schema->cnt; slot++) {
+            if (slot > 0) {
+                OUT_LIT(",");
+            }
+            out_json_str(out, schema->slots[slot].name);
+            OUT_LIT(":");
+            void *value = res->positionals[slot];
+            if (value == NULL) {
+                OUT_LIT("null");
+            } else if (schema->slots[slot].max_cnt == 1) {
+                out_json_str(out, (const char *) value);
+            } else {
+                out_json_str_list(out, (char **) value, -1);
+            }
         }
-        printf("%s [command] --help\" for more help\n", cmd->name);
+        OUT_LIT("}");
     }
-}
-
-/* ---- functions of SAPCommand ---- */
 
+    if (res->tail_argv != NULL) {
+        /* the arguments after "--" of a passthrough command */
+        OUT_LIT(",\"tail\":");
+        out_json_str_list(out, res->tail_argv, res->tail_argc);
+    }
 
+    if (cmd != NULL && cmd->parse_by_self == 1) {
+        /* the arguments of a command parsing them by itself */
+        OUT_LIT(",\"args\":");
+        out_json_str_list(out, res->argv + 1, res->argc - 1);
+    }
 
-/* ++++ functions of cmd_exec ++++ */
+    if (res->err.code != parse_ok) {
+        OUT_LIT(",\"error\":{\"code\":");
+        out_uint(out, (uint32_t) res->err.code);
+        OUT_LIT(",\"expected\":");
+        out_uint(out, (uint32_t) res->err.expected);
+        OUT_LIT(",\"argv_idx\":");
+        out_uint(out, (uint32_t) res->err.argv_idx);
+        OUT_LIT(",\"byte_offset\":");
+        out_uint(out, (uint32_t) res->err.byte_offset);
+        OUT_LIT("}");
+    }
+    OUT_LIT("}\n");
+    #undef OUT_LIT
 
-int void_exec(SAPCommand *caller) {
-    assert(caller != NULL);
+    return out->total - start;
+}
 
-    printf("The command %s haven't been allocate function\n", caller->name);
+#define SAP_RECORD_VERSION 2
 
+static size_t put_u8(SAPOutput *out, uint8_t value) {
+    if (out != NULL) {
+        out_put(out, (const char *) &value, 1);
+    }
     return 1;
 }
 
-int void_self_parse_exec(SAPCommand *caller, int argc, char *argv[]) {
-    assert(caller != NULL);
-    assert(argv != NULL);
-
-    printf("The command %s haven't been allocate function\n", caller->name);
-    printf("argc: %d\n", argc);
-    for (int i = 0; i < argc; i++) {
-        printf("argv[%d]: %s\n", i, argv[i]);
+static size_t put_u32(SAPOutput *out, uint32_t value) {
+    if (out != NULL) {
+        /* little-endian on every host */
+        unsigned char bytes[4] = {
+            (unsigned char) value, (unsigned char) (value >> 8),
+            (unsigned char) (value >> 16), (unsigned char) (value >> 24)
+        };
+        out_put(out, (const char *) bytes, 4);
     }
+    return 4;
+}
 
-    return 1;
+/**
+ * @brief put a string as its 32-bit length, its bytes and the null terminator, so it can be read in place.
+ */
+static size_t put_str(SAPOutput *out, const char *str) {
+    size_t len = strlen(str);
+    put_u32(out, (uint32_t) len);
+    if (out != NULL) {
+        out_put(out, str, len + 1);
+    }
+    return 4 + len + 1;
 }
 
-static int help_exec(SAPCommand *caller) {
-    /* verify the caller */
-    assert(caller != NULL);
-    assert(strcmp("help", caller->name) == 0);
+/**
+ * @brief put a list of strings as its 32-bit count and the strings.
+ *
+ * @param[in] cnt   - the number of the strings, -1 if the list is NULL-terminated.
+ */
+static size_t put_str_list(SAPOutput *out, char **list, int cnt) {
+    if (cnt < 0) {
+        cnt = 0;
+        while (list[cnt] != NULL) {
+            cnt++;
+        }
+    }
+    size_t len = put_u32(out, (uint32_t) cnt);
+    for (int i = 0; i < cnt; i++) {
+        len += put_str(out, list[i]);
+    }
+    return len;
+}
 
-    Flag *cmd_flag = get_flag(caller, "cmd");
+/**
+ * @brief put the body of a record (everything after its length), only measure it if $out is NULL.
+ *
+ * @return size_t - the length of the body.
+ */
+static size_t put_record_body(const SAPParseResult *res, SAPOutput *out) {
+    const SAPCommand *cmd = res->cmd;
+    size_t len = 0;
+
+    len += put_u8(out, SAP_RECORD_VERSION);
+    len += put_u8(out, (uint8_t) res->err.code);
+    len += put_u8(out, (uint8_t) res->err.expected);
+    len += put_u8(out, (cmd == NULL) ? 0 : (uint8_t) (cmd->tree_node.depth + 1));
+    len += put_u32(out, (uint32_t) res->err.argv_idx);
+    len += put_u32(out, (uint32_t) res->err.byte_offset);
+
+    /* the command path */
+    if (cmd != NULL) {
+        SAPCommand *call_stack[MAX_CMD_DEPTH];
+        get_cmd_stack((SAPCommand *) cmd, call_stack);
+        for (int i = 0; i <= cmd->tree_node.depth; i++) {
+            len += put_str(out, call_stack[i]->name);
+        }
+    }
 
-    assert(cmd_flag != NULL);
-    if (cmd_flag->value == NULL) {
-        print_cmd_help(&rootCmd);
-    } else {
-        int depth_cmd2get_help = 0;
-        SAPCommand *cmd2get_help = find_sap_without_sub_root(&rootCmd, (char **) cmd_flag->value, &depth_cmd2get_help);
-        if (cmd2get_help == NULL) {
-            printf("Unknown command: %s. See '%s help'.\n", ((const char **)cmd_flag->value)[depth_cmd2get_help], rootCmd.name);
-            return -1;
+    /* the given flags: name, type, values */
+    int given_cnt = 0;
+    if (cmd != NULL && cmd->parse_by_self == 0) {
+        for (int i = 0; i < cmd->flag_cnt; i++) {
+            given_cnt += (res->values[i] != NULL);
+        }
+    }
+    len += put_u8(out, (uint8_t) given_cnt);
+    for (int i = 0; given_cnt > 0 && i < cmd->flag_cnt; i++) {
+        void *value = res->values[i];
+        if (value == NULL) {
+            continue;
+        }
+        len += put_str(out, cmd->flags[i]->flag_name);
+        len += put_u8(out, (uint8_t) cmd->flags[i]->type);
+        if (cmd->flags[i]->type == no_arg) {
+            /* the count of a repeat_count flag */
+            len += put_u32(out, (cmd->flags[i]->repeat == repeat_count) ? (uint32_t) *(const int *) value : 0);
+        } else if (cmd->flags[i]->type == single_arg && cmd->flags[i]->repeat != repeat_append) {
+            len += put_u32(out, 1);
+            len += put_str(out, (const char *) value);
+        } else {
+            len += put_str_list(out, (char **) value, -1);
         }
-        print_cmd_help(cmd2get_help);
     }
 
-    return 0;
-}
+    /* the positional slots: each slot name and its arguments, none for a slot receiving nothing */
+    const SAPPositionals *schema = (cmd != NULL && cmd->parse_by_self == 0) ? cmd->positionals : NULL;
+    int slot_cnt = (schema != NULL) ? schema->cnt : 0;
+    len += put_u8(out, (uint8_t) slot_cnt);
+    for (int slot = 0; slot < slot_cnt; slot++) {
+        void *value = res->positionals[slot];
+        len += put_str(out, schema->slots[slot].name);
+        if (value == NULL) {
+            len += put_u32(out, 0);
+        } else if (schema->slots[slot].max_cnt == 1) {
+            len += put_u32(out, 1);
+            len += put_str(out, (const char *) value);
+        } else {
+            len += put_str_list(out, (char **) value, -1);
+        }
+    }
 
-static int call_exec(SAPCommand *caller, int argc, char *argv[]) {
-    assert(caller!= NULL);
+    /* the tail of a passthrough command: whether there is one, then its arguments */
+    len += put_u8(out, res->tail_argv != NULL);
+    if (res->tail_argv != NULL) {
+        len += put_str_list(out, res->tail_argv, res->tail_argc);
+    }
 
-    if (caller->parse_by_self == 1) {
-        assert(caller->exec_self_parse != NULL);
-        return caller->exec_self_parse(caller, argc, argv);
+    /* the arguments of a command parsing them by itself */
+    int arg_cnt = (cmd != NULL && cmd->parse_by_self == 1) ? res->argc - 1 : 0;
+    len += put_u32(out, (uint32_t) arg_cnt);
+    for (int i = 0; i < arg_cnt; i++) {
+        len += put_str(out, res->argv[i + 1]);
     }
+    return len;
+}
 
-    int ret = parse_flags(caller, argc, argv);
+size_t sap_write_record(const SAPParseResult *res, SAPOutput *out) {
+    assert(res != NULL);
+    assert(out != NULL);
 
-    if (ret != 0 && parse_err != normal) {
-        switch (parse_err) {
-        case unknown_arg:
-            printf("Argument unrecognized: %s\n", argv[ret]);
-            break;
-        case too_many_args:
-            printf("Too many arguments: %s\n", argv[ret]);
-            break;
-        case too_few_args:
-            printf("Too few arguments: %s\n", argv[ret]);
-            break;
-        case illegal_equal:
-            printf("Illegal option: %s\n", argv[ret]);
-            break;
-        default:
-            printf("Unknown error occurs on: %s\n", argv[ret]);
-            break;
-        }
+    /* measure the body first, the record is written in a single pass without allocation */
+    size_t body_len = put_record_body(res, NULL);
+    put_u32(out, (uint32_t) body_len);
+    put_record_body(res, out);
+    return 4 + body_len;
+}
 
-        return -1;
+typedef struct {
+    const unsigned char *p;     /* the next byte to read */
+    const unsigned char *end;   /* the end of the record */
+    int bad;                    /* whether the record is truncated or malformed */
+} RecordCursor;
+
+static uint32_t get_u8(RecordCursor *cur) {
+    if (cur->end - cur->p < 1) {
+        cur->bad = 1;
+        return 0;
     }
+    return *cur->p++;
+}
 
-    if (helpFlag.value != NULL) {
-        /* if the help flag is provided */
-        print_cmd_help(caller);
+static uint32_t get_u32(RecordCursor *cur) {
+    if (cur->end - cur->p < 4) {
+        cur->bad = 1;
         return 0;
     }
+    uint32_t value = (uint32_t) cur->p[0] | ((uint32_t) cur->p[1] << 8) |
+                     ((uint32_t) cur->p[2] << 16) | ((uint32_t) cur->p[3] << 24);
+    cur->p += 4;
+    return value;
+}
 
-    return caller->exec(caller);
+/**
+ * @brief get a string in place, it's null-terminated in the record.
+ */
+static char *get_str(RecordCursor *cur) {
+    uint32_t len = get_u32(cur);
+    if (cur->bad || (size_t) (cur->end - cur->p) < (size_t) len + 1 || cur->p[len] != '\0') {
+        cur->bad = 1;
+        return NULL;
+    }
+    char *str = (char *) cur->p;
+    cur->p += len + 1;
+    return str;
 }
 
-/* ---- functions of cmd_exec ---- */
+int sap_read_record(const char *data, size_t len, SAPParseResult *res, size_t *used) {
+    assert(data != NULL);
+    assert(res != NULL);
 
+    seal_root_cmd();
+    memset(res, 0, sizeof(SAPParseResult));
+    res->err.flag_id = SAP_NIL;
 
+    RecordCursor cur = { (const unsigned char *) data, (const unsigned char *) data + len, 0 };
+    uint32_t body_len = get_u32(&cur);
+    if (cur.bad || body_len > len - 4) {
+        return -1;
+    }
+    cur.end = cur.p + body_len;
 
-/* ++++ functions for initialization ++++ */
+    /* every string takes 5 bytes at least, so the pointers of the lists fit in a block of this bound */
+    size_t block_cap = body_len / 5 + 2;
+    char **block = (char **) arena_alloc(&res->arena, sizeof(char *) * block_cap);
+    size_t block_used = 0;
 
-static void add_helpcmd() {
-    init_sap_command(&helpCmd, "help", "Display this help message", NULL, help_exec);
-    // set_cmd_self_parse(&helpCmd, help_exec);
-    set_flag_type(&helpFlag, no_arg);
-    add_subcmd(&rootCmd, &helpCmd);
-}
+    SAPCommand *cmd = NULL;
+    if (get_u8(&cur) != SAP_RECORD_VERSION) {
+        goto bad_record;
+    }
+    res->err.code = (ParseErr) get_u8(&cur);
+    res->err.expected = (ExpectedKind) get_u8(&cur);
+    uint32_t path_cnt = get_u8(&cur);
+    res->err.argv_idx = (int) get_u32(&cur);
+    res->err.byte_offset = (int) get_u32(&cur);
+
+    /* resolve the command path in the current tree, path[0] is the root */
+    for (uint32_t i = 0; i < path_cnt; i++) {
+        char *name = get_str(&cur);
+        if (cur.bad) {
+            goto bad_record;
+        }
+        cmd = (i == 0) ? &rootCmd : find_child(cmd, name);
+        if (cmd == NULL) {
+            goto bad_record;
+        }
+    }
+    res->cmd = cmd;
+    if (cmd != NULL) {
+        for (int i = 0; i < cmd->flag_cnt; i++) {
+            res->values[i] = cmd->flags[i]->dft_value;
+        }
+    }
 
-static void check_shorthand() {
-    #define not_stack_select (((stack_select) == 0)? 1: 0)
-    TreeNode *stack[MAX_CMD_COUNT][2];      /* two stack cosplay a queue */
-    int top[2] = {-1, -1};                  /* the top ptr of the two stack */
-    int stack_select = 0;                   /* select the available stack*/
+    uint32_t given_cnt = get_u8(&cur);
+    for (uint32_t k = 0; k < given_cnt; k++) {
+        char *name = get_str(&cur);
+        uint32_t type = get_u8(&cur);
+        uint32_t value_cnt = get_u32(&cur);
+        if (cur.bad || cmd == NULL) {
+            goto bad_record;
+        }
 
-    /* push the root into stack */
-    stack[++top[stack_select]][stack_select] = &(rootCmd.tree_node);
+        /* the flag must exist with the same type */
+        uint32_t name_id = sap_name_id(name);
+        SAPFlagIndex *index = get_flag_index(cmd);
+        int pos = 0;
+        while (pos < cmd->flag_cnt && index->name_ids[pos] != name_id) {
+            pos++;
+        }
+        if (pos == cmd->flag_cnt || (uint32_t) cmd->flags[pos]->type != type) {
+            goto bad_record;
+        }
 
-    while (top[stack_select] >= 0) {
-        TreeNode *stack_top = stack[top[stack_select]][stack_select];
-        SAPCommand *crt_cmd = node2cmd(stack_top);   /* current command */
-        SAPCommand *call_stack[MAX_CMD_DEPTH];
-        get_cmd_stack(crt_cmd, call_stack);
-        Flag *ch_occupied[26] = {0};
-        for (int i = 0; i < crt_cmd->flag_cnt; i++) {
-            if (crt_cmd->flags[i]->shorthand!= '\0') {
-                int char_idx = crt_cmd->flags[i]->shorthand - 'a';
-                if (ch_occupied[char_idx] != NULL) {
-                    int j = 0;
-                    printf("In command: ");
-                    while (call_stack[j] != crt_cmd) {
-                        printf("%s ", call_stack[j]->name);
-                        j++;
-                    }
-                    printf("%s\n", crt_cmd->name);
-                    printf("Warning: shorthand '%c' is already occupied by %s\n", crt_cmd->flags[i]->shorthand, ch_occupied[char_idx]->flag_name);
-                } else {
-                    ch_occupied[char_idx] = crt_cmd->flags[i];
+        if (type == no_arg && cmd->flags[pos]->repeat == repeat_count && value_cnt > 0) {
+            int *count = (int *) arena_alloc(&res->arena, sizeof(int));
+            *count = (int) value_cnt;
+            res->values[pos] = count;
+        } else if (type == no_arg) {
+            res->values[pos] = (void *) &IS_PROVIDED;
+        } else if (type == single_arg && cmd->flags[pos]->repeat != repeat_append) {
+            if (value_cnt != 1) {
+                goto bad_record;
+            }
+            res->values[pos] = get_str(&cur);
+            if (!cur.bad && (res->values[pos] = check_choice(cmd->flags[pos], res->values[pos], 0)) == NULL) {
+                goto bad_record;
+            }
+        } else {
+            if ((size_t) value_cnt + 1 > block_cap - block_used) {
+                goto bad_record;
+            }
+            char **list = block + block_used;
+            for (uint32_t j = 0; j < value_cnt && !cur.bad; j++) {
+                list[j] = get_str(&cur);
+                if (!cur.bad && (list[j] = check_choice(cmd->flags[pos], list[j], 0)) == NULL) {
+                    goto bad_record;
                 }
             }
+            list[value_cnt] = NULL;
+            block_used += value_cnt + 1;
+            res->values[pos] = list;
         }
+    }
 
-        for (int i = 0; i < stack_top->child_cnt; i++) {
-            /* push the subcmds into the other stack */
-            stack[++top[not_stack_select]][not_stack_select] = stack_top->children[i];
+    /* the positional slots, in the order of the slots of the command */
+    const SAPPositionals *schema = (cmd != NULL && cmd->parse_by_self == 0) ? cmd->positionals : NULL;
+    uint32_t slot_cnt = get_u8(&cur);
+    if (cur.bad || slot_cnt != (uint32_t) ((schema != NULL) ? schema->cnt : 0)) {
+        goto bad_record;
+    }
+    for (uint32_t slot = 0; slot < slot_cnt; slot++) {
+        char *name = get_str(&cur);
+        uint32_t value_cnt = get_u32(&cur);
+        int max_cnt = schema->slots[slot].max_cnt;
+        if (cur.bad || strcmp(name, schema->slots[slot].name) != 0 || (max_cnt >= 0 && value_cnt > (uint32_t) max_cnt)) {
+            goto bad_record;
+        }
+        if (value_cnt == 0) {
+            continue;
         }
+        char **list = NULL;
+        if (max_cnt != 1) {
+            if ((size_t) value_cnt + 1 > block_cap - block_used) {
+                goto bad_record;
+            }
+            list = block + block_used;
+            block_used += value_cnt + 1;
+            list[value_cnt] = NULL;
+            res->positionals[slot] = list;
+        }
+        for (uint32_t j = 0; j < value_cnt; j++) {
+            char *arg = get_str(&cur);
+            /* the arguments of a failed parse may be of the wrong type, as they were given */
+            if (cur.bad || (res->err.code == parse_ok && !check_pos_type(schema->slots[slot].type, arg))) {
+                goto bad_record;
+            }
+            if (list != NULL) {
+                list[j] = arg;
+            } else {
+                res->positionals[slot] = arg;
+            }
+        }
+        res->pos_cnt += (int) value_cnt;
+    }
 
-        if (--top[stack_select] < 0) {
-            /* pop and judge whether the stack is empty */
-            stack_select = not_stack_select;    /* switch the stack */
+    /* the tail of a passthrough command */
+    if (get_u8(&cur) != 0) {
+        uint32_t tail_cnt = get_u32(&cur);
+        if (cur.bad || cmd == NULL || (size_t) tail_cnt + 1 > block_cap - block_used) {
+            goto bad_record;
+        }
+        res->tail_argv = block + block_used;
+        block_used += tail_cnt + 1;
+        for (uint32_t j = 0; j < tail_cnt && !cur.bad; j++) {
+            res->tail_argv[j] = get_str(&cur);
         }
+        res->tail_argv[tail_cnt] = NULL;
+        res->tail_argc = (int) tail_cnt;
+    }
 
-        /* ---- non-leaf node ---- */
+    /* argv of the command: its name and the arguments of a command parsing them by itself */
+    uint32_t arg_cnt = get_u32(&cur);
+    if (cur.bad || (size_t) arg_cnt + 2 > block_cap - block_used || (cmd == NULL && arg_cnt > 0)) {
+        goto bad_record;
     }
-    #undef not_stack_select
+    if (cmd != NULL) {
+        res->argv = block + block_used;
+        res->argv[0] = (char *) cmd->name;
+        for (uint32_t j = 0; j < arg_cnt && !cur.bad; j++) {
+            res->argv[j + 1] = get_str(&cur);
+        }
+        res->argv[arg_cnt + 1] = NULL;
+        res->argc = (int) arg_cnt + 1;
+    }
+
+    if (cur.bad || cur.p != cur.end) {
+        goto bad_record;
+    }
+    if (used != NULL) {
+        *used = 4 + (size_t) body_len;
+    }
+    return 0;
+
+bad_record:
+    arena_free(&res->arena);
+    memset(res, 0, sizeof(SAPParseResult));
+    res->err.flag_id = SAP_NIL;
+    return -1;
 }
 
-/* ---- functions for initialization ----*/
+/* ---- functions of serialisation ---- */
 
 
 
-/* ++++ global frame functions that will be called by user ++++ */
+/* ++++ functions of getopt ++++ */
 
-void init_root_cmd(const char *name, const char *short_desc, const char *long_desc, CmdExec exec) {
-    /* init the help flag */
-    init_flag(&helpFlag, "help", 'h', "Display the help message", NULL);
-    /* call init_sap_cmd to init root cmd */
-    init_sap_command(&rootCmd, name, short_desc, long_desc, exec);
+enum { permute = 0, require_order = 1, return_in_order = 2 };
+
+void sap_getopt_init(SAPGetopt *st) {
+    assert(st != NULL);
+    memset(st, 0, sizeof(SAPGetopt));
+    st->optind = 1;
+    st->opterr = 1;
 }
 
-void init_sap_command(SAPCommand *cmd, const char *name, const char *short_desc, const char *long_desc, CmdExec exec) {
-    assert(cmd != NULL);                /* ensure the command pointer is not null */
-    ++g_cmd_cnt;
-    assert(g_cmd_cnt <= MAX_CMD_COUNT); /* ensure the command count does not exceed the maximum limit */
+void sap_getopt_free(SAPGetopt *st) {
+    assert(st != NULL);
+    free(st->table.flag_index);
+    st->table.flag_index = NULL;
+    st->optstring = NULL;
+    st->longopts = NULL;
+}
 
-    cmd->name = name;                   /* set the command name */
-    cmd->short_desc = short_desc;       /* set the short description of the command */
-    cmd->long_desc = long_desc;         /* set the long description of the command */
-    cmd->flag_cnt = 0;                  /* initialize the flag count to 0 */
-    cmd->parse_by_self = 0;             /* set parse_by_self to 0 (default parse by the framework) */
-    cmd->default_flag = NULL;           /* initialize the default flag to null */
-    cmd->exec_self_parse = NULL;        /* initialize the self-parse execution function to null */
-    cmd->exec = (exec == NULL) ? void_exec : exec; /* set the execution function, use void_exec if null */
-    add_flag(cmd, &helpFlag);           /* add the help flag to the command */
+/**
+ * @brief build the flag table of the short options of $optstring and the long options of $longopts.
+ */
+static void getopt_build_table(SAPGetopt *st, const char *optstring, const SAPOption *longopts) {
+    free(st->table.flag_index);
+    memset(&st->table, 0, sizeof(SAPCommand));
+    st->optstring = optstring;
+    st->longopts = longopts;
+
+    for (const char *p = optstring; *p != '\0'; p++) {
+        if (*p == ':' || ((*p == '+' || *p == '-') && p == optstring)) {
+            continue;
+        }
+        assert(st->table.flag_cnt < MAX_OPT_COUNT);     /* the table holds MAX_OPT_COUNT options */
+        int i = st->table.flag_cnt++;
+        st->flags[i].flag_name = "";
+        st->flags[i].shorthand = *p;
+        st->flags[i].name_id = SAP_NIL;
+        st->has_arg[i] = (p[1] != ':') ? sap_no_argument : (p[2] == ':') ? sap_optional_argument : sap_required_argument;
+        st->flags[i].type = (st->has_arg[i] == sap_no_argument) ? no_arg : single_arg;
+        st->long_idx[i] = -1;
+        st->table.flags[i] = &st->flags[i];
+    }
+    for (int k = 0; longopts != NULL && longopts[k].name != NULL; k++) {
+        assert(st->table.flag_cnt < MAX_OPT_COUNT);     /* the table holds MAX_OPT_COUNT options */
+        int i = st->table.flag_cnt++;
+        st->flags[i].flag_name = longopts[k].name;
+        st->flags[i].shorthand = '\0';
+        st->flags[i].name_id = SAP_NIL;
+        st->has_arg[i] = (unsigned char) longopts[k].has_arg;
+        st->flags[i].type = (longopts[k].has_arg == sap_no_argument) ? no_arg : single_arg;
+        st->long_idx[i] = k;
+        st->table.flags[i] = &st->flags[i];
+    }
+    get_flag_index(&st->table);
+}
 
-    init_tree_node(&cmd->tree_node);    /* initialize the tree node for the command */
+/**
+ * @brief move the options argv[last_nonopt, optind) before the non-options argv[first_nonopt, last_nonopt).
+ */
+static void getopt_exchange(SAPGetopt *st, char *argv[]) {
+    #define REVERSE(from, to) \
+        for (int lo = (from), hi = (to) - 1; lo < hi; lo++, hi--) { \
+            char *tmp = argv[lo]; argv[lo] = argv[hi]; argv[hi] = tmp; \
+        }
+    /* rotate by three reversals */
+    REVERSE(st->first_nonopt, st->last_nonopt);
+    REVERSE(st->last_nonopt, st->optind);
+    REVERSE(st->first_nonopt, st->optind);
+    #undef REVERSE
+
+    st->first_nonopt += st->optind - st->last_nonopt;
+    st->last_nonopt = st->optind;
 }
 
-void set_cmd_self_parse(SAPCommand *cmd, CmdExecWithArg self_parse_exec) {
-    /* ensure the incoming command pointer is not null */
-    assert(cmd != NULL);
-    /* set the command to parse arguments by itself */
-    cmd->parse_by_self = 1;
-    /* if the provided self-parse execution function is null */
-    if (self_parse_exec == NULL) {
-        /* use the default void self-parse execution function */
-        cmd->exec_self_parse = void_self_parse_exec;
-    } else {
-        /* use the provided self-parse execution function */
-        cmd->exec_self_parse = self_parse_exec;
+static void getopt_error(int print_errors, const char *fmt, const char *prog, const char *what) {
+    if (print_errors) {
+        SAPOutput *err_out = sap_get_output(sap_err_channel);
+        out_printf(err_out, fmt, prog, what);
+        sap_output_flush(err_out);
     }
 }
 
-SAPCommand* add_subcmd(SAPCommand *parent, SAPCommand *child) {
-    /* ensure the parent command pointer is not null */
-    assert(parent!= NULL);
-    /* ensure the child command pointer is not null */
-    assert(child!= NULL);
-
-    /* attempt to append the child node to the parent node */
-    if (append_child(&parent->tree_node, &child->tree_node) == NULL) {
-        return NULL;
+/**
+ * @brief process the long option at st->nextchar (after "--").
+ */
+static int getopt_long_option(SAPGetopt *st, int argc, char *argv[], const char *optstring,
+                              const SAPOption *longopts, int *longindex, int print_errors) {
+    char *name = st->nextchar;
+    size_t len = strcspn(name, "=");
+    SAPFlagIndex *index = get_flag_index(&st->table);
+    int lo, hi;
+    get_flag_range(&st->table, name, len, &lo, &hi);
+
+    /* the exact name first, then an unambiguous prefix, the first one in longopts wins */
+    int found = -1, exact = 0, ambiguous = 0;
+    for (int pos = lo; pos < hi; pos++) {
+        int k = st->long_idx[index->by_name[pos].flag];
+        if (k < 0) {
+            continue;       /* a short option */
+        }
+        int is_exact = (strlen(longopts[k].name) == len);
+        if (found < 0 || (is_exact && !exact) || (is_exact == exact && k < found)) {
+            found = k;
+            exact = is_exact;
+        }
+    }
+    for (int pos = lo; pos < hi && found >= 0 && !exact; pos++) {
+        int k = st->long_idx[index->by_name[pos].flag];
+        if (
+            k >= 0 && (longopts[k].has_arg != longopts[found].has_arg ||
+            longopts[k].flag != longopts[found].flag || longopts[k].val != longopts[found].val)
+        ) {
+            ambiguous = 1;
+        }
     }
 
-    return parent;
-}
+    st->optind++;
+    st->nextchar = NULL;
+    if (ambiguous) {
+        getopt_error(print_errors, "%s: option '--%s' is ambiguous\n", argv[0], name);
+        st->optopt = 0;
+        return '?';
+    }
+    if (found < 0) {
+        getopt_error(print_errors, "%s: unrecognized option '--%s'\n", argv[0], name);
+        st->optopt = 0;
+        return '?';
+    }
 
-int do_parse_subcmd(int argc, char *argv[]) {
-    /* initialize a pointer to the command to be executed */
-    SAPCommand *cmd2run = NULL;
-    /* initialize the depth counter */
-    int depth = 0;
+    const SAPOption *opt = &longopts[found];
+    if (name[len] == '=') {
+        if (opt->has_arg == sap_no_argument) {
+            getopt_error(print_errors, "%s: option '--%s' doesn't allow an argument\n", argv[0], opt->name);
+            st->optopt = opt->val;
+            return '?';
+        }
+        st->optarg = name + len + 1;
+    } else if (opt->has_arg == sap_required_argument) {
+        if (st->optind >= argc) {
+            getopt_error(print_errors, "%s: option '--%s' requires an argument\n", argv[0], opt->name);
+            st->optopt = opt->val;
+            return (optstring[0] == ':') ? ':' : '?';
+        }
+        st->optarg = argv[st->optind++];
+    }
 
-    /* allocate memory for a flag to specify the command to get help */
-    /* the helpCmd's default flag */
-    Flag *cmd2get_help = (Flag *) malloc(sizeof(Flag));
-    init_flag(cmd2get_help, "cmd", 'c', "Specify the command to get help", NULL);   /* initialize the flag */
-    set_flag_type(cmd2get_help, multi_arg);
-    add_helpcmd();                              /* add the help subcommand to the root command */
-    // set_flag_type(cmd2get_help, multi_arg);
-    add_default_flag(&helpCmd, cmd2get_help);   /* add the flag to the help command as the default flag */
-    check_shorthand();                          /* check the duplicate shorthand */
+    if (longindex != NULL) {
+        *longindex = found;
+    }
+    if (opt->flag != NULL) {
+        *opt->flag = opt->val;
+        return 0;
+    }
+    return opt->val;
+}
 
-    /* find the command to execute considering flags */
-    cmd2run = find_sap_consider_flags(&rootCmd, argv, &depth);
+int sap_getopt_long(SAPGetopt *st, int argc, char *argv[], const char *optstring, const SAPOption *longopts, int *longindex) {
+    assert(st != NULL);
+    assert(argv != NULL);
+    assert(optstring != NULL);
 
-    /* if the command to execute is found */
-    if (cmd2run != NULL) {
-        /* execute the command and return its result */
-        return call_exec(cmd2run, argc - depth, argv + depth);
-    } else {
-        /* print an error message for unknown commands */
-        printf("Unknown command: %s. See '%s help'.\n", argv[depth], rootCmd.name);
-        /* return -1 to indicate an unknown command */
+    #define NONOPTION_P (argv[st->optind][0] != '-' || argv[st->optind][1] == '\0')
+    if (argc < 1) {
         return -1;
     }
-}
+    st->optarg = NULL;
 
-void free_root_cmd() {
-    #define not_stack_select (((stack_select) == 0)? 1: 0)
-    TreeNode *stack[MAX_CMD_COUNT][2];      /* two stack cosplay a queue */
-    int top[2] = {-1, -1};                  /* the top ptr of the two stack */
-    int stack_select = 0;                   /* select the available stack*/
+    if (st->optind == 0 || optstring != st->optstring || longopts != st->longopts) {
+        /* (re)initialize the parser */
+        if (st->optind == 0) {
+            st->optind = 1;
+        }
+        st->first_nonopt = st->last_nonopt = st->optind;
+        st->nextchar = NULL;
+        if (optstring != st->optstring || longopts != st->longopts) {
+            getopt_build_table(st, optstring, longopts);    /* the table is kept while the options are the same */
+        }
+    }
+    st->ordering = (optstring[0] == '+') ? require_order : (optstring[0] == '-') ? return_in_order : permute;
+    if (optstring[0] == '+' || optstring[0] == '-') {
+        optstring++;
+    }
+    int print_errors = st->opterr && optstring[0] != ':';
 
-    /* push the root into stack */
-    stack[++top[stack_select]][stack_select] = &(rootCmd.tree_node);
+    if (st->nextchar == NULL || *st->nextchar == '\0') {
+        /* advance to the next element */
+        if (st->last_nonopt > st->optind) {
+            st->last_nonopt = st->optind;
+        }
+        if (st->first_nonopt > st->optind) {
+            st->first_nonopt = st->optind;
+        }
 
-    while (top[stack_select] >= 0) {
-        TreeNode *stack_top = stack[top[stack_select]][stack_select];
-        SAPCommand *crt_cmd = node2cmd(stack_top);   /* current command */
+        if (st->ordering == permute) {
+            /* move the options over the skipped non-options, then skip the following non-options */
+            if (st->first_nonopt != st->last_nonopt && st->last_nonopt != st->optind) {
+                getopt_exchange(st, argv);
+            } else if (st->last_nonopt != st->optind) {
+                st->first_nonopt = st->optind;
+            }
+            while (st->optind < argc && NONOPTION_P) {
+                st->optind++;
+            }
+            st->last_nonopt = st->optind;
+        }
 
-        for (int i = 0; i < crt_cmd->flag_cnt; i++) {
-            if (crt_cmd->flags[i]->type == multi_arg) {
-                free(crt_cmd->flags[i]->value);
+        if (st->optind != argc && strcmp(argv[st->optind], "--") == 0) {
+            /* "--" ends the options, the rest are non-options */
+            st->optind++;
+            if (st->first_nonopt != st->last_nonopt && st->last_nonopt != st->optind) {
+                getopt_exchange(st, argv);
+            } else if (st->first_nonopt == st->last_nonopt) {
+                st->first_nonopt = st->optind;
             }
+            st->last_nonopt = argc;
+            st->optind = argc;
         }
 
-        for (int i = 0; i < stack_top->child_cnt; i++) {
-            /* push the subcmds into the other stack */
-            stack[++top[not_stack_select]][not_stack_select] = stack_top->children[i];
+        if (st->optind == argc) {
+            /* point optind at the non-options moved to the end */
+            if (st->first_nonopt != st->last_nonopt) {
+                st->optind = st->first_nonopt;
+            }
+            return -1;
         }
 
-        if (--top[stack_select] < 0) {
-            /* pop and judge whether the stack is empty */
-            stack_select = not_stack_select;    /* switch the stack */
+        if (NONOPTION_P) {
+            if (st->ordering == require_order) {
+                return -1;
+            }
+            st->optarg = argv[st->optind++];
+            return 1;
         }
 
-        /* ---- non-leaf node ---- */
+        if (longopts != NULL && argv[st->optind][1] == '-') {
+            st->nextchar = argv[st->optind] + 2;
+            return getopt_long_option(st, argc, argv, optstring, longopts, longindex, print_errors);
+        }
+        st->nextchar = argv[st->optind] + 1;
     }
-    #undef not_stack_select
-    free(helpCmd.default_flag);
-    free_node_tree(&rootCmd.tree_node);
+    #undef NONOPTION_P
+
+    /* the next character of the short option cluster, through the shorthand table */
+    unsigned char ch = (unsigned char) *st->nextchar++;
+    int slot = (ch == ':' || ch == ';') ? 0 : get_flag_index(&st->table)->by_shorthand[ch];
+    if (*st->nextchar == '\0') {
+        st->optind++;
+    }
+    if (slot == 0) {
+        char what[2] = { (char) ch, '\0' };
+        getopt_error(print_errors, "%s: invalid option -- '%s'\n", argv[0], what);
+        st->optopt = ch;
+        return '?';
+    }
+
+    int has_arg = st->has_arg[slot - 1];
+    if (has_arg == sap_optional_argument) {
+        if (*st->nextchar != '\0') {
+            st->optarg = st->nextchar;
+            st->optind++;
+        }
+        st->nextchar = NULL;
+    } else if (has_arg == sap_required_argument) {
+        if (*st->nextchar != '\0') {
+            st->optarg = st->nextchar;
+            st->optind++;
+        } else if (st->optind == argc) {
+            char what[2] = { (char) ch, '\0' };
+            getopt_error(print_errors, "%s: option requires an argument -- '%s'\n", argv[0], what);
+            st->optopt = ch;
+            st->nextchar = NULL;
+            return (optstring[0] == ':') ? ':' : '?';
+        } else {
+            st->optarg = argv[st->optind++];
+        }
+        st->nextchar = NULL;
+    }
+    return ch;
 }
 
-/* ---- global frame functions that will be called by user ---- */
+int sap_getopt(SAPGetopt *st, int argc, char *argv[], const char *optstring) {
+    return sap_getopt_long(st, argc, argv, optstring, NULL, NULL);
+}
+
+/* ---- functions of getopt ---- */
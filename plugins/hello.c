@@ -0,0 +1,33 @@
+/**
+ * @file ./plugins/hello.c
+ * @brief a sample plugin of scap, greets someone
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * the library functions are resolved from the executable, which is linked with -rdynamic.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <scap.h>
+
+int sap_plugin_exec(SAPCommand *caller) {
+    const char *name = (const char *) get_flag(caller, "name")->value;
+    char msg[256];
+    int len = snprintf(msg, sizeof(msg), "hello, %s\n", (name == NULL) ? "world" : name);
+    if (len < 0 || len >= (int) sizeof(msg)) {
+        return -1;
+    }
+
+    if (get_flag(caller, "shout")->value != NULL) {
+        for (int i = 0; i < len; i++) {
+            msg[i] = (char) toupper((unsigned char) msg[i]);
+        }
+    }
+    sap_output_write(sap_get_output(sap_out_channel), msg, (size_t) len);
+    return 0;
+}
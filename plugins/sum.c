@@ -0,0 +1,21 @@
+/**
+ * @file ./plugins/sum.c
+ * @brief a sample plugin of scap, returns the sum of its arguments
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ */
+
+#include <stdlib.h>
+
+#include <scap.h>
+
+int sap_plugin_exec(SAPCommand *caller) {
+    char **numbers = (char **) caller->default_flag->value;
+    int sum = 0;
+    for (int i = 0; numbers != NULL && numbers[i] != NULL; i++) {
+        sum += atoi(numbers[i]);
+    }
+    return sum;
+}
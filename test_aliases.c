@@ -0,0 +1,197 @@
+/**
+ * @file test_aliases.c
+ * @brief the test of the aliases of the commands and the flags of scap.c
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_aliases
+ * the commands and the flags looked up by their aliases, exactly and by prefix, the aliases added after
+ * the first parse, the warning of a colliding shorthand alias and the aliases listed by the help.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static SAPCommand removeCmd;
+static Flag force, yank, recursive, quiet, verbose;
+
+static int nop_exec(SAPCommand *caller) {
+    (void) caller;
+    return 0;
+}
+
+static void build_tree(void) {
+    init_root_cmd("tool", "the aliases", NULL, nop_exec);
+
+    init_sap_command(&removeCmd, "remove", "remove the files", NULL, nop_exec);
+    add_subcmd(&rootCmd, &removeCmd);
+    expect(add_cmd_alias(&removeCmd, "rm") == 0, "the alias of remove");
+
+    init_flag(&force, "force", 'f', "don't ask", NULL);
+    set_flag_type(&force, no_arg);
+    expect(add_flag_alias(&force, "yes", 'y') == 0, "a long name and a shorthand");
+    expect(add_flag_alias(&force, NULL, 'F') == 0, "a shorthand only");
+    init_flag(&yank, "yank", '\0', "a prefix shared with yes", NULL);
+    set_flag_type(&yank, no_arg);
+    init_flag(&recursive, "recursive", 'r', "a prefix shared with its alias", NULL);
+    set_flag_type(&recursive, no_arg);
+    expect(add_flag_alias(&recursive, "recurse", 'R') == 0, "a prefix of the name");
+    init_flag(&quiet, "quiet", 'q', "its shorthand alias collides", NULL);
+    set_flag_type(&quiet, no_arg);
+    expect(add_flag_alias(&quiet, "silent", 'f') == 0, "a colliding shorthand");
+    add_flag(&removeCmd, &force);
+    add_flag(&removeCmd, &yank);
+    add_flag(&removeCmd, &recursive);
+    add_flag(&removeCmd, &quiet);
+
+    init_flag(&verbose, "verbose", 'v', "a persist flag", NULL);
+    set_flag_type(&verbose, no_arg);
+    add_persist_flag(&rootCmd, &verbose);
+}
+
+/**
+ * @brief run a command line by do_parse_subcmd, capture its output and its errors.
+ */
+static int run_captured(int argc, char *argv[], SAPMemBuf *out_mem, SAPMemBuf *err_mem) {
+    SAPOutput out, err;
+    sap_output_mem(&out, out_mem);
+    sap_output_mem(&err, err_mem);
+    sap_set_output(sap_out_channel, &out);
+    sap_set_output(sap_err_channel, &err);
+    int ret = do_parse_subcmd(argc, argv);
+    sap_set_output(sap_out_channel, NULL);
+    sap_set_output(sap_err_channel, NULL);
+    sap_output_free(&out);
+    sap_output_free(&err);
+    return ret;
+}
+
+/**
+ * @brief parse a command line, return whether it succeeds for remove with exactly the given flag set.
+ */
+static int gives(int argc, char *argv[], const char *flag_name) {
+    SAPParseResult res;
+    int ok = sap_parse(argc, argv, &res) == 0 && res.cmd == &removeCmd;
+    static const char *names[] = {"force", "yank", "recursive", "quiet", "verbose"};
+    for (size_t i = 0; ok && i < sizeof(names) / sizeof(names[0]); i++) {
+        ok = (sap_get_value(&res, names[i]) != NULL) == (strcmp(names[i], flag_name) == 0);
+    }
+    sap_free_result(&res);
+    return ok;
+}
+
+static void test_warning(void) {
+    SAPMemBuf out_mem = {0}, err_mem = {0};
+    char *line[] = {"tool", "rm", "-y", NULL};
+    expect(run_captured(3, line, &out_mem, &err_mem) == 0, "tool rm -y");
+    const char *warning = "In command: tool remove\nWarning: shorthand 'f' is already occupied by force\n";
+    expect(err_mem.data != NULL && strcmp(err_mem.data, warning) == 0, "the warning of the colliding alias");
+    sap_mem_buf_free(&out_mem);
+    sap_mem_buf_free(&err_mem);
+}
+
+static void test_lookup(void) {
+    char *by_alias[] = {"tool", "rm", "--yes", NULL};
+    expect(gives(3, by_alias, "force"), "--yes");
+    char *short_alias[] = {"tool", "remove", "-y", NULL};
+    expect(gives(3, short_alias, "force"), "-y");
+    char *short_only[] = {"tool", "rm", "-F", NULL};
+    expect(gives(3, short_only, "force"), "-F");
+    char *primary[] = {"tool", "rm", "-f", NULL};
+    expect(gives(3, primary, "force"), "the primary shorthand wins over the alias");
+    char *silent[] = {"tool", "rm", "--silent", NULL};
+    expect(gives(3, silent, "quiet"), "--silent");
+    char *recurse[] = {"tool", "rm", "-R", NULL};
+    expect(gives(3, recurse, "recursive"), "-R");
+
+    SAPParseResult res;
+    char *prefix[] = {"tool", "rm", "--ye", NULL};
+    expect(sap_parse(3, prefix, &res) != 0 && res.err.code == unknown_arg, "no prefix without prefix matching");
+    sap_free_result(&res);
+}
+
+static void test_prefix(void) {
+    SAPParseResult res;
+    char buf[256];
+    set_prefix_match(&rootCmd, 1);
+
+    char *alias[] = {"tool", "rm", "--ye", NULL};
+    expect(gives(3, alias, "force"), "a prefix of an alias");
+    char *sil[] = {"tool", "rm", "--sil", NULL};
+    expect(gives(3, sil, "quiet"), "a prefix of another alias");
+
+    /* recurse and recursive name the same flag */
+    char *same[] = {"tool", "rm", "--recur", NULL};
+    expect(gives(3, same, "recursive"), "the names of a single flag aren't ambiguous");
+    char *exact[] = {"tool", "rm", "--recurse", NULL};
+    expect(gives(3, exact, "recursive"), "an exact alias");
+
+    char *ambiguous[] = {"tool", "rm", "--y", NULL};
+    expect(sap_parse(3, ambiguous, &res) != 0 && res.err.code == ambiguous_arg, "a prefix of an alias and a name");
+    sap_format_error(&res, buf, sizeof(buf));
+    expect(strcmp(buf, "Ambiguous option: --y, possibilities: --yank --yes\n") == 0, "the alias among the candidates");
+    sap_free_result(&res);
+
+    set_prefix_match(&rootCmd, 0);
+}
+
+static void test_added_later(void) {
+    /* the indices were built by the parses above */
+    expect(add_flag_alias(&force, "assume", '\0') == 0, "an alias added after a parse");
+    char *added[] = {"tool", "rm", "--assume", NULL};
+    expect(gives(3, added, "force"), "the alias added after a parse");
+
+    /* the persist flag is held by every command */
+    expect(add_flag_alias(&verbose, "loud", 'L') == 0, "an alias of the persist flag");
+    char *in_remove[] = {"tool", "rm", "--loud", NULL};
+    expect(gives(3, in_remove, "verbose"), "the alias of the persist flag in remove");
+    SAPParseResult res;
+    char *in_root[] = {"tool", "-L", NULL};
+    expect(sap_parse(2, in_root, &res) == 0 && res.cmd == &rootCmd && sap_get_value(&res, "verbose") != NULL, "in the root");
+    sap_free_result(&res);
+
+    expect(add_flag_alias(&force, "a", '\0') == 0 && add_flag_alias(&force, "b", '\0') == -1, "MAX_ALIAS_COUNT aliases");
+}
+
+static void test_help(void) {
+    SAPMemBuf out_mem = {0}, err_mem = {0};
+
+    char *help[] = {"tool", "help", NULL};
+    expect(run_captured(2, help, &out_mem, &err_mem) == 0, "tool help");
+    expect(out_mem.data != NULL && strstr(out_mem.data, "  remove, rm\tremove the files\n") != NULL, "the alias of the command");
+    sap_mem_buf_free(&out_mem);
+
+    char *help_rm[] = {"tool", "help", "rm", NULL};
+    expect(run_captured(3, help_rm, &out_mem, &err_mem) == 0, "tool help rm");
+    const char *lines[] = {
+        "  -f, -y, -F, --force, --yes, --assume, --a\tdon't ask",
+        "  -r, -R, --recursive, --recurse\t",
+        "  -q, -f, --quiet, --silent\t",
+        "  -v, -L, --verbose, --loud\t",
+        "  --yank\t",
+    };
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        expect(out_mem.data != NULL && strstr(out_mem.data, lines[i]) != NULL, lines[i]);
+    }
+    sap_mem_buf_free(&out_mem);
+    sap_mem_buf_free(&err_mem);
+}
+
+int main(void) {
+    build_tree();
+    test_warning();
+    test_lookup();
+    test_prefix();
+    test_added_later();
+    test_help();
+    free_root_cmd();
+    printf("aliases test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,254 @@
+/**
+ * @file test_async.c
+ * @brief the test of the asynchronous execution and the executors of scap.c
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_async
+ * sap_exec_async on the inline executor (completed before it returns) and on a thread pool (completed once from
+ * a worker), sap_thread_pool_destroy running the tasks still queued, and the synchronous fallback for the
+ * synchronous handlers, the parse errors, the help flag and an unknown command.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+#define TASK_CNT 64
+
+static SAPCommand buildCmd, gateCmd, syncCmd;
+static Flag jobs;
+
+/* the completion of a task, one per parse result */
+typedef struct {
+    int calls;          /* the calls of on_done */
+    int ret;
+    pthread_t thread;   /* the thread on_done is called from */
+} Done;
+
+static SAPParseResult results[TASK_CNT];
+static Done dones[TASK_CNT];
+static int completed = 0;       /* the calls of on_done of all the tasks */
+static int asyncCalls = 0;      /* the calls of the asynchronous handlers */
+static int syncCalls = 0;
+static int gateOpen = 0;        /* the gate handler waits until it is set */
+static int sinkCalls = 0;
+static ParseErr sinkCode = parse_ok;
+
+/**
+ * @brief complete with the value of --jobs.
+ */
+static void build_async(SAPParseResult *res, SAPCompletion *done) {
+    __atomic_fetch_add(&asyncCalls, 1, __ATOMIC_SEQ_CST);
+    sap_complete(done, atoi((char *) sap_get_value(res, "jobs")));
+}
+
+/**
+ * @brief hold the worker until the gate is open.
+ */
+static void gate_async(SAPParseResult *res, SAPCompletion *done) {
+    (void) res;
+    while (!__atomic_load_n(&gateOpen, __ATOMIC_SEQ_CST)) {
+        usleep(1000);
+    }
+    sap_complete(done, 0);
+}
+
+static int sync_exec(SAPCommand *caller) {
+    (void) caller;
+    syncCalls++;
+    return 7;
+}
+
+static void on_done(SAPParseResult *res, int ret, void *ctx) {
+    (void) res;
+    Done *done = (Done *) ctx;
+    done->ret = ret;
+    done->thread = pthread_self();
+    __atomic_fetch_add(&done->calls, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&completed, 1, __ATOMIC_SEQ_CST);
+}
+
+static void counting_sink(const SAPParseResult *res, void *ctx) {
+    (void) ctx;
+    sinkCalls++;
+    sinkCode = res->err.code;
+}
+
+static void build_tree(void) {
+    init_root_cmd("tool", "the asynchronous execution", NULL, NULL);
+    init_sap_command(&buildCmd, "build", "an asynchronous command", NULL, NULL);
+    set_cmd_async_exec(&buildCmd, build_async);
+    init_flag(&jobs, "jobs", 'j', "the number of jobs", NULL);
+    add_flag(&buildCmd, &jobs);
+    init_sap_command(&gateCmd, "gate", "an asynchronous command waiting for the gate", NULL, NULL);
+    set_cmd_async_exec(&gateCmd, gate_async);
+    init_sap_command(&syncCmd, "sync", "a synchronous command", NULL, sync_exec);
+    add_subcmd(&rootCmd, &buildCmd);
+    add_subcmd(&rootCmd, &gateCmd);
+    add_subcmd(&rootCmd, &syncCmd);
+}
+
+/**
+ * @brief parse "tool build --jobs $i" into results[$i] and clear its completion.
+ */
+static void parse_build(int i) {
+    static char nums[TASK_CNT][16];     /* the values point into the arguments */
+    snprintf(nums[i], sizeof(nums[i]), "%d", i);
+    char *line[] = {"tool", "build", "--jobs", nums[i], NULL};
+    expect(sap_parse(4, line, &results[i]) == 0, "the parse of build");
+    memset(&dones[i], 0, sizeof(Done));
+}
+
+static void reset_counts(void) {
+    completed = asyncCalls = syncCalls = sinkCalls = 0;
+    sinkCode = parse_ok;
+}
+
+/**
+ * @brief whether every task in [0, $cnt) completed exactly once with its --jobs from a thread other than the caller.
+ */
+static int all_done_once(int cnt) {
+    int ok = 1;
+    for (int i = 0; i < cnt; i++) {
+        ok = ok && dones[i].calls == 1 && dones[i].ret == i && !pthread_equal(dones[i].thread, pthread_self());
+    }
+    return ok;
+}
+
+static void test_inline(void) {
+    reset_counts();
+    parse_build(3);
+    sap_exec_async(sap_inline_executor(), &results[3], on_done, &dones[3]);
+    expect(asyncCalls == 1 && dones[3].calls == 1 && dones[3].ret == 3, "inline: completed before returning");
+    expect(pthread_equal(dones[3].thread, pthread_self()), "inline: on the calling thread");
+
+    /* on_done can be NULL */
+    sap_exec_async(sap_inline_executor(), &results[3], NULL, NULL);
+    expect(asyncCalls == 2 && dones[3].calls == 1, "inline: without on_done");
+    sap_free_result(&results[3]);
+}
+
+static void test_pool(void) {
+    reset_counts();
+    SAPExecutor *pool = sap_thread_pool_create(4);
+    expect(pool != NULL, "pool: created");
+
+    for (int i = 0; i < TASK_CNT; i++) {
+        parse_build(i);
+        sap_exec_async(pool, &results[i], on_done, &dones[i]);
+    }
+    /* wait for the workers, at most about 10 seconds */
+    for (int wait = 0; wait < 10000 && __atomic_load_n(&completed, __ATOMIC_SEQ_CST) < TASK_CNT; wait++) {
+        usleep(1000);
+    }
+    expect(__atomic_load_n(&completed, __ATOMIC_SEQ_CST) == TASK_CNT, "pool: all the tasks completed");
+    sap_thread_pool_destroy(pool);
+
+    expect(asyncCalls == TASK_CNT && completed == TASK_CNT, "pool: each handler once");
+    expect(all_done_once(TASK_CNT), "pool: on_done once per task from a worker");
+    for (int i = 0; i < TASK_CNT; i++) {
+        sap_free_result(&results[i]);
+    }
+}
+
+static void *open_gate_later(void *arg) {
+    (void) arg;
+    usleep(50000);
+    __atomic_store_n(&gateOpen, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+static void test_destroy_drains(void) {
+    reset_counts();
+    gateOpen = 0;
+    SAPExecutor *pool = sap_thread_pool_create(1);
+    expect(pool != NULL, "drain: created");
+
+    /* the only worker waits at the gate, so the tasks behind it are still queued when the pool is destroyed */
+    SAPParseResult gate_res;
+    Done gate_done = {0};
+    char *gate_line[] = {"tool", "gate", NULL};
+    expect(sap_parse(2, gate_line, &gate_res) == 0, "drain: the parse of gate");
+    sap_exec_async(pool, &gate_res, on_done, &gate_done);
+    for (int i = 0; i < TASK_CNT; i++) {
+        parse_build(i);
+        sap_exec_async(pool, &results[i], on_done, &dones[i]);
+    }
+
+    pthread_t opener;
+    expect(pthread_create(&opener, NULL, open_gate_later, NULL) == 0, "drain: the opener thread");
+    sap_thread_pool_destroy(pool);
+    pthread_join(opener, NULL);
+
+    expect(gate_done.calls == 1 && completed == TASK_CNT + 1, "drain: the queued tasks ran before destroy returned");
+    expect(all_done_once(TASK_CNT), "drain: on_done once per queued task");
+    for (int i = 0; i < TASK_CNT; i++) {
+        sap_free_result(&results[i]);
+    }
+    sap_free_result(&gate_res);
+}
+
+/**
+ * @brief run $line on a thread pool, it must complete before sap_exec_async returns, on the calling thread.
+ */
+static int run_sync(int argc, char *line[], const char *what) {
+    SAPExecutor *pool = sap_thread_pool_create(2);
+    SAPParseResult res;
+    Done done = {0};
+    sap_parse(argc, line, &res);
+    sap_exec_async(pool, &res, on_done, &done);
+    expect(done.calls == 1 && pthread_equal(done.thread, pthread_self()), what);
+    sap_thread_pool_destroy(pool);
+    expect(done.calls == 1 && asyncCalls == 0, what);
+    sap_free_result(&res);
+    return done.ret;
+}
+
+static void test_sync_fallback(void) {
+    reset_counts();
+    sap_set_error_sink(counting_sink, NULL);
+    SAPMemBuf mem = {0};
+    SAPOutput out;
+    sap_output_mem(&out, &mem);
+    sap_set_output(sap_out_channel, &out);
+
+    char *sync[] = {"tool", "sync", NULL};
+    expect(run_sync(2, sync, "fallback: a synchronous handler") == 7 && syncCalls == 1, "fallback: the handler ran");
+
+    char *bad[] = {"tool", "build", "--bogus", NULL};
+    expect(run_sync(3, bad, "fallback: a parse error") == -1, "fallback: a parse error fails");
+    expect(sinkCalls == 1 && sinkCode == unknown_arg, "fallback: the parse error reported");
+
+    char *help[] = {"tool", "build", "--help", NULL};
+    expect(run_sync(3, help, "fallback: the help flag") == 0 && mem.len > 0, "fallback: the help printed");
+    expect(strstr(mem.data, "--jobs") != NULL && sinkCalls == 1, "fallback: the help of build");
+
+    char *nope[] = {"tool", "nope", NULL};
+    expect(run_sync(2, nope, "fallback: an unknown command") == -1, "fallback: an unknown command fails");
+    expect(sinkCalls == 2 && sinkCode == unknown_cmd, "fallback: the unknown command reported");
+
+    sap_set_output(sap_out_channel, NULL);
+    sap_output_free(&out);
+    sap_mem_buf_free(&mem);
+    sap_set_error_sink(NULL, NULL);
+}
+
+int main(void) {
+    build_tree();
+    test_inline();
+    test_pool();
+    test_destroy_drains();
+    test_sync_fallback();
+    free_root_cmd();
+    printf("async test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
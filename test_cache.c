@@ -0,0 +1,274 @@
+/**
+ * @file test_cache.c
+ * @brief the test of the parse cache of scap.c against sap_parse
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_cache
+ * fresh copies of the repeated command lines are parsed by sap_parse and through the cache, the cached results must
+ * point into their own copy at the same token and offset: the values, the lists, the counts, the positional slots
+ * and the tail. then the keys of the same bytes split otherwise, and the cache stepping aside at a low hit rate.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static SAPCommand copyCmd, sumCmd, lsCmd, remoteCmd, runCmd;
+static Flag verbose, jobs, tags, mode, level, include, files, quiet;
+
+static void build_tree(void) {
+    static const char *modes[] = {"fast", "slow", NULL};
+    init_root_cmd("tool", "the parse cache", NULL, NULL);
+
+    /* copy [options] <src> [dst], every kind of value */
+    init_sap_command(&copyCmd, "copy", "copy a file", NULL, NULL);
+    init_flag(&verbose, "verbose", 'v', "a counted flag", NULL);
+    set_flag_type(&verbose, no_arg);
+    set_flag_repeat(&verbose, repeat_count);
+    init_flag(&jobs, "jobs", 'j', "a flag with a default", "1");
+    init_flag(&tags, "tag", 't', "an appended flag", NULL);
+    set_flag_repeat(&tags, repeat_append);
+    init_flag(&mode, "mode", 'm', "a flag with choices", "fast");
+    set_flag_choices(&mode, modes);
+    init_flag(&level, "level", 'l', "a flag from the environment", "0");
+    set_flag_env(&level, "SCAP_TEST_CACHE_LEVEL");
+    add_flag(&copyCmd, &verbose);
+    add_flag(&copyCmd, &jobs);
+    add_flag(&copyCmd, &tags);
+    add_flag(&copyCmd, &mode);
+    add_flag(&copyCmd, &level);
+    expect(add_positional(&copyCmd, "src", "the source", pos_string, 1, 1) == 0, "the slot src");
+    expect(add_positional(&copyCmd, "dst", "the destination", pos_string, 0, 1) == 1, "the slot dst");
+    add_subcmd(&rootCmd, &copyCmd);
+
+    /* sum <nums>..., a variadic slot */
+    init_sap_command(&sumCmd, "sum", "add the numbers", NULL, NULL);
+    expect(add_positional(&sumCmd, "nums", "the numbers", pos_int, 1, -1) == 0, "the slot nums");
+    add_subcmd(&rootCmd, &sumCmd);
+
+    /* ls [-I dirs...] [files]..., the lists of the default flag and a multi_arg flag */
+    init_sap_command(&lsCmd, "ls", "list the files", NULL, NULL);
+    init_flag(&include, "include", 'I', "the included directories", NULL);
+    set_flag_type(&include, multi_arg);
+    init_flag(&files, "files", 'f', "the files", NULL);
+    set_flag_type(&files, multi_arg);
+    add_flag(&lsCmd, &include);
+    add_default_flag(&lsCmd, &files);
+    add_subcmd(&rootCmd, &lsCmd);
+
+    /* remote run [-q] -- <command>..., a nested passthrough command */
+    init_sap_command(&remoteCmd, "remote", "the remote commands", NULL, NULL);
+    init_sap_command(&runCmd, "run", "run a command", NULL, NULL);
+    set_cmd_passthrough(&runCmd, 1);
+    init_flag(&quiet, "quiet", 'q', "print less", NULL);
+    set_flag_type(&quiet, no_arg);
+    add_flag(&runCmd, &quiet);
+    add_subcmd(&remoteCmd, &runCmd);
+    add_subcmd(&rootCmd, &remoteCmd);
+}
+
+/**
+ * @brief a fresh copy of a command line, every token in a block of its own.
+ */
+static char **copy_line(char *line[], int *argc) {
+    int cnt = 0;
+    while (line[cnt] != NULL) {
+        cnt++;
+    }
+    char **copy = (char **) malloc(sizeof(char *) * (size_t) (cnt + 1));
+    for (int i = 0; i < cnt; i++) {
+        copy[i] = strdup(line[i]);
+    }
+    copy[cnt] = NULL;
+    *argc = cnt;
+    return copy;
+}
+
+static void free_line(char **line, int argc) {
+    for (int i = 0; i < argc; i++) {
+        free(line[i]);
+    }
+    free(line);
+}
+
+/**
+ * @brief whether a value of the cached result is the value of sap_parse rebased onto the other copy.
+ *
+ * a string in argv is at the same token and the same offset of the other copy, any other pointer is the same.
+ */
+static int rebased(const void *value, const void *cached, char *line[], char *other[], int argc) {
+    for (int i = 0; i < argc; i++) {
+        const char *p = (const char *) value;
+        if (p >= line[i] && p <= line[i] + strlen(line[i])) {
+            return cached == other[i] + (p - line[i]);
+        }
+    }
+    return cached == value;
+}
+
+static int rebased_list(void *value, void *cached, char *line[], char *other[], int argc) {
+    char **list = (char **) value, **cached_list = (char **) cached;
+    if (list == NULL || cached_list == NULL) {
+        return list == cached_list;
+    }
+    int k = 0;
+    for (; list[k] != NULL; k++) {
+        if (!rebased(list[k], cached_list[k], line, other, argc)) {
+            return 0;
+        }
+    }
+    return cached_list[k] == NULL;
+}
+
+/**
+ * @brief parse two fresh copies of a command line, by sap_parse and through the cache, the results must agree.
+ */
+static void check_line(SAPParseCache *cache, char *tokens[], const char *what) {
+    int argc;
+    char **line = copy_line(tokens, &argc);
+    char **other = copy_line(tokens, &argc);
+    SAPParseResult res, cached;
+    int ret = sap_parse(argc, line, &res);
+    int cached_ret = sap_cache_parse(cache, argc, other, &cached);
+
+    int same = ret == cached_ret && res.cmd == cached.cmd && res.err.code == cached.err.code &&
+               res.err.argv_idx == cached.err.argv_idx;
+    if (same && ret == 0) {
+        same = res.argc == cached.argc && res.argv_offset == cached.argv_offset && cached.argv == other + res.argv_offset &&
+               memcmp(&res.given, &cached.given, sizeof(res.given)) == 0 &&
+               memcmp(&res.from_env, &cached.from_env, sizeof(res.from_env)) == 0;
+        /* the tail is a slice of the other copy */
+        same = same && res.tail_argc == cached.tail_argc &&
+               (res.tail_argv == NULL ? cached.tail_argv == NULL : cached.tail_argv == other + (res.tail_argv - line));
+        for (int i = 0; same && i < res.cmd->flag_cnt; i++) {
+            Flag *flag = res.cmd->flags[i];
+            void *value = res.values[i], *cached_value = cached.values[i];
+            if (flag->repeat == repeat_count && value != NULL) {
+                same = cached_value != NULL && *(int *) value == *(int *) cached_value;
+            } else if ((flag->type == multi_arg || flag->repeat == repeat_append) && value != flag->dft_value) {
+                same = rebased_list(value, cached_value, line, other, argc);
+            } else {
+                same = rebased(value, cached_value, line, other, argc);
+            }
+        }
+        same = same && res.pos_cnt == cached.pos_cnt;
+        for (int slot = 0; same && slot < MAX_POS_COUNT; slot++) {
+            if (res.cmd == &sumCmd && slot == 0) {
+                same = rebased_list(res.positionals[slot], cached.positionals[slot], line, other, argc);
+            } else {
+                same = rebased(res.positionals[slot], cached.positionals[slot], line, other, argc);
+            }
+        }
+    }
+    expect(same, what);
+
+    sap_free_result(&res);
+    sap_free_result(&cached);
+    free_line(line, argc);
+    free_line(other, argc);
+}
+
+static void test_differential(void) {
+    SAPParseCache *cache = sap_cache_create(16);
+    char *lines[][12] = {
+        {"tool", "copy", "-vvv", "a", "b", "--jobs=4", "-tX", "--tag", "Y", "-v", NULL},
+        {"tool", "copy", "src", "-m", "slow", "--", "-dst", NULL},
+        {"tool", "copy", "-j8", "only", "-l", "3", NULL},
+        {"tool", "copy", "-v", "one", NULL},
+        {"tool", "sum", "1", "2", "--", "-3", NULL},
+        {"tool", "ls", "p", "q", "-I", "i1", "i2", NULL},
+        {"tool", "ls", "-Iinc", NULL},
+        {"tool", "ls", NULL},
+        {"tool", "remote", "run", "-q", "--", "make", "-j8", "--", "all", NULL},
+        {"tool", "remote", "run", "--", NULL},
+        /* the erroneous lines are parsed every time */
+        {"tool", "bogus", NULL},
+        {"tool", "copy", NULL},
+        {"tool", "copy", "-m", "bad", "a", NULL},
+        {"tool", "sum", "1", "x", NULL},
+    };
+    int cnt = (int) (sizeof(lines) / sizeof(lines[0]));
+
+    /* a line is cached the second time, the rounds after hit */
+    for (int round = 0; round < 4; round++) {
+        if (round == 3) {
+            setenv("SCAP_TEST_CACHE_LEVEL", "9", 1);    /* the fallbacks are resolved on a hit as well */
+        }
+        for (int i = 0; i < cnt; i++) {
+            char what[64];
+            snprintf(what, sizeof(what), "the line %d of the round %d", i, round);
+            check_line(cache, lines[i], what);
+        }
+    }
+    unsetenv("SCAP_TEST_CACHE_LEVEL");
+
+    SAPCacheStats stats;
+    sap_cache_stats(cache, &stats);
+    expect(stats.entries == 10 && stats.evictions == 0, "only the successful lines are cached");
+    expect(stats.hits == 10 * 2 && stats.bypassed == 0, "the successful lines hit from their third parse");
+
+    /* the same bytes split into other tokens are another line */
+    sap_cache_clear(cache);
+    char *split[] = {"tool", "ls", "ab", "c", NULL};
+    char *resplit[] = {"tool", "ls", "a", "bc", NULL};
+    for (int i = 0; i < 3; i++) {
+        check_line(cache, split, "ab c");
+        check_line(cache, resplit, "a bc");
+    }
+    sap_cache_stats(cache, &stats);
+    expect(stats.entries == 2, "the keys of the same bytes");
+    sap_cache_free(cache);
+}
+
+static void test_bypass(void) {
+    SAPParseCache *cache = sap_cache_create(4);
+    SAPCacheStats stats;
+    SAPParseResult res;
+    char num[16];
+    char *unique[] = {"tool", "sum", num, NULL};
+
+    /* every line new, the cache can't pay and steps aside */
+    for (int i = 0; i < 8192; i++) {
+        snprintf(num, sizeof(num), "%d", i);
+        expect(sap_cache_parse(cache, 3, unique, &res) == 0 && res.positionals[0] != NULL, "a unique line");
+        sap_free_result(&res);
+    }
+    sap_cache_stats(cache, &stats);
+    expect(stats.bypassed > 0 && stats.hits == 0, "the cache steps aside");
+
+    /* the results are the same while it's bypassed */
+    char *repeated[] = {"tool", "copy", "-vv", "a", "--tag", "x", NULL};
+    for (int i = 0; i < 32; i++) {
+        check_line(cache, repeated, "a line while bypassed");
+    }
+
+    /* a repeated line: a sampled window pays, the cache is looked up again */
+    for (int i = 0; i < 40000; i++) {
+        expect(sap_cache_parse(cache, 6, repeated, &res) == 0, "the repeated line");
+        sap_free_result(&res);
+    }
+    SAPCacheStats before;
+    sap_cache_stats(cache, &before);
+    for (int i = 0; i < 1000; i++) {
+        check_line(cache, repeated, "a line after the bypass");
+    }
+    sap_cache_stats(cache, &stats);
+    expect(stats.hits - before.hits == 1000 && stats.bypassed == before.bypassed, "the cache is back");
+    sap_cache_free(cache);
+}
+
+int main(void) {
+    build_tree();
+    test_differential();
+    test_bypass();
+    free_root_cmd();
+    printf("cache test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
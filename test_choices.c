@@ -0,0 +1,165 @@
+/**
+ * @file test_choices.c
+ * @brief the test of the choice flags of scap.c
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_choices
+ * the values of the choice flags given on the command line, by the environment and by the config file,
+ * their canonical strings and ids, and the rejection of the values out of the choices.
+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static Flag format, tags, level;
+
+static const char *format_choices[] = {"json", "yaml", "text", NULL};
+static const char *tag_choices[] = {"a", "b", "c", NULL};
+static const char *level_choices[] = {"low", "high", NULL};
+
+static void build_tree(void) {
+    init_root_cmd("tool", "the choice flags", NULL, NULL);
+
+    /* the default value is given as a copy, the choices make it canonical */
+    static char text[] = "text";
+    init_flag(&format, "format", 'f', "the output format", text);
+    set_flag_choices(&format, format_choices);
+    init_flag(&tags, "tags", 't', "the tags", NULL);
+    set_flag_type(&tags, multi_arg);
+    set_flag_choices(&tags, tag_choices);
+    init_flag(&level, "level", 'l', "the level", NULL);
+    set_flag_choices(&level, level_choices);
+    set_flag_env(&level, "SCAP_TEST_LEVEL");
+    set_flag_config_key(&level, "level");
+    add_flag(&rootCmd, &format);
+    add_flag(&rootCmd, &tags);
+    add_flag(&rootCmd, &level);
+}
+
+static void test_values(void) {
+    SAPParseResult res;
+
+    char *line[] = {"tool", "--format", "yaml", NULL};
+    expect(sap_parse(3, line, &res) == 0 && sap_get_choice(&res, "format") == 1, "the id of a given choice");
+    const char *value = (const char *) sap_get_value(&res, "format");
+    expect(value != NULL && strcmp(value, "yaml") == 0 && value != line[2], "the value is the canonical string");
+    expect(sap_choice_id(&format, value) == 1 && sap_choice_id(&format, line[2]) == 1, "sap_choice_id of the value and of a copy");
+    expect(sap_choice_id(&format, "xml") == -1 && sap_choice_id(&format, "yam") == -1, "sap_choice_id of the other strings");
+    sap_free_result(&res);
+
+    char *none[] = {"tool", NULL};
+    expect(sap_parse(1, none, &res) == 0 && sap_get_choice(&res, "format") == 2, "the id of the default value");
+    expect(sap_get_value(&res, "format") == format.dft_value && sap_get_source(&res, "format") == source_default, "the canonical default value");
+    expect(sap_get_choice(&res, "level") == -1, "no value, no id");
+    sap_free_result(&res);
+
+    char *list[] = {"tool", "-t", "c", "a", NULL};
+    expect(sap_parse(4, list, &res) == 0, "a list of choices");
+    char **got = (char **) sap_get_value(&res, "tags");
+    expect(got != NULL && sap_choice_id(&tags, got[0]) == 2 && sap_choice_id(&tags, got[1]) == 0 && got[2] == NULL, "the ids of the list");
+    expect(got != NULL && got[0] != list[2] && strcmp(got[0], "c") == 0, "the list of canonical strings");
+    sap_free_result(&res);
+}
+
+static void test_rejection(void) {
+    SAPParseResult res;
+    char buf[256];
+
+    char *single[] = {"tool", "-f", "xml", NULL};
+    expect(sap_parse(3, single, &res) != 0 && res.err.code == invalid_choice, "a value out of the choices");
+    expect(res.err.argv_idx == 2 && res.err.expected == expect_choice && res.err.flag_id == format.name_id, "the rejected value");
+    sap_format_error(&res, buf, sizeof(buf));
+    expect(strcmp(buf, "Invalid value: xml, choices: json yaml text\n") == 0, "the choices in the message");
+    sap_free_result(&res);
+
+    char *attached[] = {"tool", "--format=jso", NULL};
+    expect(sap_parse(2, attached, &res) != 0 && res.err.code == invalid_choice && res.err.argv_idx == 1, "a prefix of a choice");
+    sap_free_result(&res);
+
+    char *list[] = {"tool", "-t", "a", "d", "b", NULL};
+    expect(sap_parse(5, list, &res) != 0 && res.err.code == invalid_choice && res.err.argv_idx == 3, "a list with a value out of the choices");
+    sap_format_error(&res, buf, sizeof(buf));
+    expect(strcmp(buf, "Invalid value: d, choices: a b c\n") == 0, "the choices of the list in the message");
+    sap_free_result(&res);
+}
+
+static void test_fallbacks(void) {
+    SAPParseResult res;
+    char buf[256];
+    char *line[] = {"tool", NULL};
+
+    char path[] = "/tmp/scap_choices_XXXXXX";
+    int fd = mkstemp(path);
+    expect(fd >= 0, "the config file");
+    const char *text = "level = low\n";
+    expect(write(fd, text, strlen(text)) == (ssize_t) strlen(text), "the config text");
+    close(fd);
+    expect(sap_load_config(path) == 0, "the config loaded");
+
+    expect(sap_parse(1, line, &res) == 0 && sap_get_choice(&res, "level") == 0, "a choice from the config");
+    expect(sap_get_source(&res, "level") == source_config, "the source of the config choice");
+    sap_free_result(&res);
+
+    setenv("SCAP_TEST_LEVEL", "high", 1);
+    expect(sap_parse(1, line, &res) == 0 && sap_get_choice(&res, "level") == 1, "a choice from the environment");
+    expect(sap_get_source(&res, "level") == source_env, "the environment wins over the config");
+    sap_free_result(&res);
+
+    setenv("SCAP_TEST_LEVEL", "mid", 1);
+    expect(sap_parse(1, line, &res) != 0 && res.err.code == invalid_choice && res.err.argv_idx == -1, "a bad choice from the environment");
+    sap_format_error(&res, buf, sizeof(buf));
+    expect(strcmp(buf, "Invalid value: mid (environment variable SCAP_TEST_LEVEL), choices: low high\n") == 0, "the variable in the message");
+    sap_free_result(&res);
+    unsetenv("SCAP_TEST_LEVEL");
+
+    fd = open(path, O_WRONLY | O_TRUNC);
+    text = "level = medium\n";
+    expect(fd >= 0 && write(fd, text, strlen(text)) == (ssize_t) strlen(text), "the config text, again");
+    close(fd);
+    expect(sap_load_config(path) == 0, "the config loaded again");
+    expect(sap_parse(1, line, &res) != 0 && res.err.code == invalid_choice && res.err.argv_idx == -1, "a bad choice from the config");
+    sap_format_error(&res, buf, sizeof(buf));
+    expect(strcmp(buf, "Invalid value: medium (config key level), choices: low high\n") == 0, "the key in the message");
+    sap_free_result(&res);
+
+    sap_free_config();
+    unlink(path);
+}
+
+static void test_default_choice(void) {
+    /* a default value out of the choices is a programming error, caught by an assertion */
+    pid_t pid = fork();
+    if (pid == 0) {
+        freopen("/dev/null", "w", stderr);
+        Flag bad;
+        init_flag(&bad, "bad", '\0', "a bad default", "xml");
+        set_flag_choices(&bad, format_choices);
+        _exit(0);
+    }
+    int status = 0;
+    expect(pid > 0 && waitpid(pid, &status, 0) == pid, "the child");
+    expect(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT, "the default value must be a choice");
+}
+
+int main(void) {
+    build_tree();
+    test_values();
+    test_rejection();
+    test_fallbacks();
+    test_default_choice();
+    free_root_cmd();
+    printf("choices test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file test_compact.c
+ * @brief the test of the compact snapshot of a command tree in scap.c
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_compact
+ * the layout of sap_compact_build (breadth-first commands, interned strings), the command paths resolved by
+ * sap_compact_find, the flags found by sap_compact_find_flag, a persist flag stored once, and the snapshot
+ * staying as it was when the pointer tree changes.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static SAPCommand remoteCmd, addCmd, removeCmd, commitCmd, tagCmd;
+static Flag quiet, verbose, message;
+
+static void build_tree(void) {
+    init_root_cmd("git", "the compact snapshot", NULL, NULL);
+    init_sap_command(&remoteCmd, "remote", "manage the remotes", "the long description of remote", NULL);
+    init_sap_command(&addCmd, "add", "add a remote", NULL, NULL);
+    init_sap_command(&removeCmd, "remove", "remove a remote", NULL, NULL);
+    init_sap_command(&commitCmd, "commit", "record the changes", NULL, NULL);
+
+    init_flag(&verbose, "verbose", 'v', "print more", NULL);
+    set_flag_type(&verbose, no_arg);
+    add_flag(&remoteCmd, &verbose);
+    init_flag(&message, "message", 'm', "the message", NULL);
+    add_flag(&commitCmd, &message);
+
+    add_subcmd(&remoteCmd, &addCmd);
+    add_subcmd(&remoteCmd, &removeCmd);
+    add_subcmd(&rootCmd, &remoteCmd);
+    add_subcmd(&rootCmd, &commitCmd);
+
+    /* added to every command of the tree */
+    init_flag(&quiet, "quiet", 'q', "print less", NULL);
+    set_flag_type(&quiet, no_arg);
+    add_persist_flag(&rootCmd, &quiet);
+}
+
+static const char *cmd_name(const SAPCompactTree *tree, uint32_t cmd) {
+    return sap_str_get(&tree->strs, tree->cmds[cmd].name);
+}
+
+static void test_layout(const SAPCompactTree *tree) {
+    /* git, remote, commit, add, remove */
+    expect(tree->cmd_cnt == 5, "the number of commands");
+    expect(strcmp(cmd_name(tree, 0), "git") == 0 && tree->cmds[0].parent == SAP_NIL, "the root first");
+    expect(tree->cmds[0].child_cnt == 2 && tree->cmds[0].first_child == 1, "the children of the root");
+    expect(strcmp(cmd_name(tree, 1), "remote") == 0 && strcmp(cmd_name(tree, 2), "commit") == 0, "breadth-first");
+    expect(tree->cmds[1].first_child == 3 && tree->cmds[1].child_cnt == 2, "the children of remote");
+    expect(tree->cmds[3].parent == 1 && tree->cmds[4].parent == 1 && tree->cmds[2].parent == 0, "the parents");
+
+    expect(strcmp(sap_str_get(&tree->strs, tree->descs[1].short_desc), "manage the remotes") == 0 &&
+           strcmp(sap_str_get(&tree->strs, tree->descs[1].long_desc), "the long description of remote") == 0,
+           "the descriptions of remote");
+    expect(tree->descs[2].long_desc == SAP_NIL, "no long description");
+}
+
+static void test_find(const SAPCompactTree *tree) {
+    int idx = -1;
+    char *remote_add[] = {"remote", "add", NULL};
+    uint32_t cmd = sap_compact_find(tree, remote_add, &idx);
+    expect(strcmp(cmd_name(tree, cmd), "add") == 0 && idx == 2, "find: remote add");
+    expect(strcmp(cmd_name(tree, tree->cmds[cmd].parent), "remote") == 0, "find: the parent of add");
+
+    char *none[] = {NULL};
+    expect(sap_compact_find(tree, none, &idx) == 0 && idx == 0, "find: the root for an empty path");
+
+    char *option[] = {"remote", "-v", "add", NULL};
+    cmd = sap_compact_find(tree, option, &idx);
+    expect(strcmp(cmd_name(tree, cmd), "remote") == 0 && idx == 1, "find: stops at an option");
+
+    char *unknown[] = {"remote", "nope", NULL};
+    cmd = sap_compact_find(tree, unknown, &idx);
+    expect(strcmp(cmd_name(tree, cmd), "remote") == 0 && idx == 1, "find: stops at an unknown name");
+
+    /* interned names, but not children of the root */
+    char *grandchild[] = {"add", NULL};
+    expect(sap_compact_find(tree, grandchild, &idx) == 0 && idx == 0, "find: a command of another level");
+    char *flag_name[] = {"verbose", NULL};
+    expect(sap_compact_find(tree, flag_name, &idx) == 0 && idx == 0, "find: the name of a flag");
+
+    char *commit[] = {"commit", "remote", NULL};
+    cmd = sap_compact_find(tree, commit, NULL);
+    expect(strcmp(cmd_name(tree, cmd), "commit") == 0, "find: out_idx can be NULL");
+}
+
+static void test_find_flag(const SAPCompactTree *tree) {
+    char *remote[] = {"remote", NULL};
+    char *remote_add[] = {"remote", "add", NULL};
+    char *commit[] = {"commit", NULL};
+    uint32_t remote_cmd = sap_compact_find(tree, remote, NULL);
+    uint32_t add_cmd = sap_compact_find(tree, remote_add, NULL);
+    uint32_t commit_cmd = sap_compact_find(tree, commit, NULL);
+
+    uint32_t flag = sap_compact_find_flag(tree, remote_cmd, "verbose");
+    expect(flag != SAP_NIL && strcmp(sap_str_get(&tree->strs, tree->flags[flag].name), "verbose") == 0,
+           "find_flag: verbose of remote");
+    expect(tree->flags[flag].shorthand == 'v' && tree->flags[flag].type == no_arg &&
+           strcmp(sap_str_get(&tree->strs, tree->flags[flag].usage), "print more") == 0, "find_flag: the fields");
+    flag = sap_compact_find_flag(tree, commit_cmd, "message");
+    expect(flag != SAP_NIL && tree->flags[flag].type == single_arg, "find_flag: message of commit");
+
+    expect(sap_compact_find_flag(tree, 0, "verbose") == SAP_NIL, "find_flag: a flag of another command");
+    expect(sap_compact_find_flag(tree, add_cmd, "message") == SAP_NIL, "find_flag: a flag of a sibling");
+    expect(sap_compact_find_flag(tree, remote_cmd, "nope") == SAP_NIL, "find_flag: an unknown name");
+    expect(sap_compact_find_flag(tree, remote_cmd, "add") == SAP_NIL, "find_flag: the name of a command");
+}
+
+static void test_persist_once(const SAPCompactTree *tree) {
+    /* the persist flag and the help flag are found on every command, as the same entry */
+    uint32_t quiet_idx = sap_compact_find_flag(tree, 0, "quiet");
+    uint32_t help_idx = sap_compact_find_flag(tree, 0, "help");
+    int same = quiet_idx != SAP_NIL && help_idx != SAP_NIL;
+    for (uint32_t i = 1; i < tree->cmd_cnt; i++) {
+        same = same && sap_compact_find_flag(tree, i, "quiet") == quiet_idx &&
+            sap_compact_find_flag(tree, i, "help") == help_idx;
+    }
+    expect(same, "persist: one entry for all the commands");
+
+    int quiet_cnt = 0;
+    for (uint32_t i = 0; i < tree->flag_cnt; i++) {
+        quiet_cnt += strcmp(sap_str_get(&tree->strs, tree->flags[i].name), "quiet") == 0;
+    }
+    expect(quiet_cnt == 1, "persist: stored once");
+
+    /* help and quiet on the five commands, verbose and message once */
+    expect(tree->flag_cnt == 4 && tree->flag_ref_cnt == 12, "persist: the unique flags and the references");
+}
+
+static void test_snapshot(SAPCompactTree *tree) {
+    size_t bytes = sap_compact_bytes(tree);
+
+    /* the snapshot doesn't change with the pointer tree */
+    init_sap_command(&tagCmd, "tag", "create a tag", NULL, NULL);
+    add_subcmd(&rootCmd, &tagCmd);
+    char *tag[] = {"tag", NULL};
+    int idx = -1;
+    expect(sap_compact_find(tree, tag, &idx) == 0 && idx == 0, "snapshot: a command added later isn't there");
+    expect(tree->cmd_cnt == 5 && sap_compact_bytes(tree) == bytes, "snapshot: unchanged");
+
+    SAPCompactTree *again = sap_compact_build(&rootCmd);
+    expect(again->cmd_cnt == 6 && sap_compact_find(again, tag, &idx) != 0 && idx == 1, "snapshot: a new snapshot");
+    sap_compact_free(again);
+}
+
+int main(void) {
+    build_tree();
+    SAPCompactTree *tree = sap_compact_build(&rootCmd);
+    expect(tree != NULL, "the compact tree");
+    test_layout(tree);
+    test_find(tree);
+    test_find_flag(tree);
+    test_persist_once(tree);
+    test_snapshot(tree);
+    sap_compact_free(tree);
+    free_root_cmd();
+    printf("compact test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
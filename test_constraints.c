@@ -0,0 +1,142 @@
+/**
+ * @file test_constraints.c
+ * @brief the test of the flag constraints of scap.c
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_constraints
+ * every kind of constraint is violated and satisfied, by sap_parse and by the incremental parse,
+ * the message names the constraint, and the constraints are compiled again when the command changes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static SAPCommand deployCmd;
+static Flag target, force, dry, region, zone, token, user, extra;
+
+static void build_tree(void) {
+    init_root_cmd("tool", "the flag constraints", NULL, NULL);
+
+    init_sap_command(&deployCmd, "deploy", "deploy a target", NULL, NULL);
+    init_flag(&target, "target", 't', "required", NULL);
+    set_flag_env(&target, "SCAP_TEST_TARGET");
+    init_flag(&force, "force", 'f', "exclusive with dry", NULL);
+    set_flag_type(&force, no_arg);
+    init_flag(&dry, "dry", 'n', "exclusive with force", NULL);
+    set_flag_type(&dry, no_arg);
+    init_flag(&region, "region", 'r', "one of region and zone", NULL);
+    init_flag(&zone, "zone", 'z', "one of region and zone", NULL);
+    init_flag(&token, "token", 'k', "requires user", NULL);
+    init_flag(&user, "user", 'u', "required by token", NULL);
+    Flag *all[] = {&target, &force, &dry, &region, &zone, &token, &user};
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+        add_flag(&deployCmd, all[i]);
+    }
+    add_subcmd(&rootCmd, &deployCmd);
+
+    Flag *required[] = {&target, NULL};
+    Flag *exclusive[] = {&force, &dry, NULL};
+    Flag *one_of[] = {&region, &zone, NULL};
+    Flag *requires[] = {&token, &user, NULL};
+    expect(add_flag_constraint(&deployCmd, constraint_required, required) == 0, "the required constraint");
+    expect(add_flag_constraint(&deployCmd, constraint_exclusive, exclusive) == 1, "the exclusive constraint");
+    expect(add_flag_constraint(&deployCmd, constraint_one_of, one_of) == 2, "the one_of constraint");
+    expect(add_flag_constraint(&deployCmd, constraint_requires, requires) == 3, "the requires constraint");
+}
+
+/**
+ * @brief parse a command line by sap_parse and by the incremental parse, check the message of a violation.
+ *
+ * @return int - the return value of sap_parse.
+ */
+static int parse_both(int argc, char *argv[], const char *message, const char *what) {
+    SAPParseResult res;
+    char buf[256];
+    int ret = sap_parse(argc, argv, &res);
+    if (message == NULL) {
+        expect(ret == 0 && res.cmd == &deployCmd, what);
+    } else {
+        expect(ret != 0 && res.err.code == violated_constraint && res.err.argv_idx == 1, what);
+        sap_format_error(&res, buf, sizeof(buf));
+        expect(strcmp(buf, message) == 0, what);
+    }
+
+    SAPParseState st;
+    sap_parse_begin(&st);
+    int st_ret = 0;
+    for (int i = 1; i <= argc && st_ret == 0; i++) {
+        st_ret = sap_parse_feed(&st, i, argv);
+    }
+    if (st_ret == 0) {
+        st_ret = sap_parse_end(&st);
+    }
+    expect(st_ret == ret && st.res.err.code == res.err.code && st.res.err.argv_idx == res.err.argv_idx, what);
+    sap_parse_state_free(&st);
+    sap_free_result(&res);
+    return ret;
+}
+
+static void test_kinds(void) {
+    char *ok[] = {"tool", "deploy", "-t", "x", "-z", "a", "-k", "abc", "-u", "me", NULL};
+    parse_both(10, ok, NULL, "all the constraints satisfied");
+
+    char *required[] = {"tool", "deploy", "-r", "eu", NULL};
+    parse_both(4, required, "Constraint violated in command: deploy, required flags missing: --target\n", "a required flag missing");
+
+    char *exclusive[] = {"tool", "deploy", "-t", "x", "-r", "eu", "-fn", NULL};
+    parse_both(7, exclusive, "Constraint violated in command: deploy, mutually exclusive flags given: --force --dry\n", "exclusive flags given");
+
+    char *one_of[] = {"tool", "deploy", "-t", "x", "-f", NULL};
+    parse_both(5, one_of, "Constraint violated in command: deploy, one of the flags is required: --region --zone\n", "none of one_of given");
+
+    char *requires[] = {"tool", "deploy", "-t", "x", "-r", "eu", "-k", "abc", NULL};
+    parse_both(8, requires, "Constraint violated in command: deploy, --token requires: --user\n", "a flag without the flag it requires");
+
+    char *user_only[] = {"tool", "deploy", "-t", "x", "-r", "eu", "-u", "me", NULL};
+    parse_both(8, user_only, NULL, "requires is one-way");
+
+    /* the first violated constraint in the declaration order is reported */
+    char *several[] = {"tool", "deploy", "-f", "-n", NULL};
+    parse_both(4, several, "Constraint violated in command: deploy, required flags missing: --target\n", "the first violated constraint");
+
+    /* a flag given by the environment counts as given */
+    setenv("SCAP_TEST_TARGET", "x", 1);
+    char *env[] = {"tool", "deploy", "-r", "eu", NULL};
+    parse_both(4, env, NULL, "a required flag given by the environment");
+    unsetenv("SCAP_TEST_TARGET");
+}
+
+static void test_recompile(void) {
+    /* the constraints were compiled by the first parse, the command changes afterwards */
+    init_flag(&extra, "extra", 'e', "added after the first parse", NULL);
+    set_flag_type(&extra, no_arg);
+    add_flag(&deployCmd, &extra);
+    Flag *exclusive[] = {&extra, &force, NULL};
+    expect(add_flag_constraint(&deployCmd, constraint_exclusive, exclusive) == 4, "a constraint on the added flag");
+
+    char *added[] = {"tool", "deploy", "-t", "x", "-r", "eu", "-f", "--extra", NULL};
+    parse_both(8, added, "Constraint violated in command: deploy, mutually exclusive flags given: --extra --force\n", "the constraint of the added flag");
+
+    char *old[] = {"tool", "deploy", "-e", "-r", "eu", NULL};
+    parse_both(5, old, "Constraint violated in command: deploy, required flags missing: --target\n", "the former constraints still hold");
+
+    char *ok[] = {"tool", "deploy", "-t", "x", "-r", "eu", "-e", "-n", NULL};
+    parse_both(8, ok, NULL, "the added flag alone");
+}
+
+int main(void) {
+    build_tree();
+    test_kinds();
+    test_recompile();
+    free_root_cmd();
+    printf("constraints test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
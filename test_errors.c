@@ -0,0 +1,213 @@
+/**
+ * @file test_errors.c
+ * @brief the test of the error sinks of scap.c
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_errors
+ * the errors reported by do_parse_subcmd through the default sink, a sink of the caller, the file descriptor sink
+ * (a pipe) and the FILE sink (a tmpfile), byte for byte, with the messages longer than the stack buffer of the sinks,
+ * and sap_format_error truncating into a short buffer.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static SAPCommand runCmd;
+static Flag verbose;
+
+/* the calls of the sink of the caller */
+static int sinkCalls = 0;
+static ParseErr sinkCode = parse_ok;
+static void *sinkCtx = NULL;
+
+static int run_exec(SAPCommand *caller) {
+    (void) caller;
+    return 0;
+}
+
+static void build_tree(void) {
+    init_root_cmd("tool", "the error sinks", NULL, NULL);
+    init_sap_command(&runCmd, "run", "a command", NULL, run_exec);
+    init_flag(&verbose, "verbose", 'v', "a flag", NULL);
+    set_flag_type(&verbose, no_arg);
+    add_flag(&runCmd, &verbose);
+    add_subcmd(&rootCmd, &runCmd);
+}
+
+static void counting_sink(const SAPParseResult *res, void *ctx) {
+    sinkCalls++;
+    sinkCode = res->err.code;
+    sinkCtx = ctx;
+}
+
+/**
+ * @brief an unknown option of $len bytes and its message, free both.
+ */
+static char *long_option(size_t len, char **message) {
+    char *opt = (char *) malloc(len + 1);
+    memset(opt, 'y', len);
+    opt[0] = opt[1] = '-';
+    opt[len] = '\0';
+    const char *prefix = "Argument unrecognized: ";
+    *message = (char *) malloc(strlen(prefix) + len + 2);
+    sprintf(*message, "%s%s\n", prefix, opt);
+    return opt;
+}
+
+static void test_default_sink(void) {
+    SAPMemBuf mem = {0};
+    SAPOutput out;
+    sap_output_mem(&out, &mem);
+    sap_set_output(sap_err_channel, &out);
+    sap_set_error_sink(NULL, NULL);
+
+    char *bogus[] = {"tool", "run", "--bogus", NULL};
+    expect(do_parse_subcmd(3, bogus) != 0, "an unknown option fails");
+    expect(strcmp(mem.data, "Argument unrecognized: --bogus\n") == 0, "the default sink: an unknown option");
+
+    mem.len = 0;
+    char *nope[] = {"tool", "nope", NULL};
+    expect(do_parse_subcmd(2, nope) != 0, "an unknown command fails");
+    expect(strcmp(mem.data, "Unknown command: nope. See 'tool help'.\n") == 0, "the default sink: an unknown command");
+
+    mem.len = 0;
+    char *message;
+    char *opt = long_option(300, &message);
+    char *line[] = {"tool", "run", opt, NULL};
+    expect(do_parse_subcmd(3, line) != 0, "a long unknown option fails");
+    expect(mem.len == strlen(message) && strcmp(mem.data, message) == 0, "the default sink: a long message");
+    free(opt);
+    free(message);
+
+    sap_set_output(sap_err_channel, NULL);
+    sap_output_free(&out);
+    sap_mem_buf_free(&mem);
+}
+
+static void test_caller_sink(void) {
+    int ctx;
+    sap_set_error_sink(counting_sink, &ctx);
+
+    /* the parse itself never reports */
+    SAPParseResult res;
+    char *bogus[] = {"tool", "run", "--bogus", NULL};
+    expect(sap_parse(3, bogus, &res) != 0 && sinkCalls == 0, "sap_parse doesn't call the sink");
+    sap_free_result(&res);
+
+    expect(do_parse_subcmd(3, bogus) != 0, "an unknown option fails");
+    expect(sinkCalls == 1 && sinkCode == unknown_arg && sinkCtx == &ctx, "the sink of the caller with its context");
+    char *fine[] = {"tool", "run", "-v", NULL};
+    expect(do_parse_subcmd(3, fine) == 0 && sinkCalls == 1, "a successful parse doesn't call the sink");
+
+    /* NULL restores the default sink */
+    sap_set_error_sink(NULL, NULL);
+    SAPMemBuf mem = {0};
+    SAPOutput out;
+    sap_output_mem(&out, &mem);
+    sap_set_output(sap_err_channel, &out);
+    expect(do_parse_subcmd(3, bogus) != 0 && sinkCalls == 1 && mem.len > 0, "the default sink is back");
+    sap_set_output(sap_err_channel, NULL);
+    sap_output_free(&out);
+    sap_mem_buf_free(&mem);
+}
+
+/**
+ * @brief read what a pipe holds, at most $size - 1 bytes, null-terminated.
+ */
+static size_t read_pipe(int fd, char *buf, size_t size) {
+    ssize_t n = read(fd, buf, size - 1);
+    buf[(n > 0) ? n : 0] = '\0';
+    return (n > 0) ? (size_t) n : 0;
+}
+
+static void test_fd_sink(void) {
+    int fds[2];
+    expect(pipe(fds) == 0, "the pipe");
+    sap_set_error_sink(sap_fd_error_sink, (void *) (intptr_t) fds[1]);
+    char buf[1024];
+
+    char *bogus[] = {"tool", "run", "--bogus", NULL};
+    expect(do_parse_subcmd(3, bogus) != 0, "an unknown option fails");
+    read_pipe(fds[0], buf, sizeof(buf));
+    expect(strcmp(buf, "Argument unrecognized: --bogus\n") == 0, "the fd sink: an unknown option");
+
+    char *illegal[] = {"tool", "run", "--verbose=1", NULL};
+    expect(do_parse_subcmd(3, illegal) != 0, "a value of a no_arg flag fails");
+    read_pipe(fds[0], buf, sizeof(buf));
+    expect(strcmp(buf, "Illegal option: --verbose=1\n") == 0, "the fd sink: an illegal option");
+
+    /* longer than the stack buffer of the sink */
+    char *message;
+    char *opt = long_option(300, &message);
+    char *line[] = {"tool", "run", opt, NULL};
+    expect(do_parse_subcmd(3, line) != 0, "a long unknown option fails");
+    size_t len = read_pipe(fds[0], buf, sizeof(buf));
+    expect(len == strlen(message) && strcmp(buf, message) == 0, "the fd sink: a long message");
+    free(opt);
+    free(message);
+
+    sap_set_error_sink(NULL, NULL);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_file_sink(void) {
+    FILE *fp = tmpfile();
+    expect(fp != NULL, "the tmpfile");
+    sap_set_error_sink(sap_file_error_sink, fp);
+
+    char *nope[] = {"tool", "nope", NULL};
+    expect(do_parse_subcmd(2, nope) != 0, "an unknown command fails");
+    char *message;
+    char *opt = long_option(300, &message);
+    char *line[] = {"tool", "run", opt, NULL};
+    expect(do_parse_subcmd(3, line) != 0, "a long unknown option fails");
+    sap_set_error_sink(NULL, NULL);
+
+    const char *first = "Unknown command: nope. See 'tool help'.\n";
+    size_t expected_len = strlen(first) + strlen(message);
+    char buf[1024];
+    rewind(fp);
+    size_t len = fread(buf, 1, sizeof(buf), fp);
+    expect(len == expected_len && memcmp(buf, first, strlen(first)) == 0 &&
+           memcmp(buf + strlen(first), message, strlen(message)) == 0, "the file sink: both messages");
+    free(opt);
+    free(message);
+    fclose(fp);
+}
+
+static void test_format_error(void) {
+    SAPParseResult res;
+    char *bogus[] = {"tool", "run", "--bogus", NULL};
+    expect(sap_parse(3, bogus, &res) != 0, "an unknown option fails");
+
+    const char *message = "Argument unrecognized: --bogus\n";
+    char buf[10];
+    memset(buf, '#', sizeof(buf));
+    expect(sap_format_error(&res, buf, sizeof(buf)) == strlen(message), "the length of the whole message");
+    expect(memcmp(buf, message, 9) == 0 && buf[9] == '\0', "the message truncated and terminated");
+    expect(sap_format_error(&res, NULL, 0) == strlen(message), "the length only");
+    sap_free_result(&res);
+}
+
+int main(void) {
+    build_tree();
+    test_default_sink();
+    test_caller_sink();
+    test_fd_sink();
+    test_file_sink();
+    test_format_error();
+    free_root_cmd();
+    printf("errors test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,235 @@
+/**
+ * @file test_fallback.c
+ * @brief the test of the fallback values of scap.c, from the environment and the config file
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_fallback
+ * the precedence default < config < environment < command line told by sap_get_source, the quoting and the
+ * repeated keys of the config file, and the texts of the no_arg, repeat_count and multi_arg flags.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static Flag level, name, color, verbose, paths;
+static char configPath[] = "/tmp/scap_fallback_XXXXXX";
+
+static void build_tree(void) {
+    init_root_cmd("tool", "the fallback values", NULL, NULL);
+
+    init_flag(&level, "level", 'l', "every source", "1");
+    set_flag_env(&level, "SCAP_TEST_LEVEL");
+    set_flag_config_key(&level, "level");
+    init_flag(&name, "name", 'n', "a quoted config value", NULL);
+    set_flag_config_key(&name, "name");
+    init_flag(&color, "color", 'c', "a no_arg flag", NULL);
+    set_flag_type(&color, no_arg);
+    set_flag_env(&color, "SCAP_TEST_COLOR");
+    set_flag_config_key(&color, "color");
+    init_flag(&verbose, "verbose", 'v', "a counted flag", NULL);
+    set_flag_type(&verbose, no_arg);
+    set_flag_repeat(&verbose, repeat_count);
+    set_flag_env(&verbose, "SCAP_TEST_VERBOSE");
+    init_flag(&paths, "paths", 'p', "a multi_arg flag", NULL);
+    set_flag_type(&paths, multi_arg);
+    set_flag_env(&paths, "SCAP_TEST_PATHS");
+    set_flag_config_key(&paths, "paths");
+    add_flag(&rootCmd, &level);
+    add_flag(&rootCmd, &name);
+    add_flag(&rootCmd, &color);
+    add_flag(&rootCmd, &verbose);
+    add_flag(&rootCmd, &paths);
+}
+
+/**
+ * @brief write the text to the config file and load it.
+ */
+static void load_config(const char *text) {
+    int fd = open(configPath, O_WRONLY | O_TRUNC);
+    expect(fd >= 0 && write(fd, text, strlen(text)) == (ssize_t) strlen(text), "the config text");
+    close(fd);
+    expect(sap_load_config(configPath) == 0, "the config loaded");
+}
+
+static int is_value(const SAPParseResult *res, const char *flag_name, const char *expected) {
+    const char *value = (const char *) sap_get_value(res, flag_name);
+    return value != NULL && strcmp(value, expected) == 0;
+}
+
+static void test_precedence(void) {
+    SAPParseResult res;
+    char *none[] = {"tool", NULL};
+    char *given[] = {"tool", "-l", "4", NULL};
+
+    expect(sap_parse(1, none, &res) == 0 && sap_get_source(&res, "level") == source_default, "the default");
+    expect(sap_get_value(&res, "level") == level.dft_value, "the default value");
+    sap_free_result(&res);
+
+    load_config("level = 2\n");
+    expect(sap_parse(1, none, &res) == 0 && sap_get_source(&res, "level") == source_config, "the config over the default");
+    expect(is_value(&res, "level", "2"), "the config value");
+    sap_free_result(&res);
+
+    setenv("SCAP_TEST_LEVEL", "3", 1);
+    expect(sap_parse(1, none, &res) == 0 && sap_get_source(&res, "level") == source_env, "the environment over the config");
+    expect(sap_get_value(&res, "level") == getenv("SCAP_TEST_LEVEL"), "the environment value");
+    sap_free_result(&res);
+
+    expect(sap_parse(3, given, &res) == 0 && sap_get_source(&res, "level") == source_argv, "the command line over all");
+    expect(sap_get_value(&res, "level") == given[2], "the command line value");
+    sap_free_result(&res);
+
+    /* an empty variable is a value as well */
+    setenv("SCAP_TEST_LEVEL", "", 1);
+    expect(sap_parse(1, none, &res) == 0 && sap_get_source(&res, "level") == source_env, "an empty variable");
+    expect(is_value(&res, "level", ""), "the empty value");
+    sap_free_result(&res);
+    unsetenv("SCAP_TEST_LEVEL");
+
+    sap_free_config();
+    expect(sap_parse(1, none, &res) == 0 && sap_get_source(&res, "level") == source_default, "the default again");
+    expect(sap_get_source(&res, "nothing") == source_default, "an unknown flag");
+    sap_free_result(&res);
+}
+
+static void test_config_text(void) {
+    SAPParseResult res;
+    char *none[] = {"tool", NULL};
+
+    load_config("# a comment\n"
+                "; another comment\n"
+                "   \n"
+                "= no key\n"
+                "level = 2\n"
+                "name = \"  two words  \"  \r\n"
+                "  level\t=\t5  \n"
+                "paths = \"a\n"
+                "no equal sign\n"
+                "level = 6");      /* no newline at the end */
+    expect(sap_parse(1, none, &res) == 0, "the config file");
+    expect(is_value(&res, "level", "6"), "the last value of a repeated key wins");
+    expect(is_value(&res, "name", "  two words  "), "the quotes are stripped, the spaces inside are kept");
+    char **list = (char **) sap_get_value(&res, "paths");
+    expect(list != NULL && strcmp(list[0], "\"a") == 0 && list[1] == NULL, "an unbalanced quote is kept");
+    expect(sap_get_source(&res, "color") == source_default, "the keys not in the file");
+    sap_free_result(&res);
+
+    load_config("name=\"\"\n");
+    expect(sap_parse(1, none, &res) == 0 && is_value(&res, "name", ""), "an empty quoted value");
+    expect(sap_get_source(&res, "level") == source_default, "the file replaces the loaded one");
+    sap_free_result(&res);
+    sap_free_config();
+}
+
+static void test_no_arg(void) {
+    SAPParseResult res;
+    char *none[] = {"tool", NULL};
+    static const char *falses[] = {"", "0", "false", "no", "off", "FALSE", "Off"};
+
+    for (size_t i = 0; i < sizeof(falses) / sizeof(falses[0]); i++) {
+        setenv("SCAP_TEST_COLOR", falses[i], 1);
+        expect(sap_parse(1, none, &res) == 0 && sap_get_value(&res, "color") == NULL, "a false text");
+        expect(sap_get_source(&res, "color") == source_default, "a false text isn't given");
+        sap_free_result(&res);
+    }
+
+    static const char *trues[] = {"1", "yes", "on", "true", "anything"};
+    for (size_t i = 0; i < sizeof(trues) / sizeof(trues[0]); i++) {
+        setenv("SCAP_TEST_COLOR", trues[i], 1);
+        expect(sap_parse(1, none, &res) == 0 && sap_get_value(&res, "color") != NULL, "a true text");
+        expect(sap_get_source(&res, "color") == source_env, "a true text is given");
+        sap_free_result(&res);
+    }
+    unsetenv("SCAP_TEST_COLOR");
+
+    load_config("color = off\n");
+    expect(sap_parse(1, none, &res) == 0 && sap_get_value(&res, "color") == NULL, "a false text of the config");
+    sap_free_result(&res);
+    load_config("color = on\n");
+    expect(sap_parse(1, none, &res) == 0 && sap_get_source(&res, "color") == source_config, "a true text of the config");
+    sap_free_result(&res);
+    sap_free_config();
+}
+
+static void test_count(void) {
+    SAPParseResult res;
+    char *none[] = {"tool", NULL};
+    static const struct {
+        const char *text;
+        int count;      /* 0 if the flag isn't given */
+    } cases[] = {
+        {"3", 3}, {"1", 1}, {"0", 0}, {"-2", 0}, {"", 0}, {"no", 0}, {"yes", 1}, {"2x", 1},
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        setenv("SCAP_TEST_VERBOSE", cases[i].text, 1);
+        expect(sap_parse(1, none, &res) == 0, "a counted text");
+        int *count = (int *) sap_get_value(&res, "verbose");
+        if (cases[i].count == 0) {
+            expect(count == NULL && sap_get_source(&res, "verbose") == source_default, "a text counting nothing");
+        } else {
+            expect(count != NULL && *count == cases[i].count, "the count of a text");
+        }
+        sap_free_result(&res);
+    }
+
+    /* the command line wins, its count isn't added to the one of the environment */
+    setenv("SCAP_TEST_VERBOSE", "5", 1);
+    char *line[] = {"tool", "-vv", NULL};
+    expect(sap_parse(2, line, &res) == 0 && *(int *) sap_get_value(&res, "verbose") == 2, "the count of the command line");
+    sap_free_result(&res);
+    unsetenv("SCAP_TEST_VERBOSE");
+}
+
+static void test_split(void) {
+    SAPParseResult res;
+    char *none[] = {"tool", NULL};
+
+    setenv("SCAP_TEST_PATHS", "  a\tb  c\n d ", 1);
+    expect(sap_parse(1, none, &res) == 0, "a list from the environment");
+    char **list = (char **) sap_get_value(&res, "paths");
+    expect(list != NULL && strcmp(list[0], "a") == 0 && strcmp(list[1], "b") == 0, "the list is split by whitespace");
+    expect(list != NULL && strcmp(list[2], "c") == 0 && strcmp(list[3], "d") == 0 && list[4] == NULL, "the list is whole");
+    expect(strcmp(getenv("SCAP_TEST_PATHS"), "  a\tb  c\n d ") == 0, "the variable isn't changed");
+    sap_free_result(&res);
+
+    setenv("SCAP_TEST_PATHS", " \t ", 1);
+    expect(sap_parse(1, none, &res) == 0 && sap_get_value(&res, "paths") == NULL, "a blank list");
+    expect(sap_get_source(&res, "paths") == source_default, "a blank list isn't given");
+    sap_free_result(&res);
+    unsetenv("SCAP_TEST_PATHS");
+
+    load_config("paths = \" x  y \"\n");
+    expect(sap_parse(1, none, &res) == 0 && sap_get_source(&res, "paths") == source_config, "a list from the config");
+    list = (char **) sap_get_value(&res, "paths");
+    expect(list != NULL && strcmp(list[0], "x") == 0 && strcmp(list[1], "y") == 0 && list[2] == NULL, "a quoted list");
+    sap_free_result(&res);
+    sap_free_config();
+}
+
+int main(void) {
+    int fd = mkstemp(configPath);
+    expect(fd >= 0, "the config file");
+    close(fd);
+
+    build_tree();
+    test_precedence();
+    test_config_text();
+    test_no_arg();
+    test_count();
+    test_split();
+    free_root_cmd();
+    unlink(configPath);
+    printf("fallback test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/**
+ * @file test_getopt.c
+ * @brief the differential test of the getopt shim of scap.c against glibc
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * random command lines are parsed by glibc getopt_long and by sap_getopt_long,
+ * every call must return the same option, optind, optarg, optopt and longindex,
+ * and argv must be permuted the same way.
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <scap.h>
+
+#define MAX_ARGS 10
+
+static int glibc_flag, sap_flag;
+
+static const struct option glibc_longopts[] = {
+    {"alpha", no_argument, NULL, 'a'},
+    {"al", no_argument, NULL, 'x'},
+    {"beta", required_argument, NULL, 'b'},
+    {"beta-two", required_argument, NULL, 'B'},
+    {"gamma", optional_argument, NULL, 'g'},
+    {"flagged", no_argument, &glibc_flag, 7},
+    {NULL, 0, NULL, 0}
+};
+
+static const SAPOption sap_longopts[] = {
+    {"alpha", sap_no_argument, NULL, 'a'},
+    {"al", sap_no_argument, NULL, 'x'},
+    {"beta", sap_required_argument, NULL, 'b'},
+    {"beta-two", sap_required_argument, NULL, 'B'},
+    {"gamma", sap_optional_argument, NULL, 'g'},
+    {"flagged", sap_no_argument, &sap_flag, 7},
+    {NULL, 0, NULL, 0}
+};
+
+static const char *optstrings[] = {"ab:c::d", "+ab:c::d", "-ab:c::d", ":ab:c::d", "+:ab:c::d"};
+
+static char *tokens[] = {
+    "-a", "-b", "-bval", "-c", "-cval", "-abx", "-d", "-z", "-", "--", "-ac", "-:", "-;",
+    "--alpha", "--al", "--alp", "--beta", "--beta=v", "--be", "--bet", "--beta-", "--gamma", "--gamma=v",
+    "--alpha=x", "--flagged", "--unknown", "--=", "x", "y", "z",
+};
+
+/**
+ * @brief parse a command line by both, return the number of the mismatches.
+ */
+static int compare(const char *optstring, int longs, int argc, char *line[]) {
+    char *glibc_argv[MAX_ARGS + 1], *sap_argv[MAX_ARGS + 1];
+    memcpy(glibc_argv, line, sizeof(char *) * (argc + 1));
+    memcpy(sap_argv, line, sizeof(char *) * (argc + 1));
+
+    SAPGetopt st;
+    sap_getopt_init(&st);
+    st.opterr = 0;
+    opterr = 0;
+    optind = 0;     /* full reinitialization of glibc getopt */
+    glibc_flag = sap_flag = 0;
+
+    for (int call = 0; ; call++) {
+        int glibc_idx = -1, sap_idx = -1;
+        int glibc_ret = longs ? getopt_long(argc, glibc_argv, optstring, glibc_longopts, &glibc_idx)
+                              : getopt(argc, glibc_argv, optstring);
+        int sap_ret = longs ? sap_getopt_long(&st, argc, sap_argv, optstring, sap_longopts, &sap_idx)
+                            : sap_getopt(&st, argc, sap_argv, optstring);
+
+        int mismatch = glibc_ret != sap_ret || optind != st.optind || optarg != st.optarg ||
+                       glibc_idx != sap_idx || glibc_flag != sap_flag ||
+                       ((glibc_ret == '?' || glibc_ret == ':') && optopt != st.optopt);
+        if (mismatch) {
+            printf("mismatch at call %d with \"%s\"%s:", call, optstring, longs ? " (long)" : "");
+            for (int i = 0; i < argc; i++) {
+                printf(" %s", line[i]);
+            }
+            printf("\n  glibc: ret %d optind %d optarg %s optopt %d longindex %d\n",
+                   glibc_ret, optind, optarg ? optarg : "(null)", optopt, glibc_idx);
+            printf("  scap:  ret %d optind %d optarg %s optopt %d longindex %d\n",
+                   sap_ret, st.optind, st.optarg ? st.optarg : "(null)", st.optopt, sap_idx);
+            sap_getopt_free(&st);
+            return 1;
+        }
+        if (glibc_ret == -1) {
+            break;
+        }
+    }
+
+    sap_getopt_free(&st);
+    if (memcmp(glibc_argv, sap_argv, sizeof(char *) * argc) != 0) {
+        printf("argv permuted differently with \"%s\"\n", optstring);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief two parsers are interleaved, each must behave as if it ran alone.
+ */
+static int test_reentrancy(void) {
+    char *line1[] = {"prog", "x", "-a", "--beta", "v", "y", "-cz", NULL};
+    char *line2[] = {"prog", "--gamma=1", "-d", "w", "--al", NULL};
+    int expected1[] = {'a', 'b', 'c', -1};
+    int expected2[] = {'g', 'd', 'x', -1};
+    SAPGetopt st1, st2;
+    sap_getopt_init(&st1);
+    sap_getopt_init(&st2);
+
+    int fail = 0;
+    for (int i = 0; i < 4; i++) {
+        fail |= sap_getopt_long(&st1, 7, line1, "ab:c::d", sap_longopts, NULL) != expected1[i];
+        fail |= sap_getopt_long(&st2, 5, line2, "ab:c::d", sap_longopts, NULL) != expected2[i];
+    }
+    fail |= st1.optind != 5 || st2.optind != 4;     /* the non-options are moved to the end */
+    fail |= strcmp(line1[5], "x") != 0 || strcmp(line2[4], "w") != 0;
+
+    sap_getopt_free(&st1);
+    sap_getopt_free(&st2);
+    if (fail) {
+        printf("the interleaved parsers interfere\n");
+    }
+    return fail;
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = (argc > 1) ? atol(argv[1]) : 200000;
+    const int token_cnt = (int) (sizeof(tokens) / sizeof(tokens[0]));
+    const int optstring_cnt = (int) (sizeof(optstrings) / sizeof(optstrings[0]));
+    int failures = 0;
+
+    unsetenv("POSIXLY_CORRECT");
+    srand(20250330);
+    for (long it = 0; it < iterations && failures < 10; it++) {
+        char *line[MAX_ARGS + 1];
+        int line_argc = 1 + rand() % MAX_ARGS;
+        line[0] = "prog";
+        for (int i = 1; i < line_argc; i++) {
+            line[i] = tokens[rand() % token_cnt];
+        }
+        line[line_argc] = NULL;
+        failures += compare(optstrings[it % optstring_cnt], (int) (it / optstring_cnt) % 2, line_argc, line);
+    }
+    failures += test_reentrancy();
+
+    printf("getopt differential test: %ld command lines, %d failure(s)\n", iterations, failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+/**
+ * @file test_incremental.c
+ * @brief the differential test of the incremental parse of scap.c against sap_parse
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_incremental [iterations]
+ * random command lines are parsed by sap_parse and by sap_parse_feed, fed a token at a time,
+ * both must return the same result: the command, the error, every value and the tail after "--" (or its operands).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <scap.h>
+
+#define MAX_ARGS 8
+
+static SAPCommand subCmd, leafCmd, sub2Cmd, selfCmd;
+static Flag verbose, output, only, inputs, level, files, out, name;
+
+static const char *output_choices[] = {"x", "y", "z", NULL};
+static const char *file_choices[] = {"a", "b", "y", NULL};
+static const char *name_choices[] = {"y", "help", NULL};
+
+static char *tokens[] = {
+    "sub", "sub2", "leaf", "self", "-v", "-vvv", "-o", "x", "-ox", "-vo", "-ov", "-i", "a", "b",
+    "--inputs", "--in=a", "--out", "--output=z", "--o", "--ou", "--on", "--verb", "--level", "-l3", "-f", "--files",
+    "-n", "help", "y", "-", "--", "-x", "--bogus",
+};
+
+static int nop_exec(SAPCommand *caller) {
+    (void) caller;
+    return 0;
+}
+
+static int nop_self_parse(SAPCommand *caller, int argc, char *argv[]) {
+    (void) caller;
+    (void) argc;
+    (void) argv;
+    return 0;
+}
+
+static void build_tree(void) {
+    init_root_cmd("r", "the incremental parse", NULL, nop_exec);
+    set_prefix_match(&rootCmd, 1);
+
+    init_flag(&verbose, "verbose", 'v', "counted", NULL);
+    set_flag_type(&verbose, no_arg);
+    set_flag_repeat(&verbose, repeat_count);
+    init_flag(&output, "output", 'o', "a choice", "x");
+    set_flag_choices(&output, output_choices);
+    init_flag(&only, "only", '\0', "a prefix shared with output", NULL);
+    set_flag_type(&only, no_arg);
+    init_flag(&inputs, "inputs", 'i', "appended lists", NULL);
+    set_flag_type(&inputs, multi_arg);
+    set_flag_repeat(&inputs, repeat_append);
+    set_flag_choices(&inputs, file_choices);
+    add_flag(&rootCmd, &verbose);
+    add_flag(&rootCmd, &output);
+    add_flag(&rootCmd, &only);
+    add_flag(&rootCmd, &inputs);
+
+    /* sub [files]..., the default flag appends its arguments */
+    init_sap_command(&subCmd, "sub", "a default multi_arg flag", NULL, nop_exec);
+    init_flag(&files, "files", 'f', "the files", NULL);
+    set_flag_type(&files, multi_arg);
+    set_flag_repeat(&files, repeat_append);
+    set_flag_choices(&files, file_choices);
+    add_default_flag(&subCmd, &files);
+    init_flag(&out, "out", 'o', "a plain single_arg flag", NULL);
+    add_flag(&subCmd, &out);
+    add_subcmd(&rootCmd, &subCmd);
+
+    /* sub leaf [name], a default single_arg choice flag */
+    init_sap_command(&leafCmd, "leaf", "a default single_arg flag", NULL, nop_exec);
+    init_flag(&name, "name", 'n', "the name", NULL);
+    set_flag_choices(&name, name_choices);
+    add_default_flag(&leafCmd, &name);
+    add_subcmd(&subCmd, &leafCmd);
+
+    init_sap_command(&sub2Cmd, "sub2", "no flag of its own, a passthrough tail", NULL, nop_exec);
+    set_cmd_passthrough(&sub2Cmd, 1);
+    add_subcmd(&rootCmd, &sub2Cmd);
+
+    init_sap_command(&selfCmd, "self", "parses its arguments itself", NULL, NULL);
+    set_cmd_self_parse(&selfCmd, nop_self_parse);
+    add_subcmd(&rootCmd, &selfCmd);
+
+    /* the persist flag of sub and leaf */
+    init_flag(&level, "level", 'l', "a persist flag", "1");
+    add_persist_flag(&subCmd, &level);
+}
+
+/**
+ * @brief whether two values of a flag are the same, the lists and the counts are compared by content.
+ */
+static int same_value(const Flag *flag, void *a, void *b) {
+    if (a == b) {
+        return 1;
+    }
+    if (a == NULL || b == NULL) {
+        return 0;
+    }
+    if (flag->repeat == repeat_count) {
+        return *(int *) a == *(int *) b;
+    }
+    if (flag->type == multi_arg || flag->repeat == repeat_append) {
+        char **x = (char **) a, **y = (char **) b;
+        int i = 0;
+        for (; x[i] != NULL && y[i] != NULL; i++) {
+            if (x[i] != y[i]) {
+                return 0;
+            }
+        }
+        return x[i] == y[i];
+    }
+    return 0;
+}
+
+/**
+ * @brief parse a command line by both, return the number of the mismatches.
+ */
+static int compare(int argc, char *argv[]) {
+    SAPParseResult res;
+    int ret = sap_parse(argc, argv, &res);
+
+    SAPParseState st;
+    sap_parse_begin(&st);
+    int st_ret = 0;
+    for (int i = 1; i <= argc && st_ret == 0; i++) {
+        st_ret = sap_parse_feed(&st, i, argv);
+    }
+    if (st_ret == 0) {
+        st_ret = sap_parse_end(&st);
+    }
+
+    const SAPParseResult *inc = &st.res;
+    int same = ret == st_ret && res.cmd == inc->cmd && res.err.code == inc->err.code
+               && res.err.argv_idx == inc->err.argv_idx && res.err.byte_offset == inc->err.byte_offset
+               && res.err.flag_id == inc->err.flag_id;
+    if (same && ret == 0 && !res.cmd->parse_by_self) {
+        for (int i = 0; same && i < res.cmd->flag_cnt; i++) {
+            same = same_value(res.cmd->flags[i], res.values[i], inc->values[i]);
+        }
+        same = same && res.tail_argc == inc->tail_argc && res.tail_argv == inc->tail_argv;
+    }
+
+    if (!same) {
+        printf("mismatch:");
+        for (int i = 0; i < argc; i++) {
+            printf(" %s", argv[i]);
+        }
+        printf("\n  sap_parse:   ret %d cmd %s err %d at %d:%d flag %u tail %d\n", ret,
+               res.cmd ? res.cmd->name : "-", res.err.code, res.err.argv_idx, res.err.byte_offset, res.err.flag_id, res.tail_argc);
+        printf("  incremental: ret %d cmd %s err %d at %d:%d flag %u tail %d\n", st_ret,
+               inc->cmd ? inc->cmd->name : "-", inc->err.code, inc->err.argv_idx, inc->err.byte_offset, inc->err.flag_id, inc->tail_argc);
+    }
+    sap_free_result(&res);
+    sap_parse_state_free(&st);
+    return !same;
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = (argc > 1) ? atol(argv[1]) : 200000;
+    const int token_cnt = (int) (sizeof(tokens) / sizeof(tokens[0]));
+    int failures = 0;
+
+    build_tree();
+
+    srand(20250330);
+    for (long it = 0; it < iterations && failures < 10; it++) {
+        char *line[MAX_ARGS + 1];
+        int line_argc = 1 + rand() % MAX_ARGS;
+        line[0] = "r";
+        for (int i = 1; i < line_argc; i++) {
+            line[i] = tokens[rand() % token_cnt];
+        }
+        line[line_argc] = NULL;
+        failures += compare(line_argc, line);
+    }
+
+    free_root_cmd();
+
+    printf("incremental differential test: %ld command lines, %d failure(s)\n", iterations, failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,224 @@
+/**
+ * @file test_lazy.c
+ * @brief the test of the lazy commands of scap.c
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_lazy
+ * the builders registered by set_cmd_builder run only when the parser descends into their command (the siblings
+ * stay unbuilt), exactly once however often the command is parsed, on demand by sap_build_cmd, for the help of
+ * the command and for a compact snapshot, and the persist flags reach the commands created by the builders.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static SAPCommand remoteCmd, addCmd, showCmd, commitCmd, statusCmd, tagCmd, pruneCmd;
+static Flag quiet, verbose, fetch, message, shortFlag, sign, dryRun;
+
+/* the calls of each builder */
+static int remoteBuilt = 0, addBuilt = 0, showBuilt = 0, commitBuilt = 0, statusBuilt = 0, tagBuilt = 0, pruneBuilt = 0;
+
+static void build_add(SAPCommand *cmd) {
+    addBuilt++;
+    init_flag(&fetch, "fetch", 'f', "fetch the remote", NULL);
+    set_flag_type(&fetch, no_arg);
+    add_flag(cmd, &fetch);
+}
+
+static void build_show(SAPCommand *cmd) {
+    (void) cmd;
+    showBuilt++;
+}
+
+static void build_prune(SAPCommand *cmd) {
+    pruneBuilt++;
+    init_flag(&dryRun, "dry-run", 'n', "only list the branches", NULL);
+    set_flag_type(&dryRun, no_arg);
+    add_flag(cmd, &dryRun);
+}
+
+static void build_remote(SAPCommand *cmd) {
+    remoteBuilt++;
+    init_flag(&verbose, "verbose", 'v', "print more", NULL);
+    set_flag_type(&verbose, no_arg);
+    add_flag(cmd, &verbose);
+
+    /* the subcommands can be lazy as well */
+    init_sap_command(&addCmd, "add", "add a remote", NULL, NULL);
+    set_cmd_builder(&addCmd, build_add);
+    init_sap_command(&showCmd, "show", "show a remote", NULL, NULL);
+    set_cmd_builder(&showCmd, build_show);
+    init_sap_command(&pruneCmd, "prune", "prune the stale branches", NULL, NULL);
+    set_cmd_builder(&pruneCmd, build_prune);
+    add_subcmd(cmd, &addCmd);
+    add_subcmd(cmd, &showCmd);
+    add_subcmd(cmd, &pruneCmd);
+}
+
+static void build_commit(SAPCommand *cmd) {
+    commitBuilt++;
+    init_flag(&message, "message", 'm', "the message", NULL);
+    add_flag(cmd, &message);
+}
+
+static void build_status(SAPCommand *cmd) {
+    statusBuilt++;
+    init_flag(&shortFlag, "short", 's', "the short format", NULL);
+    set_flag_type(&shortFlag, no_arg);
+    add_flag(cmd, &shortFlag);
+}
+
+static void build_tag(SAPCommand *cmd) {
+    tagBuilt++;
+    init_flag(&sign, "sign", 'S', "sign the tag", NULL);
+    set_flag_type(&sign, no_arg);
+    add_flag(cmd, &sign);
+}
+
+static void build_tree(void) {
+    init_root_cmd("git", "the lazy commands", NULL, NULL);
+    init_sap_command(&remoteCmd, "remote", "manage the remotes", NULL, NULL);
+    set_cmd_builder(&remoteCmd, build_remote);
+    init_sap_command(&commitCmd, "commit", "record the changes", NULL, NULL);
+    set_cmd_builder(&commitCmd, build_commit);
+    init_sap_command(&statusCmd, "status", "show the status", NULL, NULL);
+    set_cmd_builder(&statusCmd, build_status);
+    init_sap_command(&tagCmd, "tag", "create a tag", NULL, NULL);
+    set_cmd_builder(&tagCmd, build_tag);
+    add_subcmd(&rootCmd, &remoteCmd);
+    add_subcmd(&rootCmd, &commitCmd);
+    add_subcmd(&rootCmd, &statusCmd);
+    add_subcmd(&rootCmd, &tagCmd);
+
+    /* before any builder runs */
+    init_flag(&quiet, "quiet", 'q', "print less", NULL);
+    set_flag_type(&quiet, no_arg);
+    add_persist_flag(&rootCmd, &quiet);
+}
+
+static int built_cnt(void) {
+    return remoteBuilt + addBuilt + showBuilt + commitBuilt + statusBuilt + tagBuilt + pruneBuilt;
+}
+
+/**
+ * @brief parse a command line, return the parse error code, the result is freed.
+ */
+static int parse(int argc, char *argv[], const char *quiet_what) {
+    SAPParseResult res;
+    int ret = sap_parse(argc, argv, &res);
+    if (quiet_what != NULL) {
+        expect(ret == 0 && sap_get_value(&res, "quiet") != NULL, quiet_what);
+    }
+    sap_free_result(&res);
+    return ret;
+}
+
+static void test_descend(void) {
+    expect(built_cnt() == 0, "nothing built at the registration");
+
+    char *commit[] = {"git", "commit", "-m", "first", "-q", NULL};
+    expect(parse(5, commit, "descend: the persist flag on commit") == 0, "descend: commit");
+    expect(commitBuilt == 1 && built_cnt() == 1, "descend: only commit built, not its siblings");
+
+    for (int i = 0; i < 3; i++) {
+        parse(5, commit, NULL);
+    }
+    expect(commitBuilt == 1, "descend: commit built once");
+
+    /* the root only compares the names of its children */
+    char *unknown[] = {"git", "nope", NULL};
+    expect(parse(2, unknown, NULL) != 0 && built_cnt() == 1, "descend: an unknown command builds nothing");
+
+    /* a lazy command built by its lazy parent */
+    char *remote_add[] = {"git", "remote", "add", "--fetch", "-q", NULL};
+    expect(parse(5, remote_add, "descend: the persist flag on a lazily built grandchild") == 0, "descend: remote add");
+    expect(remoteBuilt == 1 && addBuilt == 1 && showBuilt == 0, "descend: remote and add built, not show");
+    expect(get_flag(&addCmd, "verbose") == NULL, "descend: a flag of remote isn't on add");
+
+    char *remote[] = {"git", "remote", "-v", "-q", NULL};
+    expect(parse(4, remote, "descend: the persist flag on remote") == 0 && remoteBuilt == 1, "descend: remote once");
+    expect(statusBuilt == 0 && tagBuilt == 0, "descend: the siblings stay unbuilt");
+}
+
+static void test_build_on_demand(void) {
+    sap_build_cmd(&showCmd);
+    expect(showBuilt == 1 && get_flag(&showCmd, "quiet") != NULL, "on demand: show built with the persist flag");
+    sap_build_cmd(&showCmd);
+    sap_build_cmd(&remoteCmd);
+    expect(showBuilt == 1 && remoteBuilt == 1, "on demand: nothing done when built already");
+
+    char *show[] = {"git", "remote", "show", NULL};
+    expect(parse(3, show, NULL) == 0 && showBuilt == 1, "on demand: not built again by the parser");
+}
+
+static void test_help(void) {
+    SAPMemBuf mem = {0};
+    SAPOutput out;
+    sap_output_mem(&out, &mem);
+    sap_set_output(sap_out_channel, &out);
+
+    /* the help of the root lists status by name */
+    char *root_help[] = {"git", "--help", NULL};
+    expect(do_parse_subcmd(2, root_help) == 0, "help: of the root");
+    expect(strstr(mem.data, "status") != NULL && statusBuilt == 0, "help: the root lists status unbuilt");
+
+    mem.len = 0;
+    char *status_help[] = {"git", "status", "--help", NULL};
+    expect(do_parse_subcmd(3, status_help) == 0, "help: of status");
+    expect(statusBuilt == 1 && strstr(mem.data, "--short") != NULL, "help: status built for its help");
+    expect(strstr(mem.data, "--quiet") != NULL, "help: the persist flag in the help of status");
+
+    mem.len = 0;
+    char *help_cmd[] = {"git", "help", "status", NULL};
+    expect(do_parse_subcmd(3, help_cmd) == 0 && statusBuilt == 1, "help: the help command doesn't build again");
+    expect(strstr(mem.data, "--short") != NULL, "help: the help command prints status");
+
+    /* the help printed without a parse */
+    mem.len = 0;
+    expect(pruneBuilt == 0, "help: prune unbuilt");
+    print_cmd_help(&pruneCmd);
+    sap_output_flush(&out);
+    expect(pruneBuilt == 1 && strstr(mem.data, "--dry-run") != NULL, "help: print_cmd_help builds prune");
+
+    sap_set_output(sap_out_channel, NULL);
+    sap_output_free(&out);
+    sap_mem_buf_free(&mem);
+}
+
+static void test_compact(void) {
+    expect(tagBuilt == 0, "compact: tag unbuilt before the snapshot");
+    SAPCompactTree *tree = sap_compact_build(&rootCmd);
+    expect(tagBuilt == 1 && built_cnt() == 7, "compact: the snapshot builds the rest, each builder once");
+
+    char *tag[] = {"tag", NULL};
+    uint32_t cmd = sap_compact_find(tree, tag, NULL);
+    expect(sap_compact_find_flag(tree, cmd, "sign") != SAP_NIL, "compact: the flag of tag");
+    expect(sap_compact_find_flag(tree, cmd, "quiet") == sap_compact_find_flag(tree, 0, "quiet") &&
+           sap_compact_find_flag(tree, 0, "quiet") != SAP_NIL, "compact: the persist flag on tag");
+    sap_compact_free(tree);
+
+    tree = sap_compact_build(&rootCmd);
+    expect(built_cnt() == 7, "compact: a second snapshot builds nothing");
+    sap_compact_free(tree);
+
+    char *line[] = {"git", "tag", "-S", "-q", NULL};
+    expect(parse(4, line, "compact: the persist flag on tag") == 0 && tagBuilt == 1, "compact: tag parsed");
+}
+
+int main(void) {
+    build_tree();
+    test_descend();
+    test_build_on_demand();
+    test_help();
+    test_compact();
+    free_root_cmd();
+    printf("lazy test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,246 @@
+/**
+ * @file test_multicall.c
+ * @brief the test of the multi-call dispatch of scap.c, busybox style
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_multicall --links <dir>
+ * the binary is its own multi-call binary: it creates a symlink to itself in <dir> for every entry point,
+ * then runs every link as a child process and checks the output and the exit status.
+ * any other command line is dispatched, as the links do.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static SAPCommand falseCmd, echoCmd, netCmd, pingCmd, traceCmd, lazyCmd, lazyLeaf;
+static Flag noNewline, words, count, hops;
+
+/* ++++ the tools ++++ */
+
+static int true_exec(SAPCommand *caller) {
+    (void) caller;
+    return 0;
+}
+
+static int false_exec(SAPCommand *caller) {
+    (void) caller;
+    return 1;
+}
+
+static int echo_exec(SAPCommand *caller) {
+    char **list = (char **) get_flag(caller, "words")->value;
+    for (int i = 0; list != NULL && list[i] != NULL; i++) {
+        printf("%s%s", (i == 0) ? "" : " ", list[i]);
+    }
+    if (get_flag(caller, "no-newline")->value == NULL) {
+        printf("\n");
+    }
+    return 0;
+}
+
+static int ping_exec(SAPCommand *caller) {
+    printf("ping x%s\n", (const char *) get_flag(caller, "count")->value);
+    return 0;
+}
+
+static int trace_exec(SAPCommand *caller) {
+    printf("trace %s hops\n", (const char *) get_flag(caller, "hops")->value);
+    return 0;
+}
+
+static void build_lazy(SAPCommand *cmd) {
+    init_sap_command(&lazyLeaf, "leaf", "a leaf built on demand", NULL, true_exec);
+    add_subcmd(cmd, &lazyLeaf);
+}
+
+static void build_tree(void) {
+    init_root_cmd("box", "a multi-call binary", NULL, NULL);
+    set_multi_call(&rootCmd, 1);
+
+    /* the root has at most MAX_SUBCMD_COUNT subcommands, help included */
+    init_sap_command(&falseCmd, "false", "do nothing, unsuccessfully", NULL, false_exec);
+
+    init_sap_command(&echoCmd, "echo", "print the words", NULL, echo_exec);
+    init_flag(&noNewline, "no-newline", 'n', "don't print the newline", NULL);
+    set_flag_type(&noNewline, no_arg);
+    init_flag(&words, "words", 'w', "the words", NULL);
+    set_flag_type(&words, multi_arg);
+    add_flag(&echoCmd, &noNewline);
+    add_default_flag(&echoCmd, &words);
+
+    init_sap_command(&netCmd, "net", "the network tools", NULL, NULL);
+    init_sap_command(&pingCmd, "ping", "ping a host", NULL, ping_exec);
+    init_flag(&count, "count", 'c', "the number of the pings", "1");
+    add_flag(&pingCmd, &count);
+    init_sap_command(&traceCmd, "trace", "trace the route to a host", NULL, trace_exec);
+    init_flag(&hops, "hops", 'm', "the max hops", "30");
+    add_flag(&traceCmd, &hops);
+
+    init_sap_command(&lazyCmd, "lazy", "a command built on demand", NULL, NULL);
+    set_cmd_builder(&lazyCmd, build_lazy);
+
+    add_subcmd(&rootCmd, &falseCmd);
+    add_subcmd(&rootCmd, &echoCmd);
+    add_subcmd(&rootCmd, &netCmd);
+    add_subcmd(&netCmd, &pingCmd);
+    add_subcmd(&netCmd, &traceCmd);
+    add_subcmd(&rootCmd, &lazyCmd);
+}
+
+/* ---- the tools ---- */
+
+/* ++++ the driver ++++ */
+
+/**
+ * @brief run a command line in a child process, return its exit status, its stdout is stored in $out.
+ * the errors are expected by some cases, the stderr of the child is discarded.
+ */
+static int run(char *argv[], char *out, size_t size) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(open("/dev/null", O_WRONLY), STDERR_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    close(fds[1]);
+    size_t len = 0;
+    ssize_t n;
+    while (len + 1 < size && (n = read(fds[0], out + len, size - len - 1)) > 0) {
+        len += (size_t) n;
+    }
+    out[len] = '\0';
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void expect_run(char *argv[], int status, const char *output) {
+    char out[256];
+    int ret = run(argv, out, sizeof(out));
+    if (ret != status || strcmp(out, output) != 0) {
+        printf("failed: %s exits with %d and prints \"%s\" (got %d, \"%s\")\n", argv[0], status, output, ret, out);
+        failures++;
+    }
+}
+
+/**
+ * @brief the checks in the process: the parse result of an entry point, and the incremental parse agrees.
+ */
+static void test_parse(void) {
+    char *ping[] = {"/usr/local/bin/net", "ping", "-c", "3", NULL};
+    SAPParseResult res;
+    expect(sap_parse(4, ping, &res) == 0 && res.cmd == &pingCmd, "net ping is parsed from argv[0]");
+    expect(res.argv_offset == 1 && strcmp((char *) sap_get_value(&res, "count"), "3") == 0, "the arguments of net ping");
+    sap_free_result(&res);
+
+    char *echo[] = {"echo", "-n", "a", NULL};
+    expect(sap_parse(3, echo, &res) == 0 && res.cmd == &echoCmd && res.argv_offset == 0, "a bare argv[0]");
+    expect(res.argv == echo && res.argc == 3, "argv[0] is the name of the entry point");
+    sap_free_result(&res);
+
+    SAPParseState st;
+    sap_parse_begin(&st);
+    sap_parse_feed(&st, 4, ping);
+    expect(sap_parse_end(&st) == 0 && st.res.cmd == &pingCmd && st.res.argv_offset == 1, "the incremental parse of net ping");
+    sap_parse_state_free(&st);
+
+    char *bogus[] = {"net", "bogus", NULL};
+    expect(sap_parse(2, bogus, &res) != 0 && res.err.code == unknown_cmd && res.err.argv_idx == 1, "an unknown subcommand of an entry point");
+    sap_free_result(&res);
+
+    char *help[] = {"/bin/help", "echo", NULL};
+    expect(sap_parse(2, help, &res) == 0 && res.cmd == &echoCmd, "help isn't an entry point");
+    sap_free_result(&res);
+
+    set_multi_call(&rootCmd, 0);
+    expect(sap_parse(3, echo, &res) != 0 && res.err.code == unknown_arg, "argv[0] is ignored without multi-call");
+    sap_free_result(&res);
+    set_multi_call(&rootCmd, 1);
+}
+
+int main(int argc, char *argv[]) {
+    build_tree();
+    if (argc != 3 || strcmp(argv[1], "--links") != 0) {
+        /* invoked through a link, or by its own name with a subcommand */
+        int ret = do_parse_subcmd(argc, argv);
+        free_root_cmd();
+        return ret;
+    }
+
+    char *self = realpath(argv[0], NULL);
+    expect(self != NULL, "the path of the binary");
+    if (self == NULL) {
+        return 1;
+    }
+
+    int cnt = sap_make_links(argv[2], self);
+    expect(cnt == rootCmd.tree_node.child_cnt - 1, "a link for every entry point");
+    expect(sap_make_links(argv[2], self) == cnt, "the links are replaced");
+
+    /* every entry point, through its link */
+    static const struct {
+        const char *name;
+        char *args[4];
+        int status;
+        const char *output;
+    } cases[] = {
+        {"false", {NULL}, 1, ""},
+        {"echo", {"hello", "world", NULL}, 0, "hello world\n"},
+        {"echo", {"-n", "x", NULL}, 0, "x"},
+        {"echo", {"--bogus", NULL}, 255, ""},
+        {"net", {"ping", "-c", "3", NULL}, 0, "ping x3\n"},
+        {"net", {"trace", NULL}, 0, "trace 30 hops\n"},
+        {"lazy", {"leaf", NULL}, 0, ""},
+    };
+    const int case_cnt = (int) (sizeof(cases) / sizeof(cases[0]));
+    char path[4096];
+    for (int i = 0; i < case_cnt; i++) {
+        char *line[5] = {path};
+        snprintf(path, sizeof(path), "%s/%s", argv[2], cases[i].name);
+        memcpy(line + 1, cases[i].args, sizeof(cases[i].args));
+        expect_run(line, cases[i].status, cases[i].output);
+    }
+    for (int i = 0; i < rootCmd.tree_node.child_cnt; i++) {
+        const char *name = node2cmd(rootCmd.tree_node.children[i])->name;
+        int covered = strcmp(name, "help") == 0;
+        for (int j = 0; j < case_cnt; j++) {
+            covered |= strcmp(cases[j].name, name) == 0;
+        }
+        expect(covered, name);      /* an entry point without a case */
+    }
+    snprintf(path, sizeof(path), "%s/help", argv[2]);
+    expect(access(path, F_OK) != 0, "no link for help");
+
+    /* the binary by its own name still dispatches argv[1] */
+    expect_run((char *[]) {self, "echo", "direct", NULL}, 0, "direct\n");
+    expect_run((char *[]) {self, "net", "ping", NULL}, 0, "ping x1\n");
+
+    test_parse();
+
+    free(self);
+    free_root_cmd();
+    printf("multi-call test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
+
+/* ---- the driver ---- */
@@ -0,0 +1,213 @@
+/**
+ * @file test_options.c
+ * @brief the test of the option syntax of scap.c
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_options
+ * the clusters of short options ("-vof"), the values attached to short options ("-ofile"),
+ * the arguments of the multi_arg flags followed by options, and the prefixes of long options.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static SAPCommand subCmd;
+static Flag verbose, output, files, upper, clash, verb, mode, more;
+static int exec_cnt = 0;
+
+static int count_exec(SAPCommand *caller) {
+    (void) caller;
+    exec_cnt++;
+    return 0;
+}
+
+static void build_tree(void) {
+    init_root_cmd("tool", "the option syntax", NULL, count_exec);
+
+    init_flag(&verbose, "verbose", 'v', "print more", NULL);
+    set_flag_type(&verbose, no_arg);
+    init_flag(&output, "output", 'o', "the output file", NULL);
+    init_flag(&files, "files", 'f', "the input files", NULL);
+    set_flag_type(&files, multi_arg);
+    add_flag(&rootCmd, &verbose);
+    add_flag(&rootCmd, &output);
+    add_flag(&rootCmd, &files);
+
+    /* "verb" is a prefix of "verbose", "mo" is a prefix of both "mode" and "more" */
+    init_flag(&verb, "verb", '\0', "a name prefixing another", NULL);
+    set_flag_type(&verb, no_arg);
+    init_flag(&mode, "mode", '\0', "the output mode", NULL);
+    init_flag(&more, "more", '\0', "show more", NULL);
+    set_flag_type(&more, no_arg);
+    add_flag(&rootCmd, &verb);
+    add_flag(&rootCmd, &mode);
+    add_flag(&rootCmd, &more);
+
+    /* the shorthands beyond 'a'..'z' are indexed by the whole byte */
+    init_sap_command(&subCmd, "sub", "a subcommand", NULL, count_exec);
+    init_flag(&upper, "upper", 'V', "an uppercase shorthand", NULL);
+    set_flag_type(&upper, no_arg);
+    init_flag(&clash, "clash", 'V', "the same shorthand again", NULL);
+    set_flag_type(&clash, no_arg);
+    add_flag(&subCmd, &upper);
+    add_flag(&subCmd, &clash);
+    add_subcmd(&rootCmd, &subCmd);
+}
+
+static void test_clusters(void) {
+    SAPParseResult res;
+
+    char *vvv[] = {"tool", "-vvv", NULL};
+    expect(sap_parse(2, vvv, &res) == 0 && sap_get_value(&res, "verbose") != NULL, "-vvv");
+    sap_free_result(&res);
+
+    char *attached[] = {"tool", "-ofile", NULL};
+    expect(sap_parse(2, attached, &res) == 0 && sap_get_value(&res, "output") == attached[1] + 2, "-ofile");
+    sap_free_result(&res);
+
+    char *separate[] = {"tool", "-vo", "file", NULL};
+    expect(sap_parse(3, separate, &res) == 0 && sap_get_value(&res, "verbose") != NULL, "-vo file, the verbose flag");
+    expect(sap_get_value(&res, "output") == separate[2], "-vo file, the value of the next argument");
+    sap_free_result(&res);
+
+    char *rest[] = {"tool", "-vof", NULL};
+    expect(sap_parse(2, rest, &res) == 0 && sap_get_value(&res, "verbose") != NULL, "-vof, the verbose flag");
+    expect(sap_get_value(&res, "output") == rest[1] + 3 && sap_get_value(&res, "files") == NULL, "-vof, 'f' is the value of -o");
+    sap_free_result(&res);
+
+    char *list[] = {"tool", "-fa", "b", NULL};
+    char **got = NULL;
+    expect(sap_parse(3, list, &res) == 0, "-fa b");
+    got = (char **) sap_get_value(&res, "files");
+    expect(got != NULL && got[0] == list[1] + 2 && got[1] == list[2] && got[2] == NULL, "-fa b, the attached value starts the list");
+    sap_free_result(&res);
+
+    char *upper_case[] = {"tool", "sub", "-V", NULL};
+    expect(sap_parse(3, upper_case, &res) == 0 && res.cmd == &subCmd && sap_get_value(&res, "upper") != NULL, "an uppercase shorthand");
+    expect(sap_get_value(&res, "clash") == NULL, "the former flag wins a duplicated shorthand");
+    sap_free_result(&res);
+}
+
+static void test_errors(void) {
+    SAPParseResult res;
+    char buf[256];
+
+    char *last[] = {"tool", "-v", "-o", NULL};
+    expect(sap_parse(3, last, &res) != 0 && res.err.code == too_few_args, "-o at the end of argv");
+    expect(res.err.argv_idx == 2 && res.err.expected == expect_arg && res.err.flag_id == sap_name_id("output"), "the flag missing its value");
+    sap_free_result(&res);
+
+    char *dash[] = {"tool", "-v-", NULL};
+    expect(sap_parse(2, dash, &res) != 0 && res.err.code == unknown_arg, "-v-");
+    expect(res.err.argv_idx == 1 && res.err.byte_offset == 2, "the offset of '-' in the cluster");
+    sap_free_result(&res);
+
+    char *unknown[] = {"tool", "-vxo", "file", NULL};
+    expect(sap_parse(3, unknown, &res) != 0 && res.err.code == unknown_arg && res.err.byte_offset == 2, "an unknown shorthand in a cluster");
+    sap_format_error(&res, buf, sizeof(buf));
+    expect(strstr(buf, "-vxo") != NULL, "the message names the cluster");
+    sap_free_result(&res);
+}
+
+static void test_multi_arg(void) {
+    SAPParseResult res;
+
+    /* the option after the arguments of a multi_arg flag isn't skipped */
+    char *line[] = {"tool", "-f", "a", "b", "-v", NULL};
+    expect(sap_parse(5, line, &res) == 0 && sap_get_value(&res, "verbose") != NULL, "the option after a multi_arg list");
+    char **got = (char **) sap_get_value(&res, "files");
+    expect(got != NULL && got[0] == line[2] && got[1] == line[3] && got[2] == NULL, "the list stops at the option");
+    sap_free_result(&res);
+
+    char *empty[] = {"tool", "-f", "-v", NULL};
+    expect(sap_parse(3, empty, &res) != 0 && res.err.code == too_few_args && res.err.argv_idx == 1, "a multi_arg flag without arguments");
+    sap_free_result(&res);
+}
+
+static void test_prefixes(void) {
+    SAPParseResult res;
+    char buf[256];
+
+    /* only the exact names are accepted by default */
+    char *off[] = {"tool", "--verbo", NULL};
+    expect(sap_parse(2, off, &res) != 0 && res.err.code == unknown_arg && res.err.argv_idx == 1, "prefix matching is off by default");
+    sap_free_result(&res);
+
+    set_prefix_match(&rootCmd, 1);
+
+    char *exact[] = {"tool", "--verb", NULL};
+    expect(sap_parse(2, exact, &res) == 0 && sap_get_value(&res, "verb") != NULL, "the exact match");
+    expect(sap_get_value(&res, "verbose") == NULL, "the exact match wins over a longer name");
+    sap_free_result(&res);
+
+    char *unique[] = {"tool", "--verbo", "--out", "file", NULL};
+    expect(sap_parse(4, unique, &res) == 0 && sap_get_value(&res, "verbose") != NULL, "a unique prefix");
+    expect(sap_get_value(&res, "verb") == NULL && sap_get_value(&res, "output") == unique[3], "a unique prefix of a single_arg flag");
+    sap_free_result(&res);
+
+    char *equal[] = {"tool", "--mod=csv", NULL};
+    expect(sap_parse(2, equal, &res) == 0 && sap_get_value(&res, "mode") == equal[1] + 6, "a unique prefix with '='");
+    sap_free_result(&res);
+
+    char *ambiguous[] = {"tool", "--mo", NULL};
+    expect(sap_parse(2, ambiguous, &res) != 0 && res.err.code == ambiguous_arg && res.err.argv_idx == 1, "an ambiguous prefix");
+    sap_format_error(&res, buf, sizeof(buf));
+    expect(strcmp(buf, "Ambiguous option: --mo, possibilities: --mode --more\n") == 0, "the candidates of an ambiguous prefix");
+    sap_free_result(&res);
+
+    char *ambiguous_equal[] = {"tool", "--mo=csv", NULL};
+    expect(sap_parse(2, ambiguous_equal, &res) != 0 && res.err.code == ambiguous_arg, "an ambiguous prefix with '='");
+    sap_format_error(&res, buf, sizeof(buf));
+    expect(strcmp(buf, "Ambiguous option: --mo=csv, possibilities: --mode --more\n") == 0, "the candidates of an ambiguous prefix with '='");
+    sap_free_result(&res);
+
+    set_prefix_match(&rootCmd, 0);
+}
+
+static void test_sealing(void) {
+    SAPMemBuf mem = {0};
+    SAPOutput out;
+    sap_output_mem(&out, &mem);
+    sap_set_output(sap_err_channel, &out);
+
+    /* do_parse_subcmd can be called repeatedly, the help command is added and the shorthands are checked once */
+    char *line[] = {"tool", "-v", NULL};
+    int child_cnt = 0;
+    for (int round = 0; round < 3; round++) {
+        expect(do_parse_subcmd(2, line) == 0, "do_parse_subcmd, again");
+        if (round == 0) {
+            child_cnt = rootCmd.tree_node.child_cnt;
+        }
+    }
+    expect(exec_cnt == 3 && rootCmd.tree_node.child_cnt == child_cnt, "a single help command");
+
+    sap_set_output(sap_err_channel, NULL);
+    sap_output_free(&out);
+
+    const char *warning = "Warning: shorthand 'V' is already occupied by upper\n";
+    int warning_cnt = 0;
+    for (const char *p = mem.data; p != NULL && (p = strstr(p, warning)) != NULL; p++) {
+        warning_cnt++;
+    }
+    expect(warning_cnt == 1, "the warning of the uppercase shorthand, only once");
+    sap_mem_buf_free(&mem);
+}
+
+int main(void) {
+    build_tree();
+    test_sealing();
+    test_clusters();
+    test_errors();
+    test_multi_arg();
+    test_prefixes();
+    free_root_cmd();
+    printf("options test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+/**
+ * @file test_output.c
+ * @brief the test of the buffered outputs of scap.c
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_output
+ * the writes batched until a flush, a write larger than the buffer written through in order, and an error message
+ * longer than SAP_OUTPUT_BUF_SIZE reported by the default error sink into an output without a buffer yet.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static SAPCommand runCmd;
+static Flag verbose;
+
+static void build_tree(void) {
+    init_root_cmd("tool", "the buffered outputs", NULL, NULL);
+    init_sap_command(&runCmd, "run", "a command", NULL, void_exec);
+    init_flag(&verbose, "verbose", 'v', "a flag", NULL);
+    set_flag_type(&verbose, no_arg);
+    add_flag(&runCmd, &verbose);
+    add_subcmd(&rootCmd, &runCmd);
+}
+
+static void test_batching(void) {
+    SAPMemBuf mem = {0};
+    SAPOutput out;
+    sap_output_mem(&out, &mem);
+
+    sap_output_write(&out, "abc", 3);
+    sap_output_write(&out, "def", 3);
+    expect(mem.len == 0 && out.len == 6, "the small writes are batched");
+    sap_output_flush(&out);
+    expect(mem.len == 6 && memcmp(mem.data, "abcdef", 6) == 0, "the flush writes them");
+
+    /* larger than the whole buffer: the batched bytes first, then the write itself */
+    size_t big_len = (size_t) SAP_OUTPUT_BUF_SIZE * 2 + 1;
+    char *big = (char *) malloc(big_len);
+    memset(big, 'x', big_len);
+    sap_output_write(&out, "g", 1);
+    sap_output_write(&out, big, big_len);
+    expect(mem.len == 7 + big_len && mem.data[6] == 'g' && mem.data[7] == 'x' && mem.data[mem.len - 1] == 'x',
+           "a large write is written through in order");
+    expect(out.total == 7 + big_len, "the total of the written bytes");
+
+    free(big);
+    sap_output_free(&out);
+    sap_mem_buf_free(&mem);
+}
+
+static void test_long_error(void) {
+    /* an unknown option longer than the initial buffer of the output */
+    size_t opt_len = (size_t) SAP_OUTPUT_BUF_SIZE + 2000;
+    char *opt = (char *) malloc(opt_len + 1);
+    memset(opt, 'x', opt_len);
+    opt[0] = opt[1] = '-';
+    opt[opt_len] = '\0';
+    char *line[] = {"tool", "run", opt, NULL};
+
+    SAPParseResult res;
+    expect(sap_parse(3, line, &res) != 0, "the unknown option fails");
+    size_t expected_len = sap_format_error(&res, NULL, 0);
+    char *expected = (char *) malloc(expected_len + 1);
+    sap_format_error(&res, expected, expected_len + 1);
+    sap_free_result(&res);
+    expect(expected_len > SAP_OUTPUT_BUF_SIZE, "the message is longer than the buffer");
+
+    /* the default sink into an output without a buffer yet */
+    SAPMemBuf mem = {0};
+    SAPOutput out;
+    sap_output_mem(&out, &mem);
+    sap_set_error_sink(NULL, NULL);
+    sap_set_output(sap_err_channel, &out);
+    expect(do_parse_subcmd(3, line) != 0, "the unknown option is reported");
+    expect(mem.len == expected_len && memcmp(mem.data, expected, expected_len) == 0, "the whole message is written");
+    expect(out.len == 0 && out.total == expected_len, "the message is flushed");
+
+    /* again, into the buffer grown by the first */
+    mem.len = 0;
+    expect(do_parse_subcmd(3, line) != 0, "the unknown option is reported again");
+    expect(mem.len == expected_len && memcmp(mem.data, expected, expected_len) == 0, "the message is written again");
+
+    sap_set_output(sap_err_channel, NULL);
+    sap_output_free(&out);
+    sap_mem_buf_free(&mem);
+    free(expected);
+    free(opt);
+}
+
+int main(void) {
+    build_tree();
+    test_batching();
+    test_long_error();
+    free_root_cmd();
+    printf("output test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
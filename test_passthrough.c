@@ -0,0 +1,199 @@
+/**
+ * @file test_passthrough.c
+ * @brief the test of the end of the options "--" of scap.c, the operands and the passthrough tail
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_passthrough
+ * by default the arguments after "--" are operands of the positional slots or the default flag, a passthrough
+ * command exposes them as the tail instead. both are checked by sap_parse and by the incremental parse.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static SAPCommand rmCmd, catCmd, runCmd;
+static Flag force, inputs, output, verbose, runOutput;
+
+static void build_tree(void) {
+    init_root_cmd("tool", "the end of the options", NULL, NULL);
+
+    /* rm <files>..., the operands fill a variadic slot */
+    init_sap_command(&rmCmd, "rm", "remove the files", NULL, NULL);
+    init_flag(&force, "force", 'f', "don't ask", NULL);
+    set_flag_type(&force, no_arg);
+    add_flag(&rmCmd, &force);
+    expect(add_positional(&rmCmd, "files", "the files", pos_string, 1, -1) == 0, "the slot of rm");
+    add_subcmd(&rootCmd, &rmCmd);
+
+    /* cat [inputs]..., the operands go to the default flag */
+    init_sap_command(&catCmd, "cat", "print the inputs", NULL, NULL);
+    init_flag(&inputs, "inputs", 'i', "the inputs", NULL);
+    set_flag_type(&inputs, multi_arg);
+    add_default_flag(&catCmd, &inputs);
+    init_flag(&output, "output", 'o', "the output", NULL);
+    add_flag(&catCmd, &output);
+    add_subcmd(&rootCmd, &catCmd);
+
+    /* run [options] -- <command>..., a wrapper passing the tail through */
+    init_sap_command(&runCmd, "run", "run a command", NULL, NULL);
+    set_cmd_passthrough(&runCmd, 1);
+    init_flag(&verbose, "verbose", 'v', "print more", NULL);
+    set_flag_type(&verbose, no_arg);
+    init_flag(&runOutput, "output", 'o', "the output", NULL);
+    add_flag(&runCmd, &verbose);
+    add_flag(&runCmd, &runOutput);
+    add_subcmd(&rootCmd, &runCmd);
+}
+
+/**
+ * @brief whether a list holds the expected arguments (by address), in order and terminated.
+ */
+static int same_list(void *value, char *expected[], int cnt) {
+    char **list = (char **) value;
+    if (list == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < cnt; i++) {
+        if (list[i] != expected[i]) {
+            return 0;
+        }
+    }
+    return list[cnt] == NULL;
+}
+
+/**
+ * @brief parse a command line by sap_parse and by the incremental parse, both must agree.
+ *
+ * @param[out] res  - the result of sap_parse, free it after.
+ * @return int      - the return value of sap_parse.
+ */
+static int parse_both(int argc, char *argv[], SAPParseResult *res, const char *what) {
+    int ret = sap_parse(argc, argv, res);
+
+    SAPParseState st;
+    sap_parse_begin(&st);
+    int st_ret = 0;
+    for (int i = 1; i <= argc && st_ret == 0; i++) {
+        st_ret = sap_parse_feed(&st, i, argv);
+    }
+    if (st_ret == 0) {
+        st_ret = sap_parse_end(&st);
+    }
+    int same = st_ret == ret && st.res.cmd == res->cmd && st.res.err.code == res->err.code &&
+               st.res.err.argv_idx == res->err.argv_idx && st.res.tail_argv == res->tail_argv &&
+               st.res.tail_argc == res->tail_argc;
+    for (int i = 0; same && ret == 0 && i < MAX_POS_COUNT; i++) {
+        same = (st.res.positionals[i] == NULL) == (res->positionals[i] == NULL);
+    }
+    expect(same, what);
+    sap_parse_state_free(&st);
+    return ret;
+}
+
+static void test_operands(void) {
+    SAPParseResult res;
+    char buf[256];
+
+    /* the arguments after "--" are operands, even if they look like options */
+    char *weird[] = {"tool", "rm", "--", "-weird-name", NULL};
+    expect(parse_both(4, weird, &res, "rm -- -weird-name") == 0 && res.cmd == &rmCmd, "an operand starting with '-'");
+    expect(same_list(sap_get_positional(&res, 0), weird + 3, 1) && res.tail_argv == NULL, "the operand in the slot");
+    sap_free_result(&res);
+
+    char *mixed[] = {"tool", "rm", "a", "-f", "--", "-f", "--", "-", "--force", NULL};
+    expect(parse_both(9, mixed, &res, "rm a -f -- -f -- - --force") == 0, "the options before, the operands after");
+    char *mixed_files[] = {mixed[2], mixed[5], mixed[6], mixed[7], mixed[8]};
+    expect(same_list(sap_get_positional(&res, 0), mixed_files, 5), "every argument after \"--\" is an operand");
+    expect(sap_get_value(&res, "force") != NULL && res.pos_cnt == 5, "the option before \"--\"");
+    sap_free_result(&res);
+
+    char *missing[] = {"tool", "rm", "--", NULL};
+    expect(parse_both(3, missing, &res, "rm --") != 0 && res.err.code == too_few_args, "no operand after \"--\"");
+    sap_format_error(&res, buf, sizeof(buf));
+    expect(strcmp(buf, "Too few arguments: missing <files>\n") == 0, "the missing slot in the message");
+    sap_free_result(&res);
+
+    /* the default flag takes the operands */
+    char *cat[] = {"tool", "cat", "-o", "out", "--", "-i", "--", NULL};
+    expect(parse_both(7, cat, &res, "cat -o out -- -i --") == 0 && res.cmd == &catCmd, "the operands of cat");
+    expect(same_list(sap_get_value(&res, "inputs"), cat + 5, 2) && res.tail_argv == NULL, "the operands in the default flag");
+    expect(sap_get_value(&res, "output") == cat[3], "the option before \"--\" of cat");
+    sap_free_result(&res);
+
+    char *cat_empty[] = {"tool", "cat", "--", NULL};
+    expect(parse_both(3, cat_empty, &res, "cat --") == 0 && sap_get_value(&res, "inputs") == NULL, "no operand of cat");
+    expect(res.tail_argv == NULL && res.tail_argc == 0, "no tail without the passthrough");
+    sap_free_result(&res);
+
+    /* a subcommand after "--" is an operand, the root has nothing to take it */
+    char *root[] = {"tool", "--", "rm", NULL};
+    expect(parse_both(3, root, &res, "tool -- rm") != 0 && res.err.code == too_many_args && res.err.argv_idx == 2, "no subcommand after \"--\"");
+    sap_free_result(&res);
+
+    char *pending[] = {"tool", "cat", "-o", "--", "x", NULL};
+    expect(parse_both(5, pending, &res, "cat -o -- x") != 0 && res.err.code == too_few_args, "a flag missing its argument before \"--\"");
+    expect(res.err.argv_idx == 2, "the flag missing its argument");
+    sap_free_result(&res);
+
+    char *no_spawn[] = {"tool", "cat", "--", "true", NULL};
+    pid_t pid;
+    expect(parse_both(4, no_spawn, &res, "cat -- true") == 0 && sap_spawn_tail(&res, &pid) == EINVAL, "no tail to spawn");
+    sap_free_result(&res);
+}
+
+static void test_tail(void) {
+    SAPParseResult res;
+
+    char *wrap[] = {"tool", "run", "-v", "--", "make", "-j8", "--", "all", NULL};
+    expect(parse_both(8, wrap, &res, "run -v -- make -j8 -- all") == 0 && res.cmd == &runCmd, "a passthrough command");
+    expect(res.tail_argv == wrap + 4 && res.tail_argc == 4, "the tail is a slice of argv");
+    expect(sap_get_value(&res, "verbose") != NULL && sap_get_value(&res, "output") == NULL, "the options before the tail");
+    sap_free_result(&res);
+
+    /* "--" at the end, an empty tail */
+    char *empty[] = {"tool", "run", "-v", "--", NULL};
+    expect(parse_both(4, empty, &res, "run -v --") == 0, "an empty tail");
+    expect(res.tail_argv == empty + 4 && res.tail_argc == 0 && res.tail_argv[0] == NULL, "the empty slice");
+    pid_t pid;
+    expect(sap_spawn_tail(&res, &pid) == EINVAL, "an empty tail isn't spawned");
+    sap_free_result(&res);
+
+    char *none[] = {"tool", "run", "-v", NULL};
+    expect(parse_both(3, none, &res, "run -v") == 0 && res.tail_argv == NULL && res.tail_argc == 0, "no \"--\", no tail");
+    sap_free_result(&res);
+
+    char *pending[] = {"tool", "run", "-o", "--", "true", NULL};
+    expect(parse_both(5, pending, &res, "run -o -- true") != 0 && res.err.code == too_few_args, "-o -- misses the argument");
+    expect(res.err.argv_idx == 2 && res.tail_argv == NULL, "the flag missing its argument, no tail");
+    sap_free_result(&res);
+
+    char *attached[] = {"tool", "run", "-o--", "--", "true", NULL};
+    expect(parse_both(5, attached, &res, "run -o-- -- true") == 0 && sap_get_value(&res, "output") == attached[2] + 2, "\"--\" attached to -o");
+    expect(res.tail_argc == 1 && res.tail_argv == attached + 4, "the tail after the attached value");
+    sap_free_result(&res);
+
+    /* the setting isn't inherited, and it can be turned off */
+    set_cmd_passthrough(&runCmd, 0);
+    char *off[] = {"tool", "run", "--", "make", NULL};
+    expect(parse_both(4, off, &res, "run -- make, passthrough off") != 0 && res.err.code == too_many_args, "an operand nobody takes");
+    sap_free_result(&res);
+    set_cmd_passthrough(&runCmd, 1);
+}
+
+int main(void) {
+    build_tree();
+    test_operands();
+    test_tail();
+    free_root_cmd();
+    printf("passthrough test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
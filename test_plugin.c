@@ -0,0 +1,102 @@
+/**
+ * @file test_plugin.c
+ * @brief the test of the plugin commands of scap.c with the sample plugins in ./plugins
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * the help must never open a shared object, and a plugin is opened only when it's dispatched.
+ * the executable is linked with -rdynamic, so the plugins call the library of the executable.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static SAPMemBuf outMem, errMem;
+static SAPOutput outCapture, errCapture;
+
+/**
+ * @brief dispatch a command line with the outputs captured, return the result of the handler.
+ */
+static int dispatch(int argc, char *argv[]) {
+    outMem.len = 0;
+    errMem.len = 0;
+    int ret = do_parse_subcmd(argc, argv);
+    sap_output_flush(&outCapture);
+    sap_output_flush(&errCapture);
+    return ret;
+}
+
+static int output_has(const SAPMemBuf *mem, const char *str) {
+    return mem->data != NULL && strstr(mem->data, str) != NULL;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("usage: %s <manifest>\n", argv[0]);
+        return 1;
+    }
+
+    sap_output_mem(&outCapture, &outMem);
+    sap_output_mem(&errCapture, &errMem);
+    sap_set_output(sap_out_channel, &outCapture);
+    sap_set_output(sap_err_channel, &errCapture);
+
+    init_root_cmd("prog", "the host of the sample plugins", NULL, NULL);
+    SAPPluginSet *plugins = sap_load_plugins(&rootCmd, argv[1]);
+    expect(plugins != NULL, "the manifest is read");
+    if (plugins == NULL) {
+        return 1;
+    }
+
+    /* the help lists and describes the plugins from the manifest */
+    char *help[] = {"prog", "help", NULL};
+    expect(dispatch(2, help) == 0, "help succeeds");
+    expect(output_has(&outMem, "hello\tGreet someone"), "help lists the plugins");
+    char *help_hello[] = {"prog", "help", "hello", NULL};
+    expect(dispatch(3, help_hello) == 0, "help of a plugin succeeds");
+    expect(output_has(&outMem, "-n, --name\tthe name to greet"), "help of a plugin shows its flags");
+    char *hello_help[] = {"prog", "hello", "--help", NULL};
+    expect(dispatch(3, hello_help) == 0 && output_has(&outMem, "--shout"), "--help of a plugin");
+    expect(sap_plugins_loaded(plugins) == 0, "the help opens no plugin");
+
+    /* parsing without executing doesn't open the plugin either */
+    char *bad_flag[] = {"prog", "hello", "--unknown", NULL};
+    SAPParseResult res;
+    expect(sap_parse(3, bad_flag, &res) != 0 && res.err.code == unknown_arg, "the flags of a plugin are checked");
+    sap_free_result(&res);
+    expect(sap_plugins_loaded(plugins) == 0, "parsing opens no plugin");
+
+    char *hello[] = {"prog", "hello", "-n", "scap", "--shout", NULL};
+    expect(dispatch(5, hello) == 0, "hello succeeds");
+    expect(output_has(&outMem, "HELLO, SCAP"), "hello greets");
+    expect(sap_plugins_loaded(plugins) == 1, "hello is opened on dispatch");
+
+    char *sum[] = {"prog", "sum", "1", "2", "39", NULL};
+    expect(dispatch(5, sum) == 42, "sum returns the sum");
+    expect(dispatch(5, sum) == 42 && sap_plugins_loaded(plugins) == 2, "sum is opened once");
+
+    char *broken[] = {"prog", "broken", NULL};
+    expect(dispatch(2, broken) == -1, "a missing shared object fails the dispatch");
+    expect(output_has(&errMem, "Failed to load plugin broken"), "a missing shared object is reported");
+    expect(sap_plugins_loaded(plugins) == 2, "the missing shared object isn't counted");
+
+    expect(sap_load_plugins(&rootCmd, "/nonexistent/plugins.manifest") == NULL, "a missing manifest");
+
+    free_root_cmd();
+    sap_free_plugins(plugins);
+    sap_set_output(sap_out_channel, NULL);
+    sap_set_output(sap_err_channel, NULL);
+    sap_output_free(&outCapture);
+    sap_output_free(&errCapture);
+    sap_mem_buf_free(&outMem);
+    sap_mem_buf_free(&errMem);
+
+    printf("plugin test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
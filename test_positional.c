@@ -0,0 +1,197 @@
+/**
+ * @file test_positional.c
+ * @brief the test of the positional slots of scap.c
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_positional
+ * every command line is parsed by sap_parse and by the incremental parse, fed a token at a time,
+ * both must assign the same arguments to the same slots or report the same error.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static SAPCommand copyCmd, sumCmd, pairCmd, remoteCmd, showCmd;
+static Flag verbose, jobs;
+
+static void build_tree(void) {
+    init_root_cmd("tool", "the positional slots", NULL, NULL);
+
+    /* copy <src> <dst> [mode] */
+    init_sap_command(&copyCmd, "copy", "copy a file", NULL, NULL);
+    init_flag(&verbose, "verbose", 'v', "print more", NULL);
+    set_flag_type(&verbose, no_arg);
+    init_flag(&jobs, "jobs", 'j', "the number of jobs", "1");
+    add_flag(&copyCmd, &verbose);
+    add_flag(&copyCmd, &jobs);
+    expect(add_positional(&copyCmd, "src", "the source", pos_string, 1, 1) == 0, "the first slot");
+    expect(add_positional(&copyCmd, "dst", "the destination", pos_string, 1, 1) == 1, "the second slot");
+    expect(add_positional(&copyCmd, "mode", "the permission bits", pos_int, 0, 1) == 2, "an optional slot");
+    expect(add_positional(&copyCmd, "owner", "a required slot", pos_string, 1, 1) == -1, "no required slot after an optional one");
+
+    /* sum <nums>... */
+    init_sap_command(&sumCmd, "sum", "add the numbers", NULL, NULL);
+    expect(add_positional(&sumCmd, "nums", "the numbers", pos_float, 1, -1) == 0, "a variadic slot");
+    expect(add_positional(&sumCmd, "more", "after the tail", pos_string, 0, 1) == -1, "no slot after a variadic one");
+    expect(add_default_flag(&sumCmd, &verbose) == NULL, "no default flag with the slots");
+
+    /* pair <items>{2,3} */
+    init_sap_command(&pairCmd, "pair", "two or three items", NULL, NULL);
+    expect(add_positional(&pairCmd, "items", "the items", pos_string, 2, 1) == -1, "max below min");
+    expect(add_positional(&pairCmd, "items", "the items", pos_string, 2, 3) == 0, "a bounded variadic slot");
+
+    /* remote [name], and the subcommand show */
+    init_sap_command(&remoteCmd, "remote", "list or show the remotes", NULL, NULL);
+    init_sap_command(&showCmd, "show", "show a remote", NULL, NULL);
+    add_positional(&remoteCmd, "name", "the remote", pos_string, 0, 1);
+
+    add_subcmd(&rootCmd, &copyCmd);
+    add_subcmd(&rootCmd, &sumCmd);
+    add_subcmd(&rootCmd, &pairCmd);
+    add_subcmd(&rootCmd, &remoteCmd);
+    add_subcmd(&remoteCmd, &showCmd);
+}
+
+/**
+ * @brief parse a command line by sap_parse and by the incremental parse, check that both agree.
+ *
+ * @return int - the return value of sap_parse, the result is kept in $res.
+ */
+static int parse_both(int argc, char *argv[], SAPParseResult *res, const char *what) {
+    int ret = sap_parse(argc, argv, res);
+
+    SAPParseState st;
+    sap_parse_begin(&st);
+    for (int i = 1; i <= argc; i++) {
+        sap_parse_feed(&st, i, argv);
+    }
+    int st_ret = sap_parse_end(&st);
+    int same = (st_ret == ret) && st.res.cmd == res->cmd && st.res.err.code == res->err.code
+               && st.res.err.argv_idx == res->err.argv_idx && st.res.err.flag_id == res->err.flag_id;
+    for (int i = 0; same && ret == 0 && i < MAX_POS_COUNT; i++) {
+        char **a = (char **) res->positionals[i], **b = (char **) st.res.positionals[i];
+        if (res->cmd->positionals == NULL || a == NULL || b == NULL) {
+            same = (a == b);
+        } else if (res->cmd == &sumCmd || res->cmd == &pairCmd) {
+            /* the lists of the variadic slots */
+            for (int k = 0; same && (a[k] != NULL || b[k] != NULL); k++) {
+                same = (a[k] == b[k]);
+            }
+        } else {
+            same = (a == b);
+        }
+    }
+    same = same && (ret != 0 || st.res.pos_cnt == res->pos_cnt);
+    sap_parse_state_free(&st);
+    expect(same, what);
+    return ret;
+}
+
+static void test_assign(void) {
+    SAPParseResult res;
+
+    /* the options and the positional arguments interleave */
+    char *copy[] = {"tool", "copy", "-v", "a.txt", "-j", "4", "b.txt", "644", NULL};
+    expect(parse_both(8, copy, &res, "copy, incremental") == 0 && res.cmd == &copyCmd, "copy");
+    expect(res.pos_cnt == 3 && sap_get_positional(&res, 0) == copy[3] && sap_get_positional(&res, 1) == copy[6], "src and dst");
+    expect(sap_get_positional(&res, 2) == copy[7] && strcmp((char *) sap_get_value(&res, "jobs"), "4") == 0, "mode and jobs");
+    sap_free_result(&res);
+
+    char *copy2[] = {"tool", "copy", "a", "b", NULL};
+    expect(parse_both(4, copy2, &res, "copy without the optional slot, incremental") == 0, "copy without mode");
+    expect(res.pos_cnt == 2 && sap_get_positional(&res, 2) == NULL, "no mode");
+    sap_free_result(&res);
+
+    char *sum[] = {"tool", "sum", "1", "2.5", "3e2", NULL};
+    expect(parse_both(5, sum, &res, "sum, incremental") == 0 && res.cmd == &sumCmd, "sum");
+    char **nums = (char **) sap_get_positional(&res, 0);
+    expect(nums != NULL && nums[0] == sum[2] && nums[1] == sum[3] && nums[2] == sum[4] && nums[3] == NULL, "the variadic list");
+    sap_free_result(&res);
+
+    char *pair[] = {"tool", "pair", "x", "y", "z", NULL};
+    expect(parse_both(5, pair, &res, "pair, incremental") == 0 && res.pos_cnt == 3, "pair of three");
+    sap_free_result(&res);
+
+    /* a word which isn't a subcommand is a positional argument of a command with subcommands */
+    char *remote[] = {"tool", "remote", "origin", NULL};
+    expect(parse_both(3, remote, &res, "remote, incremental") == 0 && res.cmd == &remoteCmd, "remote origin");
+    expect(sap_get_positional(&res, 0) == remote[2], "the remote name");
+    sap_free_result(&res);
+
+    char *show[] = {"tool", "remote", "show", NULL};
+    expect(parse_both(3, show, &res, "show, incremental") == 0 && res.cmd == &showCmd, "the subcommand wins");
+    sap_free_result(&res);
+}
+
+static void test_errors(void) {
+    SAPParseResult res;
+    char buf[256];
+
+    char *extra[] = {"tool", "copy", "a", "b", "7", "c", NULL};
+    expect(parse_both(6, extra, &res, "extra, incremental") != 0 && res.err.code == too_many_args && res.err.argv_idx == 5, "an argument beyond the slots");
+    sap_free_result(&res);
+
+    char *bad[] = {"tool", "copy", "a", "b", "rw", NULL};
+    expect(parse_both(5, bad, &res, "bad type, incremental") != 0 && res.err.code == invalid_type && res.err.argv_idx == 4, "not an int");
+    expect(res.err.flag_id == sap_name_id("mode"), "the slot of the bad argument");
+    sap_format_error(&res, buf, sizeof(buf));
+    expect(strcmp(buf, "Invalid value: rw, expected by <mode>\n") == 0, "the message of a bad type");
+    sap_free_result(&res);
+
+    char *missing[] = {"tool", "copy", "a", NULL};
+    expect(parse_both(3, missing, &res, "missing, incremental") != 0 && res.err.code == too_few_args, "a missing argument");
+    expect(res.err.expected == expect_positional && res.err.argv_idx == 3 && res.err.flag_id == sap_name_id("dst"), "the missing slot");
+    sap_format_error(&res, buf, sizeof(buf));
+    expect(strcmp(buf, "Too few arguments: missing <dst>\n") == 0, "the message of a missing argument");
+    sap_free_result(&res);
+
+    char *few[] = {"tool", "pair", "x", NULL};
+    expect(parse_both(3, few, &res, "few, incremental") != 0 && res.err.code == too_few_args, "a variadic slot short of arguments");
+    sap_free_result(&res);
+
+    char *many[] = {"tool", "pair", "w", "x", "y", "z", NULL};
+    expect(parse_both(6, many, &res, "many, incremental") != 0 && res.err.code == too_many_args && res.err.argv_idx == 5, "a variadic slot beyond its max");
+    sap_free_result(&res);
+
+    char *nan[] = {"tool", "sum", "1", "two", NULL};
+    expect(parse_both(4, nan, &res, "nan, incremental") != 0 && res.err.code == invalid_type && res.err.argv_idx == 3, "not a number");
+    sap_free_result(&res);
+
+    /* an option error wins over the positional ones, as it does over the arguments of the default flag */
+    char *opt[] = {"tool", "copy", "a", "b", "rw", "--bogus", NULL};
+    expect(parse_both(6, opt, &res, "option error, incremental") != 0 && res.err.code == unknown_arg && res.err.argv_idx == 5, "the option error first");
+    sap_free_result(&res);
+}
+
+static void test_help(void) {
+    SAPMemBuf mem = {0};
+    SAPOutput out;
+    sap_output_mem(&out, &mem);
+    sap_set_output(sap_out_channel, &out);
+    print_cmd_help(&copyCmd);
+    print_cmd_help(&sumCmd);
+    sap_set_output(sap_out_channel, NULL);
+    sap_output_free(&out);
+
+    expect(mem.data != NULL && strstr(mem.data, "Usage: copy [options] <src> <dst> [mode]\n") != NULL, "the usage of the slots");
+    expect(mem.data != NULL && strstr(mem.data, "  mode\tthe permission bits (int, optional)\n") != NULL, "an optional slot in the help");
+    expect(mem.data != NULL && strstr(mem.data, "Usage: sum [options] <nums>...\n") != NULL, "the usage of a variadic slot");
+    sap_mem_buf_free(&mem);
+}
+
+int main(void) {
+    build_tree();
+    test_assign();
+    test_errors();
+    test_help();
+    free_root_cmd();
+    printf("positional test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
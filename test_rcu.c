@@ -0,0 +1,153 @@
+/**
+ * @file test_rcu.c
+ * @brief the stress test of the tree versions of scap.c, concurrent readers and writers
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_rcu [rounds]
+ * the writers add and remove their subcommands and publish the tree, the readers parse the published versions
+ * meanwhile and check that every version is consistent: its commands parse, and only its commands.
+ * build it with -fsanitize=address or -fsanitize=thread to check the reclamation as well.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+#define READER_CNT 4
+#define WRITER_CNT 2
+
+static SAPCommand stableCmd, toggledCmds[WRITER_CNT];
+static Flag stableCount, toggledFlags[WRITER_CNT];
+static const char *toggledNames[WRITER_CNT] = {"alpha", "beta"};
+static long rounds = 2000;
+static int writersDone = 0;
+
+/**
+ * @brief whether a subcommand of the root of a version has the name.
+ */
+static int version_has(const SAPTreeVersion *version, const char *name) {
+    const SAPCommand *root = sap_version_root(version);
+    for (int i = 0; i < root->tree_node.child_cnt; i++) {
+        if (strcmp(node2cmd(root->tree_node.children[i])->name, name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *reader_main(void *arg) {
+    (void) arg;
+    SAPRcuReader reader;
+    sap_rcu_register(&reader);
+
+    uint64_t last_gen = 0;
+    long parsed = 0;
+    while (!__atomic_load_n(&writersDone, __ATOMIC_ACQUIRE) || parsed == 0) {
+        const SAPTreeVersion *version = sap_rcu_read_lock(&reader);
+        expect(sap_version_gen(version) >= last_gen, "the versions are published in order");
+        last_gen = sap_version_gen(version);
+
+        SAPParseResult res;
+        char *stable[] = {"srv", "stable", "-n", "3", NULL};
+        expect(sap_version_parse(version, 4, stable, &res) == 0 && res.cmd->origin == &stableCmd, "the stable command");
+        expect(strcmp((const char *) sap_get_value(&res, "count"), "3") == 0, "the value of the stable command");
+        sap_free_result(&res);
+
+        for (int w = 0; w < WRITER_CNT; w++) {
+            char *toggled[] = {"srv", (char *) toggledNames[w], "--level", "7", NULL};
+            int ret = sap_version_parse(version, 4, toggled, &res);
+            if (version_has(version, toggledNames[w])) {
+                expect(ret == 0 && res.cmd->origin == &toggledCmds[w], "a command of the version parses");
+                expect(ret == 0 && strcmp((const char *) sap_get_value(&res, "level"), "7") == 0, "its value");
+            } else {
+                expect(ret != 0 && res.err.code == unknown_cmd, "a command out of the version doesn't");
+            }
+            sap_free_result(&res);
+        }
+        sap_rcu_read_unlock(&reader);
+        parsed++;
+    }
+
+    sap_rcu_unregister(&reader);
+    return NULL;
+}
+
+static void *writer_main(void *arg) {
+    int w = (int) (long) arg;
+    for (long r = 0; r < rounds; r++) {
+        sap_tree_lock();
+        if (r % 2 == 0) {
+            add_subcmd(&rootCmd, &toggledCmds[w]);
+        } else {
+            remove_subcmd(&rootCmd, &toggledCmds[w]);
+        }
+        sap_tree_unlock();
+        sap_tree_publish();
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        rounds = atol(argv[1]);
+    }
+
+    /* the commands and the flags are initialized before the threads, the writers only move them */
+    init_root_cmd("srv", "the tree versions under concurrent writers", NULL, NULL);
+    init_sap_command(&stableCmd, "stable", "always in the tree", NULL, NULL);
+    init_flag(&stableCount, "count", 'n', "a number", "1");
+    add_flag(&stableCmd, &stableCount);
+    add_subcmd(&rootCmd, &stableCmd);
+    for (int w = 0; w < WRITER_CNT; w++) {
+        init_sap_command(&toggledCmds[w], toggledNames[w], "added and removed by a writer", NULL, NULL);
+        init_flag(&toggledFlags[w], "level", 'l', "a number", "0");
+        add_flag(&toggledCmds[w], &toggledFlags[w]);
+    }
+    expect(sap_tree_publish() == 1, "the first version");
+
+    pthread_t readers[READER_CNT], writers[WRITER_CNT];
+    for (int i = 0; i < READER_CNT; i++) {
+        pthread_create(&readers[i], NULL, reader_main, NULL);
+    }
+    for (int w = 0; w < WRITER_CNT; w++) {
+        pthread_create(&writers[w], NULL, writer_main, (void *) (long) w);
+    }
+    for (int w = 0; w < WRITER_CNT; w++) {
+        pthread_join(writers[w], NULL);
+    }
+    __atomic_store_n(&writersDone, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < READER_CNT; i++) {
+        pthread_join(readers[i], NULL);
+    }
+
+    /* every writer added and removed its command as often, and the published tree agrees */
+    sap_rcu_synchronize();
+    SAPRcuReader reader;
+    sap_rcu_register(&reader);
+    const SAPTreeVersion *version = sap_rcu_read_lock(&reader);
+    expect(sap_version_gen(version) == (uint64_t) (1 + WRITER_CNT * rounds), "a version per publish");
+    for (int w = 0; w < WRITER_CNT; w++) {
+        expect(version_has(version, toggledNames[w]) == (int) (rounds % 2), toggledNames[w]);
+    }
+    sap_rcu_read_unlock(&reader);
+    sap_rcu_unregister(&reader);
+
+    /* a removed command isn't found by the tree either */
+    SAPParseResult res;
+    char *removed[] = {"srv", "alpha", NULL};
+    expect((sap_parse(2, removed, &res) == 0) == (int) (rounds % 2), "the removed command");
+    sap_free_result(&res);
+    expect(remove_subcmd(&rootCmd, &stableCmd) == &rootCmd && remove_subcmd(&rootCmd, &stableCmd) == NULL, "remove once");
+
+    free_root_cmd();
+    printf("rcu test: %ld rounds, %d failure(s)\n", rounds, failures);
+    return failures == 0 ? 0 : 1;
+}
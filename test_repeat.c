@@ -0,0 +1,165 @@
+/**
+ * @file test_repeat.c
+ * @brief the test of the repeatable flags of scap.c
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_repeat
+ * the counts of the repeat_count flags, the lists of the repeat_append flags (single_arg, multi_arg and
+ * the default flag), and the lists long enough to span several chunks of the arena of the result.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+#define LONG_LIST 3000
+
+static SAPCommand addCmd;
+static Flag verbose, include, define, output, items, quiet;
+
+static void build_tree(void) {
+    init_root_cmd("tool", "the repeatable flags", NULL, NULL);
+
+    init_flag(&verbose, "verbose", 'v', "counted", NULL);
+    set_flag_type(&verbose, no_arg);
+    set_flag_repeat(&verbose, repeat_count);
+    init_flag(&include, "include", 'I', "appended, single_arg", NULL);
+    set_flag_repeat(&include, repeat_append);
+    init_flag(&define, "define", 'D', "appended, multi_arg", NULL);
+    set_flag_type(&define, multi_arg);
+    set_flag_repeat(&define, repeat_append);
+    init_flag(&output, "output", 'o', "the last one wins", NULL);
+    add_flag(&rootCmd, &verbose);
+    add_flag(&rootCmd, &include);
+    add_flag(&rootCmd, &define);
+    add_flag(&rootCmd, &output);
+
+    /* add [items]..., a single_arg default flag appending its arguments */
+    init_sap_command(&addCmd, "add", "the default flag appends", NULL, NULL);
+    init_flag(&items, "items", 'i', "the items", NULL);
+    set_flag_repeat(&items, repeat_append);
+    add_default_flag(&addCmd, &items);
+    init_flag(&quiet, "quiet", 'q', "a no_arg flag", NULL);
+    set_flag_type(&quiet, no_arg);
+    add_flag(&addCmd, &quiet);
+    add_subcmd(&rootCmd, &addCmd);
+}
+
+/**
+ * @brief whether a list holds the expected arguments (by address), in order and terminated.
+ */
+static int same_list(void *value, char *expected[], int cnt) {
+    char **list = (char **) value;
+    if (list == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < cnt; i++) {
+        if (list[i] != expected[i]) {
+            return 0;
+        }
+    }
+    return list[cnt] == NULL;
+}
+
+static void test_count(void) {
+    SAPParseResult res;
+
+    char *cluster[] = {"tool", "-vvv", NULL};
+    expect(sap_parse(2, cluster, &res) == 0 && sap_get_value(&res, "verbose") != NULL, "-vvv");
+    expect(*(int *) sap_get_value(&res, "verbose") == 3, "-vvv counts 3");
+    sap_free_result(&res);
+
+    char *separate[] = {"tool", "-v", "--verbose", "-v", NULL};
+    expect(sap_parse(4, separate, &res) == 0 && *(int *) sap_get_value(&res, "verbose") == 3, "-v --verbose -v counts 3");
+    sap_free_result(&res);
+
+    char *mixed[] = {"tool", "-vv", "-Ia", "-v", NULL};
+    expect(sap_parse(4, mixed, &res) == 0 && *(int *) sap_get_value(&res, "verbose") == 3, "the clusters add up");
+    sap_free_result(&res);
+
+    char *once[] = {"tool", "-v", NULL};
+    expect(sap_parse(2, once, &res) == 0 && *(int *) sap_get_value(&res, "verbose") == 1, "a single occurrence counts 1");
+    sap_free_result(&res);
+
+    char *none[] = {"tool", NULL};
+    expect(sap_parse(1, none, &res) == 0 && sap_get_value(&res, "verbose") == NULL, "no occurrence, no count");
+    sap_free_result(&res);
+}
+
+static void test_append(void) {
+    SAPParseResult res;
+
+    char *single[] = {"tool", "-I", "a", "--include", "b", "-Ic", NULL};
+    char *single_expected[] = {single[2], single[4], single[5] + 2};
+    expect(sap_parse(6, single, &res) == 0 && same_list(sap_get_value(&res, "include"), single_expected, 3), "the single_arg occurrences");
+    sap_free_result(&res);
+
+    char *multi[] = {"tool", "--define", "a", "b", "-v", "-D", "c", NULL};
+    char *multi_expected[] = {multi[2], multi[3], multi[6]};
+    expect(sap_parse(7, multi, &res) == 0 && same_list(sap_get_value(&res, "define"), multi_expected, 3), "the multi_arg occurrences");
+    sap_free_result(&res);
+
+    char *last[] = {"tool", "-o", "a", "-o", "b", NULL};
+    expect(sap_parse(5, last, &res) == 0 && sap_get_value(&res, "output") == last[4], "repeat_last keeps the last one");
+    sap_free_result(&res);
+
+    /* the arguments of the default flag are appended to the occurrences of the flag */
+    char *dft[] = {"tool", "add", "x", "-i", "y", "-q", "z", "w", NULL};
+    char *dft_expected[] = {dft[2], dft[4], dft[6], dft[7]};
+    expect(sap_parse(8, dft, &res) == 0 && res.cmd == &addCmd, "add");
+    expect(same_list(sap_get_value(&res, "items"), dft_expected, 4), "the default flag appends");
+    sap_free_result(&res);
+
+    char *dft_only[] = {"tool", "add", "x", "y", NULL};
+    expect(sap_parse(4, dft_only, &res) == 0 && same_list(sap_get_value(&res, "items"), dft_only + 2, 2), "the default flag alone");
+    sap_free_result(&res);
+}
+
+static void test_chunks(void) {
+    SAPParseResult res;
+    static char *line[2 * LONG_LIST + 2];
+    static char names[LONG_LIST][8];
+
+    /* "-I n" repeated, the list is far larger than the first chunk of the arena */
+    line[0] = "tool";
+    for (int i = 0; i < LONG_LIST; i++) {
+        snprintf(names[i], sizeof(names[i]), "%d", i);
+        line[1 + 2 * i] = "-I";
+        line[2 + 2 * i] = names[i];
+    }
+    line[1 + 2 * LONG_LIST] = NULL;
+
+    char **expected = (char **) malloc(sizeof(char *) * LONG_LIST);
+    for (int i = 0; i < LONG_LIST; i++) {
+        expected[i] = names[i];
+    }
+    expect(sap_parse(1 + 2 * LONG_LIST, line, &res) == 0, "a long list");
+    expect(same_list(sap_get_value(&res, "include"), expected, LONG_LIST), "the long list is whole and in order");
+    sap_free_result(&res);
+
+    /* the same count of no_arg occurrences */
+    for (int i = 1; i <= LONG_LIST; i++) {
+        line[i] = "-v";
+    }
+    line[LONG_LIST + 1] = NULL;
+    expect(sap_parse(1 + LONG_LIST, line, &res) == 0 && *(int *) sap_get_value(&res, "verbose") == LONG_LIST, "a long count");
+    sap_free_result(&res);
+    free(expected);
+}
+
+int main(void) {
+    build_tree();
+    test_count();
+    test_append();
+    test_chunks();
+    free_root_cmd();
+    printf("repeat test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
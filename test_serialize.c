@@ -0,0 +1,387 @@
+/**
+ * @file test_serialize.c
+ * @brief the test of the serialisation of the parse results of scap.c
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_serialize
+ * the JSON of the single, multi, counted, appended and choice values, of the positional slots and the tail, and of
+ * the escaped strings, the binary records read back into the same results (their JSON compared), the records
+ * batched in one buffer, and the malformed records: truncated, of another version, naming an unknown command, flag
+ * or slot, of another flag type, with a value that isn't a choice or of the type of its slot, with more arguments
+ * than a slot takes, and with trailing bytes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static SAPCommand buildCmd, execCmd, copyCmd, sumCmd, runCmd;
+static Flag verbose, force, jobs, tags, include, mode, output, quiet;
+
+static void build_tree(void) {
+    static const char *modes[] = {"fast", "slow", NULL};
+    init_root_cmd("tool", "the serialisation", NULL, NULL);
+
+    init_sap_command(&buildCmd, "build", "every kind of value", NULL, NULL);
+    init_flag(&verbose, "verbose", 'v', "a counted flag", NULL);
+    set_flag_type(&verbose, no_arg);
+    set_flag_repeat(&verbose, repeat_count);
+    init_flag(&force, "force", 'f', "a switch", NULL);
+    set_flag_type(&force, no_arg);
+    init_flag(&jobs, "jobs", 'j', "a single value", "1");
+    init_flag(&tags, "tag", 't', "an appended value", NULL);
+    set_flag_repeat(&tags, repeat_append);
+    init_flag(&include, "include", 'I', "multiple values", NULL);
+    set_flag_type(&include, multi_arg);
+    init_flag(&mode, "mode", 'm', "a choice", "fast");
+    set_flag_choices(&mode, modes);
+    init_flag(&output, "output", 'o', "a value never given", NULL);
+    add_flag(&buildCmd, &verbose);
+    add_flag(&buildCmd, &force);
+    add_flag(&buildCmd, &jobs);
+    add_flag(&buildCmd, &tags);
+    add_flag(&buildCmd, &include);
+    add_flag(&buildCmd, &mode);
+    add_flag(&buildCmd, &output);
+    add_subcmd(&rootCmd, &buildCmd);
+
+    init_sap_command(&execCmd, "exec", "parses its own arguments", NULL, NULL);
+    set_cmd_self_parse(&execCmd, NULL);
+    add_subcmd(&rootCmd, &execCmd);
+
+    /* copy <src> [dst], sum <nums>..., run [-q] -- <command>... */
+    init_sap_command(&copyCmd, "copy", "the positional slots", NULL, NULL);
+    expect(add_positional(&copyCmd, "src", "the source", pos_string, 1, 1) == 0, "the slot src");
+    expect(add_positional(&copyCmd, "dst", "the destination", pos_string, 0, 1) == 1, "the slot dst");
+    add_subcmd(&rootCmd, &copyCmd);
+    init_sap_command(&sumCmd, "sum", "a variadic slot", NULL, NULL);
+    expect(add_positional(&sumCmd, "nums", "the numbers", pos_int, 1, -1) == 0, "the slot nums");
+    add_subcmd(&rootCmd, &sumCmd);
+    init_sap_command(&runCmd, "run", "a passthrough command", NULL, NULL);
+    set_cmd_passthrough(&runCmd, 1);
+    init_flag(&quiet, "quiet", 'q', "print less", NULL);
+    set_flag_type(&quiet, no_arg);
+    add_flag(&runCmd, &quiet);
+    add_subcmd(&rootCmd, &runCmd);
+}
+
+/**
+ * @brief the JSON of a parse result, null-terminated, free it.
+ */
+static char *to_json(const SAPParseResult *res) {
+    SAPMemBuf mem = {0};
+    SAPOutput out;
+    sap_output_mem(&out, &mem);
+    size_t len = sap_write_json(res, &out);
+    sap_output_free(&out);
+    expect(len == mem.len, "the length of the JSON");
+    return mem.data;
+}
+
+/**
+ * @brief the record of a parse result, free it.
+ */
+static char *to_record(const SAPParseResult *res, size_t *len) {
+    SAPMemBuf mem = {0};
+    SAPOutput out;
+    sap_output_mem(&out, &mem);
+    *len = sap_write_record(res, &out);
+    sap_output_free(&out);
+    expect(*len == mem.len, "the length of the record");
+    return mem.data;
+}
+
+static void test_json(void) {
+    SAPParseResult res;
+    char *line[] = {"tool", "build", "-vvv", "--force", "-j", "4", "--tag", "a", "-tb", "--mode", "slow",
+                    "-I", "x", "y", NULL};
+    expect(sap_parse(14, line, &res) == 0, "the parse of every kind of value");
+    char *json = to_json(&res);
+    expect(strcmp(json, "{\"cmd\":[\"tool\",\"build\"],\"flags\":{\"help\":false,\"verbose\":3,\"force\":true,"
+                        "\"jobs\":\"4\",\"tag\":[\"a\",\"b\"],\"include\":[\"x\",\"y\"],\"mode\":\"slow\","
+                        "\"output\":null}}\n") == 0, "the JSON of every kind of value");
+    free(json);
+    sap_free_result(&res);
+
+    /* the quotes, the backslashes and the control characters are escaped */
+    char *escaped[] = {"tool", "build", "--jobs", "a\"b\\c\nd\te\rf\001g\037", NULL};
+    expect(sap_parse(4, escaped, &res) == 0, "the parse of the special characters");
+    json = to_json(&res);
+    expect(strstr(json, "\"jobs\":\"a\\\"b\\\\c\\nd\\te\\rf\\u0001g\\u001f\"") != NULL, "the escaped string");
+    expect(strstr(json, "\"verbose\":0,\"force\":false") != NULL, "a counted flag not given is 0");
+    free(json);
+    sap_free_result(&res);
+
+    /* the arguments of a command parsing them by itself */
+    char *self[] = {"tool", "exec", "--any", "thing", NULL};
+    expect(sap_parse(4, self, &res) == 0, "the parse of the own arguments");
+    json = to_json(&res);
+    expect(strcmp(json, "{\"cmd\":[\"tool\",\"exec\"],\"flags\":{},\"args\":[\"--any\",\"thing\"]}\n") == 0,
+           "the JSON of the own arguments");
+    free(json);
+    sap_free_result(&res);
+
+    /* the positional slots by name and the tail */
+    char *copy[] = {"tool", "copy", "a b", NULL};
+    expect(sap_parse(3, copy, &res) == 0, "the parse of the slots");
+    json = to_json(&res);
+    expect(strcmp(json, "{\"cmd\":[\"tool\",\"copy\"],\"flags\":{\"help\":false},"
+                        "\"positionals\":{\"src\":\"a b\",\"dst\":null}}\n") == 0, "the JSON of the slots");
+    free(json);
+    sap_free_result(&res);
+    char *sum[] = {"tool", "sum", "1", "22", NULL};
+    expect(sap_parse(4, sum, &res) == 0, "the parse of a variadic slot");
+    json = to_json(&res);
+    expect(strstr(json, "\"positionals\":{\"nums\":[\"1\",\"22\"]}") != NULL, "the JSON of a variadic slot");
+    free(json);
+    sap_free_result(&res);
+    char *run[] = {"tool", "run", "-q", "--", "make", "-j8", NULL};
+    expect(sap_parse(6, run, &res) == 0, "the parse of the tail");
+    json = to_json(&res);
+    expect(strcmp(json, "{\"cmd\":[\"tool\",\"run\"],\"flags\":{\"help\":false,\"quiet\":true},"
+                        "\"tail\":[\"make\",\"-j8\"]}\n") == 0, "the JSON of the tail");
+    free(json);
+    sap_free_result(&res);
+
+    /* an error */
+    char *bad[] = {"tool", "build", "--mode", "slower", NULL};
+    expect(sap_parse(4, bad, &res) != 0, "the parse of a bad choice");
+    json = to_json(&res);
+    expect(strstr(json, "\"error\":{\"code\":") != NULL && strstr(json, "\"argv_idx\":3") != NULL,
+           "the JSON of an error");
+    free(json);
+    sap_free_result(&res);
+}
+
+/**
+ * @brief parse a command line, write its record and read it back, both results must have the same JSON.
+ */
+static void check_round_trip(char *line[], const char *what) {
+    int argc = 0;
+    while (line[argc] != NULL) {
+        argc++;
+    }
+    SAPParseResult res, back;
+    sap_parse(argc, line, &res);
+    size_t len, used = 0;
+    char *record = to_record(&res, &len);
+    int ret = sap_read_record(record, len, &back, &used);
+    expect(ret == 0 && used == len, what);
+    if (ret == 0) {
+        char *json = to_json(&res), *back_json = to_json(&back);
+        expect(strcmp(json, back_json) == 0, what);
+        expect(back.err.code == res.err.code && back.err.argv_idx == res.err.argv_idx &&
+               back.err.byte_offset == res.err.byte_offset, what);
+        free(json);
+        free(back_json);
+        sap_free_result(&back);
+    }
+    free(record);
+    sap_free_result(&res);
+}
+
+static void test_round_trip(void) {
+    char *every[] = {"tool", "build", "-vvv", "--force", "-j", "4", "--tag", "a", "-tb", "--mode", "slow",
+                     "-I", "x", "y", NULL};
+    check_round_trip(every, "the record of every kind of value");
+    char *defaults[] = {"tool", "build", NULL};
+    check_round_trip(defaults, "the record of the defaults");
+    char *single[] = {"tool", "build", "-v", "-I", "only", NULL};
+    check_round_trip(single, "the record of a single count and list item");
+    char *escaped[] = {"tool", "build", "--jobs", "a\"b\\c\nd\001", NULL};
+    check_round_trip(escaped, "the record of the special characters");
+    char *self[] = {"tool", "exec", "--any", "thing", NULL};
+    check_round_trip(self, "the record of the own arguments");
+    char *root[] = {"tool", NULL};
+    check_round_trip(root, "the record of the root");
+    char *bad[] = {"tool", "build", "--mode", "slower", NULL};
+    check_round_trip(bad, "the record of an error");
+    char *copy[] = {"tool", "copy", "a", "b", NULL};
+    check_round_trip(copy, "the record of the slots");
+    char *optional[] = {"tool", "copy", "a", NULL};
+    check_round_trip(optional, "the record of an empty slot");
+    char *sum[] = {"tool", "sum", "1", "2", "3", NULL};
+    check_round_trip(sum, "the record of a variadic slot");
+    char *typed[] = {"tool", "sum", "1", "x", NULL};
+    check_round_trip(typed, "the record of an argument of the wrong type");
+    char *run[] = {"tool", "run", "-q", "--", "make", "-j8", "--", "all", NULL};
+    check_round_trip(run, "the record of the tail");
+    char *empty_tail[] = {"tool", "run", "--", NULL};
+    check_round_trip(empty_tail, "the record of an empty tail");
+    char *no_tail[] = {"tool", "run", NULL};
+    check_round_trip(no_tail, "the record without a tail");
+
+    /* the slots and the tail read back */
+    SAPParseResult slots;
+    sap_parse(5, sum, &slots);
+    size_t slots_len;
+    char *slots_record = to_record(&slots, &slots_len);
+    sap_free_result(&slots);
+    expect(sap_read_record(slots_record, slots_len, &slots, NULL) == 0, "the record of the slots is read");
+    char **nums = (char **) sap_get_positional(&slots, 0);
+    expect(slots.pos_cnt == 3 && nums != NULL && strcmp(nums[2], "3") == 0 && nums[3] == NULL, "the variadic slot");
+    sap_free_result(&slots);
+    free(slots_record);
+    sap_parse(8, run, &slots);
+    slots_record = to_record(&slots, &slots_len);
+    sap_free_result(&slots);
+    expect(sap_read_record(slots_record, slots_len, &slots, NULL) == 0, "the record of the tail is read");
+    expect(slots.tail_argc == 4 && strcmp(slots.tail_argv[0], "make") == 0 && strcmp(slots.tail_argv[3], "all") == 0 &&
+           slots.tail_argv[4] == NULL, "the tail");
+    sap_free_result(&slots);
+    free(slots_record);
+
+    /* the values read back point into the record */
+    SAPParseResult res, back;
+    sap_parse(14, every, &res);
+    size_t len;
+    char *record = to_record(&res, &len);
+    expect(sap_read_record(record, len, &back, NULL) == 0, "the record is read");
+    const char *jobs_value = (const char *) sap_get_value(&back, "jobs");
+    const char *mode_value = (const char *) sap_get_value(&back, "mode");
+    expect(jobs_value >= record && jobs_value < record + len && strcmp(jobs_value, "4") == 0, "a value in place");
+    expect(mode_value != NULL && strcmp(mode_value, "slow") == 0, "the choice");
+    expect(sap_get_value(&back, "output") == NULL, "a value never given");
+    sap_free_result(&back);
+    free(record);
+    sap_free_result(&res);
+}
+
+static void test_batch(void) {
+    char *first[] = {"tool", "build", "-vv", NULL};
+    char *second[] = {"tool", "exec", "x", NULL};
+    SAPParseResult res;
+    SAPMemBuf mem = {0};
+    SAPOutput out;
+    sap_output_mem(&out, &mem);
+    sap_parse(3, first, &res);
+    size_t first_len = sap_write_record(&res, &out);
+    sap_free_result(&res);
+    sap_parse(3, second, &res);
+    size_t second_len = sap_write_record(&res, &out);
+    sap_free_result(&res);
+    sap_output_free(&out);
+
+    size_t used;
+    expect(sap_read_record(mem.data, mem.len, &res, &used) == 0 && used == first_len && res.cmd == &buildCmd,
+           "the first record of a batch");
+    sap_free_result(&res);
+    expect(sap_read_record(mem.data + used, mem.len - used, &res, &used) == 0 && used == second_len &&
+           res.cmd == &execCmd, "the second record of a batch");
+    sap_free_result(&res);
+    sap_mem_buf_free(&mem);
+}
+
+/**
+ * @brief replace the first $len bytes equal to $from in a record by $to.
+ */
+static void patch(char *record, size_t record_len, const char *from, const char *to, size_t len) {
+    for (size_t i = 0; i + len <= record_len; i++) {
+        if (memcmp(record + i, from, len) == 0) {
+            memcpy(record + i, to, len);
+            return;
+        }
+    }
+    expect(0, "the patched bytes are in the record");
+}
+
+/**
+ * @brief whether a record is rejected and leaves an empty result.
+ */
+static int rejected(const char *record, size_t len) {
+    SAPParseResult res;
+    memset(&res, 0xff, sizeof(res));
+    int ret = sap_read_record(record, len, &res, NULL);
+    int empty = res.cmd == NULL && res.argv == NULL && res.arena.chunks == NULL;
+    if (ret == 0) {
+        sap_free_result(&res);
+    }
+    return ret == -1 && empty;
+}
+
+static void test_bad_record(void) {
+    char *line[] = {"tool", "build", "-j", "4", "--mode", "slow", NULL};
+    SAPParseResult res;
+    sap_parse(6, line, &res);
+    size_t len;
+    char *record = to_record(&res, &len);
+    sap_free_result(&res);
+    char *copy = (char *) malloc(len + 1);
+
+    /* truncated: the length, the body */
+    expect(rejected(record, 3), "a truncated length");
+    expect(rejected(record, len - 1), "a truncated body");
+
+    memcpy(copy, record, len);
+    copy[4] = 99;
+    expect(rejected(copy, len), "another version");
+
+    memcpy(copy, record, len);
+    patch(copy, len, "build", "bxild", 5);
+    expect(rejected(copy, len), "an unknown command");
+
+    memcpy(copy, record, len);
+    patch(copy, len, "jobs", "jabs", 4);
+    expect(rejected(copy, len), "an unknown flag");
+
+    /* the byte after the name of the flag is its type */
+    memcpy(copy, record, len);
+    patch(copy, len, "jobs\0\0", "jobs\0\1", 6);
+    expect(rejected(copy, len), "another flag type");
+
+    memcpy(copy, record, len);
+    patch(copy, len, "slow", "slaw", 4);
+    expect(rejected(copy, len), "a value that isn't a choice");
+
+    /* a byte more than the body holds */
+    memcpy(copy, record, len);
+    copy[0] = (char) (copy[0] + 1);
+    copy[len] = 0;
+    expect(rejected(copy, len + 1), "the trailing bytes");
+
+    memcpy(copy, record, len);
+    expect(!rejected(copy, len), "the record itself is read");
+    free(copy);
+    free(record);
+
+    /* the slots: an unknown name, more arguments than a slot takes, an argument of another type */
+    char *slots[] = {"tool", "copy", "a", "b", NULL};
+    sap_parse(4, slots, &res);
+    record = to_record(&res, &len);
+    sap_free_result(&res);
+    copy = (char *) malloc(len);
+    memcpy(copy, record, len);
+    patch(copy, len, "dst", "dsx", 3);
+    expect(rejected(copy, len), "an unknown slot");
+    memcpy(copy, record, len);
+    patch(copy, len, "dst\0\1", "dst\0\2", 5);
+    expect(rejected(copy, len), "two arguments of a slot taking one");
+    free(copy);
+    free(record);
+
+    char *nums[] = {"tool", "sum", "1", "2", NULL};
+    sap_parse(4, nums, &res);
+    record = to_record(&res, &len);
+    sap_free_result(&res);
+    patch(record, len, "2\0", "x\0", 2);
+    expect(rejected(record, len), "an argument of another type");
+    free(record);
+}
+
+int main(void) {
+    build_tree();
+    test_json();
+    test_round_trip();
+    test_batch();
+    test_bad_record();
+    free_root_cmd();
+    printf("serialize test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
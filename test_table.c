@@ -0,0 +1,257 @@
+/**
+ * @file test_table.c
+ * @brief the test of the subtrees added from tables by add_subcmd_table
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_table
+ * a subtree with its flags added from tables and parsed, the children arrays moved out of the block by a later
+ * add_subcmd, a table command freed by free_sap_command, and the tables rejected with nothing changed: a bad parent
+ * or owner index, a command in a tree or given twice, more than MAX_SUBCMD_COUNT subcommands, more than
+ * MAX_OPT_COUNT flags and deeper than MAX_CMD_DEPTH, the commands linked before a rejected one unlinked again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static SAPCommand aCmd, bCmd, a1Cmd, a2Cmd, a3Cmd, leafCmd, b1Cmd, b2Cmd, b3Cmd, b4Cmd;
+static SAPCommand xCmd, yCmd, wCmd;
+#define POOL_SIZE (MAX_SUBCMD_COUNT + MAX_CMD_DEPTH)
+static SAPCommand pool[POOL_SIZE];
+static Flag aFlag, leafFlag, b1Flag, b2Flag, xFlag, yFlag;
+static Flag optFlags[MAX_OPT_COUNT + 1];
+static char poolNames[POOL_SIZE][16], optNames[MAX_OPT_COUNT + 1][16];
+
+static int parses_to(char *line[], const SAPCommand *cmd) {
+    int argc = 0;
+    while (line[argc] != NULL) {
+        argc++;
+    }
+    SAPParseResult res;
+    int ok = sap_parse(argc, line, &res) == 0 && res.cmd == cmd;
+    sap_free_result(&res);
+    return ok;
+}
+
+static int child_at(const SAPCommand *parent, int i, const SAPCommand *child) {
+    return i < parent->tree_node.child_cnt && parent->tree_node.children[i] == &child->tree_node;
+}
+
+static void test_build(void) {
+    init_root_cmd("tool", "the subtrees from tables", NULL, NULL);
+    init_sap_command(&aCmd, "a", "a command", NULL, NULL);
+    init_sap_command(&bCmd, "b", "a command", NULL, NULL);
+    init_sap_command(&a1Cmd, "a1", "a subcommand", NULL, NULL);
+    init_sap_command(&a2Cmd, "a2", "a subcommand", NULL, NULL);
+    init_sap_command(&leafCmd, "leaf", "a leaf", NULL, NULL);
+    init_sap_command(&b1Cmd, "b1", "a subcommand", NULL, NULL);
+    init_sap_command(&b2Cmd, "b2", "a subcommand", NULL, NULL);
+    init_sap_command(&b3Cmd, "b3", "a subcommand", NULL, NULL);
+    init_flag(&aFlag, "all", 'a', "a flag of a", NULL);
+    set_flag_type(&aFlag, no_arg);
+    init_flag(&leafFlag, "name", 'n', "a flag of leaf", NULL);
+    init_flag(&b1Flag, "one", '1', "a flag of b", NULL);
+    set_flag_type(&b1Flag, no_arg);
+    init_flag(&b2Flag, "two", '2', "a flag of b", NULL);
+    set_flag_type(&b2Flag, no_arg);
+
+    /* tool {a {a1 {leaf}, a2}, b {b1, b2, b3}}, the flags in any order */
+    SAPCommand *cmds[] = {&aCmd, &bCmd, &a1Cmd, &a2Cmd, &leafCmd, &b1Cmd, &b2Cmd, &b3Cmd};
+    int parents[] = {-1, -1, 0, 0, 2, 1, 1, 1};
+    Flag *flags[] = {&b2Flag, &leafFlag, &aFlag, &b1Flag};
+    int owners[] = {1, 4, 0, 1};
+    int top_cnt = rootCmd.tree_node.child_cnt;
+    expect(add_subcmd_table(&rootCmd, cmds, parents, 8, flags, owners, 4) == 0, "the table is added");
+    expect(rootCmd.tree_node.child_cnt == top_cnt + 2 && child_at(&rootCmd, top_cnt, &aCmd) &&
+           child_at(&rootCmd, top_cnt + 1, &bCmd), "the commands of the root, in order");
+    expect(child_at(&aCmd, 0, &a1Cmd) && child_at(&aCmd, 1, &a2Cmd) && child_at(&a1Cmd, 0, &leafCmd) &&
+           child_at(&bCmd, 2, &b3Cmd), "the subcommands, in order");
+    expect(leafCmd.tree_node.depth == 3 && leafCmd.tree_node.parent == &a1Cmd.tree_node, "the depth and the parent");
+    expect(aCmd.tree_node.in_block && bCmd.tree_node.in_block && a1Cmd.tree_node.in_block &&
+           !leafCmd.tree_node.in_block && leafCmd.tree_node.children == NULL, "the children arrays in the block");
+    expect(bCmd.flag_cnt == 3 && bCmd.flags[1] == &b2Flag && bCmd.flags[2] == &b1Flag, "the flags of b, in order");
+
+    char *leaf_line[] = {"tool", "a", "a1", "leaf", "--name", "x", NULL};
+    char *b_line[] = {"tool", "b", "-12", NULL};
+    char *b3_line[] = {"tool", "b", "b3", NULL};
+    expect(parses_to(leaf_line, &leafCmd), "the parse of a nested table command");
+    expect(parses_to(b_line, &bCmd), "the parse of the flags of a table command");
+    expect(parses_to(b3_line, &b3Cmd), "the parse of the last subcommand");
+
+    /* b has room for a 4th child in its block, a has none for a 3rd: its array is moved out */
+    init_sap_command(&b4Cmd, "b4", "a subcommand", NULL, NULL);
+    init_sap_command(&a3Cmd, "a3", "a subcommand", NULL, NULL);
+    TreeNode **b_children = bCmd.tree_node.children;
+    expect(add_subcmd(&bCmd, &b4Cmd) != NULL && bCmd.tree_node.children == b_children && bCmd.tree_node.in_block,
+           "a child added in the room of the block");
+    expect(add_subcmd(&aCmd, &a3Cmd) != NULL && !aCmd.tree_node.in_block, "the children array moved out");
+    expect(child_at(&aCmd, 0, &a1Cmd) && child_at(&aCmd, 1, &a2Cmd) && child_at(&aCmd, 2, &a3Cmd),
+           "the children moved in order");
+    char *a3_line[] = {"tool", "a", "a3", NULL};
+    char *b4_line[] = {"tool", "b", "b4", NULL};
+    expect(parses_to(a3_line, &a3Cmd) && parses_to(b4_line, &b4Cmd) && parses_to(leaf_line, &leafCmd),
+           "the parse after the children are added");
+
+    /* a table command freed by itself: its own array and a part of the block */
+    int child_cnt = rootCmd.tree_node.child_cnt;
+    free_sap_command(&aCmd);
+    free_sap_command(&bCmd);
+    char *a_line[] = {"tool", "a", NULL};
+    SAPParseResult res;
+    expect(sap_parse(2, a_line, &res) != 0 && res.err.code == unknown_cmd, "a freed command is gone");
+    sap_free_result(&res);
+    expect(rootCmd.tree_node.child_cnt == child_cnt - 2, "the freed commands are removed");
+    free_root_cmd();
+}
+
+/**
+ * @brief whether a rejected table left the commands out of the tree, with their own flags only.
+ */
+static int untouched(SAPCommand *cmds[], int cnt, int top_cnt) {
+    int ok = rootCmd.tree_node.child_cnt == top_cnt;
+    for (int i = 0; i < cnt; i++) {
+        if (cmds[i] == &wCmd) {
+            continue;   /* in the tree before */
+        }
+        ok = ok && cmds[i]->tree_node.parent == NULL && cmds[i]->tree_node.child_cnt == 0 &&
+             cmds[i]->tree_node.children == NULL && cmds[i]->flag_cnt == 1;
+    }
+    return ok;
+}
+
+static void test_invalid(void) {
+    init_root_cmd("tool", "the invalid tables", NULL, NULL);
+    init_sap_command(&xCmd, "x", "a command", NULL, NULL);
+    init_sap_command(&yCmd, "y", "a command", NULL, NULL);
+    init_sap_command(&wCmd, "w", "a command in the tree", NULL, NULL);
+    add_subcmd(&rootCmd, &wCmd);
+    init_flag(&xFlag, "ex", 'x', "a flag of x", NULL);
+    init_flag(&yFlag, "why", 'y', "a flag of y", NULL);
+    int top_cnt = rootCmd.tree_node.child_cnt;
+
+    SAPCommand *two[] = {&xCmd, &yCmd};
+    Flag *flags[] = {&xFlag, &yFlag};
+    int forward[] = {-1, 1}, below[] = {-2, -1}, owners[] = {0, 1}, bad_owners[] = {0, 2};
+    int fine[] = {-1, 0};
+    expect(add_subcmd_table(&rootCmd, two, forward, 2, flags, owners, 2) == -1 && untouched(two, 2, top_cnt),
+           "a parent index not before the command");
+    expect(add_subcmd_table(&rootCmd, two, below, 2, flags, owners, 2) == -1 && untouched(two, 2, top_cnt),
+           "a parent index below -1");
+    expect(add_subcmd_table(&rootCmd, two, fine, 2, flags, bad_owners, 2) == -1 && untouched(two, 2, top_cnt),
+           "an owner index out of the table");
+
+    /* x and y are linked with their flags before x comes again, then unlinked */
+    SAPCommand *twice[] = {&xCmd, &yCmd, &xCmd};
+    int twice_parents[] = {-1, 0, -1};
+    expect(add_subcmd_table(&rootCmd, twice, twice_parents, 3, flags, owners, 2) == -1 &&
+           untouched(twice, 3, top_cnt), "a command given twice");
+
+    SAPCommand *in_tree[] = {&xCmd, &wCmd};
+    expect(add_subcmd_table(&rootCmd, in_tree, fine, 2, NULL, NULL, 0) == -1 && untouched(in_tree, 2, top_cnt),
+           "a command in a tree");
+    SAPCommand *itself[] = {&xCmd};
+    int top[] = {-1};
+    expect(add_subcmd_table(&xCmd, itself, top, 1, NULL, NULL, 0) == -1 && xCmd.tree_node.child_cnt == 0,
+           "a command under itself");
+
+    /* the rejected commands can be added afterwards */
+    expect(add_subcmd_table(&rootCmd, two, fine, 2, flags, owners, 2) == 0, "the commands added afterwards");
+    char *line[] = {"tool", "x", "y", "--why", "1", NULL};
+    expect(parses_to(line, &yCmd), "the parse of the commands added afterwards");
+    free_root_cmd();
+}
+
+/**
+ * @brief a fresh root and the first cnt commands of the pool, not in a tree.
+ */
+static void init_pool(int cnt) {
+    init_root_cmd("tool", "the limits of the tables", NULL, NULL);
+    for (int i = 0; i < cnt; i++) {
+        snprintf(poolNames[i], sizeof(poolNames[i]), "c%d", i);
+        init_sap_command(&pool[i], poolNames[i], "a command", NULL, NULL);
+    }
+}
+
+static void test_limits(void) {
+    SAPCommand *cmds[POOL_SIZE];
+    int parents[POOL_SIZE];
+    for (int i = 0; i < POOL_SIZE; i++) {
+        cmds[i] = &pool[i];
+    }
+
+    /* c0 with MAX_SUBCMD_COUNT + 1 subcommands, then MAX_SUBCMD_COUNT */
+    init_pool(MAX_SUBCMD_COUNT + 2);
+    for (int i = 0; i < MAX_SUBCMD_COUNT + 2; i++) {
+        parents[i] = (i == 0) ? -1 : 0;
+    }
+    int top_cnt = rootCmd.tree_node.child_cnt;
+    expect(add_subcmd_table(&rootCmd, cmds, parents, MAX_SUBCMD_COUNT + 2, NULL, NULL, 0) == -1 &&
+           untouched(cmds, MAX_SUBCMD_COUNT + 2, top_cnt), "more than MAX_SUBCMD_COUNT subcommands of a command");
+    expect(add_subcmd_table(&rootCmd, cmds, parents, MAX_SUBCMD_COUNT + 1, NULL, NULL, 0) == 0 &&
+           pool[0].tree_node.child_cnt == MAX_SUBCMD_COUNT, "MAX_SUBCMD_COUNT subcommands of a command");
+    free_root_cmd();
+
+    /* the root has its own subcommands already */
+    init_pool(MAX_SUBCMD_COUNT + 1);
+    for (int i = 0; i < MAX_SUBCMD_COUNT + 1; i++) {
+        parents[i] = -1;
+    }
+    top_cnt = rootCmd.tree_node.child_cnt;
+    int room = MAX_SUBCMD_COUNT - top_cnt;
+    expect(add_subcmd_table(&rootCmd, cmds, parents, room + 1, NULL, NULL, 0) == -1 && untouched(cmds, room + 1, top_cnt),
+           "more than MAX_SUBCMD_COUNT subcommands of the parent");
+    expect(add_subcmd_table(&rootCmd, cmds, parents, room, NULL, NULL, 0) == 0 &&
+           rootCmd.tree_node.child_cnt == MAX_SUBCMD_COUNT, "MAX_SUBCMD_COUNT subcommands of the parent");
+    free_root_cmd();
+
+    /* a chain one level too deep, then as deep as it can be */
+    init_pool(MAX_CMD_DEPTH);
+    for (int i = 0; i < MAX_CMD_DEPTH; i++) {
+        parents[i] = i - 1;
+    }
+    top_cnt = rootCmd.tree_node.child_cnt;
+    expect(add_subcmd_table(&rootCmd, cmds, parents, MAX_CMD_DEPTH, NULL, NULL, 0) == -1 &&
+           untouched(cmds, MAX_CMD_DEPTH, top_cnt), "deeper than MAX_CMD_DEPTH");
+    expect(add_subcmd_table(&rootCmd, cmds, parents, MAX_CMD_DEPTH - 1, NULL, NULL, 0) == 0 &&
+           pool[MAX_CMD_DEPTH - 2].tree_node.depth == MAX_CMD_DEPTH - 1, "as deep as MAX_CMD_DEPTH");
+    free_root_cmd();
+
+    /*
+     * MAX_OPT_COUNT + 1 flags in the table, then MAX_OPT_COUNT, which don't fit with the help flag of pool[1]:
+     * pool[0] is linked with its flag first, then unlinked
+     */
+    init_pool(2);
+    Flag *flags[MAX_OPT_COUNT + 2];
+    int owners[MAX_OPT_COUNT + 2];
+    for (int k = 0; k <= MAX_OPT_COUNT; k++) {
+        snprintf(optNames[k], sizeof(optNames[k]), "o%d", k);
+        init_flag(&optFlags[k], optNames[k], '\0', "a flag", NULL);
+        flags[k] = &optFlags[k];
+        owners[k] = 1;
+    }
+    flags[MAX_OPT_COUNT + 1] = &xFlag;
+    owners[MAX_OPT_COUNT + 1] = 0;
+    init_flag(&xFlag, "ex", 'x', "a flag of c0", NULL);
+    parents[0] = parents[1] = -1;
+    top_cnt = rootCmd.tree_node.child_cnt;
+    expect(add_subcmd_table(&rootCmd, cmds, parents, 2, flags, owners, MAX_OPT_COUNT + 1) == -1 &&
+           untouched(cmds, 2, top_cnt), "more than MAX_OPT_COUNT flags in the table");
+    expect(add_subcmd_table(&rootCmd, cmds, parents, 2, flags + 1, owners + 1, MAX_OPT_COUNT + 1) == -1 &&
+           untouched(cmds, 2, top_cnt), "more than MAX_OPT_COUNT flags with the help flag");
+    free_root_cmd();
+}
+
+int main(void) {
+    test_build();
+    test_invalid();
+    test_limits();
+    printf("table test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
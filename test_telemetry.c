@@ -0,0 +1,213 @@
+/**
+ * @file test_telemetry.c
+ * @brief the test of the usage telemetry of scap.c
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_telemetry
+ * the counters of a telemetry file aggregated across its opens (and a child process), the report of the
+ * reporting commands (--top), the reporting command added twice, and the files that aren't telemetry files.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <scap.h>
+
+#include "test_util.h"
+
+static SAPCommand runCmd, adminCmd;
+static Flag verbose, output;
+static char usagePath[] = "/tmp/scap_usage_XXXXXX";
+static char otherPath[] = "/tmp/scap_other_XXXXXX";
+
+static void build_tree(void) {
+    init_root_cmd("tool", "the usage telemetry", NULL, NULL);
+
+    init_sap_command(&runCmd, "run", "a counted command", NULL, void_exec);
+    init_flag(&verbose, "verbose", 'v', "a counted flag", NULL);
+    set_flag_type(&verbose, no_arg);
+    init_flag(&output, "output", 'o', "another counted flag", NULL);
+    add_flag(&runCmd, &verbose);
+    add_flag(&runCmd, &output);
+    add_subcmd(&rootCmd, &runCmd);
+
+    init_sap_command(&adminCmd, "admin", "holds the second reporting command", NULL, NULL);
+    add_subcmd(&rootCmd, &adminCmd);
+
+    /* each call adds a command of its own */
+    expect(add_telemetry_cmd(&rootCmd, "usage") == &rootCmd, "the reporting command of the root");
+    expect(add_telemetry_cmd(&adminCmd, "stats") == &adminCmd, "the reporting command of admin");
+}
+
+static int parse_once(int argc, char *argv[]) {
+    SAPParseResult res;
+    int ret = sap_parse(argc, argv, &res);
+    sap_free_result(&res);
+    return ret;
+}
+
+/**
+ * @brief run a command line by do_parse_subcmd, capture its output.
+ */
+static int run_captured(int argc, char *argv[], SAPMemBuf *out_mem, SAPMemBuf *err_mem) {
+    SAPOutput out, err;
+    sap_output_mem(&out, out_mem);
+    sap_output_mem(&err, err_mem);
+    sap_set_output(sap_out_channel, &out);
+    sap_set_output(sap_err_channel, &err);
+    int ret = do_parse_subcmd(argc, argv);
+    sap_set_output(sap_out_channel, NULL);
+    sap_set_output(sap_err_channel, NULL);
+    sap_output_free(&out);
+    sap_output_free(&err);
+    return ret;
+}
+
+static void test_commands(void) {
+    SAPParseResult res;
+    char *usage[] = {"tool", "usage", "--top", "2", NULL};
+    char *stats[] = {"tool", "admin", "stats", "-n", "3", NULL};
+
+    expect(sap_parse(4, usage, &res) == 0 && res.cmd != NULL && strcmp(res.cmd->name, "usage") == 0, "tool usage");
+    SAPCommand *root_usage = res.cmd;
+    expect(root_usage->tree_node.parent == &rootCmd.tree_node, "the parent of usage");
+    expect(strcmp((const char *) sap_get_value(&res, "top"), "2") == 0, "the --top of usage");
+    sap_free_result(&res);
+
+    expect(sap_parse(5, stats, &res) == 0 && res.cmd != NULL && strcmp(res.cmd->name, "stats") == 0, "tool admin stats");
+    expect(res.cmd != root_usage && res.cmd->tree_node.parent == &adminCmd.tree_node, "the second command is another one");
+    expect(strcmp((const char *) sap_get_value(&res, "top"), "3") == 0, "the --top of stats");
+    sap_free_result(&res);
+
+    /* no file is open yet */
+    SAPMemBuf out_mem = {0}, err_mem = {0};
+    expect(run_captured(4, usage, &out_mem, &err_mem) != 0, "no telemetry to report");
+    expect(err_mem.data != NULL && strcmp(err_mem.data, "No usage telemetry is open\n") == 0, "the message without telemetry");
+    sap_mem_buf_free(&out_mem);
+    sap_mem_buf_free(&err_mem);
+}
+
+static void test_aggregate(void) {
+    char *both[] = {"tool", "run", "-v", "-o", "x", NULL};
+    char *one[] = {"tool", "run", "--verbose", NULL};
+    char *none[] = {"tool", "run", NULL};
+
+    expect(sap_telemetry_open(usagePath) == 0, "the first open");
+    expect(parse_once(5, both) == 0 && parse_once(5, both) == 0, "the parses of the first open");
+    sap_telemetry_close();
+
+    /* another process adds to the same counters */
+    pid_t pid = fork();
+    if (pid == 0) {
+        int ok = sap_telemetry_open(usagePath) == 0 && parse_once(3, one) == 0;
+        _exit(ok ? 0 : 1);
+    }
+    int status = 1;
+    expect(pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0, "the child");
+
+    expect(sap_telemetry_open(usagePath) == 0, "the second open");
+    expect(parse_once(2, none) == 0, "the parse of the second open");
+
+    SAPMemBuf mem = {0};
+    SAPOutput out;
+    sap_output_mem(&out, &mem);
+    expect(sap_telemetry_report(&out, 3) == 3, "the top 3 entries");
+    sap_output_flush(&out);
+    const char *expected = "           4  tool run\n"
+                           "           3  tool run --verbose\n"
+                           "           2  tool run --output\n";
+    expect(mem.data != NULL && strcmp(mem.data, expected) == 0, "the counters are aggregated");
+    sap_output_free(&out);
+    sap_mem_buf_free(&mem);
+}
+
+static void test_report(void) {
+    SAPMemBuf out_mem = {0}, err_mem = {0};
+
+    char *top[] = {"tool", "usage", "--top", "2", NULL};
+    expect(run_captured(4, top, &out_mem, &err_mem) == 0, "tool usage --top 2");
+    const char *expected = "           4  tool run\n"
+                           "           3  tool run --verbose\n";
+    expect(out_mem.data != NULL && strcmp(out_mem.data, expected) == 0, "the report of --top 2");
+    sap_mem_buf_free(&out_mem);
+
+    /* the reporting commands are counted as well, 0 writes all the entries */
+    char *all[] = {"tool", "admin", "stats", "-n", "0", NULL};
+    expect(run_captured(5, all, &out_mem, &err_mem) == 0, "tool admin stats -n 0");
+    expect(out_mem.data != NULL && strstr(out_mem.data, "           1  tool usage --top\n") != NULL, "the count of usage --top");
+    expect(out_mem.data != NULL && strstr(out_mem.data, "           1  tool admin stats --top\n") != NULL, "the count of stats --top");
+    expect(out_mem.data != NULL && strstr(out_mem.data, "           0  tool run --help\n") != NULL, "the flags never given");
+    sap_mem_buf_free(&out_mem);
+
+    char *dft[] = {"tool", "usage", NULL};
+    expect(run_captured(2, dft, &out_mem, &err_mem) == 0, "tool usage");
+    int lines = 0;
+    for (const char *p = out_mem.data; p != NULL && (p = strchr(p, '\n')) != NULL; p++) {
+        lines++;
+    }
+    expect(lines == 10, "10 entries by default");
+    sap_mem_buf_free(&out_mem);
+    sap_mem_buf_free(&err_mem);
+}
+
+static void test_rejection(void) {
+    struct stat st;
+    expect(stat(usagePath, &st) == 0, "the size of a telemetry file");
+
+    /* a file of another size, left as it is */
+    int fd = open(otherPath, O_WRONLY | O_TRUNC);
+    const char *text = "not a telemetry file\n";
+    expect(fd >= 0 && write(fd, text, strlen(text)) == (ssize_t) strlen(text), "the text of the other file");
+    close(fd);
+    expect(sap_telemetry_open(otherPath) == -1, "a file of another size");
+    struct stat other;
+    expect(stat(otherPath, &other) == 0 && other.st_size == (off_t) strlen(text), "the other file isn't truncated");
+
+    /* a file of the same size without the magic */
+    fd = open(otherPath, O_WRONLY | O_TRUNC);
+    char *junk = (char *) malloc((size_t) st.st_size);
+    memset(junk, 'x', (size_t) st.st_size);
+    expect(fd >= 0 && write(fd, junk, (size_t) st.st_size) == (ssize_t) st.st_size, "the junk of the other file");
+    close(fd);
+    free(junk);
+    expect(sap_telemetry_open(otherPath) == -1, "a file without the magic");
+
+    /* the open file is kept */
+    SAPMemBuf mem = {0};
+    SAPOutput out;
+    sap_output_mem(&out, &mem);
+    expect(sap_telemetry_report(&out, 1) == 1, "the open file is kept");
+    sap_output_flush(&out);
+    expect(mem.data != NULL && strcmp(mem.data, "           4  tool run\n") == 0, "the counters of the open file");
+    sap_output_free(&out);
+    sap_mem_buf_free(&mem);
+}
+
+int main(void) {
+    int fd = mkstemp(usagePath);    /* empty, sap_telemetry_open sizes it */
+    expect(fd >= 0, "the telemetry file");
+    close(fd);
+    fd = mkstemp(otherPath);
+    expect(fd >= 0, "the other file");
+    close(fd);
+
+    build_tree();
+    test_commands();
+    test_aggregate();
+    test_report();
+    test_rejection();
+    sap_telemetry_close();
+    free_root_cmd();
+    unlink(usagePath);
+    unlink(otherPath);
+    printf("telemetry test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}
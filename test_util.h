@@ -0,0 +1,33 @@
+/**
+ * @file test_util.h
+ * @brief the helper shared by the tests of scap
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * every test counts its failed expectations and exits with 1 if any, included once by the test program.
+ * the count is atomic, so the threads of a test may expect as well.
+ */
+
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <stdio.h>
+
+static int failures = 0;
+
+/**
+ * @brief count a failed expectation and print what it was.
+ *
+ * @param[in] ok - nonzero if the expectation holds
+ * @param[in] what - what was expected
+ */
+static void expect(int ok, const char *what) {
+    if (!ok) {
+        printf("failed: %s\n", what);
+        __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+    }
+}
+
+#endif /* TEST_UTIL_H */
@@ -0,0 +1,135 @@
+/**
+ * @file test_wrapper.cpp
+ * @brief the test of the c++ wrapper scap.hpp
+ * @author Fendy (xingfen.star@gmail.com)
+ * @version 1.0
+ * @date 2025-03-30
+ * @copyright Copyright (c) 2025
+ *
+ * usage: test_wrapper
+ * the typed values of the results, a flag read from several commands, an unknown command reported by exec, and the teardown of a tree
+ * whose root, commands and flags are destroyed in any order.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include <scap.hpp>
+
+#include "test_util.h"
+
+static char *line_build[] = {
+    (char *) "make", (char *) "build", (char *) "-v", (char *) "--jobs", (char *) "8", (char *) "a.c", (char *) "b.c", nullptr
+};
+static char *line_clean[] = {(char *) "make", (char *) "clean", (char *) "--jobs", (char *) "2", (char *) "-v", nullptr};
+
+static void test_values() {
+    scap::Root root("make", "a build tool");
+    scap::Command build("build", "build the targets");
+    scap::Command clean("clean", "remove the outputs");
+    scap::Flag<bool> verbose("verbose", 'v', "print more");
+    scap::Flag<int> jobs("jobs", 'j', "the number of jobs", 1);
+    scap::Flag<scap::Args> inputs("inputs", 'i', "the input files");
+    scap::Flag<bool> dry("dry", 'n', "only a flag of clean");
+
+    build.add(verbose).add(jobs).add_default(inputs);
+    clean.add(dry).add(jobs).add(verbose);     /* other positions than in build */
+    root.add(build).add(clean);
+
+    /* the cached position of a flag is checked against each command */
+    for (int round = 0; round < 2; round++) {
+        scap::Result res = root.parse(7, line_build);
+        expect(res.ok() && res[jobs] == 8 && res[verbose] && res[inputs].size() == 2, "the values of build");
+        expect(res[inputs][1] == "b.c" && !res.has(dry), "the list and a flag of another command");
+
+        scap::Result other = root.parse(5, line_clean);
+        expect(other.ok() && other[jobs] == 2 && other[verbose] && !other[dry], "the values of clean");
+        expect(other.raw_value(jobs) == line_clean[3] && other.raw_value(inputs) == nullptr, "the raw values of clean");
+    }
+
+    char *bad[] = {(char *) "make", (char *) "build", (char *) "--jobs", (char *) "x", nullptr};
+    scap::Result res = root.parse(4, bad);
+    expect(res.ok() && !res.valid(jobs) && res[jobs] == 1, "a malformed value reads as the default");
+
+    /* exec reports an unknown command through the error sink */
+    static int reported = 0;
+    sap_set_error_sink([](const SAPParseResult *r, void *) { reported += (r->err.code == unknown_cmd); }, nullptr);
+    char *nope[] = {(char *) "make", (char *) "nope", nullptr};
+    scap::Result unknown = root.parse(2, nope);
+    expect(unknown.exec() == -1 && reported == 1, "exec reports an unknown command");
+    sap_set_error_sink(nullptr, nullptr);
+}
+
+/**
+ * @brief build a tree from heap objects, destroy them in the given order, then parse with a new tree.
+ *
+ * the order is a permutation of: 0 the root, 1 the command, 2 the subcommand, 3 the flag, 4 the persist flag.
+ */
+static void test_teardown(const int order[5], const char *what) {
+    auto root = std::make_unique<scap::Root>("tool", "the teardown");
+    auto cmd = std::make_unique<scap::Command>("cmd", "a command");
+    auto sub = std::make_unique<scap::Command>("sub", "a subcommand");
+    auto flag = std::make_unique<scap::Flag<int>>("num", 'n', "a number", 0);
+    auto persist = std::make_unique<scap::Flag<bool>>("quiet", 'q', "a persist flag");
+    static const char *choices[] = {"1", "2", nullptr};
+    set_flag_choices(flag->raw(), choices);
+
+    cmd->add(*sub).add(*flag);
+    root->add(*cmd);
+    root->persist(*persist);
+    char *line[] = {(char *) "tool", (char *) "cmd", (char *) "sub", (char *) "-q", nullptr};
+    scap::Result res = root->parse(4, line);
+    expect(res.ok() && res[*persist], what);
+    res = scap::Result();
+
+    for (int i = 0; i < 5; i++) {
+        switch (order[i]) {
+        case 0:
+            root.reset();
+            break;
+        case 1:
+            expect(root == nullptr || root->raw()->tree_node.child_cnt == 2, what);    /* cmd and help */
+            cmd.reset();
+            expect(root == nullptr || root->raw()->tree_node.child_cnt == 1, what);
+            break;
+        case 2:
+            sub.reset();
+            break;
+        case 3:
+            flag.reset();
+            break;
+        case 4:
+            persist.reset();
+            expect(root == nullptr || get_flag(root->raw(), "quiet") == nullptr, what);
+            break;
+        }
+    }
+
+    /* the library state is whole again */
+    scap::Root again("tool", "again");
+    scap::Command cmd2("cmd", "a command");
+    again.add(cmd2);
+    char *line2[] = {(char *) "tool", (char *) "cmd", nullptr};
+    expect(again.parse(2, line2).ok(), what);
+}
+
+int main() {
+    test_values();
+
+    static const int orders[][5] = {
+        {0, 1, 2, 3, 4},    /* the root first */
+        {4, 3, 2, 1, 0},    /* the root last */
+        {1, 3, 0, 4, 2},    /* the command, then the root, the subcommand last */
+        {2, 4, 1, 0, 3},
+        {3, 0, 2, 1, 4},
+    };
+    for (const auto &order : orders) {
+        char what[64];
+        snprintf(what, sizeof(what), "teardown in the order %d%d%d%d%d", order[0], order[1], order[2], order[3], order[4]);
+        test_teardown(order, what);
+    }
+
+    printf("wrapper test: %d failure(s)\n", failures);
+    return failures == 0 ? 0 : 1;
+}